@@ -4,6 +4,7 @@
 layout(set = 0, binding = 0, std140) uniform entity {
     mat4 ModelMatrix;
     mat4 MVPMatrix;
+    mat4 NormalMatrix;
 } Entity;
 
 layout(location = 0) in vec3 InPosition;
@@ -17,7 +18,7 @@ void main() {
     gl_Position = Entity.MVPMatrix * vec4(InPosition, 1);
     OutPosition = vec3(Entity.ModelMatrix * vec4(InPosition, 1));
 
-    mat3 NormalMatrix = transpose(inverse(mat3(Entity.ModelMatrix)));
+    mat3 NormalMatrix = mat3(Entity.NormalMatrix);
     OutNormal = normalize(NormalMatrix * normalize(InNormal));
     // OutTangent = NormalMatrix * normalize(InTangent);
 
@@ -4,6 +4,7 @@
 layout(set = 0, binding = 0, std140) uniform entity {
     mat4 ModelMatrix;
     mat4 MVPMatrix;
+    mat4 NormalMatrix;
 } Entity;
 
 layout(location = 0) in vec3 InPosition;
@@ -4,7 +4,11 @@
 #define LIGHT_MODE_DIRECTIONAL 0
 #define LIGHT_MODE_POINT 1
 
-layout (set = 0, binding = 0, std140) uniform u_light_ubo {
+layout (set = 0, binding = 0, std140) uniform u_camera_ubo {
+    mat4 view_space_mtx;
+    vec3 pos;
+} camera_ubo;
+layout (set = 0, binding = 1, std140) uniform u_light_ubo {
     mat4 view_mtxs[6];
     vec3 pos;
     vec3 direction;
@@ -16,21 +20,16 @@ layout (set = 0, binding = 0, std140) uniform u_light_ubo {
     float quadratic;
     float ambient;
 } light_ubo;
-// layout (set = 2, binding = 0) uniform u_material {
-//     uint shine_exponent;
-// } material;
-layout (set = 2, binding = 0) uniform sampler2D tex;
-layout (set = 3, binding = 0) uniform sampler2D shadow_map_2d;
-layout (set = 4, binding = 0) uniform samplerCube shadow_map_3d;
-layout (push_constant) uniform u_push_constants {
-    vec3 view_pos;
-} push_constants;
+layout (set = 0, binding = 7) uniform sampler2D shadow_map_2d;
+layout (set = 0, binding = 8) uniform samplerCube shadow_map_3d;
+layout (set = 1, binding = 0) uniform sampler2D tex;
 
 layout (location = 0) in vec3 in_frag_pos;
 layout (location = 1) in vec4 in_frag_pos_light_space;
 layout (location = 2) in vec3 in_frag_norm;
 layout (location = 3) in vec2 in_frag_uv;
 layout (location = 4) in vec3 in_frag_light_dir;
+layout (location = 5) flat in uint in_frag_receives_shadow;
 
 layout (location = 0) out vec4 out_color;
 
@@ -86,10 +85,10 @@ void main() {
     // Light Calculations
     float diffuse = max(dot(frag_norm, frag_light_dir), 0.0);
     // float shadow = pcf_filter(frag_pos_light_space, depth_bias);
-    float shadow = calc_shadow(frag_pos_light_space, depth_bias, vec2(0));
+    float shadow = in_frag_receives_shadow != 0 ? calc_shadow(frag_pos_light_space, depth_bias, vec2(0)) : 1.0;
     // return;
     float attenuation = light_ubo.mode == LIGHT_MODE_DIRECTIONAL ? 1 : calc_attenuation(distance(in_frag_pos, light_ubo.pos));
     vec4 light_color = light_ubo.color * (light_ubo.ambient + (shadow * diffuse)) * attenuation;
     vec4 surface_color = texture(tex, in_frag_uv);
-    out_color = surface_color * light_color;
+    out_color = vec4((surface_color * light_color).rgb, surface_color.a); // Alpha is only blended for transparent entities.
 }
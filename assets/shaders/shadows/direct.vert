@@ -3,8 +3,13 @@
 
 #define LIGHT_MODE_DIRECTIONAL 0
 #define LIGHT_MODE_POINT 1
+#define RENDER_FLAG_RECEIVES_SHADOW 4u
 
-layout (set = 0, binding = 0, std140) uniform u_light_ubo {
+layout (set = 0, binding = 0, std140) uniform u_camera_ubo {
+    mat4 view_space_mtx;
+    vec3 pos;
+} camera_ubo;
+layout (set = 0, binding = 1, std140) uniform u_light_ubo {
     mat4 view_mtxs[6];
     vec3 pos;
     vec3 direction;
@@ -16,10 +21,27 @@ layout (set = 0, binding = 0, std140) uniform u_light_ubo {
     float quadratic;
     float ambient;
 } light_ubo;
-layout (set = 1, binding = 0, std140) uniform u_model_ubo {
+struct model {
     mat4 model_mtx;
-    mat4 mvp_mtx;
-} model_ubo;
+    mat4 normal_mtx;
+};
+struct entity {
+    vec3 center;
+    uint draw_group;
+    vec3 extent;
+    uint render_flags;
+    float radius;
+    uint material_index;
+};
+layout (set = 0, binding = 4, std430) readonly buffer u_models {
+    model models[];
+};
+layout (set = 0, binding = 5, std430) readonly buffer u_entities {
+    entity entities[];
+};
+layout (set = 0, binding = 6, std430) readonly buffer u_instances {
+    uint instance_entities[];
+};
 
 layout (location = 0) in vec3 in_vert_pos;
 layout (location = 1) in vec3 in_vert_norm;
@@ -30,6 +52,7 @@ layout (location = 1) out vec4 out_frag_pos_light_space;
 layout (location = 2) out vec3 out_frag_norm;
 layout (location = 3) out vec2 out_frag_uv;
 layout (location = 4) out vec3 out_frag_light_dir;
+layout (location = 5) flat out uint out_frag_receives_shadow;
 
 // Converts fragment's x/y coordinates from NDC-space: [-1..1] to uv-space: [0..1] for sampling shadow map.
 const mat4 ndc_to_uv_mtx = mat4(0.5, 0.0, 0.0, 0.0,
@@ -38,14 +61,18 @@ const mat4 ndc_to_uv_mtx = mat4(0.5, 0.0, 0.0, 0.0,
                                 0.5, 0.5, 0.0, 1.0);
 
 void main() {
+    uint entity_idx = instance_entities[gl_InstanceIndex];
+    model m = models[entity_idx];
     vec4 vert_pos = vec4(in_vert_pos, 1);
-    gl_Position = model_ubo.mvp_mtx * vert_pos;
-    out_frag_pos = vec3(model_ubo.model_mtx * vert_pos);
-    out_frag_norm = transpose(inverse(mat3(model_ubo.model_mtx))) * in_vert_norm;
+    vec4 world_pos = m.model_mtx * vert_pos;
+    gl_Position = camera_ubo.view_space_mtx * world_pos;
+    out_frag_pos = vec3(world_pos);
+    out_frag_norm = mat3(m.normal_mtx) * in_vert_norm;
     vec3 frag_norm_bias = out_frag_norm * light_ubo.normal_bias * 0.001;
     out_frag_pos_light_space = ndc_to_uv_mtx * light_ubo.view_mtxs[0] * vec4(out_frag_pos + frag_norm_bias, 1);
     out_frag_uv = in_vert_uv;
     out_frag_light_dir = light_ubo.mode == LIGHT_MODE_DIRECTIONAL
                          ? -light_ubo.direction
-                         : light_ubo.pos - vec3(model_ubo.model_mtx * vert_pos);
+                         : light_ubo.pos - vec3(world_pos);
+    out_frag_receives_shadow = entities[entity_idx].render_flags & RENDER_FLAG_RECEIVES_SHADOW;
 }
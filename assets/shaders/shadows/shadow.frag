@@ -1,7 +1,7 @@
 #version 450
 #extension GL_ARB_separate_shader_objects : enable
 
-layout (set = 0, binding = 0, std140) uniform u_light_ubo {
+layout (set = 0, binding = 1, std140) uniform u_light_ubo {
     mat4 view_mtxs[6];
     vec3 pos;
     vec3 direction;
@@ -4,7 +4,7 @@
 #define LIGHT_MODE_DIRECTIONAL 0
 #define LIGHT_MODE_POINT 1
 
-layout (set = 0, binding = 0, std140) uniform u_light_ubo {
+layout (set = 0, binding = 1, std140) uniform u_light_ubo {
     mat4 view_mtxs[6];
     vec3 pos;
     vec3 direction;
@@ -16,10 +16,16 @@ layout (set = 0, binding = 0, std140) uniform u_light_ubo {
     float quadratic;
     float ambient;
 } light_ubo;
-layout (set = 1, binding = 0, std140) uniform u_model_ubo {
+struct model {
     mat4 model_mtx;
-    mat4 mvp_mtx;
-} model_ubo;
+    mat4 normal_mtx;
+};
+layout (set = 0, binding = 4, std430) readonly buffer u_models {
+    model models[];
+};
+layout (set = 0, binding = 6, std430) readonly buffer u_instances {
+    uint instance_entities[];
+};
 layout (push_constant) uniform u_push_constants {
     uint direction_view_mtx_idx;
 } push_constants;
@@ -28,6 +34,7 @@ layout (location = 0) out vec3 out_frag_pos;
 
 void main() {
     uint view_mtx_idx = light_ubo.mode == LIGHT_MODE_DIRECTIONAL ? 0 : push_constants.direction_view_mtx_idx;
-    out_frag_pos = vec3(model_ubo.model_mtx * vec4(in_vert_pos, 1));
-    gl_Position = light_ubo.view_mtxs[view_mtx_idx] * model_ubo.model_mtx * vec4(in_vert_pos, 1);
+    vec4 world_pos = models[instance_entities[gl_InstanceIndex]].model_mtx * vec4(in_vert_pos, 1);
+    out_frag_pos = vec3(world_pos);
+    gl_Position = light_ubo.view_mtxs[view_mtx_idx] * world_pos;
 }
@@ -1,7 +1,7 @@
 #version 450
 #extension GL_ARB_separate_shader_objects : enable
 
-layout (set = 0, binding = 0, std140) uniform u_light_ubo {
+struct light {
     mat4 view_mtxs[6];
     vec3 pos;
     vec3 direction;
@@ -12,10 +12,16 @@ layout (set = 0, binding = 0, std140) uniform u_light_ubo {
     float linear;
     float quadratic;
     float ambient;
-} light_ubo;
+};
+layout (set = 0, binding = 2, std430) readonly buffer u_lights {
+    light lights[];
+};
+layout (push_constant) uniform u_push_constants {
+    uint light_idx;
+} push_constants;
 
 layout (location = 0) out vec4 color;
 
 void main() {
-    color = light_ubo.color;
+    color = lights[push_constants.light_idx].color;
 }
@@ -1,13 +1,23 @@
 #version 450
 #extension GL_ARB_separate_shader_objects : enable
 
-layout (set = 1, binding = 0, std140) uniform u_model_ubo {
+layout (set = 0, binding = 0, std140) uniform u_camera_ubo {
+    mat4 view_space_mtx;
+    vec3 pos;
+} camera_ubo;
+struct model {
     mat4 model_mtx;
-    mat4 mvp_mtx;
-} model_ubo;
+    mat4 normal_mtx;
+};
+layout (set = 0, binding = 3, std430) readonly buffer u_light_models {
+    model light_models[];
+};
+layout (push_constant) uniform u_push_constants {
+    uint light_idx;
+} push_constants;
 
 layout (location = 0) in vec3 in_vert_pos;
 
 void main() {
-    gl_Position = model_ubo.mvp_mtx * vec4(in_vert_pos, 1);
+    gl_Position = camera_ubo.view_space_mtx * light_models[push_constants.light_idx].model_mtx * vec4(in_vert_pos, 1);
 }
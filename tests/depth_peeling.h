@@ -57,6 +57,8 @@ static void create_vulkan_state(state *State, vulkan_instance *VulkanInstance, a
     ////////////////////////////////////////////////////////////
     /// Attachment Images
     ////////////////////////////////////////////////////////////
+
+    // Peel attachments never leave the render pass, so they are transient and shared by every swapchain image's framebuffer.
     vtk::image_info PeelDepthImageInfo = {};
     PeelDepthImageInfo.Width = Swapchain->Extent.width;
     PeelDepthImageInfo.Height = Swapchain->Extent.height;
@@ -65,7 +67,7 @@ static void create_vulkan_state(state *State, vulkan_instance *VulkanInstance, a
     PeelDepthImageInfo.UsageFlags = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT;
     PeelDepthImageInfo.MemoryPropertyFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
     PeelDepthImageInfo.AspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
-    CTK_ITERATE(2) State->AttachmentImages.PeelDepth[IterationIndex] = vtk::create_image(Device, &PeelDepthImageInfo);
+    CTK_ITERATE(2) State->AttachmentImages.PeelDepth[IterationIndex] = create_transient_attachment_image(Device, &PeelDepthImageInfo);
 
     vtk::image_info PeelColorImageInfo = {};
     PeelColorImageInfo.Width = Swapchain->Extent.width;
@@ -75,7 +77,7 @@ static void create_vulkan_state(state *State, vulkan_instance *VulkanInstance, a
     PeelColorImageInfo.UsageFlags = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT;
     PeelColorImageInfo.MemoryPropertyFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
     PeelColorImageInfo.AspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-    State->AttachmentImages.PeelColor = vtk::create_image(Device, &PeelColorImageInfo);
+    State->AttachmentImages.PeelColor = create_transient_attachment_image(Device, &PeelColorImageInfo);
 
     ////////////////////////////////////////////////////////////
     /// Render Pass
@@ -94,7 +96,7 @@ static void create_vulkan_state(state *State, vulkan_instance *VulkanInstance, a
         PeelDepthAttachment->Description.format = PeelDepthImageInfo.Format;
         PeelDepthAttachment->Description.samples = VK_SAMPLE_COUNT_1_BIT;
         PeelDepthAttachment->Description.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-        PeelDepthAttachment->Description.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+        PeelDepthAttachment->Description.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
         PeelDepthAttachment->Description.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
         PeelDepthAttachment->Description.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
         PeelDepthAttachment->Description.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
@@ -106,7 +108,7 @@ static void create_vulkan_state(state *State, vulkan_instance *VulkanInstance, a
     PeelColorAttachment->Description.format = PeelColorImageInfo.Format;
     PeelColorAttachment->Description.samples = VK_SAMPLE_COUNT_1_BIT;
     PeelColorAttachment->Description.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-    PeelColorAttachment->Description.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+    PeelColorAttachment->Description.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
     PeelColorAttachment->Description.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
     PeelColorAttachment->Description.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
     PeelColorAttachment->Description.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
@@ -160,13 +162,24 @@ static void create_vulkan_state(state *State, vulkan_instance *VulkanInstance, a
 
     // Subpass Dependencies
     RenderPassInfo.SubpassDependencies.Count = 2 + (state::DEPTH_PEEL_LAYER_COUNT * 2);
+
+    // Peel depth and color attachments are shared between frames, so the previous frame's input attachment reads and attachment writes
+    // must finish before this frame clears them.
     RenderPassInfo.SubpassDependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
     RenderPassInfo.SubpassDependencies[0].dstSubpass = 0;
-    RenderPassInfo.SubpassDependencies[0].srcStageMask = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
-    RenderPassInfo.SubpassDependencies[0].dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-    RenderPassInfo.SubpassDependencies[0].srcAccessMask = VK_ACCESS_MEMORY_READ_BIT;
-    RenderPassInfo.SubpassDependencies[0].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-    RenderPassInfo.SubpassDependencies[0].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
+    RenderPassInfo.SubpassDependencies[0].srcStageMask = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT |
+                                                         VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT |
+                                                         VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT |
+                                                         VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+    RenderPassInfo.SubpassDependencies[0].dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT |
+                                                         VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT |
+                                                         VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+    RenderPassInfo.SubpassDependencies[0].srcAccessMask = VK_ACCESS_MEMORY_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT |
+                                                          VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+    RenderPassInfo.SubpassDependencies[0].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT |
+                                                          VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT |
+                                                          VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+    RenderPassInfo.SubpassDependencies[0].dependencyFlags = 0;
 
     RenderPassInfo.SubpassDependencies[1].srcSubpass = 0;
     RenderPassInfo.SubpassDependencies[1].dstSubpass = 1;
@@ -520,12 +533,13 @@ static void record_render_command_buffers(state *State, vulkan_instance *VulkanI
             {
                 vtk::graphics_pipeline *FirstPeelGP = &State->GraphicsPipelines.FirstPeel;
                 vtk::descriptor_set *DescriptorSets[] = { &State->DescriptorSets.EntityMatrixesBuffer };
+
+                // Graphics Pipeline
+                vkCmdBindPipeline(CommandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, FirstPeelGP->Handle);
+
                 for(u32 EntityIndex = 0; EntityIndex < State->Scene.Entities.Count; ++EntityIndex) {
                     mesh *Mesh = State->Scene.Entities.Values[EntityIndex].Mesh;
 
-                    // Graphics Pipeline
-                    vkCmdBindPipeline(CommandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, FirstPeelGP->Handle);
-
                     // Bind Descriptor Sets
                     vtk::bind_descriptor_sets(CommandBuffer, FirstPeelGP->Layout, 0, DescriptorSets, CTK_ARRAY_COUNT(DescriptorSets),
                                               SwapchainImageIndex, EntityIndex);
@@ -588,6 +602,9 @@ static void record_render_command_buffers(state *State, vulkan_instance *VulkanI
                     AttachmentClearRect.rect.offset = { 0, 0 };
                     vkCmdClearAttachments(CommandBuffer, 2, AttachmentClears, 1, &AttachmentClearRect);
 
+                    // Graphics Pipeline
+                    vkCmdBindPipeline(CommandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, PeelGP->Handle);
+
                     // Bind peel depth image input attachment descriptor set.
                     u32 InputAttachmentDescriptorSetIndex = (IterationIndex % 2) == 0 ? 0 : 1;
                     vkCmdBindDescriptorSets(CommandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, PeelGP->Layout,
@@ -597,9 +614,6 @@ static void record_render_command_buffers(state *State, vulkan_instance *VulkanI
                     for(u32 EntityIndex = 0; EntityIndex < State->Scene.Entities.Count; ++EntityIndex) {
                         mesh *Mesh = State->Scene.Entities.Values[EntityIndex].Mesh;
 
-                        // Graphics Pipeline
-                        vkCmdBindPipeline(CommandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, PeelGP->Handle);
-
                         // Bind Descriptor Sets
                         vtk::bind_descriptor_sets(CommandBuffer, PeelGP->Layout, 0, DescriptorSets, CTK_ARRAY_COUNT(DescriptorSets),
                                                   SwapchainImageIndex, EntityIndex);
@@ -4,8 +4,8 @@
 
 struct input_attachments_test
 {
-    ctk::sarray<vtk::image, 4> DepthImages;
-    ctk::sarray<vtk::image, 4> ColorImages;
+    vtk::image DepthImage;
+    vtk::image ColorImage;
     VkDescriptorPool PresentDescriptorPool;
     VkDescriptorSetLayout PresentDescriptorSetLayout;
     ctk::sarray<VkDescriptorSet, 4> PresentDescriptorSets;
@@ -40,11 +40,10 @@ input_attachments_test_create_state(vulkan_instance *VulkanInstance, assets *Ass
     ColorImageInfo.MemoryPropertyFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
     ColorImageInfo.AspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
 
-    CTK_ITERATE(Swapchain->Images.Count)
-    {
-        ctk::push(&InputAttachmentsTest.DepthImages, vtk::create_image(Device, &DepthImageInfo));
-        ctk::push(&InputAttachmentsTest.ColorImages, vtk::create_image(Device, &ColorImageInfo));
-    }
+    // Depth and color are only consumed as input attachments inside the same render pass, so a single transient pair is shared by all
+    // swapchain images; the external subpass dependency below orders each frame's writes after the previous frame's reads.
+    InputAttachmentsTest.DepthImage = create_transient_attachment_image(Device, &DepthImageInfo);
+    InputAttachmentsTest.ColorImage = create_transient_attachment_image(Device, &ColorImageInfo);
 
     ////////////////////////////////////////////////////////////
     /// Render Pass
@@ -56,7 +55,7 @@ input_attachments_test_create_state(vulkan_instance *VulkanInstance, assets *Ass
     DepthAttachment->Description.format = DepthImageInfo.Format;
     DepthAttachment->Description.samples = VK_SAMPLE_COUNT_1_BIT;
     DepthAttachment->Description.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-    DepthAttachment->Description.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+    DepthAttachment->Description.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
     DepthAttachment->Description.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
     DepthAttachment->Description.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
     DepthAttachment->Description.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
@@ -68,7 +67,7 @@ input_attachments_test_create_state(vulkan_instance *VulkanInstance, assets *Ass
     ColorAttachment->Description.format = ColorImageInfo.Format;
     ColorAttachment->Description.samples = VK_SAMPLE_COUNT_1_BIT;
     ColorAttachment->Description.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-    ColorAttachment->Description.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+    ColorAttachment->Description.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
     ColorAttachment->Description.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
     ColorAttachment->Description.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
     ColorAttachment->Description.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
@@ -100,12 +99,19 @@ input_attachments_test_create_state(vulkan_instance *VulkanInstance, assets *Ass
     // Subpass Dependencies
     TestRenderPassInfo.SubpassDependencies.Count = 3;
 
+    // Depth and color attachments are shared between frames, so the previous frame's input attachment reads and depth writes must
+    // finish before this frame clears them.
     TestRenderPassInfo.SubpassDependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
     TestRenderPassInfo.SubpassDependencies[0].dstSubpass = 0;
-    TestRenderPassInfo.SubpassDependencies[0].srcStageMask = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
-    TestRenderPassInfo.SubpassDependencies[0].dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-    TestRenderPassInfo.SubpassDependencies[0].srcAccessMask = VK_ACCESS_MEMORY_READ_BIT;
-    TestRenderPassInfo.SubpassDependencies[0].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+    TestRenderPassInfo.SubpassDependencies[0].srcStageMask = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT |
+                                                             VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT |
+                                                             VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+    TestRenderPassInfo.SubpassDependencies[0].dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT |
+                                                             VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
+    TestRenderPassInfo.SubpassDependencies[0].srcAccessMask = VK_ACCESS_MEMORY_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+    TestRenderPassInfo.SubpassDependencies[0].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT |
+                                                              VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT |
+                                                              VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
     TestRenderPassInfo.SubpassDependencies[0].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
 
     // This dependency transitions the input attachment from color attachment to shader read
@@ -129,8 +135,8 @@ input_attachments_test_create_state(vulkan_instance *VulkanInstance, assets *Ass
     CTK_ITERATE(Swapchain->Images.Count)
     {
         vtk::framebuffer_info *FramebufferInfo = ctk::push(&TestRenderPassInfo.FramebufferInfos);
-        ctk::push(&FramebufferInfo->Attachments, InputAttachmentsTest.DepthImages[IterationIndex].View);
-        ctk::push(&FramebufferInfo->Attachments, InputAttachmentsTest.ColorImages[IterationIndex].View);
+        ctk::push(&FramebufferInfo->Attachments, InputAttachmentsTest.DepthImage.View);
+        ctk::push(&FramebufferInfo->Attachments, InputAttachmentsTest.ColorImage.View);
         ctk::push(&FramebufferInfo->Attachments, Swapchain->Images[IterationIndex].View);
         FramebufferInfo->Extent = Swapchain->Extent;
         FramebufferInfo->Layers = 1;
@@ -191,8 +197,8 @@ input_attachments_test_create_state(vulkan_instance *VulkanInstance, assets *Ass
     ctk::sarray<VkWriteDescriptorSet, 16> WriteDescriptorSets = {};
     CTK_ITERATE(Swapchain->Images.Count)
     {
-        vtk::image *DepthImage = InputAttachmentsTest.DepthImages + IterationIndex;
-        vtk::image *ColorImage = InputAttachmentsTest.ColorImages + IterationIndex;
+        vtk::image *DepthImage = &InputAttachmentsTest.DepthImage;
+        vtk::image *ColorImage = &InputAttachmentsTest.ColorImage;
         VkDescriptorSet PresentDescriptorSet = InputAttachmentsTest.PresentDescriptorSets[IterationIndex];
 
         VkWriteDescriptorSet *DepthWriteDescriptorSet = ctk::push(&WriteDescriptorSets);
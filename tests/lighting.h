@@ -21,6 +21,7 @@ static const ctk::vec2<f32> ATTENUATION_VALUES[ATTENUATION_VALUE_COUNT] = {
 struct matrix_ubo {
     glm::mat4 ModelMatrix;
     glm::mat4 ModelViewProjectionMatrix;
+    glm::mat4 NormalMatrix;
 };
 
 struct light {
@@ -50,6 +51,8 @@ struct scene {
     ctk::sarray<transform, MAX_LIGHTS> LightTransforms;
     ctk::sarray<matrix_ubo, MAX_ENTITIES> EntityMatrixUBOs;
     ctk::sarray<matrix_ubo, MAX_LIGHTS> LightMatrixUBOs;
+    u32 MatrixUBOStride; // sizeof(matrix_ubo) rounded up to minUniformBufferOffsetAlignment, for dynamic offsets.
+    u8 *MatrixUBOStaging; // MAX_ENTITIES matrix UBOs laid out at MatrixUBOStride.
 };
 
 struct lighting_push_constants {
@@ -625,7 +628,7 @@ static void create_main_render_pass(state *State, vulkan_instance *VulkanInstanc
     AlbedoAttachment->Description.format = VK_FORMAT_R8G8B8A8_UNORM;
     AlbedoAttachment->Description.samples = VK_SAMPLE_COUNT_1_BIT;
     AlbedoAttachment->Description.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-    AlbedoAttachment->Description.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+    AlbedoAttachment->Description.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
     AlbedoAttachment->Description.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
     AlbedoAttachment->Description.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
     AlbedoAttachment->Description.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
@@ -636,7 +639,7 @@ static void create_main_render_pass(state *State, vulkan_instance *VulkanInstanc
     PositionAttachment->Description.format = VK_FORMAT_R16G16B16A16_SFLOAT;
     PositionAttachment->Description.samples = VK_SAMPLE_COUNT_1_BIT;
     PositionAttachment->Description.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-    PositionAttachment->Description.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+    PositionAttachment->Description.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
     PositionAttachment->Description.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
     PositionAttachment->Description.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
     PositionAttachment->Description.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
@@ -647,7 +650,7 @@ static void create_main_render_pass(state *State, vulkan_instance *VulkanInstanc
     NormalAttachment->Description.format = VK_FORMAT_R16G16B16A16_SFLOAT;
     NormalAttachment->Description.samples = VK_SAMPLE_COUNT_1_BIT;
     NormalAttachment->Description.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-    NormalAttachment->Description.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+    NormalAttachment->Description.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
     NormalAttachment->Description.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
     NormalAttachment->Description.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
     NormalAttachment->Description.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
@@ -658,7 +661,7 @@ static void create_main_render_pass(state *State, vulkan_instance *VulkanInstanc
     DepthAttachment->Description.format = State->AttachmentImages.Depth.Format;
     DepthAttachment->Description.samples = VK_SAMPLE_COUNT_1_BIT;
     DepthAttachment->Description.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-    DepthAttachment->Description.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+    DepthAttachment->Description.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
     DepthAttachment->Description.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
     DepthAttachment->Description.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
     DepthAttachment->Description.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
@@ -680,7 +683,7 @@ static void create_main_render_pass(state *State, vulkan_instance *VulkanInstanc
     MaterialIndexAttachment->Description.format = VK_FORMAT_R32_UINT;
     MaterialIndexAttachment->Description.samples = VK_SAMPLE_COUNT_1_BIT;
     MaterialIndexAttachment->Description.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-    MaterialIndexAttachment->Description.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+    MaterialIndexAttachment->Description.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
     MaterialIndexAttachment->Description.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
     MaterialIndexAttachment->Description.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
     MaterialIndexAttachment->Description.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
@@ -708,13 +711,24 @@ static void create_main_render_pass(state *State, vulkan_instance *VulkanInstanc
 
     // Subpass Dependencies
     RenderPassInfo.SubpassDependencies.Count = 3;
+
+    // G-buffer and depth attachments are shared between frames, so the previous frame's input attachment reads and attachment writes
+    // must finish before this frame clears them.
     RenderPassInfo.SubpassDependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
     RenderPassInfo.SubpassDependencies[0].dstSubpass = 0;
-    RenderPassInfo.SubpassDependencies[0].srcStageMask = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
-    RenderPassInfo.SubpassDependencies[0].dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-    RenderPassInfo.SubpassDependencies[0].srcAccessMask = VK_ACCESS_MEMORY_READ_BIT;
-    RenderPassInfo.SubpassDependencies[0].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-    RenderPassInfo.SubpassDependencies[0].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
+    RenderPassInfo.SubpassDependencies[0].srcStageMask = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT |
+                                                         VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT |
+                                                         VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT |
+                                                         VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+    RenderPassInfo.SubpassDependencies[0].dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT |
+                                                         VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT |
+                                                         VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+    RenderPassInfo.SubpassDependencies[0].srcAccessMask = VK_ACCESS_MEMORY_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT |
+                                                          VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+    RenderPassInfo.SubpassDependencies[0].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT |
+                                                          VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT |
+                                                          VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+    RenderPassInfo.SubpassDependencies[0].dependencyFlags = 0;
 
     RenderPassInfo.SubpassDependencies[1].srcSubpass = 0;
     RenderPassInfo.SubpassDependencies[1].dstSubpass = 1;
@@ -881,12 +895,20 @@ static void create_vulkan_state(state *State, vulkan_instance *VulkanInstance, a
     /// Uniform Buffers
     ////////////////////////////////////////////////////////////
     static const u32 UNIFORM_BUFFER_ARRAY_PADDING = 8;
+
+    // Matrix UBOs are bound with dynamic offsets, which must be multiples of minUniformBufferOffsetAlignment. At 192 bytes, matrix_ubo
+    // isn't a multiple of every device's alignment, so each one is padded out to the stride.
+    VkPhysicalDeviceProperties PhysicalDeviceProperties = {};
+    vkGetPhysicalDeviceProperties(Device->Physical, &PhysicalDeviceProperties);
+    u32 UBOAlignment = (u32)PhysicalDeviceProperties.limits.minUniformBufferOffsetAlignment;
+    State->Scene.MatrixUBOStride = (sizeof(matrix_ubo) + UBOAlignment - 1) / UBOAlignment * UBOAlignment;
+    State->Scene.MatrixUBOStaging = ctk::allocate<u8>(scene::MAX_ENTITIES * State->Scene.MatrixUBOStride);
     State->UniformBuffers.EntityMatrixes =
-        vtk::create_uniform_buffer(&VulkanInstance->HostBuffer, &VulkanInstance->Device, scene::MAX_ENTITIES, sizeof(matrix_ubo), Swapchain->Images.Count);
+        vtk::create_uniform_buffer(&VulkanInstance->HostBuffer, &VulkanInstance->Device, scene::MAX_ENTITIES, State->Scene.MatrixUBOStride, Swapchain->Images.Count);
     State->UniformBuffers.ShadowMapEntityMatrixes =
-        vtk::create_uniform_buffer(&VulkanInstance->HostBuffer, &VulkanInstance->Device, scene::MAX_ENTITIES, sizeof(matrix_ubo), Swapchain->Images.Count);
+        vtk::create_uniform_buffer(&VulkanInstance->HostBuffer, &VulkanInstance->Device, scene::MAX_ENTITIES, State->Scene.MatrixUBOStride, Swapchain->Images.Count);
     State->UniformBuffers.LightMatrixes =
-        vtk::create_uniform_buffer(&VulkanInstance->HostBuffer, &VulkanInstance->Device, scene::MAX_LIGHTS, sizeof(matrix_ubo), Swapchain->Images.Count);
+        vtk::create_uniform_buffer(&VulkanInstance->HostBuffer, &VulkanInstance->Device, scene::MAX_LIGHTS, State->Scene.MatrixUBOStride, Swapchain->Images.Count);
     State->UniformBuffers.Lights =
         vtk::create_uniform_buffer(&VulkanInstance->HostBuffer, &VulkanInstance->Device, 1, sizeof(State->Scene.Lights) + UNIFORM_BUFFER_ARRAY_PADDING, Swapchain->Images.Count);
     State->UniformBuffers.Materials =
@@ -895,6 +917,8 @@ static void create_vulkan_state(state *State, vulkan_instance *VulkanInstance, a
     ////////////////////////////////////////////////////////////
     /// Attachment Images
     ////////////////////////////////////////////////////////////
+    // All attachment images below are only accessed inside the main render pass, so they are created transient and shared by every
+    // swapchain image's framebuffer.
     vtk::image_info DepthImageInfo = {};
     DepthImageInfo.Width = Swapchain->Extent.width;
     DepthImageInfo.Height = Swapchain->Extent.height;
@@ -903,7 +927,7 @@ static void create_vulkan_state(state *State, vulkan_instance *VulkanInstance, a
     DepthImageInfo.UsageFlags = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
     DepthImageInfo.MemoryPropertyFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
     DepthImageInfo.AspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
-    State->AttachmentImages.Depth = vtk::create_image(Device, &DepthImageInfo);
+    State->AttachmentImages.Depth = create_transient_attachment_image(Device, &DepthImageInfo);
 
     vtk::image_info ColorImageInfo = {};
     ColorImageInfo.Width = Swapchain->Extent.width;
@@ -913,10 +937,10 @@ static void create_vulkan_state(state *State, vulkan_instance *VulkanInstance, a
     ColorImageInfo.MemoryPropertyFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
     ColorImageInfo.AspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
     ColorImageInfo.Format = VK_FORMAT_R8G8B8A8_UNORM;
-    State->AttachmentImages.Albedo = vtk::create_image(Device, &ColorImageInfo);
+    State->AttachmentImages.Albedo = create_transient_attachment_image(Device, &ColorImageInfo);
     ColorImageInfo.Format = VK_FORMAT_R16G16B16A16_SFLOAT;
-    State->AttachmentImages.Position = vtk::create_image(Device, &ColorImageInfo);
-    State->AttachmentImages.Normal = vtk::create_image(Device, &ColorImageInfo);
+    State->AttachmentImages.Position = create_transient_attachment_image(Device, &ColorImageInfo);
+    State->AttachmentImages.Normal = create_transient_attachment_image(Device, &ColorImageInfo);
 
     vtk::image_info MaterialIndexImageInfo = {};
     MaterialIndexImageInfo.Width = Swapchain->Extent.width;
@@ -926,7 +950,7 @@ static void create_vulkan_state(state *State, vulkan_instance *VulkanInstance, a
     MaterialIndexImageInfo.MemoryPropertyFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
     MaterialIndexImageInfo.AspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
     MaterialIndexImageInfo.Format = VK_FORMAT_R32_UINT;
-    State->AttachmentImages.MaterialIndex = vtk::create_image(Device, &MaterialIndexImageInfo);
+    State->AttachmentImages.MaterialIndex = create_transient_attachment_image(Device, &MaterialIndexImageInfo);
 
     ////////////////////////////////////////////////////////////
     /// Shadow Maps
@@ -1044,11 +1068,11 @@ static void record_shadow_map_render_pass(vulkan_instance *VulkanInstance, state
     vkCmdBeginRenderPass(CommandBuffer, &RenderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
         vtk::graphics_pipeline *ShadowMapGP = &State->GraphicsPipelines.ShadowMap;
         vtk::descriptor_set *DescriptorSets[] = { &State->DescriptorSets.ShadowMapEntityMatrixes };
+        vkCmdBindPipeline(CommandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, ShadowMapGP->Handle);
         for (u32 EntityIndex = 0; EntityIndex < Scene->Entities.Count; ++EntityIndex) {
             entity *Entity = Scene->Entities.Values + EntityIndex;
             mesh *Mesh = Entity->Mesh;
 
-            vkCmdBindPipeline(CommandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, ShadowMapGP->Handle);
             vtk::bind_descriptor_sets(CommandBuffer, ShadowMapGP->Layout, 0, DescriptorSets, CTK_ARRAY_COUNT(DescriptorSets),
                                       SwapchainImageIndex, EntityIndex);
             vkCmdBindVertexBuffers(CommandBuffer, 0, 1, &Mesh->VertexRegion.Buffer->Handle, &Mesh->VertexRegion.Offset);
@@ -1093,12 +1117,12 @@ static void record_main_render_pass(vulkan_instance *VulkanInstance, assets *Ass
         {
             vtk::graphics_pipeline *DeferredGP = &State->GraphicsPipelines.Deferred;
             vtk::descriptor_set *DescriptorSets[] = { &State->DescriptorSets.EntityMatrixes };
+            vkCmdBindPipeline(CommandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, DeferredGP->Handle);
             for (u32 EntityIndex = 0; EntityIndex < Scene->Entities.Count; ++EntityIndex) {
                 entity *Entity = Scene->Entities.Values + EntityIndex;
                 VkDescriptorSet *TextureDS = Entity->TextureDS->Instances + 0;
                 mesh *Mesh = Entity->Mesh;
 
-                vkCmdBindPipeline(CommandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, DeferredGP->Handle);
                 vtk::bind_descriptor_sets(CommandBuffer, DeferredGP->Layout, 0, DescriptorSets, CTK_ARRAY_COUNT(DescriptorSets),
                                           SwapchainImageIndex, EntityIndex);
                 vkCmdBindDescriptorSets(CommandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, DeferredGP->Layout,
@@ -1167,6 +1191,21 @@ static void record_main_render_pass(vulkan_instance *VulkanInstance, assets *Ass
     vtk::validate_vk_result(vkEndCommandBuffer(CommandBuffer), "vkEndCommandBuffer", "error during render pass command recording");
 }
 
+// With uniform scale, transpose(inverse(M)) only differs from M by a 1/s^2 factor, which the deferred shader's normalize() removes, so the
+// model matrix is used directly and the inverse is skipped.
+static glm::mat4 normal_matrix(glm::mat4 ModelMatrix, ctk::vec3<f32> Scale) {
+    if (Scale.X == Scale.Y && Scale.Y == Scale.Z)
+        return ModelMatrix;
+    return glm::mat4(glm::transpose(glm::inverse(glm::mat3(ModelMatrix))));
+}
+
+// Writes matrix UBOs to Region at the scene's padded stride, so each starts at a valid dynamic offset.
+static void write_matrix_ubos(VkDevice LogicalDevice, scene *Scene, vtk::region *Region, matrix_ubo *MatrixUBOs, u32 Count) {
+    for (u32 i = 0; i < Count; ++i)
+        memcpy(Scene->MatrixUBOStaging + i * Scene->MatrixUBOStride, MatrixUBOs + i, sizeof(matrix_ubo));
+    vtk::write_to_host_region(LogicalDevice, Region, Scene->MatrixUBOStaging, Count * Scene->MatrixUBOStride, 0);
+}
+
 static void update_entities(VkDevice LogicalDevice, scene *Scene, glm::mat4 ViewProjectionMatrix, vtk::region *Region) {
     if (Scene->Entities.Count == 0)
         return;
@@ -1183,9 +1222,10 @@ static void update_entities(VkDevice LogicalDevice, scene *Scene, glm::mat4 View
         ModelMatrix = glm::scale(ModelMatrix, { EntityTransform->Scale.X, EntityTransform->Scale.Y, EntityTransform->Scale.Z });
         EntityMatrixUBO->ModelMatrix = ModelMatrix;
         EntityMatrixUBO->ModelViewProjectionMatrix = ViewProjectionMatrix * ModelMatrix;
+        EntityMatrixUBO->NormalMatrix = normal_matrix(ModelMatrix, EntityTransform->Scale);
     }
 
-    vtk::write_to_host_region(LogicalDevice, Region, Scene->EntityMatrixUBOs.Data, ctk::byte_count(&Scene->EntityMatrixUBOs), 0);
+    write_matrix_ubos(LogicalDevice, Scene, Region, Scene->EntityMatrixUBOs.Data, Scene->EntityMatrixUBOs.Count);
 }
 
 static glm::mat4 light_view_projection_matrix(struct transform *t) {
@@ -1245,13 +1285,14 @@ static void update_lights(VkDevice LogicalDevice, state *State, glm::mat4 world_
         model_mtx = glm::scale(model_mtx, { 0.25f, 0.25f, 0.25f });
         LightMatrixUBO->ModelMatrix = model_mtx;
         LightMatrixUBO->ModelViewProjectionMatrix = world_view_proj_mtx * model_mtx;
+        LightMatrixUBO->NormalMatrix = model_mtx; // Uniform scale.
 
         // Light-Space View-Projection Matrix
         Scene->Lights[i].view_proj_mtx = light_view_projection_matrix(light_trans);
     }
 
-    vtk::write_to_host_region(LogicalDevice, State->UniformBuffers.LightMatrixes.Regions + SwapchainImageIndex,
-                              Scene->LightMatrixUBOs.Data, ctk::byte_count(&Scene->LightMatrixUBOs), 0);
+    write_matrix_ubos(LogicalDevice, Scene, State->UniformBuffers.LightMatrixes.Regions + SwapchainImageIndex, Scene->LightMatrixUBOs.Data,
+                      Scene->LightMatrixUBOs.Count);
     vtk::write_to_host_region(LogicalDevice, State->UniformBuffers.Lights.Regions + SwapchainImageIndex,
                               &Scene->Lights, sizeof(Scene->Lights), 0);
 }
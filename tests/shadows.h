@@ -1,4 +1,6 @@
 #include <windows.h>
+#include <immintrin.h>
+#include <float.h>
 
 #define GLFW_INCLUDE_VULKAN
 #include <glfw/glfw3.h>
@@ -7,6 +9,7 @@
 #define GLM_FORCE_DEPTH_ZERO_TO_ONE
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/quaternion.hpp>
 
 #define STB_IMAGE_IMPLEMENTATION
 #define STB_IMAGE_STATIC
@@ -71,6 +74,237 @@ static struct window *create_window() {
     return win;
 }
 
+////////////////////////////////////////////////////////////
+/// Timing
+////////////////////////////////////////////////////////////
+static f64 get_time_ms() {
+    static LARGE_INTEGER freq = {};
+    if (freq.QuadPart == 0)
+        QueryPerformanceFrequency(&freq);
+    LARGE_INTEGER counter = {};
+    QueryPerformanceCounter(&counter);
+    return counter.QuadPart * 1000.0 / freq.QuadPart;
+}
+
+////////////////////////////////////////////////////////////
+/// Jobs
+////////////////////////////////////////////////////////////
+// Runs fn on elements [first, first + count).
+typedef void (*job_fn)(void *data, u32 first, u32 count);
+
+struct job {
+    job_fn fn;
+    void *data;
+    u32 first;
+    u32 count;
+    LONG volatile *pending;
+};
+
+static u32 const MAX_WORKERS = 32;
+static u32 const JOB_QUEUE_SIZE = 1024; // Power of 2.
+
+// Owners push and pop at the bottom; idle workers steal the oldest jobs from the top.
+struct job_queue {
+    SRWLOCK lock;
+    struct job jobs[JOB_QUEUE_SIZE];
+    u32 top;
+    u32 bottom;
+};
+
+// Worker 0 is the thread that calls parallel_for(); it runs jobs too while it waits. Background jobs have a queue of their own that only the
+// worker threads take from, so a frame waiting on its own jobs never ends up running one.
+struct job_system {
+    struct job_queue queues[MAX_WORKERS];
+    struct job_queue background;
+    HANDLE threads[MAX_WORKERS];
+    HANDLE wake;
+    u32 worker_count;
+    LONG volatile quit;
+};
+
+struct worker_info {
+    struct job_system *jobs;
+    u32 idx;
+};
+
+// The worker running on this thread, for per-worker resources like command pools. Threads outside a job system count as worker 0, which is
+// also the thread that calls parallel_for().
+static thread_local u32 current_worker_idx;
+
+static bool pop_job(struct job_queue *queue, struct job *job) {
+    AcquireSRWLockExclusive(&queue->lock);
+    bool popped = queue->bottom != queue->top;
+    if (popped)
+        *job = queue->jobs[--queue->bottom & (JOB_QUEUE_SIZE - 1)];
+    ReleaseSRWLockExclusive(&queue->lock);
+    return popped;
+}
+
+static bool steal_job(struct job_queue *queue, struct job *job) {
+    AcquireSRWLockExclusive(&queue->lock);
+    bool stolen = queue->bottom != queue->top;
+    if (stolen)
+        *job = queue->jobs[queue->top++ & (JOB_QUEUE_SIZE - 1)];
+    ReleaseSRWLockExclusive(&queue->lock);
+    return stolen;
+}
+
+// Steals the oldest job only if it's counted by pending.
+static bool steal_pending_job(struct job_queue *queue, LONG volatile *pending, struct job *job) {
+    AcquireSRWLockExclusive(&queue->lock);
+    bool stolen = queue->bottom != queue->top && queue->jobs[queue->top & (JOB_QUEUE_SIZE - 1)].pending == pending;
+    if (stolen)
+        *job = queue->jobs[queue->top++ & (JOB_QUEUE_SIZE - 1)];
+    ReleaseSRWLockExclusive(&queue->lock);
+    return stolen;
+}
+
+static void push_job(struct job_queue *queue, struct job *job) {
+    AcquireSRWLockExclusive(&queue->lock);
+    if (queue->bottom - queue->top == JOB_QUEUE_SIZE)
+        CTK_FATAL("job queue is full (size: %u)", JOB_QUEUE_SIZE)
+    queue->jobs[queue->bottom++ & (JOB_QUEUE_SIZE - 1)] = *job;
+    ReleaseSRWLockExclusive(&queue->lock);
+}
+
+static void execute_job(struct job *job) {
+    job->fn(job->data, job->first, job->count);
+    InterlockedDecrement(job->pending);
+}
+
+// Runs one job from worker_idx's queue, or one stolen from another worker's, or (for worker threads) a background job. Returns false when
+// there was nothing to run.
+static bool run_job(struct job_system *jobs, u32 worker_idx) {
+    struct job job = {};
+    bool found = pop_job(jobs->queues + worker_idx, &job);
+    for (u32 i = 1; !found && i < jobs->worker_count; ++i)
+        found = steal_job(jobs->queues + (worker_idx + i) % jobs->worker_count, &job);
+    if (!found && worker_idx != 0)
+        found = steal_job(&jobs->background, &job);
+    if (!found)
+        return false;
+    execute_job(&job);
+    return true;
+}
+
+static DWORD WINAPI worker_main(void *param) {
+    auto info = (struct worker_info *)param;
+    struct job_system *jobs = info->jobs;
+    u32 idx = info->idx;
+    free(info);
+    current_worker_idx = idx;
+    while (!jobs->quit)
+        if (!run_job(jobs, idx))
+            WaitForSingleObject(jobs->wake, INFINITE);
+    return 0;
+}
+
+// A worker_count of 0 uses one worker per logical processor.
+static struct job_system *create_job_system(u32 worker_count = 0) {
+    if (worker_count == 0) {
+        SYSTEM_INFO sys_info = {};
+        GetSystemInfo(&sys_info);
+        worker_count = sys_info.dwNumberOfProcessors;
+    }
+    auto jobs = ctk_zalloc<struct job_system>();
+    jobs->worker_count = ctk_clamp(worker_count, 1u, MAX_WORKERS);
+    jobs->wake = CreateSemaphore(NULL, 0, LONG_MAX, NULL);
+    for (u32 i = 0; i < jobs->worker_count; ++i)
+        InitializeSRWLock(&jobs->queues[i].lock);
+    InitializeSRWLock(&jobs->background.lock);
+    for (u32 i = 1; i < jobs->worker_count; ++i) {
+        auto info = (struct worker_info *)malloc(sizeof(struct worker_info));
+        info->jobs = jobs;
+        info->idx = i;
+        jobs->threads[i] = CreateThread(NULL, 0, worker_main, info, 0, NULL);
+        if (jobs->threads[i] == NULL)
+            CTK_FATAL("failed to create worker thread %u", i)
+    }
+    return jobs;
+}
+
+static void destroy_job_system(struct job_system *jobs) {
+    jobs->quit = 1;
+    ReleaseSemaphore(jobs->wake, jobs->worker_count, NULL);
+    for (u32 i = 1; i < jobs->worker_count; ++i) {
+        WaitForSingleObject(jobs->threads[i], INFINITE);
+        CloseHandle(jobs->threads[i]);
+    }
+    CloseHandle(jobs->wake);
+    free(jobs);
+}
+
+// Splits [0, count) into batches of batch_size and spreads them over every worker's queue without waiting for them. pending counts the
+// batches still to run and must outlive them. A NULL job system runs everything on the calling thread before returning.
+static void begin_parallel_for(struct job_system *jobs, u32 count, u32 batch_size, job_fn fn, void *data, LONG volatile *pending) {
+    u32 batch_count = (count + batch_size - 1) / batch_size;
+    if (jobs == NULL || jobs->worker_count == 1 || batch_count <= 1) {
+        *pending = 0;
+        if (count > 0)
+            fn(data, 0, count);
+        return;
+    }
+
+    *pending = (LONG)batch_count;
+    for (u32 i = 0; i < batch_count; ++i) {
+        struct job job = {};
+        job.fn = fn;
+        job.data = data;
+        job.first = i * batch_size;
+        job.count = count - job.first < batch_size ? count - job.first : batch_size;
+        job.pending = pending;
+        push_job(jobs->queues + i % jobs->worker_count, &job);
+    }
+    ReleaseSemaphore(jobs->wake, jobs->worker_count - 1, NULL);
+}
+
+// Helps run jobs until every batch counted by pending is done.
+static void wait_for_jobs(struct job_system *jobs, LONG volatile *pending) {
+    while (*pending > 0)
+        if (!run_job(jobs, 0))
+            YieldProcessor();
+}
+
+static void parallel_for(struct job_system *jobs, u32 count, u32 batch_size, job_fn fn, void *data) {
+    LONG volatile pending = 0;
+    begin_parallel_for(jobs, count, batch_size, fn, data, &pending);
+    wait_for_jobs(jobs, &pending);
+}
+
+// Like begin_parallel_for(), but for work that isn't waited on this frame: [0, count) goes on the background queue one job per index, run by
+// worker threads in the order begun. Without worker threads, it all runs on the calling thread before returning.
+static void begin_background_jobs(struct job_system *jobs, u32 count, job_fn fn, void *data, LONG volatile *pending) {
+    if (jobs == NULL || jobs->worker_count == 1) {
+        *pending = 0;
+        if (count > 0)
+            fn(data, 0, count);
+        return;
+    }
+
+    *pending = (LONG)count;
+    for (u32 i = 0; i < count; ++i) {
+        struct job job = {};
+        job.fn = fn;
+        job.data = data;
+        job.first = i;
+        job.count = 1;
+        job.pending = pending;
+        push_job(&jobs->background, &job);
+    }
+    ReleaseSemaphore(jobs->wake, jobs->worker_count - 1, NULL);
+}
+
+// Waits for background jobs counted by pending, helping with them while they're next in the queue, but never with anyone else's.
+static void wait_for_background_jobs(struct job_system *jobs, LONG volatile *pending) {
+    struct job job = {};
+    while (*pending > 0) {
+        if (steal_pending_job(&jobs->background, pending, &job))
+            execute_job(&job);
+        else
+            YieldProcessor();
+    }
+}
+
 ////////////////////////////////////////////////////////////
 /// Vulkan Core
 ////////////////////////////////////////////////////////////
@@ -85,13 +319,42 @@ struct vk_core {
         struct vtk_buffer host;
     } buffers;
     struct vtk_region staging_region;
+    struct {
+        VkPipelineCache cache;
+        bool cache_loaded; // Whether cache was seeded from PIPELINE_CACHE_PATH.
+        u32 count;
+        f64 create_ms; // Wall time of the pipeline batches, see finish_pipeline_batch().
+    } pipelines;
+    bool draw_indirect_first_instance; // Whether indirect draws can start at a non-zero firstInstance, see create_vk_core().
+    u32 max_draw_indirect_count; // Per vkCmdDrawIndexedIndirect() call; 1 without multiDrawIndirect.
+    struct {
+        PFN_vkCreateDescriptorUpdateTemplate create;
+        PFN_vkUpdateDescriptorSetWithTemplate update;
+    } descriptor_update_templates; // NULL without Vulkan 1.1 or VK_KHR_descriptor_update_template, see create_vk_core().
+};
+
+// Pipeline cache data is saved on exit and fed back on the next startup, prefixed by a header identifying the device and driver that
+// wrote it. Data from anything else is dropped rather than handed to the driver, which isn't required to reject it safely.
+static char const *const PIPELINE_CACHE_PATH = "assets/data/pipelines.cache";
+static u32 const PIPELINE_CACHE_MAGIC = 0x43504647; // "GFPC"
+static u32 const MAX_PIPELINE_CACHE_SIZE = 64 * CTK_MEGABYTE; // Larger files are treated as corrupt.
+
+struct pipeline_cache_header {
+    u32 magic;
+    u32 vendor_id;
+    u32 device_id;
+    u32 driver_version;
+    u8 uuid[VK_UUID_SIZE];
+    u32 data_size;
 };
 
 static void create_buffers(struct vk_core *vk) {
     struct vtk_buffer_info host_buf_info = {};
     host_buf_info.size = 256 * CTK_MEGABYTE;
     host_buf_info.usage_flags = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT |
-                                VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+                                VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+                                VK_BUFFER_USAGE_TRANSFER_SRC_BIT |
+                                VK_BUFFER_USAGE_TRANSFER_DST_BIT;
     host_buf_info.memory_property_flags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
                                           VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
     host_buf_info.sharing_mode = VK_SHARING_MODE_EXCLUSIVE;
@@ -102,12 +365,99 @@ static void create_buffers(struct vk_core *vk) {
     device_buf_info.usage_flags = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT |
                                   VK_BUFFER_USAGE_VERTEX_BUFFER_BIT |
                                   VK_BUFFER_USAGE_INDEX_BUFFER_BIT |
+                                  VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+                                  VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT |
                                   VK_BUFFER_USAGE_TRANSFER_DST_BIT;
     device_buf_info.memory_property_flags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
     device_buf_info.sharing_mode = VK_SHARING_MODE_EXCLUSIVE;
     vk->buffers.device = vtk_create_buffer(&vk->device, &device_buf_info);
 }
 
+static struct pipeline_cache_header get_pipeline_cache_header(struct vk_core *vk, u32 data_size) {
+    VkPhysicalDeviceProperties props = {};
+    vkGetPhysicalDeviceProperties(vk->device.physical, &props);
+    struct pipeline_cache_header header = {};
+    header.magic = PIPELINE_CACHE_MAGIC;
+    header.vendor_id = props.vendorID;
+    header.device_id = props.deviceID;
+    header.driver_version = props.driverVersion;
+    memcpy(header.uuid, props.pipelineCacheUUID, VK_UUID_SIZE);
+    header.data_size = data_size;
+    return header;
+}
+
+// A missing, stale, truncated or oversized cache file starts an empty cache instead.
+static void create_pipeline_cache(struct vk_core *vk) {
+    void *data = NULL;
+    u32 data_size = 0;
+    FILE *file = fopen(PIPELINE_CACHE_PATH, "rb");
+    if (file != NULL) {
+        struct pipeline_cache_header header = {};
+        long file_size = fseek(file, 0, SEEK_END) == 0 ? ftell(file) : -1;
+        if (file_size >= (long)sizeof(header) && fseek(file, 0, SEEK_SET) == 0 && fread(&header, sizeof(header), 1, file) == 1 &&
+            header.data_size <= MAX_PIPELINE_CACHE_SIZE && (u64)file_size == sizeof(header) + (u64)header.data_size) {
+            struct pipeline_cache_header expected = get_pipeline_cache_header(vk, header.data_size);
+            if (memcmp(&header, &expected, sizeof(header)) == 0) {
+                data = malloc(header.data_size);
+                if (data != NULL && fread(data, 1, header.data_size, file) == header.data_size)
+                    data_size = header.data_size;
+            }
+        }
+        if (data_size == 0)
+            fprintf(stderr, "ignoring stale or invalid pipeline cache \"%s\"\n", PIPELINE_CACHE_PATH);
+        fclose(file);
+    }
+
+    VkPipelineCacheCreateInfo info = {};
+    info.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+    info.initialDataSize = data_size;
+    info.pInitialData = data;
+    vtk_validate_result(vkCreatePipelineCache(vk->device.logical, &info, NULL, &vk->pipelines.cache), "failed to create pipeline cache");
+    vk->pipelines.cache_loaded = data_size > 0;
+    free(data);
+}
+
+static void save_pipeline_cache(struct vk_core *vk) {
+    size_t data_size = 0;
+    vtk_validate_result(vkGetPipelineCacheData(vk->device.logical, vk->pipelines.cache, &data_size, NULL), "failed to get pipeline cache size");
+    void *data = malloc(data_size);
+    vtk_validate_result(vkGetPipelineCacheData(vk->device.logical, vk->pipelines.cache, &data_size, data), "failed to get pipeline cache data");
+
+    // The cache only speeds up the next startup, so failing to write it isn't worth aborting shutdown over.
+    FILE *file = fopen(PIPELINE_CACHE_PATH, "wb");
+    if (file == NULL) {
+        fprintf(stderr, "failed to open pipeline cache \"%s\" for writing\n", PIPELINE_CACHE_PATH);
+        free(data);
+        return;
+    }
+    struct pipeline_cache_header header = get_pipeline_cache_header(vk, (u32)data_size);
+    fwrite(&header, sizeof(header), 1, file);
+    fwrite(data, 1, data_size, file);
+    bool written = !ferror(file);
+    if (fclose(file) != 0 || !written)
+        fprintf(stderr, "failed to write pipeline cache \"%s\"\n", PIPELINE_CACHE_PATH);
+    free(data);
+}
+
+// The optional features indirect draws use, set only where every device has them: the device isn't picked until vtk_create_device().
+static VkPhysicalDeviceFeatures get_indirect_draw_features(VkInstance instance) {
+    u32 device_count = 0;
+    vtk_validate_result(vkEnumeratePhysicalDevices(instance, &device_count, NULL), "failed to get physical device count");
+    auto devices = (VkPhysicalDevice *)malloc(device_count * sizeof(VkPhysicalDevice));
+    vtk_validate_result(vkEnumeratePhysicalDevices(instance, &device_count, devices), "failed to get physical devices");
+    VkPhysicalDeviceFeatures common = {};
+    common.drawIndirectFirstInstance = device_count > 0;
+    common.multiDrawIndirect = device_count > 0;
+    for (u32 i = 0; i < device_count; ++i) {
+        VkPhysicalDeviceFeatures features = {};
+        vkGetPhysicalDeviceFeatures(devices[i], &features);
+        common.drawIndirectFirstInstance = common.drawIndirectFirstInstance && features.drawIndirectFirstInstance;
+        common.multiDrawIndirect = common.multiDrawIndirect && features.multiDrawIndirect;
+    }
+    free(devices);
+    return common;
+}
+
 static struct vk_core *create_vk_core(struct window *window) {
     auto vk = ctk_zalloc<vk_core>();
 
@@ -117,7 +467,37 @@ static struct vk_core *create_vk_core(struct window *window) {
     VkPhysicalDeviceFeatures features = {};
     features.geometryShader = VK_TRUE;
     features.samplerAnisotropy = VK_TRUE;
+
+    // gpu_cull.comp and hiz_cull.comp write indirect draws with a non-zero firstInstance, which needs drawIndirectFirstInstance; without it,
+    // both are left off and everything is drawn directly. Without multiDrawIndirect, Hi-Z culled draws take an indirect draw each.
+    VkPhysicalDeviceFeatures indirect_draw_features = get_indirect_draw_features(vk->instance.handle);
+    features.drawIndirectFirstInstance = indirect_draw_features.drawIndirectFirstInstance;
+    features.multiDrawIndirect = indirect_draw_features.multiDrawIndirect;
     vk->device = vtk_create_device(vk->instance.handle, vk->surface, &features);
+    vk->draw_indirect_first_instance = features.drawIndirectFirstInstance;
+    VkPhysicalDeviceProperties props = {};
+    vkGetPhysicalDeviceProperties(vk->device.physical, &props);
+    vk->max_draw_indirect_count = features.multiDrawIndirect ? props.limits.maxDrawIndirectCount : 1;
+
+    // Descriptor update templates are core from Vulkan 1.1. vtk_create_device() can't enable extensions, so on a 1.0 device the KHR entry
+    // points are only found if vtk enabled VK_KHR_descriptor_update_template itself; otherwise write_descriptor_set() falls back to
+    // vkUpdateDescriptorSets(). The device's entry points are NULL past the instance's API version, so both are checked.
+    if (props.apiVersion >= VK_API_VERSION_1_1) {
+        vk->descriptor_update_templates.create =
+            (PFN_vkCreateDescriptorUpdateTemplate)vkGetDeviceProcAddr(vk->device.logical, "vkCreateDescriptorUpdateTemplate");
+        vk->descriptor_update_templates.update =
+            (PFN_vkUpdateDescriptorSetWithTemplate)vkGetDeviceProcAddr(vk->device.logical, "vkUpdateDescriptorSetWithTemplate");
+    }
+    if (vk->descriptor_update_templates.create == NULL || vk->descriptor_update_templates.update == NULL) {
+        vk->descriptor_update_templates.create =
+            (PFN_vkCreateDescriptorUpdateTemplate)vkGetDeviceProcAddr(vk->device.logical, "vkCreateDescriptorUpdateTemplateKHR");
+        vk->descriptor_update_templates.update =
+            (PFN_vkUpdateDescriptorSetWithTemplate)vkGetDeviceProcAddr(vk->device.logical, "vkUpdateDescriptorSetWithTemplateKHR");
+    }
+    if (vk->descriptor_update_templates.create == NULL || vk->descriptor_update_templates.update == NULL) {
+        vk->descriptor_update_templates.create = NULL;
+        vk->descriptor_update_templates.update = NULL;
+    }
 
     vk->swapchain = vtk_create_swapchain(&vk->device, vk->surface);
 
@@ -129,10 +509,402 @@ static struct vk_core *create_vk_core(struct window *window) {
 
     create_buffers(vk);
     vk->staging_region = vtk_allocate_region(&vk->buffers.host, 64 * CTK_MEGABYTE);
+    create_pipeline_cache(vk);
 
     return vk;
 }
 
+static void read_from_host_region(struct vk_core *vk, struct vtk_region *region, void *dst, VkDeviceSize size) {
+    void *src = NULL;
+    vtk_validate_result(vkMapMemory(vk->device.logical, region->buffer->memory, region->offset, size, 0, &src), "failed to map host region");
+    memcpy(dst, src, size);
+    vkUnmapMemory(vk->device.logical, region->buffer->memory);
+}
+
+// Whether an image created from info with transient usage can be bound to lazily-allocated memory. A device can expose a lazily-allocated
+// type that the image's memoryTypeBits don't include, so this checks a probe image's requirements rather than only the type's existence.
+static bool lazily_allocated_memory_supported(struct vk_core *vk, struct vtk_image_info const *info) {
+    VkImageCreateInfo probe_info = info->image;
+    probe_info.usage |= VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT;
+    VkImage probe = VK_NULL_HANDLE;
+    vtk_validate_result(vkCreateImage(vk->device.logical, &probe_info, NULL, &probe), "failed to create transient probe image");
+    VkMemoryRequirements mem_reqs = {};
+    vkGetImageMemoryRequirements(vk->device.logical, probe, &mem_reqs);
+    vkDestroyImage(vk->device.logical, probe, NULL);
+
+    VkMemoryPropertyFlags lazy_flags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT;
+    VkPhysicalDeviceMemoryProperties mem_props = {};
+    vkGetPhysicalDeviceMemoryProperties(vk->device.physical, &mem_props);
+    for (u32 i = 0; i < mem_props.memoryTypeCount; ++i)
+        if ((mem_reqs.memoryTypeBits & (1u << i)) && (mem_props.memoryTypes[i].propertyFlags & lazy_flags) == lazy_flags)
+            return true;
+    return false;
+}
+
+struct compute_pipeline {
+    VkPipeline handle;
+    VkPipelineLayout layout;
+};
+
+// Compute work is recorded into the graphics command buffers, relying on the graphics queue family also supporting compute.
+static struct compute_pipeline create_compute_pipeline(struct vk_core *vk, struct vtk_shader *shader, VkDescriptorSetLayout set_layout,
+                                                       u32 push_constant_size) {
+    struct compute_pipeline cp = {};
+
+    VkPushConstantRange push_constant_range = { VK_SHADER_STAGE_COMPUTE_BIT, 0, push_constant_size };
+    VkPipelineLayoutCreateInfo layout_info = {};
+    layout_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    layout_info.setLayoutCount = 1;
+    layout_info.pSetLayouts = &set_layout;
+    layout_info.pushConstantRangeCount = push_constant_size > 0 ? 1 : 0;
+    layout_info.pPushConstantRanges = &push_constant_range;
+    vtk_validate_result(vkCreatePipelineLayout(vk->device.logical, &layout_info, NULL, &cp.layout), "failed to create compute pipeline layout");
+
+    VkComputePipelineCreateInfo info = {};
+    info.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    info.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    info.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+    info.stage.module = shader->handle;
+    info.stage.pName = "main";
+    info.layout = cp.layout;
+    vtk_validate_result(vkCreateComputePipelines(vk->device.logical, vk->pipelines.cache, 1, &info, NULL, &cp.handle), "failed to create compute pipeline");
+
+    return cp;
+}
+
+// Same pipeline as vtk_create_graphics_pipeline() makes from info, created against the pipeline cache. The pipeline is given its own layout
+// from info's set layouts and push constant ranges, unless a shared layout is passed.
+static struct vtk_graphics_pipeline create_graphics_pipeline(struct vk_core *vk, struct vtk_render_pass *rp, u32 subpass,
+                                                             struct vtk_graphics_pipeline_info *info, VkPipelineLayout shared_layout) {
+    struct vtk_graphics_pipeline gp = {};
+
+    gp.layout = shared_layout;
+    if (shared_layout == VK_NULL_HANDLE) {
+        VkPipelineLayoutCreateInfo layout_info = {};
+        layout_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+        layout_info.setLayoutCount = info->descriptor_set_layouts.count;
+        layout_info.pSetLayouts = info->descriptor_set_layouts.data;
+        layout_info.pushConstantRangeCount = info->push_constant_ranges.count;
+        layout_info.pPushConstantRanges = info->push_constant_ranges.data;
+        vtk_validate_result(vkCreatePipelineLayout(vk->device.logical, &layout_info, NULL, &gp.layout),
+                            "failed to create graphics pipeline layout");
+    }
+
+    VkPipelineShaderStageCreateInfo stages[8] = {};
+    CTK_ASSERT(info->shaders.count <= CTK_ARRAY_COUNT(stages))
+    for (u32 i = 0; i < info->shaders.count; ++i) {
+        stages[i].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+        stages[i].stage = info->shaders[i]->stage;
+        stages[i].module = info->shaders[i]->handle;
+        stages[i].pName = "main";
+    }
+
+    VkVertexInputAttributeDescription attributes[16] = {};
+    CTK_ASSERT(info->vertex_inputs.count <= CTK_ARRAY_COUNT(attributes))
+    for (u32 i = 0; i < info->vertex_inputs.count; ++i) {
+        struct vtk_vertex_input *input = info->vertex_inputs + i;
+        attributes[i] = { input->location, input->binding, input->attribute->format, input->attribute->offset };
+    }
+    VkPipelineVertexInputStateCreateInfo vertex_input_state = {};
+    vertex_input_state.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+    vertex_input_state.vertexBindingDescriptionCount = info->vertex_input_binding_descriptions.count;
+    vertex_input_state.pVertexBindingDescriptions = info->vertex_input_binding_descriptions.data;
+    vertex_input_state.vertexAttributeDescriptionCount = info->vertex_inputs.count;
+    vertex_input_state.pVertexAttributeDescriptions = attributes;
+
+    VkPipelineViewportStateCreateInfo viewport_state = {};
+    viewport_state.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+    viewport_state.viewportCount = info->viewports.count;
+    viewport_state.pViewports = info->viewports.data;
+    viewport_state.scissorCount = info->scissors.count;
+    viewport_state.pScissors = info->scissors.data;
+
+    VkPipelineColorBlendStateCreateInfo color_blend_state = info->color_blend_state;
+    color_blend_state.attachmentCount = info->color_blend_attachment_states.count;
+    color_blend_state.pAttachments = info->color_blend_attachment_states.data;
+
+    VkGraphicsPipelineCreateInfo pipeline_info = {};
+    pipeline_info.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+    pipeline_info.stageCount = info->shaders.count;
+    pipeline_info.pStages = stages;
+    pipeline_info.pVertexInputState = &vertex_input_state;
+    pipeline_info.pInputAssemblyState = &info->input_assembly_state;
+    pipeline_info.pViewportState = &viewport_state;
+    pipeline_info.pRasterizationState = &info->rasterization_state;
+    pipeline_info.pMultisampleState = &info->multisample_state;
+    pipeline_info.pDepthStencilState = &info->depth_stencil_state;
+    pipeline_info.pColorBlendState = &color_blend_state;
+    pipeline_info.layout = gp.layout;
+    pipeline_info.renderPass = rp->handle;
+    pipeline_info.subpass = subpass;
+    vtk_validate_result(vkCreateGraphicsPipelines(vk->device.logical, vk->pipelines.cache, 1, &pipeline_info, NULL, &gp.handle),
+                        "failed to create graphics pipeline");
+
+    return gp;
+}
+
+// Pipelines are described up front and created by a batch of jobs, one pipeline each. The pipeline cache is only externally synchronized
+// when created with VK_PIPELINE_CACHE_CREATE_EXTERNALLY_SYNCHRONIZED_BIT, so every job creates against it at once.
+static u32 const MAX_PIPELINE_DESCS = 16;
+
+struct pipeline_desc {
+    VkPipelineBindPoint bind_point;
+
+    // Graphics
+    struct vtk_graphics_pipeline_info graphics_info;
+    struct vtk_render_pass *rp;
+    u32 subpass;
+    VkPipelineLayout shared_layout; // VK_NULL_HANDLE when the pipeline owns its layout.
+    struct vtk_graphics_pipeline *graphics;
+
+    // Compute
+    struct vtk_shader *shader;
+    VkDescriptorSetLayout set_layout;
+    u32 push_constant_size;
+    struct compute_pipeline *compute;
+
+    f64 done_ms;
+};
+
+struct pipeline_batch {
+    struct vk_core *vk;
+    struct ctk_array<struct pipeline_desc, MAX_PIPELINE_DESCS> descs;
+    LONG volatile pending;
+    f64 start_ms;
+    bool finished;
+};
+
+static void push_graphics_pipeline(struct pipeline_batch *batch, struct vtk_render_pass *rp, u32 subpass,
+                                   struct vtk_graphics_pipeline_info *info, VkPipelineLayout shared_layout,
+                                   struct vtk_graphics_pipeline *pipeline) {
+    struct pipeline_desc *desc = ctk_push(&batch->descs);
+    desc->bind_point = VK_PIPELINE_BIND_POINT_GRAPHICS;
+    desc->graphics_info = *info;
+    desc->rp = rp;
+    desc->subpass = subpass;
+    desc->shared_layout = shared_layout;
+    desc->graphics = pipeline;
+}
+
+static void push_compute_pipeline(struct pipeline_batch *batch, struct vtk_shader *shader, VkDescriptorSetLayout set_layout,
+                                  u32 push_constant_size, struct compute_pipeline *pipeline) {
+    struct pipeline_desc *desc = ctk_push(&batch->descs);
+    desc->bind_point = VK_PIPELINE_BIND_POINT_COMPUTE;
+    desc->shader = shader;
+    desc->set_layout = set_layout;
+    desc->push_constant_size = push_constant_size;
+    desc->compute = pipeline;
+}
+
+static void create_batch_pipelines(void *data, u32 first, u32 count) {
+    auto batch = (struct pipeline_batch *)data;
+    for (u32 i = first; i < first + count; ++i) {
+        struct pipeline_desc *desc = batch->descs + i;
+        if (desc->bind_point == VK_PIPELINE_BIND_POINT_GRAPHICS)
+            *desc->graphics = create_graphics_pipeline(batch->vk, desc->rp, desc->subpass, &desc->graphics_info, desc->shared_layout);
+        else
+            *desc->compute = create_compute_pipeline(batch->vk, desc->shader, desc->set_layout, desc->push_constant_size);
+        desc->done_ms = get_time_ms();
+    }
+}
+
+static void begin_pipeline_batch(struct job_system *jobs, struct pipeline_batch *batch) {
+    batch->start_ms = get_time_ms();
+    begin_background_jobs(jobs, batch->descs.count, create_batch_pipelines, batch, &batch->pending);
+}
+
+// Returns whether every pipeline in batch has been created, adding the batch to vk's pipeline stats the first time it has.
+static bool finish_pipeline_batch(struct pipeline_batch *batch) {
+    if (batch->pending > 0)
+        return false;
+    if (!batch->finished) {
+        f64 done_ms = batch->start_ms;
+        for (u32 i = 0; i < batch->descs.count; ++i)
+            done_ms = batch->descs[i].done_ms > done_ms ? batch->descs[i].done_ms : done_ms;
+        batch->vk->pipelines.count += batch->descs.count;
+        batch->vk->pipelines.create_ms += done_ms - batch->start_ms;
+        batch->finished = true;
+    }
+    return true;
+}
+
+static void wait_for_pipeline_batch(struct job_system *jobs, struct pipeline_batch *batch) {
+    wait_for_background_jobs(jobs, &batch->pending);
+    finish_pipeline_batch(batch);
+}
+
+// Every pool an allocator chains gets the same capacity.
+static VkDescriptorPoolSize const DESCRIPTOR_POOL_SIZES[] = {
+    { VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 32 },
+    { VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 16 },
+    { VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 64 },
+    { VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 16 },
+    { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 96 },
+};
+static u32 const DESCRIPTOR_POOL_MAX_SETS = 64;
+static u32 const MAX_TEMPLATE_ENTRIES = 16;
+
+// Descriptor sets come from a chain of pools: when the current pool can't fit an allocation, the allocation moves on to the next pool,
+// which is created if the chain ends there. Pool capacity is tracked here rather than by allocating until a pool fails, as running a pool
+// out is only reported from Vulkan 1.1. Resetting an allocator (see reset_descriptor_allocator()) frees every set and keeps its pools.
+struct descriptor_allocator {
+    VkDescriptorPool *pools;
+    u32 pool_count;
+    u32 pool_capacity;
+    u32 curr_pool;
+    u32 free_sets; // In the current pool.
+    u32 free_descriptors[CTK_ARRAY_COUNT(DESCRIPTOR_POOL_SIZES)];
+};
+
+// How to write a set's bindings from a packed struct of VkDescriptorBufferInfos and VkDescriptorImageInfos. Entry i is binding i, with its
+// info at offset in the struct. handle is the matching VkDescriptorUpdateTemplate, or VK_NULL_HANDLE when the device has no update
+// templates and write_descriptor_set() builds the writes itself.
+struct descriptor_template_entry {
+    VkDescriptorType type;
+    u32 offset;
+};
+
+struct descriptor_template {
+    struct ctk_array<struct descriptor_template_entry, MAX_TEMPLATE_ENTRIES> entries;
+    VkDescriptorUpdateTemplate handle;
+};
+
+static VkDescriptorPool create_descriptor_pool(VkDevice device) {
+    VkDescriptorPoolCreateInfo pool_info = {};
+    pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    pool_info.flags = 0;
+    pool_info.maxSets = DESCRIPTOR_POOL_MAX_SETS;
+    pool_info.poolSizeCount = CTK_ARRAY_COUNT(DESCRIPTOR_POOL_SIZES);
+    pool_info.pPoolSizes = DESCRIPTOR_POOL_SIZES;
+    VkDescriptorPool pool = VK_NULL_HANDLE;
+    vtk_validate_result(vkCreateDescriptorPool(device, &pool_info, NULL, &pool), "failed to create descriptor pool");
+    return pool;
+}
+
+static u32 get_descriptor_pool_size_index(VkDescriptorType type) {
+    u32 idx = 0;
+    while (idx < CTK_ARRAY_COUNT(DESCRIPTOR_POOL_SIZES) && DESCRIPTOR_POOL_SIZES[idx].type != type)
+        ++idx;
+    if (idx == CTK_ARRAY_COUNT(DESCRIPTOR_POOL_SIZES))
+        CTK_FATAL("descriptor type %u isn't in DESCRIPTOR_POOL_SIZES", type)
+    return idx;
+}
+
+// Creates a set layout with a binding per stages entry and the template for writing its sets.
+static void create_descriptor_set_layout(struct vk_core *vk, struct descriptor_template_entry const *entries,
+                                         VkShaderStageFlags const *stages, u32 binding_count, VkDescriptorSetLayout *layout,
+                                         struct descriptor_template *tmpl) {
+    CTK_ASSERT(binding_count <= MAX_TEMPLATE_ENTRIES)
+    VkDescriptorSetLayoutBinding bindings[MAX_TEMPLATE_ENTRIES] = {};
+    VkDescriptorUpdateTemplateEntry update_entries[MAX_TEMPLATE_ENTRIES] = {};
+    tmpl->entries.count = 0;
+    for (u32 i = 0; i < binding_count; ++i) {
+        bindings[i] = { i, entries[i].type, 1, stages[i] };
+        update_entries[i] = { i, 0, 1, entries[i].type, entries[i].offset, 0 };
+        ctk_push(&tmpl->entries, entries[i]);
+    }
+    VkDescriptorSetLayoutCreateInfo info = {};
+    info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    info.bindingCount = binding_count;
+    info.pBindings = bindings;
+    vtk_validate_result(vkCreateDescriptorSetLayout(vk->device.logical, &info, NULL, layout), "error creating descriptor set layout");
+
+    tmpl->handle = VK_NULL_HANDLE;
+    if (vk->descriptor_update_templates.create != NULL) {
+        VkDescriptorUpdateTemplateCreateInfo tmpl_info = {};
+        tmpl_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_UPDATE_TEMPLATE_CREATE_INFO;
+        tmpl_info.descriptorUpdateEntryCount = binding_count;
+        tmpl_info.pDescriptorUpdateEntries = update_entries;
+        tmpl_info.templateType = VK_DESCRIPTOR_UPDATE_TEMPLATE_TYPE_DESCRIPTOR_SET;
+        tmpl_info.descriptorSetLayout = *layout;
+        vtk_validate_result(vk->descriptor_update_templates.create(vk->device.logical, &tmpl_info, NULL, &tmpl->handle),
+                            "error creating descriptor update template");
+    }
+}
+
+// Reserves room for set_count sets needing descriptors[i] of each DESCRIPTOR_POOL_SIZES type, and returns the pool to allocate them from.
+static VkDescriptorPool reserve_descriptor_pool(struct descriptor_allocator *allocator, VkDevice device, u32 const *descriptors,
+                                                u32 set_count) {
+    bool fits = allocator->pool_count > 0 && set_count <= allocator->free_sets;
+    for (u32 i = 0; i < CTK_ARRAY_COUNT(DESCRIPTOR_POOL_SIZES); ++i) {
+        CTK_ASSERT(descriptors[i] <= DESCRIPTOR_POOL_SIZES[i].descriptorCount)
+        fits = fits && descriptors[i] <= allocator->free_descriptors[i];
+    }
+    if (!fits) {
+        CTK_ASSERT(set_count <= DESCRIPTOR_POOL_MAX_SETS)
+        allocator->curr_pool = allocator->pool_count > 0 ? allocator->curr_pool + 1 : 0;
+        if (allocator->curr_pool == allocator->pool_count) {
+            if (allocator->pool_count == allocator->pool_capacity) {
+                allocator->pool_capacity = allocator->pool_capacity > 0 ? allocator->pool_capacity * 2 : 4;
+                allocator->pools = (VkDescriptorPool *)realloc(allocator->pools, allocator->pool_capacity * sizeof(VkDescriptorPool));
+            }
+            allocator->pools[allocator->pool_count++] = create_descriptor_pool(device);
+        }
+        allocator->free_sets = DESCRIPTOR_POOL_MAX_SETS;
+        for (u32 i = 0; i < CTK_ARRAY_COUNT(DESCRIPTOR_POOL_SIZES); ++i)
+            allocator->free_descriptors[i] = DESCRIPTOR_POOL_SIZES[i].descriptorCount;
+    }
+    allocator->free_sets -= set_count;
+    for (u32 i = 0; i < CTK_ARRAY_COUNT(DESCRIPTOR_POOL_SIZES); ++i)
+        allocator->free_descriptors[i] -= descriptors[i];
+    return allocator->pools[allocator->curr_pool];
+}
+
+// Frees every set allocated from allocator; the caller must know none are still in use by the GPU.
+static void reset_descriptor_allocator(struct descriptor_allocator *allocator, VkDevice device) {
+    for (u32 i = 0; i < allocator->pool_count; ++i)
+        vtk_validate_result(vkResetDescriptorPool(device, allocator->pools[i], 0), "failed to reset descriptor pool");
+    allocator->curr_pool = 0;
+    allocator->free_sets = DESCRIPTOR_POOL_MAX_SETS;
+    for (u32 i = 0; i < CTK_ARRAY_COUNT(DESCRIPTOR_POOL_SIZES); ++i)
+        allocator->free_descriptors[i] = DESCRIPTOR_POOL_SIZES[i].descriptorCount;
+}
+
+// Allocates set_count sets of layout, whose bindings are described by tmpl.
+static void allocate_descriptor_sets(struct descriptor_allocator *allocator, VkDevice device, VkDescriptorSetLayout layout,
+                                     struct descriptor_template *tmpl, u32 set_count, VkDescriptorSet *sets) {
+    u32 descriptors[CTK_ARRAY_COUNT(DESCRIPTOR_POOL_SIZES)] = {};
+    for (u32 i = 0; i < tmpl->entries.count; ++i)
+        descriptors[get_descriptor_pool_size_index(tmpl->entries[i].type)] += set_count;
+    VkDescriptorSetLayout layouts[DESCRIPTOR_POOL_MAX_SETS] = {};
+    for (u32 i = 0; i < set_count; ++i)
+        layouts[i] = layout;
+    VkDescriptorSetAllocateInfo info = {};
+    info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    info.descriptorPool = reserve_descriptor_pool(allocator, device, descriptors, set_count);
+    info.descriptorSetCount = set_count;
+    info.pSetLayouts = layouts;
+    vtk_validate_result(vkAllocateDescriptorSets(device, &info, sets), "failed to allocate descriptor sets");
+}
+
+static void write_descriptor_set(struct vk_core *vk, VkDescriptorSet set, struct descriptor_template *tmpl, void const *data) {
+    if (tmpl->handle != VK_NULL_HANDLE) {
+        vk->descriptor_update_templates.update(vk->device.logical, set, tmpl->handle, data);
+        return;
+    }
+    VkWriteDescriptorSet writes[MAX_TEMPLATE_ENTRIES] = {};
+    for (u32 i = 0; i < tmpl->entries.count; ++i) {
+        struct descriptor_template_entry *entry = tmpl->entries + i;
+        auto info = (u8 const *)data + entry->offset;
+        VkWriteDescriptorSet *write = writes + i;
+        write->sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        write->dstSet = set;
+        write->dstBinding = i;
+        write->dstArrayElement = 0;
+        write->descriptorCount = 1;
+        write->descriptorType = entry->type;
+        if (entry->type == VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER || entry->type == VK_DESCRIPTOR_TYPE_STORAGE_IMAGE)
+            write->pImageInfo = (VkDescriptorImageInfo const *)info;
+        else
+            write->pBufferInfo = (VkDescriptorBufferInfo const *)info;
+    }
+    vkUpdateDescriptorSets(vk->device.logical, tmpl->entries.count, writes, 0, NULL);
+}
+
+static VkDescriptorBufferInfo get_region_descriptor(struct vtk_region *region) {
+    return { region->buffer->handle, region->offset, region->size };
+}
+
 ////////////////////////////////////////////////////////////
 /// App
 ////////////////////////////////////////////////////////////
@@ -145,6 +917,22 @@ struct shader_load_info : public asset_load_info {
     VkShaderStageFlagBits stage;
 };
 
+// File scope so the shader watcher can find each shader's source (its SPIR-V path without ".spv").
+static struct shader_load_info const SHADER_LOAD_INFOS[] = {
+    { "shadow_vert", "assets/shaders/shadows/shadow.vert.spv", VK_SHADER_STAGE_VERTEX_BIT },
+    { "shadow_frag", "assets/shaders/shadows/shadow.frag.spv", VK_SHADER_STAGE_FRAGMENT_BIT },
+    { "direct_vert", "assets/shaders/shadows/direct.vert.spv", VK_SHADER_STAGE_VERTEX_BIT },
+    { "direct_frag", "assets/shaders/shadows/direct.frag.spv", VK_SHADER_STAGE_FRAGMENT_BIT },
+    { "unlit_vert", "assets/shaders/shadows/unlit.vert.spv", VK_SHADER_STAGE_VERTEX_BIT },
+    { "unlit_frag", "assets/shaders/shadows/unlit.frag.spv", VK_SHADER_STAGE_FRAGMENT_BIT },
+    { "fullscreen_texture_vert", "assets/shaders/shadows/fullscreen_texture.vert.spv", VK_SHADER_STAGE_VERTEX_BIT },
+    { "fullscreen_texture_frag", "assets/shaders/shadows/fullscreen_texture.frag.spv", VK_SHADER_STAGE_FRAGMENT_BIT },
+    { "hiz_reduce_comp", "assets/shaders/shadows/hiz_reduce.comp.spv", VK_SHADER_STAGE_COMPUTE_BIT },
+    { "hiz_cull_comp", "assets/shaders/shadows/hiz_cull.comp.spv", VK_SHADER_STAGE_COMPUTE_BIT },
+    { "gpu_cull_comp", "assets/shaders/shadows/gpu_cull.comp.spv", VK_SHADER_STAGE_COMPUTE_BIT },
+};
+static u32 const SHADER_COUNT = CTK_ARRAY_COUNT(SHADER_LOAD_INFOS);
+
 struct texture_load_info : public asset_load_info {
     VkFilter filter;
 };
@@ -155,16 +943,25 @@ struct vertex {
     struct ctk_v2<f32> uv;
 };
 
+// Bounds are computed at load in model space: an AABB (center +/- extent) and a bounding sphere around the same center.
 struct mesh {
     struct ctk_buffer<struct vertex> vertexes;
     struct ctk_buffer<u32> indexes;
     struct vtk_region vertex_region;
     struct vtk_region index_region;
+    struct ctk_v3<f32> bounds_center;
+    struct ctk_v3<f32> bounds_extent;
+    f32 bounds_radius;
+};
+
+struct camera_ubo {
+    alignas(16) glm::mat4 view_space_mtx;
+    alignas(16) struct ctk_v3<f32> position;
 };
 
 struct model_ubo {
     alignas(16) glm::mat4 model_mtx;
-    alignas(16) glm::mat4 mvp_mtx;
+    alignas(16) glm::mat4 normal_mtx;
 };
 
 enum {
@@ -204,22 +1001,305 @@ struct material_ubo {
     u32 shine_exponent;
 };
 
-static u32 const MAX_ENTITIES = 1024;
+// Per-renderable data, indexed like the renderables and matching the std430 layout of gpu_cull.comp, direct.vert and shadow.vert. Vertex
+// shaders look an instance's entity up in the frame's instance buffer, then read its model UBO and render flags by entity index.
+struct gpu_entity {
+    f32 center[3];
+    u32 draw_group; // See get_draw_group(), or NO_DRAW_GROUP for renderables without a mesh.
+    f32 extent[3];
+    u32 render_flags;
+    f32 radius;
+    u32 material_index;
+    u32 pad[2];
+};
+
+static u32 const CHUNK_SIZE = 1024; // Multiple of SIMD_WIDTH.
 static u32 const MAX_LIGHTS = 16;
 static u32 const MAX_MATERIALS = 16;
 static u32 const SHADOW_MAP_SIZE = 4096;
 // static u32 const SHADOW_MAP_SIZE = 8192;
 static VkFormat const OMNI_SHADOW_MAP_FORMAT = VK_FORMAT_D32_SFLOAT;//VK_FORMAT_R32_SFLOAT; // Image will have color aspect but hold depth data.
 
+// Storage that grows CHUNK_SIZE elements at a time. Chunks are never moved or freed once pushed, so pointers into them stay valid.
+template<typename chunk>
+struct chunk_list {
+    chunk **data;
+    u32 count;
+    u32 capacity;
+};
+
+template<typename chunk>
+static chunk *push_chunk(struct chunk_list<chunk> *list) {
+    if (list->count == list->capacity) {
+        list->capacity = list->capacity == 0 ? 8 : list->capacity * 2;
+        list->data = (chunk **)realloc(list->data, list->capacity * sizeof(chunk *));
+    }
+    return list->data[list->count++] = ctk_zalloc<chunk>();
+}
+
+template<typename chunk>
+static void destroy_chunk_list(struct chunk_list<chunk> *list) {
+    for (u32 i = 0; i < list->count; ++i)
+        free(list->data[i]);
+    free(list->data);
+    *list = {};
+}
+
+struct draw {
+    u64 sort_key; // See get_sort_key().
+    struct mesh *mesh;
+    struct vtk_descriptor_set *texture_desc_set;
+    u32 model_ubo_chunk;
+    u32 model_ubo_idx;
+};
+
+// Consecutive draws of the same mesh and texture, drawn as one instanced draw whose instances start at first_instance in the frame's
+// instance buffer.
+struct draw_batch {
+    struct mesh *mesh;
+    struct vtk_descriptor_set *texture_desc_set;
+    u32 first_instance;
+    u32 instance_count;
+};
+
+// Counted while recording: binds made and binds skipped because the state was already bound, and draw calls made per state change.
+struct bind_stats {
+    u32 draws;
+    u32 state_changes; // Bound states, i.e. the draws' states that needed at least one bind.
+    u32 binds;
+    u32 binds_skipped;
+};
+
+// Rebuilt every frame, either from a linear pass where each chunk's draws are written to their own CHUNK_SIZE range in parallel and then
+// packed in chunk order, or from a BVH query per view. Either way the list comes out the same regardless of thread count.
+struct draw_list {
+    struct draw *draws;
+    struct draw *sort_scratch;
+    u32 *chunk_counts;
+    u32 *visible; // BVH query results.
+    u32 count;
+    u32 chunk_capacity;
+    struct draw_batch *batches;
+    u32 batch_count;
+
+    // Software occlusion: the view's occluders rasterised at OCCLUSION_BUFFER_WIDTH x OCCLUSION_BUFFER_HEIGHT, nearest depth per pixel.
+    f32 *occlusion_depth;
+    glm::vec4 *occluder_verts; // Clip-space occluder vertexes.
+    u32 occluder_vert_capacity;
+    u32 occluded; // Draws removed by software occlusion culling.
+};
+
+// Render queues, built once per frame: the camera's opaque and transparent draws, and each of the six shadow passes' casters (one per
+// omni shadow map face).
+struct draw_lists {
+    struct draw_list direct;
+    struct draw_list transparent; // Sorted back to front when batched.
+    struct draw_list shadow[6];
+    struct mesh *meshes; // Asset arrays sort keys number meshes and textures by. Without them, draws are only sorted by depth.
+    struct vtk_descriptor_set *textures;
+    u32 *chunk_drawables; // Renderables with a mesh per chunk, to report how many each view culled.
+    u32 drawable_count;
+    bool gpu_driven; // Only the transparent queue is built on the CPU; gpu_cull.comp builds the rest.
+};
+
+static u32 const VIEW_COUNT = 7; // Camera, then the six shadow faces.
+
+struct cull_settings {
+    bool gpu_driven; // Cull the camera's opaque draws and the shadow casters in gpu_cull.comp, drawing them with indirect draws.
+    bool bvh; // Query the scene's BVH per view instead of testing every entity.
+    bool frustum;
+    bool occlusion; // Cull camera draws on the GPU against a Hi-Z depth pyramid.
+    bool software_occlusion; // Cull every view's draws on the CPU against its rasterised occluders.
+    bool tiny; // Cull entities covering less than min_screen_size of the camera's screen height.
+    f32 min_screen_size;
+};
+
+static u32 const MAX_RECORD_TASKS = 64; // Secondary command buffers per frame.
+
+// Secondary command buffers a job system worker records for one swapchain image. Buffers are allocated as needed, and go on the free list
+// when the task holding them is dropped or recorded again by another worker. A task can hold its buffer and one being retired, hence the
+// free list's size.
+struct worker_cmd_pool {
+    VkCommandPool handle;
+    VkCommandBuffer free[MAX_RECORD_TASKS * 2];
+    u32 free_count;
+};
+
+// A secondary command buffer's worth of draws (see record_secondary_cmd_bufs()). Tasks are kept per swapchain image along with the buffer
+// last recorded for them, which is executed again as is while the task's signature stays the same.
+struct record_task {
+    u32 type;
+    u32 idx; // Shadow face, or direct pass phase.
+    u32 first_instance; // Camera instances drawn by a direct task.
+    u32 end_instance;
+    u64 signature; // See get_record_signature().
+    VkCommandBuffer cmd_buf;
+    u32 owner; // Worker whose pool cmd_buf is from.
+    VkCommandBuffer retired; // Buffer replaced this frame, handed back to retired_owner's pool once recording is done.
+    u32 retired_owner;
+    bool recorded; // This frame.
+    struct bind_stats binds; // From the last recording.
+};
+
+struct record_cache {
+    struct record_task tasks[MAX_RECORD_TASKS];
+    u32 task_count;
+};
+
+static u32 const MAX_INSTANCES = 128 * 1024; // Per frame, across every render queue. Draws past this are dropped.
+static u32 const MAX_GPU_ENTITIES = 128 * 1024; // Multiple of CHUNK_SIZE. Renderables past this aren't drawn.
+static u32 const MAX_MESHES = 16; // Capacity of the mesh asset map.
+static u32 const MAX_TEXTURES = 16; // Capacity of the texture asset and descriptor set maps.
+static u32 const DRAW_GROUP_TEXTURES = MAX_TEXTURES + 1; // A group per texture, then one for renderables without a texture.
+static u32 const MAX_DRAW_GROUPS = MAX_MESHES * DRAW_GROUP_TEXTURES; // Mesh x texture; see get_draw_group().
+static u32 const NO_DRAW_GROUP = CTK_U32_MAX;
+static u32 const MAX_HIZ_OBJECTS = 64 * 1024; // Camera draws past this are drawn without occlusion culling.
+static u32 const MAX_DEPTH_PYRAMID_LEVELS = 16;
+
+enum {
+    HIZ_PHASE_EARLY,
+    HIZ_PHASE_LATE,
+    HIZ_PHASE_NONE, // Hi-Z culling is off, and the direct pass is drawn in one go.
+};
+
+// World bounds of a camera draw, matching hiz_cull.comp's std430 layout.
+struct hiz_object {
+    f32 center[3];
+    u32 index_count;
+    f32 extent[3];
+    u32 pad;
+};
+
+struct hiz_push_constants {
+    glm::mat4 view_space_mtx;
+    u32 object_count;
+    u32 phase;
+    u32 test_occlusion;
+};
+
+// Hierarchical-Z occlusion culling. The depth pyramid's levels hold the furthest depth under each texel, reduced from the direct pass's
+// depth image. Everything runs on core compute, and the commands are drawn with multiDrawIndirect where the device has it and one at a time
+// where it doesn't, so it also works on software ICDs. Culling results go into indirect draw commands, one per camera draw, whose instance
+// count is 0 when culled. Commands stay in draw order rather than being compacted, so each batch's commands are a contiguous range.
+struct hiz {
+    struct vtk_image depth_pyramid;
+    struct ctk_array<VkImageView, MAX_DEPTH_PYRAMID_LEVELS> level_views;
+    VkSampler sampler;
+    VkExtent2D extent;
+    struct hiz_object *objects_staging;
+    u32 object_count;
+    struct {
+        struct ctk_array<struct vtk_region, 4> objects;
+        struct ctk_array<struct vtk_region, 4> early_cmds;
+        struct ctk_array<struct vtk_region, 4> late_cmds;
+        struct ctk_array<struct vtk_region, 4> counts; // Early-visible, late-visible and occluded, read back once the frame's fence is hit.
+    } regions;
+    glm::mat4 prev_view_space_mtx; // Camera matrix of the frame that last wrote the depth image.
+    bool prev_depth_valid;
+};
+
+struct hiz_reduce_descriptors {
+    VkDescriptorImageInfo src;
+    VkDescriptorImageInfo dst;
+};
+
+struct hiz_cull_descriptors {
+    VkDescriptorImageInfo depth_pyramid;
+    VkDescriptorBufferInfo objects;
+    VkDescriptorBufferInfo early_cmds;
+    VkDescriptorBufferInfo late_cmds;
+    VkDescriptorBufferInfo counts;
+};
+
+enum {
+    GPU_CULL_FRUSTUM = 1 << 0,
+    GPU_CULL_TINY    = 1 << 1,
+    GPU_CULL_RANGE   = 1 << 2,
+};
+
+// A cull_view as tested by gpu_cull.comp, matching its std430 layout.
+struct gpu_cull_view {
+    f32 planes[6][4];
+    f32 eye[3];
+    f32 range;
+    f32 tiny_scale;
+    u32 cull_flags;
+    u32 pad[2];
+};
+
+// GPU-driven culling. Every renderable's bounds are culled against every view in one dispatch, and each survivor is appended to its view's
+// command for its draw group (renderables sharing a mesh and texture): the command's instance count is bumped and the entity's index goes
+// in the instance range the command draws. Each group's range is sized for all of its renderables, so appends never overflow. Passes then
+// record an indirect draw per draw group rather than per batch, and only core features are used (no multi-draw or draw count).
+struct gpu_cull {
+    VkDrawIndexedIndirectCommand *cmds_staging; // VIEW_COUNT x MAX_DRAW_GROUPS, with instance counts of 0.
+    u32 group_sizes[MAX_DRAW_GROUPS];
+    u32 groups[MAX_DRAW_GROUPS]; // Draw groups with any renderables, in group order.
+    u32 group_count;
+    bool groups_valid; // Cleared while GPU-driven culling is off, as the groups aren't kept up to date then.
+    u32 groups_version; // Renderables' version the groups were built against.
+    u32 stale_templates; // Bit per swapchain image whose cmd_templates region predates the groups.
+    struct {
+        struct ctk_array<struct vtk_region, 4> views;
+        struct ctk_array<struct vtk_region, 4> cmd_templates; // Copied over cmds before culling.
+        struct ctk_array<struct vtk_region, 4> cmds;
+        struct ctk_array<struct vtk_region, 4> instances; // Entity indexes, MAX_GPU_ENTITIES per view.
+        struct ctk_array<struct vtk_region, 4> counts; // Visible per view, read back once the frame's fence is hit.
+    } regions;
+};
+
+struct gpu_cull_descriptors {
+    VkDescriptorBufferInfo entities;
+    VkDescriptorBufferInfo views;
+    VkDescriptorBufferInfo cmds;
+    VkDescriptorBufferInfo instances;
+    VkDescriptorBufferInfo counts;
+};
+
+// Bindings of the scene pipelines' set 0 (see create_scene_pipeline_layout()).
+struct frame_descriptors {
+    VkDescriptorBufferInfo camera_ubo;
+    VkDescriptorBufferInfo light_ubo; // Shadow casting light.
+    VkDescriptorBufferInfo light_ubos;
+    VkDescriptorBufferInfo light_model_ubos;
+    VkDescriptorBufferInfo entity_models;
+    VkDescriptorBufferInfo entity_data;
+    VkDescriptorBufferInfo instances;
+    VkDescriptorImageInfo directional_shadow_map;
+    VkDescriptorImageInfo omni_shadow_map;
+};
+
 struct app {
     struct vtk_vertex_layout vertex_layout;
+    struct job_system *jobs;
     struct {
-        struct vtk_uniform_buffer entity_model_ubos;
+        struct vtk_uniform_buffer camera_ubo;
         struct vtk_uniform_buffer light_model_ubos;
         struct vtk_uniform_buffer light_ubos;
     } uniform_bufs;
+    struct draw_lists draw_lists;
+    struct {
+        struct gpu_entity *staging;
+        u32 *chunk_group_sizes; // MAX_DRAW_GROUPS per chunk.
+        u32 count; // Renderables uploaded, at most MAX_GPU_ENTITIES.
+        struct {
+            struct ctk_array<struct vtk_region, 4> models; // Model UBO per renderable, uploaded when its transform changes.
+            struct ctk_array<struct vtk_region, 4> data;
+        } regions; // Per swapchain image.
+    } entities;
+    struct {
+        u32 *staging; // Entity index per instance.
+        struct ctk_array<struct vtk_region, 4> regions; // Per swapchain image.
+        u32 count;
+        u32 dropped;
+    } instances;
+    struct cull_settings culling;
+    struct hiz hiz;
+    struct gpu_cull gpu_cull;
     struct {
         struct vtk_image depth;
+        struct vtk_image transient_depth; // Only created when lazily-allocated memory is supported.
+        VkDeviceSize transient_depth_size;
     } attachment_imgs;
     struct {
         struct vtk_texture directional;
@@ -228,41 +1308,72 @@ struct app {
     struct {
         VkCommandBuffer one_time;
         struct ctk_array<VkCommandBuffer, 4> render;
+        struct worker_cmd_pool *worker_pools; // Per swapchain image, one per job system worker.
+        struct ctk_array<struct record_cache, 4> record_caches; // Per swapchain image.
     } cmd_bufs;
     struct {
         struct ctk_map<struct vtk_shader, 16> shaders;
-        struct ctk_map<struct vtk_texture, 16> textures;
-        struct ctk_map<struct mesh, 16> meshes;
+        struct ctk_map<struct vtk_texture, MAX_TEXTURES> textures;
+        struct ctk_map<struct mesh, MAX_MESHES> meshes;
     } assets;
     struct {
-        VkDescriptorPool pool;
+        struct descriptor_allocator allocator;
+        // Per swapchain image, for sets written while recording that image's frame. Reset by sync_frame() once the image's previous frame
+        // is done with them.
+        struct ctk_array<struct descriptor_allocator, 4> transient_allocators;
         struct {
-            VkDescriptorSetLayout model_ubo;
             VkDescriptorSetLayout light_ubo;
             VkDescriptorSetLayout sampler;
+            VkDescriptorSetLayout frame;
+            VkDescriptorSetLayout hiz_reduce;
+            VkDescriptorSetLayout hiz_cull;
+            VkDescriptorSetLayout gpu_cull;
         } set_layouts;
         struct {
-            struct vtk_descriptor_set entity_model_ubo;
-            struct vtk_descriptor_set light_model_ubo;
+            struct descriptor_template light_ubo;
+            struct descriptor_template sampler;
+            struct descriptor_template frame;
+            struct descriptor_template hiz_reduce;
+            struct descriptor_template hiz_cull;
+            struct descriptor_template gpu_cull;
+        } templates; // Matching set_layouts.
+        struct {
             struct vtk_descriptor_set light_ubo;
-            struct ctk_map<struct vtk_descriptor_set, 16> textures;
-            struct {
-                struct vtk_descriptor_set directional;
-                struct vtk_descriptor_set omni;
-            } shadow_maps;
+            struct vtk_descriptor_set frame; // Set 0 of the scene pipeline layout (see create_scene_pipeline_layout()).
+            struct vtk_descriptor_set gpu_frame; // frame, with the instances written by gpu_cull.comp.
+            struct ctk_map<struct vtk_descriptor_set, MAX_TEXTURES> textures; // Set 1, per material.
+            struct ctk_array<VkDescriptorSet, MAX_DEPTH_PYRAMID_LEVELS> hiz_reduce; // Per pyramid level.
+            struct ctk_array<VkDescriptorSet, 4> hiz_cull; // Per swapchain image.
+            struct ctk_array<VkDescriptorSet, 4> gpu_cull; // Per swapchain image.
         } sets;
     } descriptors;
     struct {
         struct vtk_render_pass direct;
+        struct vtk_render_pass direct_late; // Continues the direct pass after late Hi-Z culling.
+        struct vtk_render_pass direct_single; // The whole direct pass when Hi-Z culling is off; depth isn't kept.
         struct vtk_render_pass shadow;
         struct vtk_render_pass fullscreen_texture;
     } render_passes;
     struct {
         struct vtk_graphics_pipeline shadow;
         struct vtk_graphics_pipeline direct;
+        struct vtk_graphics_pipeline direct_transparent;
         struct vtk_graphics_pipeline unlit;
         struct vtk_graphics_pipeline fullscreen_texture;
     } graphics_pipelines;
+    struct {
+        VkPipelineLayout scene; // Shared by the shadow, direct, direct_transparent and unlit pipelines.
+    } pipeline_layouts;
+    struct {
+        struct pipeline_batch *first_frame;
+        struct pipeline_batch *deferred; // Pipelines the first frame doesn't need, which are created while it renders.
+    } pipeline_batches; // Kept as the descriptions reloaded shaders' pipelines are rebuilt from.
+    struct shader_reload *shader_reload;
+    struct {
+        struct compute_pipeline hiz_reduce;
+        struct compute_pipeline hiz_cull;
+        struct compute_pipeline gpu_cull;
+    } compute_pipelines;
     struct {
         struct ctk_array<VkSemaphore, 4> img_aquired;
         struct ctk_array<u32, 4> img_prev_frame;
@@ -271,6 +1382,19 @@ struct app {
         u32 curr_frame;
         u32 frame_count;
     } frame_sync;
+    struct {
+        u32 model_ubo_uploads;
+        f64 scene_update_ms;
+        f64 scene_load_ms;
+        u32 hiz_early_visible;
+        u32 hiz_late_visible;
+        u32 hiz_occluded;
+        u32 gpu_camera_visible;
+        u32 gpu_shadow_visible;
+        struct bind_stats binds;
+        u32 secondary_cmd_bufs;
+        u32 recorded_cmd_bufs;
+    } stats;
 };
 
 static struct vtk_texture load_texture(struct vtk_texture_info *info, cstr path, struct app *app, struct vk_core *vk) {
@@ -406,6 +1530,30 @@ static void load_mesh(struct mesh *mesh, cstr path, struct app *app, struct vk_c
         }
     }
 
+    // Bounds
+    struct ctk_v3<f32> lo = { FLT_MAX, FLT_MAX, FLT_MAX };
+    struct ctk_v3<f32> hi = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+    for (u32 i = 0; i < mesh->vertexes.count; ++i) {
+        struct ctk_v3<f32> *pos = &mesh->vertexes.data[i].position;
+        lo = { pos->x < lo.x ? pos->x : lo.x, pos->y < lo.y ? pos->y : lo.y, pos->z < lo.z ? pos->z : lo.z };
+        hi = { pos->x > hi.x ? pos->x : hi.x, pos->y > hi.y ? pos->y : hi.y, pos->z > hi.z ? pos->z : hi.z };
+    }
+    if (mesh->vertexes.count == 0)
+        lo = hi = {};
+    mesh->bounds_center = { (lo.x + hi.x) * 0.5f, (lo.y + hi.y) * 0.5f, (lo.z + hi.z) * 0.5f };
+    mesh->bounds_extent = { (hi.x - lo.x) * 0.5f, (hi.y - lo.y) * 0.5f, (hi.z - lo.z) * 0.5f };
+    f32 radius_sq = 0;
+    for (u32 i = 0; i < mesh->vertexes.count; ++i) {
+        struct ctk_v3<f32> *pos = &mesh->vertexes.data[i].position;
+        f32 dx = pos->x - mesh->bounds_center.x;
+        f32 dy = pos->y - mesh->bounds_center.y;
+        f32 dz = pos->z - mesh->bounds_center.z;
+        f32 dist_sq = dx * dx + dy * dy + dz * dz;
+        if (dist_sq > radius_sq)
+            radius_sq = dist_sq;
+    }
+    mesh->bounds_radius = sqrtf(radius_sq);
+
     // Allocate and write vertex/index data to their associated regions.
     u32 verts_byte_size = ctk_byte_size(&mesh->vertexes);
     u32 idxs_byte_size = ctk_byte_size(&mesh->indexes);
@@ -424,18 +1572,8 @@ static void load_mesh(struct mesh *mesh, cstr path, struct app *app, struct vk_c
 
 static void load_assets(struct app *app, struct vk_core *vk) {
     // Shaders
-    struct shader_load_info shader_load_infos[] = {
-        { "shadow_vert", "assets/shaders/shadows/shadow.vert.spv", VK_SHADER_STAGE_VERTEX_BIT },
-        { "shadow_frag", "assets/shaders/shadows/shadow.frag.spv", VK_SHADER_STAGE_FRAGMENT_BIT },
-        { "direct_vert", "assets/shaders/shadows/direct.vert.spv", VK_SHADER_STAGE_VERTEX_BIT },
-        { "direct_frag", "assets/shaders/shadows/direct.frag.spv", VK_SHADER_STAGE_FRAGMENT_BIT },
-        { "unlit_vert", "assets/shaders/shadows/unlit.vert.spv", VK_SHADER_STAGE_VERTEX_BIT },
-        { "unlit_frag", "assets/shaders/shadows/unlit.frag.spv", VK_SHADER_STAGE_FRAGMENT_BIT },
-        { "fullscreen_texture_vert", "assets/shaders/shadows/fullscreen_texture.vert.spv", VK_SHADER_STAGE_VERTEX_BIT },
-        { "fullscreen_texture_frag", "assets/shaders/shadows/fullscreen_texture.frag.spv", VK_SHADER_STAGE_FRAGMENT_BIT },
-    };
-    for (u32 i = 0; i < CTK_ARRAY_COUNT(shader_load_infos); ++i) {
-        struct shader_load_info *shader_load_info = shader_load_infos + i;
+    for (u32 i = 0; i < SHADER_COUNT; ++i) {
+        struct shader_load_info const *shader_load_info = SHADER_LOAD_INFOS + i;
         ctk_push(&app->assets.shaders, shader_load_info->name, vtk_create_shader(vk->device.logical, shader_load_info->path, shader_load_info->stage));
     }
 
@@ -467,218 +1605,126 @@ static void load_assets(struct app *app, struct vk_core *vk) {
     }
 }
 
-static void allocate_shadow_map_descriptor_set(struct app *app, struct vk_core *vk, struct vtk_descriptor_set *ds) {
+static void allocate_descriptor_set(struct app *app, struct vk_core *vk, struct vtk_descriptor_set *ds, VkDescriptorSetLayout layout,
+                                    struct descriptor_template *tmpl, u32 instance_count) {
+    ds->instances.count = instance_count;
+    allocate_descriptor_sets(&app->descriptors.allocator, vk->device.logical, layout, tmpl, instance_count, ds->instances.data);
+}
+
+// Allocates a single-instance set that's only valid until swapchain_img_idx's next frame is synced.
+static void allocate_transient_descriptor_set(struct app *app, struct vk_core *vk, u32 swapchain_img_idx, struct vtk_descriptor_set *ds,
+                                              VkDescriptorSetLayout layout, struct descriptor_template *tmpl) {
     ds->instances.count = 1;
+    allocate_descriptor_sets(app->descriptors.transient_allocators + swapchain_img_idx, vk->device.logical, layout, tmpl, 1,
+                             ds->instances.data);
+}
 
-    VkDescriptorSetAllocateInfo info = {};
-    info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
-    info.descriptorPool = app->descriptors.pool;
-    info.descriptorSetCount = ds->instances.count;
-    info.pSetLayouts = &app->descriptors.set_layouts.sampler;
-    vtk_validate_result(vkAllocateDescriptorSets(vk->device.logical, &info, ds->instances.data), "failed to allocate descriptor sets");
+static VkDescriptorImageInfo get_texture_descriptor(struct vtk_texture *texture) {
+    return { texture->sampler, texture->view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL };
 }
 
-static void create_descriptor_sets(struct app *app, struct vk_core *vk) {
-    // Pool
-    VkDescriptorPoolSize pool_sizes[] = {
-        { VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 16 },
-        { VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 16 },
-        // { VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT, 16 },
-        { VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 16 },
-    };
-    VkDescriptorPoolCreateInfo pool_info = {};
-    pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
-    pool_info.flags = 0;
-    pool_info.maxSets = 64;
-    pool_info.poolSizeCount = CTK_ARRAY_COUNT(pool_sizes);
-    pool_info.pPoolSizes = pool_sizes;
-    vtk_validate_result(vkCreateDescriptorPool(vk->device.logical, &pool_info, NULL, &app->descriptors.pool), "failed to create descriptor pool");
+static void allocate_frame_descriptor_set(struct app *app, struct vk_core *vk, struct vtk_descriptor_set *ds) {
+    allocate_descriptor_set(app, vk, ds, app->descriptors.set_layouts.frame, &app->descriptors.templates.frame, vk->swapchain.image_count);
+    ctk_push(&ds->dynamic_offsets, app->uniform_bufs.camera_ubo.element_size);
+    ctk_push(&ds->dynamic_offsets, app->uniform_bufs.light_ubos.element_size);
+}
+
+// Frame sets only differ by the instance entity indexes they point at, one region per swapchain image.
+static void write_frame_descriptor_set(struct app *app, struct vk_core *vk, struct vtk_descriptor_set *ds, struct vtk_region *instance_regions) {
+    for (u32 i = 0; i < ds->instances.count; ++i) {
+        struct frame_descriptors descriptors = {};
+        descriptors.camera_ubo = get_region_descriptor(app->uniform_bufs.camera_ubo.regions + i);
+        descriptors.light_ubo = get_region_descriptor(app->uniform_bufs.light_ubos.regions + i);
+        descriptors.light_ubos = get_region_descriptor(app->uniform_bufs.light_ubos.regions + i);
+        descriptors.light_model_ubos = get_region_descriptor(app->uniform_bufs.light_model_ubos.regions + i);
+        descriptors.entity_models = get_region_descriptor(app->entities.regions.models + i);
+        descriptors.entity_data = get_region_descriptor(app->entities.regions.data + i);
+        descriptors.instances = get_region_descriptor(instance_regions + i);
+        descriptors.directional_shadow_map = get_texture_descriptor(&app->shadow_maps.directional);
+        descriptors.omni_shadow_map = get_texture_descriptor(&app->shadow_maps.omni);
+        write_descriptor_set(vk, ds->instances[i], &app->descriptors.templates.frame, &descriptors);
+    }
+}
 
+static void create_descriptor_sets(struct app *app, struct vk_core *vk) {
     // Layouts
 
-    // model_ubo
+    // light_ubo
     {
-        VkDescriptorSetLayoutBinding binding = { 0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 1, VK_SHADER_STAGE_VERTEX_BIT };
-        VkDescriptorSetLayoutCreateInfo info = {};
-        info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
-        info.bindingCount = 1;
-        info.pBindings = &binding;
-        vtk_validate_result(vkCreateDescriptorSetLayout(vk->device.logical, &info, NULL, &app->descriptors.set_layouts.model_ubo), "error creating descriptor set layout");
+        struct descriptor_template_entry entry = { VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 0 };
+        VkShaderStageFlags stages = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
+        create_descriptor_set_layout(vk, &entry, &stages, 1, &app->descriptors.set_layouts.light_ubo,
+                                     &app->descriptors.templates.light_ubo);
     }
 
-    // light_ubo
+    // sampler
     {
-        VkDescriptorSetLayoutBinding binding = { 0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 1, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT };
-        VkDescriptorSetLayoutCreateInfo info = {};
-        info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
-        info.bindingCount = 1;
-        info.pBindings = &binding;
-        vtk_validate_result(vkCreateDescriptorSetLayout(vk->device.logical, &info, NULL, &app->descriptors.set_layouts.light_ubo), "error creating descriptor set layout");
+        struct descriptor_template_entry entry = { VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 0 };
+        VkShaderStageFlags stages = VK_SHADER_STAGE_FRAGMENT_BIT;
+        create_descriptor_set_layout(vk, &entry, &stages, 1, &app->descriptors.set_layouts.sampler,
+                                     &app->descriptors.templates.sampler);
     }
 
-    // sampler
+    // frame
     {
-        VkDescriptorSetLayoutBinding binding = { 0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_FRAGMENT_BIT };
-        VkDescriptorSetLayoutCreateInfo info = {};
-        info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
-        info.bindingCount = 1;
-        info.pBindings = &binding;
-        vtk_validate_result(vkCreateDescriptorSetLayout(vk->device.logical, &info, NULL, &app->descriptors.set_layouts.sampler), "error creating descriptor set layout");
+        struct descriptor_template_entry entries[] = {
+            { VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, offsetof(struct frame_descriptors, camera_ubo) },
+            { VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, offsetof(struct frame_descriptors, light_ubo) },
+            { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, offsetof(struct frame_descriptors, light_ubos) },
+            { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, offsetof(struct frame_descriptors, light_model_ubos) },
+            { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, offsetof(struct frame_descriptors, entity_models) },
+            { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, offsetof(struct frame_descriptors, entity_data) },
+            { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, offsetof(struct frame_descriptors, instances) },
+            { VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, offsetof(struct frame_descriptors, directional_shadow_map) },
+            { VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, offsetof(struct frame_descriptors, omni_shadow_map) },
+        };
+        VkShaderStageFlags stages[] = {
+            VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT,
+            VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT,
+            VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT,
+            VK_SHADER_STAGE_VERTEX_BIT,
+            VK_SHADER_STAGE_VERTEX_BIT,
+            VK_SHADER_STAGE_VERTEX_BIT,
+            VK_SHADER_STAGE_VERTEX_BIT,
+            VK_SHADER_STAGE_FRAGMENT_BIT,
+            VK_SHADER_STAGE_FRAGMENT_BIT,
+        };
+        CTK_ASSERT(CTK_ARRAY_COUNT(stages) == CTK_ARRAY_COUNT(entries))
+        create_descriptor_set_layout(vk, entries, stages, CTK_ARRAY_COUNT(entries), &app->descriptors.set_layouts.frame,
+                                     &app->descriptors.templates.frame);
     }
 
     // Sets
 
-    // entity_model_ubo
-    vtk_allocate_descriptor_set(&app->descriptors.sets.entity_model_ubo, app->descriptors.set_layouts.model_ubo, vk->swapchain.image_count, vk->device.logical, app->descriptors.pool);
-    ctk_push(&app->descriptors.sets.entity_model_ubo.dynamic_offsets, app->uniform_bufs.entity_model_ubos.element_size);
-
-    // light_model_ubo
-    vtk_allocate_descriptor_set(&app->descriptors.sets.light_model_ubo, app->descriptors.set_layouts.model_ubo, vk->swapchain.image_count, vk->device.logical, app->descriptors.pool);
-    ctk_push(&app->descriptors.sets.light_model_ubo.dynamic_offsets, app->uniform_bufs.light_model_ubos.element_size);
-
     // light_ubo
-    vtk_allocate_descriptor_set(&app->descriptors.sets.light_ubo, app->descriptors.set_layouts.light_ubo, vk->swapchain.image_count, vk->device.logical, app->descriptors.pool);
+    allocate_descriptor_set(app, vk, &app->descriptors.sets.light_ubo, app->descriptors.set_layouts.light_ubo,
+                            &app->descriptors.templates.light_ubo, vk->swapchain.image_count);
     ctk_push(&app->descriptors.sets.light_ubo.dynamic_offsets, app->uniform_bufs.light_ubos.element_size);
 
+    // frame
+    allocate_frame_descriptor_set(app, vk, &app->descriptors.sets.frame);
+
     // textures
     for (u32 i = 0; i < app->assets.textures.count; ++i) {
-        struct vtk_descriptor_set *ds = ctk_push(&app->descriptors.sets.textures, app->assets.textures.keys[i]);
-        ds->instances.count = 1;
-
-        VkDescriptorSetAllocateInfo info = {};
-        info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
-        info.descriptorPool = app->descriptors.pool;
-        info.descriptorSetCount = ds->instances.count;
-        info.pSetLayouts = &app->descriptors.set_layouts.sampler;
-        vtk_validate_result(vkAllocateDescriptorSets(vk->device.logical, &info, ds->instances.data), "failed to allocate descriptor sets");
+        allocate_descriptor_set(app, vk, ctk_push(&app->descriptors.sets.textures, app->assets.textures.keys[i]),
+                                app->descriptors.set_layouts.sampler, &app->descriptors.templates.sampler, 1);
     }
 
-    // shadow_maps
-    allocate_shadow_map_descriptor_set(app, vk, &app->descriptors.sets.shadow_maps.directional);
-    allocate_shadow_map_descriptor_set(app, vk, &app->descriptors.sets.shadow_maps.omni);
+    // Transient sets are allocated while recording; see allocate_transient_descriptor_set().
+    app->descriptors.transient_allocators.count = vk->swapchain.image_count;
 
     // Updates
-    struct ctk_array<VkDescriptorBufferInfo, 32> buf_infos = {};
-    struct ctk_array<VkDescriptorImageInfo, 32> img_infos = {};
-    struct ctk_array<VkWriteDescriptorSet, 32> writes = {};
-
-    // entity_model_ubo
-    for (u32 i = 0; i < app->uniform_bufs.entity_model_ubos.regions.count; ++i) {
-        struct vtk_region *region = app->uniform_bufs.entity_model_ubos.regions + i;
-        VkDescriptorBufferInfo *info = ctk_push(&buf_infos);
-        info->buffer = region->buffer->handle;
-        info->offset = region->offset;
-        info->range = region->size;
-
-        VkWriteDescriptorSet *write = ctk_push(&writes);
-        write->sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-        write->dstSet = app->descriptors.sets.entity_model_ubo.instances[i];
-        write->dstBinding = 0;
-        write->dstArrayElement = 0;
-        write->descriptorCount = 1;
-        write->descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
-        write->pBufferInfo = info;
-    }
-
-    // light_model_ubo
-    for (u32 i = 0; i < app->uniform_bufs.light_model_ubos.regions.count; ++i) {
-        struct vtk_region *region = app->uniform_bufs.light_model_ubos.regions + i;
-        VkDescriptorBufferInfo *info = ctk_push(&buf_infos);
-        info->buffer = region->buffer->handle;
-        info->offset = region->offset;
-        info->range = region->size;
-
-        VkWriteDescriptorSet *write = ctk_push(&writes);
-        write->sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-        write->dstSet = app->descriptors.sets.light_model_ubo.instances[i];
-        write->dstBinding = 0;
-        write->dstArrayElement = 0;
-        write->descriptorCount = 1;
-        write->descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
-        write->pBufferInfo = info;
-    }
-
-    // light_ubo
-    for (u32 i = 0; i < app->uniform_bufs.light_ubos.regions.count; ++i) {
-        struct vtk_region *region = app->uniform_bufs.light_ubos.regions + i;
-        VkDescriptorBufferInfo *info = ctk_push(&buf_infos);
-        info->buffer = region->buffer->handle;
-        info->offset = region->offset;
-        info->range = region->size;
-
-        VkWriteDescriptorSet *write = ctk_push(&writes);
-        write->sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-        write->dstSet = app->descriptors.sets.light_ubo.instances[i];
-        write->dstBinding = 0;
-        write->dstArrayElement = 0;
-        write->descriptorCount = 1;
-        write->descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
-        write->pBufferInfo = info;
+    for (u32 i = 0; i < app->descriptors.sets.light_ubo.instances.count; ++i) {
+        VkDescriptorBufferInfo light_ubo = get_region_descriptor(app->uniform_bufs.light_ubos.regions + i);
+        write_descriptor_set(vk, app->descriptors.sets.light_ubo.instances[i], &app->descriptors.templates.light_ubo,
+                             &light_ubo);
     }
-
-    // textures
     for (u32 i = 0; i < app->assets.textures.count; ++i) {
-        struct vtk_texture *t = app->assets.textures.values + i;
-
-        VkDescriptorImageInfo *info = ctk_push(&img_infos);
-        info->sampler = t->sampler;
-        info->imageView = t->view;
-        info->imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-
-        struct vtk_descriptor_set *ds = ctk_at(&app->descriptors.sets.textures, app->assets.textures.keys[i]);
-        VkWriteDescriptorSet *write = ctk_push(&writes);
-        write->sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-        write->dstSet = ds->instances[0];
-        write->dstBinding = 0;
-        write->dstArrayElement = 0;
-        write->descriptorCount = 1;
-        write->descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-        write->pImageInfo = info;
-    }
-
-    // shadow_maps
-
-    // directional
-    {
-        struct vtk_texture *shadow_map = &app->shadow_maps.directional;
-
-        VkDescriptorImageInfo *info = ctk_push(&img_infos);
-        info->sampler = shadow_map->sampler;
-        info->imageView = shadow_map->view;
-        info->imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-
-        struct vtk_descriptor_set *ds = &app->descriptors.sets.shadow_maps.directional;
-        VkWriteDescriptorSet *write = ctk_push(&writes);
-        write->sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-        write->dstSet = ds->instances[0];
-        write->dstBinding = 0;
-        write->dstArrayElement = 0;
-        write->descriptorCount = 1;
-        write->descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-        write->pImageInfo = info;
+        VkDescriptorImageInfo texture = get_texture_descriptor(app->assets.textures.values + i);
+        write_descriptor_set(vk, app->descriptors.sets.textures.values[i].instances[0], &app->descriptors.templates.sampler,
+                             &texture);
     }
-
-    // omni
-    {
-        struct vtk_texture *shadow_map = &app->shadow_maps.omni;
-
-        VkDescriptorImageInfo *info = ctk_push(&img_infos);
-        info->sampler = shadow_map->sampler;
-        info->imageView = shadow_map->view;
-        info->imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-
-        struct vtk_descriptor_set *ds = &app->descriptors.sets.shadow_maps.omni;
-        VkWriteDescriptorSet *write = ctk_push(&writes);
-        write->sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-        write->dstSet = ds->instances[0];
-        write->dstBinding = 0;
-        write->dstArrayElement = 0;
-        write->descriptorCount = 1;
-        write->descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-        write->pImageInfo = info;
-    }
-
-    vkUpdateDescriptorSets(vk->device.logical, writes.count, writes.data, 0, NULL);
+    write_frame_descriptor_set(app, vk, &app->descriptors.sets.frame, app->instances.regions.data);
 }
 
 static void create_render_passes(struct app *app, struct vk_core *vk) {
@@ -727,29 +1773,34 @@ static void create_render_passes(struct app *app, struct vk_core *vk) {
     }
 
     // Direct
-    {
+    // Split in two for Hi-Z culling: the early pass clears and draws what passed early culling, then the late pass loads its results and
+    // draws what late culling found. Both keep depth in a sampled layout afterwards so it can be reduced into the depth pyramid. Without
+    // Hi-Z culling, the single pass clears, draws everything and drops depth.
+    for (u32 phase = HIZ_PHASE_EARLY; phase <= HIZ_PHASE_NONE; ++phase) {
         struct vtk_render_pass_info rp_info = {};
+        bool late = phase == HIZ_PHASE_LATE;
+        bool single = phase == HIZ_PHASE_NONE;
 
         // Attachment Descriptions
         VkAttachmentDescription *depth_attachment = ctk_push(&rp_info.attachment_descriptions);
         depth_attachment->format = vk->device.depth_image_format;
         depth_attachment->samples = VK_SAMPLE_COUNT_1_BIT;
-        depth_attachment->loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-        depth_attachment->storeOp = VK_ATTACHMENT_STORE_OP_STORE;
-        depth_attachment->stencilLoadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+        depth_attachment->loadOp = late ? VK_ATTACHMENT_LOAD_OP_LOAD : VK_ATTACHMENT_LOAD_OP_CLEAR;
+        depth_attachment->storeOp = single ? VK_ATTACHMENT_STORE_OP_DONT_CARE : VK_ATTACHMENT_STORE_OP_STORE;
+        depth_attachment->stencilLoadOp = late ? VK_ATTACHMENT_LOAD_OP_DONT_CARE : VK_ATTACHMENT_LOAD_OP_CLEAR;
         depth_attachment->stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-        depth_attachment->initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-        depth_attachment->finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+        depth_attachment->initialLayout = late ? VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL : VK_IMAGE_LAYOUT_UNDEFINED;
+        depth_attachment->finalLayout = single ? VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL : VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
         ctk_push(&rp_info.clear_values, { 1.0f, 0 });
 
         VkAttachmentDescription *swapchain_attachment = ctk_push(&rp_info.attachment_descriptions);
         swapchain_attachment->format = vk->swapchain.image_format;
         swapchain_attachment->samples = VK_SAMPLE_COUNT_1_BIT;
-        swapchain_attachment->loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+        swapchain_attachment->loadOp = late ? VK_ATTACHMENT_LOAD_OP_LOAD : VK_ATTACHMENT_LOAD_OP_CLEAR;
         swapchain_attachment->storeOp = VK_ATTACHMENT_STORE_OP_STORE;
         swapchain_attachment->stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
         swapchain_attachment->stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-        swapchain_attachment->initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        swapchain_attachment->initialLayout = late ? VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL : VK_IMAGE_LAYOUT_UNDEFINED;
         swapchain_attachment->finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
         ctk_push(&rp_info.clear_values, { 0, 0, 0, 1 });
 
@@ -759,25 +1810,46 @@ static void create_render_passes(struct app *app, struct vk_core *vk) {
         ctk_push(&main->color_attachment_refs, { 1, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL });
 
         // Subpass Dependencies
-        rp_info.subpass_dependencies.count = 0;
-        // rp_info.subpass_dependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
-        // rp_info.subpass_dependencies[0].dstSubpass = 0;
-        // rp_info.subpass_dependencies[0].srcStageMask = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
-        // rp_info.subpass_dependencies[0].dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-        // rp_info.subpass_dependencies[0].srcAccessMask = VK_ACCESS_MEMORY_READ_BIT;
-        // rp_info.subpass_dependencies[0].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-        // rp_info.subpass_dependencies[0].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
+        rp_info.subpass_dependencies.count = single ? 1 : 2;
+
+        // Depth image is shared between frames and passes, so earlier depth writes and depth pyramid reductions reading it must finish
+        // before this pass writes it. The late pass also continues the early pass's color output.
+        rp_info.subpass_dependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
+        rp_info.subpass_dependencies[0].dstSubpass = 0;
+        rp_info.subpass_dependencies[0].srcStageMask = VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT |
+                                                       VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+        rp_info.subpass_dependencies[0].dstStageMask = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT |
+                                                       VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+        rp_info.subpass_dependencies[0].srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+        rp_info.subpass_dependencies[0].dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT |
+                                                        VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+        rp_info.subpass_dependencies[0].dependencyFlags = 0;
+
+        // Depth writes must land before the depth pyramid is reduced from them. The single pass doesn't keep depth.
+        rp_info.subpass_dependencies[1].srcSubpass = 0;
+        rp_info.subpass_dependencies[1].dstSubpass = VK_SUBPASS_EXTERNAL;
+        rp_info.subpass_dependencies[1].srcStageMask = VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+        rp_info.subpass_dependencies[1].dstStageMask = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+        rp_info.subpass_dependencies[1].srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+        rp_info.subpass_dependencies[1].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+        rp_info.subpass_dependencies[1].dependencyFlags = 0;
 
         // Framebuffer Infos
         for (u32 i = 0; i < vk->swapchain.image_count; ++i) {
             struct vtk_framebuffer_info *fb_info = ctk_push(&rp_info.framebuffer_infos);
-            ctk_push(&fb_info->attachments, app->attachment_imgs.depth.view);
+            VkImageView depth_view = single && app->attachment_imgs.transient_depth.handle != VK_NULL_HANDLE
+                                     ? app->attachment_imgs.transient_depth.view
+                                     : app->attachment_imgs.depth.view;
+            ctk_push(&fb_info->attachments, depth_view);
             ctk_push(&fb_info->attachments, vk->swapchain.image_views[i]);
             fb_info->extent = vk->swapchain.extent;
             fb_info->layers = 1;
         }
 
-        app->render_passes.direct = vtk_create_render_pass(vk->device.logical, vk->graphics_cmd_pool, &rp_info);
+        struct vtk_render_pass *rp = single ? &app->render_passes.direct_single
+                                   : late   ? &app->render_passes.direct_late
+                                            : &app->render_passes.direct;
+        *rp = vtk_create_render_pass(vk->device.logical, vk->graphics_cmd_pool, &rp_info);
     }
 
     // Fullscreen Texture
@@ -815,15 +1887,31 @@ static void create_render_passes(struct app *app, struct vk_core *vk) {
     }
 }
 
-static void create_graphics_pipelines(struct app *app, struct vk_core *vk) {
+// Pipelines drawing the scene share one pipeline layout, with sets ordered by how often they change: set 0 per frame (camera, lights,
+// entities, instances and shadow maps), set 1 per material (texture). Per-draw data is pushed as constants. With one layout, the frame set
+// stays bound across pipeline switches and only the texture set changes between draws. Shader reloads recreate the pipelines against it.
+static void create_scene_pipeline_layout(struct app *app, struct vk_core *vk) {
+    VkDescriptorSetLayout set_layouts[] = { app->descriptors.set_layouts.frame, app->descriptors.set_layouts.sampler };
+    VkPushConstantRange push_constant_range = { VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(u32) };
+    VkPipelineLayoutCreateInfo layout_info = {};
+    layout_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    layout_info.setLayoutCount = CTK_ARRAY_COUNT(set_layouts);
+    layout_info.pSetLayouts = set_layouts;
+    layout_info.pushConstantRangeCount = 1;
+    layout_info.pPushConstantRanges = &push_constant_range;
+    vtk_validate_result(vkCreatePipelineLayout(vk->device.logical, &layout_info, NULL, &app->pipeline_layouts.scene),
+                        "failed to create scene pipeline layout");
+}
+
+static void create_graphics_pipelines(struct app *app, struct vk_core *vk, struct pipeline_batch *batch) {
+    create_scene_pipeline_layout(app, vk);
+    VkPipelineLayout scene_layout = app->pipeline_layouts.scene;
+
     // Shadow
     {
         struct vtk_graphics_pipeline_info info = vtk_default_graphics_pipeline_info();
         ctk_push(&info.shaders, ctk_at(&app->assets.shaders, "shadow_vert"));
         ctk_push(&info.shaders, ctk_at(&app->assets.shaders, "shadow_frag"));
-        ctk_push(&info.descriptor_set_layouts, app->descriptors.set_layouts.light_ubo);
-        ctk_push(&info.descriptor_set_layouts, app->descriptors.set_layouts.model_ubo);
-        ctk_push(&info.push_constant_ranges, { VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(u32) });
         ctk_push(&info.vertex_inputs, { 0, 0, ctk_at(&app->vertex_layout.attributes, "position") });
         ctk_push(&info.vertex_input_binding_descriptions, { 0, app->vertex_layout.size, VK_VERTEX_INPUT_RATE_VERTEX });
         ctk_push(&info.viewports, { 0, 0, (f32)SHADOW_MAP_SIZE, (f32)SHADOW_MAP_SIZE, 0, 1 });
@@ -832,7 +1920,7 @@ static void create_graphics_pipelines(struct app *app, struct vk_core *vk) {
         info.depth_stencil_state.depthTestEnable = VK_TRUE;
         info.depth_stencil_state.depthWriteEnable = VK_TRUE;
         info.depth_stencil_state.depthCompareOp = VK_COMPARE_OP_LESS_OR_EQUAL;
-        app->graphics_pipelines.shadow = vtk_create_graphics_pipeline(vk->device.logical, &app->render_passes.shadow, 0, &info);
+        push_graphics_pipeline(batch, &app->render_passes.shadow, 0, &info, scene_layout, &app->graphics_pipelines.shadow);
     }
 
     // Direct
@@ -840,12 +1928,6 @@ static void create_graphics_pipelines(struct app *app, struct vk_core *vk) {
         struct vtk_graphics_pipeline_info info = vtk_default_graphics_pipeline_info();
         ctk_push(&info.shaders, ctk_at(&app->assets.shaders, "direct_vert"));
         ctk_push(&info.shaders, ctk_at(&app->assets.shaders, "direct_frag"));
-        ctk_push(&info.descriptor_set_layouts, app->descriptors.set_layouts.light_ubo);
-        ctk_push(&info.descriptor_set_layouts, app->descriptors.set_layouts.model_ubo);
-        ctk_push(&info.descriptor_set_layouts, app->descriptors.set_layouts.sampler);
-        ctk_push(&info.descriptor_set_layouts, app->descriptors.set_layouts.sampler);
-        ctk_push(&info.descriptor_set_layouts, app->descriptors.set_layouts.sampler);
-        ctk_push(&info.push_constant_ranges, { VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(struct ctk_v3<f32>) });
         ctk_push(&info.vertex_inputs, { 0, 0, ctk_at(&app->vertex_layout.attributes, "position") });
         ctk_push(&info.vertex_inputs, { 0, 1, ctk_at(&app->vertex_layout.attributes, "normal") });
         ctk_push(&info.vertex_inputs, { 0, 2, ctk_at(&app->vertex_layout.attributes, "uv") });
@@ -856,7 +1938,23 @@ static void create_graphics_pipelines(struct app *app, struct vk_core *vk) {
         info.depth_stencil_state.depthTestEnable = VK_TRUE;
         info.depth_stencil_state.depthWriteEnable = VK_TRUE;
         info.depth_stencil_state.depthCompareOp = VK_COMPARE_OP_LESS_OR_EQUAL;
-        app->graphics_pipelines.direct = vtk_create_graphics_pipeline(vk->device.logical, &app->render_passes.direct, 0, &info);
+        push_graphics_pipeline(batch, &app->render_passes.direct, 0, &info, scene_layout, &app->graphics_pipelines.direct);
+
+        // Transparent entities blend over the opaque ones by their texture's alpha, and are depth tested without writing depth.
+        info.color_blend_attachment_states.count = 0;
+        ctk_push(&info.color_blend_attachment_states,
+                 {
+                     VK_TRUE,
+                     VK_BLEND_FACTOR_SRC_ALPHA,
+                     VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA,
+                     VK_BLEND_OP_ADD,
+                     VK_BLEND_FACTOR_ONE,
+                     VK_BLEND_FACTOR_ZERO,
+                     VK_BLEND_OP_ADD,
+                     VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT,
+                 });
+        info.depth_stencil_state.depthWriteEnable = VK_FALSE;
+        push_graphics_pipeline(batch, &app->render_passes.direct, 0, &info, scene_layout, &app->graphics_pipelines.direct_transparent);
     }
 
     // Unlit
@@ -864,9 +1962,6 @@ static void create_graphics_pipelines(struct app *app, struct vk_core *vk) {
         struct vtk_graphics_pipeline_info info = vtk_default_graphics_pipeline_info();
         ctk_push(&info.shaders, ctk_at(&app->assets.shaders, "unlit_vert"));
         ctk_push(&info.shaders, ctk_at(&app->assets.shaders, "unlit_frag"));
-        ctk_push(&info.descriptor_set_layouts, app->descriptors.set_layouts.light_ubo);
-        ctk_push(&info.descriptor_set_layouts, app->descriptors.set_layouts.model_ubo);
-        ctk_push(&info.push_constant_ranges, { VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(struct ctk_v4<f32>) });
         ctk_push(&info.vertex_inputs, { 0, 0, ctk_at(&app->vertex_layout.attributes, "position") });
         ctk_push(&info.vertex_input_binding_descriptions, { 0, app->vertex_layout.size, VK_VERTEX_INPUT_RATE_VERTEX });
         ctk_push(&info.viewports, { 0, 0, (f32)vk->swapchain.extent.width, (f32)vk->swapchain.extent.height, 0, 1 });
@@ -875,7 +1970,7 @@ static void create_graphics_pipelines(struct app *app, struct vk_core *vk) {
         info.depth_stencil_state.depthTestEnable = VK_TRUE;
         info.depth_stencil_state.depthWriteEnable = VK_TRUE;
         info.depth_stencil_state.depthCompareOp = VK_COMPARE_OP_LESS_OR_EQUAL;
-        app->graphics_pipelines.unlit = vtk_create_graphics_pipeline(vk->device.logical, &app->render_passes.direct, 0, &info);
+        push_graphics_pipeline(batch, &app->render_passes.direct, 0, &info, scene_layout, &app->graphics_pipelines.unlit);
     }
 
     // Fullscreen Texture
@@ -891,7 +1986,8 @@ static void create_graphics_pipelines(struct app *app, struct vk_core *vk) {
         ctk_push(&info.viewports, { 1600 - 410, 10, 400, 400, 0, 1 });
         ctk_push(&info.scissors, { 1600 - 410, 10, 400, 400 });
         ctk_push(&info.color_blend_attachment_states, vtk_default_color_blend_attachment_state());
-        app->graphics_pipelines.fullscreen_texture = vtk_create_graphics_pipeline(vk->device.logical, &app->render_passes.fullscreen_texture, 0, &info);
+        push_graphics_pipeline(batch, &app->render_passes.fullscreen_texture, 0, &info, VK_NULL_HANDLE,
+                               &app->graphics_pipelines.fullscreen_texture);
     }
 }
 
@@ -1023,8 +2119,220 @@ static void create_shadow_maps(struct app *app, struct vk_core *vk) {
     }
 }
 
+static void create_hiz(struct app *app, struct vk_core *vk, struct pipeline_batch *batch) {
+    struct hiz *hiz = &app->hiz;
+
+    // Depth Pyramid
+    // Level 0 is the largest power of two that fits in the swapchain extent, so every level after it halves evenly.
+    hiz->extent = { 1, 1 };
+    while (hiz->extent.width * 2 <= vk->swapchain.extent.width)
+        hiz->extent.width *= 2;
+    while (hiz->extent.height * 2 <= vk->swapchain.extent.height)
+        hiz->extent.height *= 2;
+    u32 level_count = 1;
+    for (u32 size = hiz->extent.width > hiz->extent.height ? hiz->extent.width : hiz->extent.height; size > 1; size /= 2)
+        ++level_count;
+    CTK_ASSERT(level_count <= MAX_DEPTH_PYRAMID_LEVELS)
+
+    struct vtk_image_info info = vtk_default_image_info();
+    info.memory_property_flags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+    info.image.extent.width = hiz->extent.width;
+    info.image.extent.height = hiz->extent.height;
+    info.image.mipLevels = level_count;
+    info.image.format = VK_FORMAT_R32_SFLOAT;
+    info.image.tiling = VK_IMAGE_TILING_OPTIMAL;
+    info.image.usage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+    info.view.format = VK_FORMAT_R32_SFLOAT;
+    info.view.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    info.view.subresourceRange.levelCount = level_count;
+    hiz->depth_pyramid = vtk_create_image(&info, &vk->device);
+
+    // Each level is written through its own view, and read through it when reducing the next level.
+    hiz->level_views.count = level_count;
+    for (u32 i = 0; i < level_count; ++i) {
+        VkImageViewCreateInfo view_info = info.view;
+        view_info.image = hiz->depth_pyramid.handle;
+        view_info.subresourceRange.baseMipLevel = i;
+        view_info.subresourceRange.levelCount = 1;
+        vtk_validate_result(vkCreateImageView(vk->device.logical, &view_info, NULL, hiz->level_views + i), "failed to create depth pyramid level view");
+    }
+
+    // Shaders only use texelFetch(), but sampled images still need a sampler.
+    VkSamplerCreateInfo sampler_info = {};
+    sampler_info.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+    sampler_info.magFilter = VK_FILTER_NEAREST;
+    sampler_info.minFilter = VK_FILTER_NEAREST;
+    sampler_info.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+    sampler_info.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    sampler_info.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    sampler_info.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    sampler_info.maxLod = (f32)level_count;
+    vtk_validate_result(vkCreateSampler(vk->device.logical, &sampler_info, NULL, &hiz->sampler), "failed to create depth pyramid sampler");
+
+    // The pyramid stays in the general layout, since its levels are both written as storage images and read as sampled ones.
+    vtk_begin_one_time_command_buffer(app->cmd_bufs.one_time);
+        VkImageMemoryBarrier img_barrier = {};
+        img_barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        img_barrier.srcAccessMask = 0;
+        img_barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+        img_barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        img_barrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+        img_barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        img_barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        img_barrier.image = hiz->depth_pyramid.handle;
+        img_barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        img_barrier.subresourceRange.baseMipLevel = 0;
+        img_barrier.subresourceRange.levelCount = level_count;
+        img_barrier.subresourceRange.baseArrayLayer = 0;
+        img_barrier.subresourceRange.layerCount = 1;
+        vkCmdPipelineBarrier(app->cmd_bufs.one_time,
+                             VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+                             VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                             0, // Dependency Flags
+                             0, NULL, // Memory Barriers
+                             0, NULL, // Buffer Memory Barriers
+                             1, &img_barrier); // Image Memory Barriers
+    vtk_submit_one_time_command_buffer(app->cmd_bufs.one_time, vk->device.queues.graphics);
+
+    // Buffers
+    // Objects are written by the host every frame; draw commands are only touched by the GPU.
+    for (u32 i = 0; i < vk->swapchain.image_count; ++i) {
+        ctk_push(&hiz->regions.objects, vtk_allocate_region(&vk->buffers.host, MAX_HIZ_OBJECTS * sizeof(struct hiz_object), 256));
+        ctk_push(&hiz->regions.early_cmds, vtk_allocate_region(&vk->buffers.device, MAX_HIZ_OBJECTS * sizeof(VkDrawIndexedIndirectCommand), 256));
+        ctk_push(&hiz->regions.late_cmds, vtk_allocate_region(&vk->buffers.device, MAX_HIZ_OBJECTS * sizeof(VkDrawIndexedIndirectCommand), 256));
+        ctk_push(&hiz->regions.counts, vtk_allocate_region(&vk->buffers.host, 3 * sizeof(u32), 256));
+    }
+    hiz->objects_staging = (struct hiz_object *)malloc(MAX_HIZ_OBJECTS * sizeof(struct hiz_object));
+
+    // Descriptor Set Layouts
+    {
+        struct descriptor_template_entry entries[] = {
+            { VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, offsetof(struct hiz_reduce_descriptors, src) },
+            { VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, offsetof(struct hiz_reduce_descriptors, dst) },
+        };
+        VkShaderStageFlags stages[] = { VK_SHADER_STAGE_COMPUTE_BIT, VK_SHADER_STAGE_COMPUTE_BIT };
+        create_descriptor_set_layout(vk, entries, stages, CTK_ARRAY_COUNT(entries), &app->descriptors.set_layouts.hiz_reduce,
+                                     &app->descriptors.templates.hiz_reduce);
+    }
+    {
+        struct descriptor_template_entry entries[] = {
+            { VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, offsetof(struct hiz_cull_descriptors, depth_pyramid) },
+            { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, offsetof(struct hiz_cull_descriptors, objects) },
+            { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, offsetof(struct hiz_cull_descriptors, early_cmds) },
+            { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, offsetof(struct hiz_cull_descriptors, late_cmds) },
+            { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, offsetof(struct hiz_cull_descriptors, counts) },
+        };
+        VkShaderStageFlags stages[] = {
+            VK_SHADER_STAGE_COMPUTE_BIT, VK_SHADER_STAGE_COMPUTE_BIT, VK_SHADER_STAGE_COMPUTE_BIT, VK_SHADER_STAGE_COMPUTE_BIT,
+            VK_SHADER_STAGE_COMPUTE_BIT,
+        };
+        create_descriptor_set_layout(vk, entries, stages, CTK_ARRAY_COUNT(entries), &app->descriptors.set_layouts.hiz_cull,
+                                     &app->descriptors.templates.hiz_cull);
+    }
+
+    // Descriptor Sets
+    app->descriptors.sets.hiz_reduce.count = level_count;
+    allocate_descriptor_sets(&app->descriptors.allocator, vk->device.logical, app->descriptors.set_layouts.hiz_reduce,
+                             &app->descriptors.templates.hiz_reduce, level_count, app->descriptors.sets.hiz_reduce.data);
+    app->descriptors.sets.hiz_cull.count = vk->swapchain.image_count;
+    allocate_descriptor_sets(&app->descriptors.allocator, vk->device.logical, app->descriptors.set_layouts.hiz_cull,
+                             &app->descriptors.templates.hiz_cull, vk->swapchain.image_count, app->descriptors.sets.hiz_cull.data);
+
+    // Updates
+    // hiz_reduce: level 0 reduces the direct pass's depth image, every other level the one before it.
+    for (u32 i = 0; i < level_count; ++i) {
+        struct hiz_reduce_descriptors descriptors = {};
+        descriptors.src.sampler = hiz->sampler;
+        descriptors.src.imageView = i == 0 ? app->attachment_imgs.depth.view : hiz->level_views[i - 1];
+        descriptors.src.imageLayout = i == 0 ? VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL : VK_IMAGE_LAYOUT_GENERAL;
+        descriptors.dst.imageView = hiz->level_views[i];
+        descriptors.dst.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+        write_descriptor_set(vk, app->descriptors.sets.hiz_reduce[i], &app->descriptors.templates.hiz_reduce, &descriptors);
+    }
+
+    // hiz_cull
+    for (u32 i = 0; i < vk->swapchain.image_count; ++i) {
+        struct hiz_cull_descriptors descriptors = {};
+        descriptors.depth_pyramid = { hiz->sampler, hiz->depth_pyramid.view, VK_IMAGE_LAYOUT_GENERAL };
+        descriptors.objects = get_region_descriptor(hiz->regions.objects + i);
+        descriptors.early_cmds = get_region_descriptor(hiz->regions.early_cmds + i);
+        descriptors.late_cmds = get_region_descriptor(hiz->regions.late_cmds + i);
+        descriptors.counts = get_region_descriptor(hiz->regions.counts + i);
+        write_descriptor_set(vk, app->descriptors.sets.hiz_cull[i], &app->descriptors.templates.hiz_cull, &descriptors);
+    }
+
+    // Pipelines
+    push_compute_pipeline(batch, ctk_at(&app->assets.shaders, "hiz_reduce_comp"), app->descriptors.set_layouts.hiz_reduce, 0,
+                          &app->compute_pipelines.hiz_reduce);
+    push_compute_pipeline(batch, ctk_at(&app->assets.shaders, "hiz_cull_comp"), app->descriptors.set_layouts.hiz_cull,
+                          sizeof(struct hiz_push_constants), &app->compute_pipelines.hiz_cull);
+}
+
+static void create_gpu_cull(struct app *app, struct vk_core *vk, struct pipeline_batch *batch) {
+    struct gpu_cull *gc = &app->gpu_cull;
+
+    // Buffers
+    // Views, command templates and counts are host-visible; commands and instances are only touched by the GPU.
+    for (u32 i = 0; i < vk->swapchain.image_count; ++i) {
+        ctk_push(&gc->regions.views, vtk_allocate_region(&vk->buffers.host, VIEW_COUNT * sizeof(struct gpu_cull_view), 256));
+        ctk_push(&gc->regions.cmd_templates, vtk_allocate_region(&vk->buffers.host, VIEW_COUNT * MAX_DRAW_GROUPS * sizeof(VkDrawIndexedIndirectCommand), 256));
+        ctk_push(&gc->regions.cmds, vtk_allocate_region(&vk->buffers.device, VIEW_COUNT * MAX_DRAW_GROUPS * sizeof(VkDrawIndexedIndirectCommand), 256));
+        ctk_push(&gc->regions.instances, vtk_allocate_region(&vk->buffers.device, VIEW_COUNT * MAX_GPU_ENTITIES * sizeof(u32), 256));
+        ctk_push(&gc->regions.counts, vtk_allocate_region(&vk->buffers.host, VIEW_COUNT * sizeof(u32), 256));
+    }
+    gc->cmds_staging = (VkDrawIndexedIndirectCommand *)malloc(VIEW_COUNT * MAX_DRAW_GROUPS * sizeof(VkDrawIndexedIndirectCommand));
+
+    // Descriptor Set Layout
+    {
+        struct descriptor_template_entry entries[] = {
+            { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, offsetof(struct gpu_cull_descriptors, entities) },
+            { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, offsetof(struct gpu_cull_descriptors, views) },
+            { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, offsetof(struct gpu_cull_descriptors, cmds) },
+            { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, offsetof(struct gpu_cull_descriptors, instances) },
+            { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, offsetof(struct gpu_cull_descriptors, counts) },
+        };
+        VkShaderStageFlags stages[] = {
+            VK_SHADER_STAGE_COMPUTE_BIT, VK_SHADER_STAGE_COMPUTE_BIT, VK_SHADER_STAGE_COMPUTE_BIT, VK_SHADER_STAGE_COMPUTE_BIT,
+            VK_SHADER_STAGE_COMPUTE_BIT,
+        };
+        create_descriptor_set_layout(vk, entries, stages, CTK_ARRAY_COUNT(entries), &app->descriptors.set_layouts.gpu_cull,
+                                     &app->descriptors.templates.gpu_cull);
+    }
+
+    // Descriptor Sets
+    app->descriptors.sets.gpu_cull.count = vk->swapchain.image_count;
+    allocate_descriptor_sets(&app->descriptors.allocator, vk->device.logical, app->descriptors.set_layouts.gpu_cull,
+                             &app->descriptors.templates.gpu_cull, vk->swapchain.image_count, app->descriptors.sets.gpu_cull.data);
+
+    // The passes read culled instances through a frame set like the CPU-built ones.
+    allocate_frame_descriptor_set(app, vk, &app->descriptors.sets.gpu_frame);
+    write_frame_descriptor_set(app, vk, &app->descriptors.sets.gpu_frame, gc->regions.instances.data);
+
+    // Updates
+    for (u32 i = 0; i < vk->swapchain.image_count; ++i) {
+        struct gpu_cull_descriptors descriptors = {};
+        descriptors.entities = get_region_descriptor(app->entities.regions.data + i);
+        descriptors.views = get_region_descriptor(gc->regions.views + i);
+        descriptors.cmds = get_region_descriptor(gc->regions.cmds + i);
+        descriptors.instances = get_region_descriptor(gc->regions.instances + i);
+        descriptors.counts = get_region_descriptor(gc->regions.counts + i);
+        write_descriptor_set(vk, app->descriptors.sets.gpu_cull[i], &app->descriptors.templates.gpu_cull, &descriptors);
+    }
+
+    // Pipeline
+    push_compute_pipeline(batch, ctk_at(&app->assets.shaders, "gpu_cull_comp"), app->descriptors.set_layouts.gpu_cull, sizeof(u32),
+                          &app->compute_pipelines.gpu_cull);
+}
+
 static struct app *create_app(struct vk_core *vk) {
     auto app = ctk_zalloc<struct app>();
+    app->jobs = create_job_system();
+    app->culling.bvh = true;
+    app->culling.frustum = true;
+    app->culling.occlusion = vk->draw_indirect_first_instance;
+    app->culling.software_occlusion = true;
+    app->culling.tiny = false;
+    app->culling.min_screen_size = 0.005f;
 
     // Vertex Layout
     vtk_push_vertex_attribute(&app->vertex_layout, "position", 3);
@@ -1032,46 +2340,461 @@ static struct app *create_app(struct vk_core *vk) {
     vtk_push_vertex_attribute(&app->vertex_layout, "uv", 2);
 
     // Uniform Buffers
-    app->uniform_bufs.entity_model_ubos = vtk_create_uniform_buffer(&vk->buffers.host, &vk->device, MAX_ENTITIES, sizeof(struct model_ubo), vk->swapchain.image_count);
+    app->uniform_bufs.camera_ubo = vtk_create_uniform_buffer(&vk->buffers.host, &vk->device, 1, sizeof(struct camera_ubo), vk->swapchain.image_count);
     app->uniform_bufs.light_model_ubos = vtk_create_uniform_buffer(&vk->buffers.host, &vk->device, MAX_LIGHTS, sizeof(struct model_ubo), vk->swapchain.image_count);
     app->uniform_bufs.light_ubos = vtk_create_uniform_buffer(&vk->buffers.host, &vk->device, MAX_LIGHTS, sizeof(struct light_ubo), vk->swapchain.image_count);
 
+    // Entity & Instance Buffers
+    for (u32 i = 0; i < vk->swapchain.image_count; ++i) {
+        ctk_push(&app->entities.regions.models, vtk_allocate_region(&vk->buffers.host, MAX_GPU_ENTITIES * sizeof(struct model_ubo), 256));
+        ctk_push(&app->entities.regions.data, vtk_allocate_region(&vk->buffers.host, MAX_GPU_ENTITIES * sizeof(struct gpu_entity), 256));
+        ctk_push(&app->instances.regions, vtk_allocate_region(&vk->buffers.host, MAX_INSTANCES * sizeof(u32), 256));
+    }
+    app->entities.staging = (struct gpu_entity *)malloc(MAX_GPU_ENTITIES * sizeof(struct gpu_entity));
+    app->entities.chunk_group_sizes = (u32 *)malloc(MAX_GPU_ENTITIES / CHUNK_SIZE * MAX_DRAW_GROUPS * sizeof(u32));
+    app->instances.staging = (u32 *)malloc(MAX_INSTANCES * sizeof(u32));
+
     // Attachment Images
+    // A single depth image is shared by every swapchain image's framebuffer. It's sampled after the direct pass to build the Hi-Z depth
+    // pyramid, so unlike render-pass-local images it can't be transient.
     struct vtk_image_info depth_image_info = vtk_default_image_info();
     depth_image_info.memory_property_flags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
     depth_image_info.image.extent.width = vk->swapchain.extent.width;
     depth_image_info.image.extent.height = vk->swapchain.extent.height;
     depth_image_info.image.format = vk->device.depth_image_format;
     depth_image_info.image.tiling = VK_IMAGE_TILING_OPTIMAL;
-    depth_image_info.image.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+    depth_image_info.image.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
     depth_image_info.view.format = vk->device.depth_image_format;
     depth_image_info.view.subresourceRange.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
     app->attachment_imgs.depth = vtk_create_image(&depth_image_info, &vk->device);
 
+    // The single direct pass, used without Hi-Z culling, doesn't keep depth, so it gets its own transient depth image that tiled GPUs can
+    // keep on-chip. Its committed memory is compared with its requirements in the stats UI.
+    struct vtk_image_info transient_depth_info = depth_image_info;
+    transient_depth_info.image.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+    if (lazily_allocated_memory_supported(vk, &transient_depth_info)) {
+        transient_depth_info.image.usage |= VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT;
+        transient_depth_info.memory_property_flags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT;
+        app->attachment_imgs.transient_depth = vtk_create_image(&transient_depth_info, &vk->device);
+        VkMemoryRequirements mem_reqs = {};
+        vkGetImageMemoryRequirements(vk->device.logical, app->attachment_imgs.transient_depth.handle, &mem_reqs);
+        app->attachment_imgs.transient_depth_size = mem_reqs.size;
+    }
+
     // Command Buffers
     app->cmd_bufs.one_time = vtk_allocate_command_buffer(vk->device.logical, vk->graphics_cmd_pool, VK_COMMAND_BUFFER_LEVEL_PRIMARY);
     app->cmd_bufs.render.count = vk->swapchain.image_count;
     vtk_allocate_command_buffers(vk->device.logical, vk->graphics_cmd_pool, VK_COMMAND_BUFFER_LEVEL_PRIMARY, app->cmd_bufs.render.count, app->cmd_bufs.render.data);
+    u32 worker_pool_count = vk->swapchain.image_count * app->jobs->worker_count;
+    app->cmd_bufs.worker_pools = (struct worker_cmd_pool *)malloc(worker_pool_count * sizeof(struct worker_cmd_pool));
+    for (u32 i = 0; i < worker_pool_count; ++i) {
+        struct worker_cmd_pool *pool = app->cmd_bufs.worker_pools + i;
+        *pool = {};
+        VkCommandPoolCreateInfo cmd_pool_info = {};
+        cmd_pool_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+        cmd_pool_info.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+        cmd_pool_info.queueFamilyIndex = vk->device.queue_family_indexes.graphics;
+        vtk_validate_result(vkCreateCommandPool(vk->device.logical, &cmd_pool_info, NULL, &pool->handle), "failed to create worker command pool");
+    }
+    app->cmd_bufs.record_caches.count = vk->swapchain.image_count;
 
     create_shadow_maps(app, vk);
     load_assets(app, vk);
     create_descriptor_sets(app, vk);
+    app->draw_lists.meshes = app->assets.meshes.values;
+    app->draw_lists.textures = app->descriptors.sets.textures.values;
     create_render_passes(app, vk);
-    create_graphics_pipelines(app, vk);
+
+    // Pipelines
+    // Everything the first frame draws with is waited on. GPU-driven culling starts disabled, so its pipeline finishes in the background.
+    app->pipeline_batches.first_frame = ctk_zalloc<struct pipeline_batch>();
+    app->pipeline_batches.first_frame->vk = vk;
+    app->pipeline_batches.deferred = ctk_zalloc<struct pipeline_batch>();
+    app->pipeline_batches.deferred->vk = vk;
+    create_graphics_pipelines(app, vk, app->pipeline_batches.first_frame);
+    create_hiz(app, vk, app->pipeline_batches.first_frame);
+    create_gpu_cull(app, vk, app->pipeline_batches.deferred);
+    begin_pipeline_batch(app->jobs, app->pipeline_batches.first_frame);
+    begin_pipeline_batch(app->jobs, app->pipeline_batches.deferred);
+    wait_for_pipeline_batch(app->jobs, app->pipeline_batches.first_frame);
     init_frame_sync(app, vk);
 
     return app;
 }
 
+////////////////////////////////////////////////////////////
+/// Shader Reload
+////////////////////////////////////////////////////////////
+// A watcher thread sleeps on change notifications for the directories holding the GLSL source of the shaders in SHADER_LOAD_INFOS, and
+// recompiles the sources whose write time changed with glslc. Each frame,
+// update_shader_reload() loads rebuilt SPIR-V and recreates the pipelines using it as a batch on the job system. Once the whole batch is
+// done, the new pipelines are swapped in before the frame is recorded. Replaced pipelines are destroyed once the fence of every frame that
+// could still be using them has signaled, so a reload never waits for the device to go idle.
+static u32 const MAX_SHADER_DIRS = 8;
+static u32 const MAX_RETIRED_PIPELINES = 64;
+
+struct retired_pipeline {
+    VkPipeline handle;
+    VkPipelineLayout layout; // VK_NULL_HANDLE for pipelines created with a shared layout, which outlives them.
+    u32 pending_fences; // Bit per frame_sync.in_flight fence that was unsignaled when it was replaced, cleared once it signals.
+};
+
+struct shader_reload {
+    HANDLE thread;
+    HANDLE quit_event;
+    struct ctk_array<HANDLE, MAX_SHADER_DIRS> dir_changes; // Change notification per shader source directory. Watcher only.
+    LONG volatile compiled[SHADER_COUNT]; // Set by the watcher once a shader's SPIR-V is rebuilt, cleared once it's reloaded.
+    FILETIME write_times[SHADER_COUNT]; // Watcher only.
+    u32 reload_count;
+
+    // Rebuilt pipelines, waiting for batch to finish. Entry i replaces the pipeline created from live[i].
+    struct pipeline_batch *batch;
+    struct pipeline_desc *live[MAX_PIPELINE_DESCS];
+    struct vtk_graphics_pipeline graphics[MAX_PIPELINE_DESCS];
+    struct compute_pipeline compute[MAX_PIPELINE_DESCS];
+    struct ctk_array<VkShaderModule, SHADER_COUNT> retired_shaders; // Destroyed once batch is done with them.
+
+    struct ctk_array<struct retired_pipeline, MAX_RETIRED_PIPELINES> retired_pipelines;
+};
+
+static void get_shader_source_path(char *source_path, cstr spv_path) {
+    u32 size = (u32)strlen(spv_path) - 4; // Minus ".spv".
+    CTK_ASSERT(size < MAX_PATH)
+    memcpy(source_path, spv_path, size);
+    source_path[size] = '\0';
+}
+
+static bool get_write_time(cstr path, FILETIME *write_time) {
+    WIN32_FILE_ATTRIBUTE_DATA attributes = {};
+    if (!GetFileAttributesExA(path, GetFileExInfoStandard, &attributes))
+        return false;
+    *write_time = attributes.ftLastWriteTime;
+    return true;
+}
+
+// Finds the SDK's glslc, preferring the 64-bit build, and falls back to the one on PATH.
+static void get_glslc_path(char *glslc_path) {
+    char sdk_path[MAX_PATH] = {};
+    cstr const SDK_BIN_DIRS[] = { "Bin", "Bin32" };
+    u32 sdk_path_size = GetEnvironmentVariableA("VULKAN_SDK", sdk_path, MAX_PATH);
+    if (sdk_path_size > 0 && sdk_path_size < MAX_PATH - 32) {
+        for (u32 i = 0; i < CTK_ARRAY_COUNT(SDK_BIN_DIRS); ++i) {
+            sprintf(glslc_path, "%s\\%s\\glslc.exe", sdk_path, SDK_BIN_DIRS[i]);
+            if (GetFileAttributesA(glslc_path) != INVALID_FILE_ATTRIBUTES)
+                return;
+        }
+    }
+    strcpy(glslc_path, "glslc.exe");
+}
+
+// glslc runs as a child process rather than linking shaderc, which the build doesn't ship; a compile only happens when a source is
+// saved, so the process start-up isn't worth a dependency. glslc reports errors on the console and leaves the old SPIR-V in place.
+static bool compile_shader(cstr source_path, cstr spv_path) {
+    char glslc_path[MAX_PATH] = {};
+    get_glslc_path(glslc_path);
+    char cmd[3 * MAX_PATH + 16] = {};
+    sprintf(cmd, "\"%s\" \"%s\" -o \"%s\"", glslc_path, source_path, spv_path);
+
+    STARTUPINFOA startup_info = {};
+    startup_info.cb = sizeof(startup_info);
+    PROCESS_INFORMATION process = {};
+    if (!CreateProcessA(NULL, cmd, NULL, NULL, FALSE, 0, NULL, NULL, &startup_info, &process))
+        return false;
+    WaitForSingleObject(process.hProcess, INFINITE);
+    DWORD exit_code = 1;
+    GetExitCodeProcess(process.hProcess, &exit_code);
+    CloseHandle(process.hThread);
+    CloseHandle(process.hProcess);
+    return exit_code == 0;
+}
+
+// Shaders whose last rebuild hasn't been reloaded yet are skipped, so their SPIR-V isn't rewritten while it's being read. They're picked
+// up on the next change in their directory.
+static void compile_changed_shaders(struct shader_reload *reload) {
+    for (u32 i = 0; i < SHADER_COUNT; ++i) {
+        if (reload->compiled[i])
+            continue;
+        char source_path[MAX_PATH] = {};
+        get_shader_source_path(source_path, SHADER_LOAD_INFOS[i].path);
+        FILETIME write_time = {};
+        if (!get_write_time(source_path, &write_time) || CompareFileTime(&write_time, reload->write_times + i) == 0)
+            continue;
+        reload->write_times[i] = write_time;
+        if (compile_shader(source_path, SHADER_LOAD_INFOS[i].path))
+            InterlockedExchange(reload->compiled + i, 1);
+    }
+}
+
+// Sleeps until quit_event is set or a file in a shader source directory is written or renamed (editors often save through a rename).
+static DWORD WINAPI shader_watcher_main(void *param) {
+    auto reload = (struct shader_reload *)param;
+    HANDLE handles[1 + MAX_SHADER_DIRS] = { reload->quit_event };
+    for (u32 i = 0; i < reload->dir_changes.count; ++i)
+        handles[1 + i] = reload->dir_changes[i];
+    for (;;) {
+        DWORD signaled = WaitForMultipleObjects(1 + reload->dir_changes.count, handles, FALSE, INFINITE);
+        if (signaled == WAIT_OBJECT_0 || signaled >= WAIT_OBJECT_0 + 1 + reload->dir_changes.count)
+            break; // Quit, or the wait failed.
+        compile_changed_shaders(reload);
+        FindNextChangeNotification(handles[signaled - WAIT_OBJECT_0]);
+    }
+    return 0;
+}
+
+static struct shader_reload *create_shader_reload() {
+    auto reload = ctk_zalloc<struct shader_reload>();
+    char dirs[MAX_SHADER_DIRS][MAX_PATH] = {};
+    u32 dir_count = 0;
+    for (u32 i = 0; i < SHADER_COUNT; ++i) {
+        char source_path[MAX_PATH] = {};
+        get_shader_source_path(source_path, SHADER_LOAD_INFOS[i].path);
+        get_write_time(source_path, reload->write_times + i);
+
+        // Source paths are relative with '/' separators, and every shader is in a directory.
+        cstr name = strrchr(source_path, '/');
+        CTK_ASSERT(name != NULL)
+        source_path[name - source_path] = '\0';
+        bool listed = false;
+        for (u32 d = 0; d < dir_count && !listed; ++d)
+            listed = strcmp(dirs[d], source_path) == 0;
+        if (listed)
+            continue;
+        CTK_ASSERT(dir_count < MAX_SHADER_DIRS)
+        strcpy(dirs[dir_count++], source_path);
+    }
+
+    // Without notifications (e.g. on a network drive) reload is just off; the test runs the same either way.
+    for (u32 d = 0; d < dir_count; ++d) {
+        HANDLE dir_change = FindFirstChangeNotificationA(dirs[d], FALSE, FILE_NOTIFY_CHANGE_LAST_WRITE | FILE_NOTIFY_CHANGE_FILE_NAME);
+        if (dir_change == INVALID_HANDLE_VALUE)
+            fprintf(stderr, "can't watch \"%s\" for shader changes\n", dirs[d]);
+        else
+            ctk_push(&reload->dir_changes, dir_change);
+    }
+    reload->quit_event = CreateEventA(NULL, TRUE, FALSE, NULL);
+    if (reload->quit_event == NULL)
+        CTK_FATAL("failed to create shader watcher quit event")
+    reload->thread = CreateThread(NULL, 0, shader_watcher_main, reload, 0, NULL);
+    if (reload->thread == NULL)
+        CTK_FATAL("failed to create shader watcher thread")
+    return reload;
+}
+
+static void stop_shader_reload(struct app *app) {
+    struct shader_reload *reload = app->shader_reload;
+    SetEvent(reload->quit_event);
+    WaitForSingleObject(reload->thread, INFINITE);
+    CloseHandle(reload->thread);
+    CloseHandle(reload->quit_event);
+    for (u32 i = 0; i < reload->dir_changes.count; ++i)
+        FindCloseChangeNotification(reload->dir_changes[i]);
+    if (reload->batch != NULL)
+        wait_for_pipeline_batch(app->jobs, reload->batch);
+}
+
+static bool pipeline_uses_shader(struct pipeline_desc *desc, struct vtk_shader *shader) {
+    if (desc->bind_point == VK_PIPELINE_BIND_POINT_COMPUTE)
+        return desc->shader == shader;
+    for (u32 i = 0; i < desc->graphics_info.shaders.count; ++i)
+        if (desc->graphics_info.shaders[i] == shader)
+            return true;
+    return false;
+}
+
+static void swap_reloaded_pipelines(struct shader_reload *reload, struct vk_core *vk, u32 pending_fences) {
+    for (u32 i = 0; i < reload->batch->descs.count; ++i) {
+        struct pipeline_desc *live = reload->live[i];
+        struct retired_pipeline *retired = ctk_push(&reload->retired_pipelines);
+        retired->pending_fences = pending_fences;
+        if (live->bind_point == VK_PIPELINE_BIND_POINT_GRAPHICS) {
+            retired->handle = live->graphics->handle;
+            retired->layout = live->shared_layout == VK_NULL_HANDLE ? live->graphics->layout : VK_NULL_HANDLE;
+            *live->graphics = reload->graphics[i];
+        } else {
+            retired->handle = live->compute->handle;
+            retired->layout = live->compute->layout;
+            *live->compute = reload->compute[i];
+        }
+    }
+    for (u32 i = 0; i < reload->retired_shaders.count; ++i)
+        vkDestroyShaderModule(vk->device.logical, reload->retired_shaders[i], NULL);
+    reload->retired_shaders.count = 0;
+    free(reload->batch);
+    reload->batch = NULL;
+    ++reload->reload_count;
+}
+
+// Called once per frame, after sync_frame() and before anything is recorded.
+static void update_shader_reload(struct app *app, struct vk_core *vk) {
+    struct shader_reload *reload = app->shader_reload;
+
+    // Swapchain images can be acquired in any order, so frames aren't assumed to finish in submission order: each in-flight fence is polled
+    // directly. Frames submitted before a swap can only be on fences that were unsignaled at the time; a fence that's reset before it's seen
+    // signaled is just waited on through its next frame as well.
+    u32 pending_fences = 0;
+    for (u32 i = 0; i < app->frame_sync.frame_count; ++i)
+        if (vkGetFenceStatus(vk->device.logical, app->frame_sync.in_flight[i]) != VK_SUCCESS)
+            pending_fences |= 1u << i;
+    u32 kept = 0;
+    for (u32 i = 0; i < reload->retired_pipelines.count; ++i) {
+        struct retired_pipeline *retired = reload->retired_pipelines + i;
+        retired->pending_fences &= pending_fences;
+        if (retired->pending_fences == 0) {
+            vkDestroyPipeline(vk->device.logical, retired->handle, NULL);
+            vkDestroyPipelineLayout(vk->device.logical, retired->layout, NULL);
+        } else {
+            reload->retired_pipelines[kept++] = *retired;
+        }
+    }
+    reload->retired_pipelines.count = kept;
+
+    if (reload->batch != NULL) {
+        if (finish_pipeline_batch(reload->batch))
+            swap_reloaded_pipelines(reload, vk, pending_fences);
+        return;
+    }
+
+    // The deferred batch may still be creating pipelines from the shader modules a reload replaces.
+    if (!finish_pipeline_batch(app->pipeline_batches.deferred))
+        return;
+    struct ctk_array<struct vtk_shader *, SHADER_COUNT> shaders = {};
+    for (u32 i = 0; i < SHADER_COUNT; ++i) {
+        if (!reload->compiled[i])
+            continue;
+        struct shader_load_info const *shader_load_info = SHADER_LOAD_INFOS + i;
+        struct vtk_shader *shader = ctk_at(&app->assets.shaders, shader_load_info->name);
+        ctk_push(&reload->retired_shaders, shader->handle);
+        *shader = vtk_create_shader(vk->device.logical, shader_load_info->path, shader_load_info->stage);
+        ctk_push(&shaders, shader);
+        InterlockedExchange(reload->compiled + i, 0);
+    }
+    if (shaders.count == 0)
+        return;
+
+    auto batch = ctk_zalloc<struct pipeline_batch>();
+    batch->vk = vk;
+    struct pipeline_batch *live_batches[] = { app->pipeline_batches.first_frame, app->pipeline_batches.deferred };
+    for (u32 b = 0; b < CTK_ARRAY_COUNT(live_batches); ++b) {
+        for (u32 i = 0; i < live_batches[b]->descs.count; ++i) {
+            struct pipeline_desc *desc = live_batches[b]->descs + i;
+            bool uses_reloaded_shader = false;
+            for (u32 s = 0; s < shaders.count && !uses_reloaded_shader; ++s)
+                uses_reloaded_shader = pipeline_uses_shader(desc, shaders[s]);
+            if (!uses_reloaded_shader)
+                continue;
+            u32 idx = batch->descs.count;
+            reload->live[idx] = desc;
+            if (desc->bind_point == VK_PIPELINE_BIND_POINT_GRAPHICS)
+                push_graphics_pipeline(batch, desc->rp, desc->subpass, &desc->graphics_info, desc->shared_layout, reload->graphics + idx);
+            else
+                push_compute_pipeline(batch, desc->shader, desc->set_layout, desc->push_constant_size, reload->compute + idx);
+        }
+    }
+    CTK_ASSERT(reload->retired_pipelines.count + batch->descs.count <= MAX_RETIRED_PIPELINES)
+    reload->batch = batch;
+    begin_pipeline_batch(app->jobs, batch);
+}
+
+////////////////////////////////////////////////////////////
+/// SIMD
+////////////////////////////////////////////////////////////
+// Lane width is picked at compile time: 8 lanes when building with /arch:AVX2, otherwise 4 SSE2 lanes.
+#if defined(__AVX2__)
+static u32 const SIMD_WIDTH = 8;
+typedef __m256 simd_f32;
+static inline simd_f32 simd_load(f32 const *src)               { return _mm256_loadu_ps(src); }
+static inline void     simd_store(f32 *dst, simd_f32 a)        { _mm256_storeu_ps(dst, a); }
+static inline simd_f32 simd_set(f32 val)                       { return _mm256_set1_ps(val); }
+static inline simd_f32 simd_add(simd_f32 a, simd_f32 b)        { return _mm256_add_ps(a, b); }
+static inline simd_f32 simd_sub(simd_f32 a, simd_f32 b)        { return _mm256_sub_ps(a, b); }
+static inline simd_f32 simd_mul(simd_f32 a, simd_f32 b)        { return _mm256_mul_ps(a, b); }
+static inline simd_f32 simd_div(simd_f32 a, simd_f32 b)        { return _mm256_div_ps(a, b); }
+static inline simd_f32 simd_min(simd_f32 a, simd_f32 b)        { return _mm256_min_ps(a, b); }
+static inline simd_f32 simd_max(simd_f32 a, simd_f32 b)        { return _mm256_max_ps(a, b); }
+static inline simd_f32 simd_and(simd_f32 a, simd_f32 b)        { return _mm256_and_ps(a, b); }
+static inline simd_f32 simd_andnot(simd_f32 a, simd_f32 b)     { return _mm256_andnot_ps(a, b); }
+static inline simd_f32 simd_or(simd_f32 a, simd_f32 b)         { return _mm256_or_ps(a, b); }
+static inline simd_f32 simd_xor(simd_f32 a, simd_f32 b)        { return _mm256_xor_ps(a, b); }
+static inline simd_f32 simd_cmplt(simd_f32 a, simd_f32 b)      { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+static inline simd_f32 simd_cmpeq(simd_f32 a, simd_f32 b)      { return _mm256_cmp_ps(a, b, _CMP_EQ_OQ); }
+static inline u32      simd_movemask(simd_f32 a)               { return (u32)_mm256_movemask_ps(a); }
+static inline __m128   simd_quad(simd_f32 a, u32 quad)         { return quad == 0 ? _mm256_castps256_ps128(a) : _mm256_extractf128_ps(a, 1); }
+#else
+static u32 const SIMD_WIDTH = 4;
+typedef __m128 simd_f32;
+static inline simd_f32 simd_load(f32 const *src)               { return _mm_loadu_ps(src); }
+static inline void     simd_store(f32 *dst, simd_f32 a)        { _mm_storeu_ps(dst, a); }
+static inline simd_f32 simd_set(f32 val)                       { return _mm_set1_ps(val); }
+static inline simd_f32 simd_add(simd_f32 a, simd_f32 b)        { return _mm_add_ps(a, b); }
+static inline simd_f32 simd_sub(simd_f32 a, simd_f32 b)        { return _mm_sub_ps(a, b); }
+static inline simd_f32 simd_mul(simd_f32 a, simd_f32 b)        { return _mm_mul_ps(a, b); }
+static inline simd_f32 simd_div(simd_f32 a, simd_f32 b)        { return _mm_div_ps(a, b); }
+static inline simd_f32 simd_min(simd_f32 a, simd_f32 b)        { return _mm_min_ps(a, b); }
+static inline simd_f32 simd_max(simd_f32 a, simd_f32 b)        { return _mm_max_ps(a, b); }
+static inline simd_f32 simd_and(simd_f32 a, simd_f32 b)        { return _mm_and_ps(a, b); }
+static inline simd_f32 simd_andnot(simd_f32 a, simd_f32 b)     { return _mm_andnot_ps(a, b); }
+static inline simd_f32 simd_or(simd_f32 a, simd_f32 b)         { return _mm_or_ps(a, b); }
+static inline simd_f32 simd_xor(simd_f32 a, simd_f32 b)        { return _mm_xor_ps(a, b); }
+static inline simd_f32 simd_cmplt(simd_f32 a, simd_f32 b)      { return _mm_cmplt_ps(a, b); }
+static inline simd_f32 simd_cmpeq(simd_f32 a, simd_f32 b)      { return _mm_cmpeq_ps(a, b); }
+static inline u32      simd_movemask(simd_f32 a)               { return (u32)_mm_movemask_ps(a); }
+static inline __m128   simd_quad(simd_f32 a, u32 quad)         { return a; }
+#endif
+
+static inline simd_f32 simd_madd(simd_f32 a, simd_f32 b, simd_f32 c) {
+    return simd_add(simd_mul(a, b), c);
+}
+
+// Transposes SIMD_WIDTH column-major matrices held as 16 element vectors (elems[col * 4 + row]) into consecutive matrices stride bytes
+// apart, so results land directly in UBO-layout arrays.
+static void simd_store_mtxs(simd_f32 const *elems, glm::mat4 *dst, u32 stride) {
+    for (u32 quad = 0; quad < SIMD_WIDTH / 4; ++quad) {
+        for (u32 col = 0; col < 4; ++col) {
+            __m128 r0 = simd_quad(elems[col * 4 + 0], quad);
+            __m128 r1 = simd_quad(elems[col * 4 + 1], quad);
+            __m128 r2 = simd_quad(elems[col * 4 + 2], quad);
+            __m128 r3 = simd_quad(elems[col * 4 + 3], quad);
+            _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+            __m128 lanes[] = { r0, r1, r2, r3 };
+            for (u32 lane = 0; lane < 4; ++lane) {
+                auto mtx = (glm::mat4 *)((u8 *)dst + (quad * 4 + lane) * stride);
+                _mm_storeu_ps(&(*mtx)[col][0], lanes[lane]);
+            }
+        }
+    }
+}
+
 ////////////////////////////////////////////////////////////
 /// Scene
 ////////////////////////////////////////////////////////////
 struct transform {
     struct ctk_v3<f32> position;
-    struct ctk_v3<f32> rotation;
+    glm::quat rotation;
     struct ctk_v3<f32> scale;
 };
 
+static u32 const NO_PARENT = CTK_U32_MAX;
+
+// Transforms stored as structure-of-arrays (one array per component) so model matrices can be composed SIMD_WIDTH at a time. Each
+// rotation's matrix is cached when the transform is set, so composing needs no trig. Composed world matrices are kept alongside, ready
+// to upload.
+struct transform_chunk {
+    f32 position[3][CHUNK_SIZE];
+    f32 rotation[4][CHUNK_SIZE]; // x, y, z, w
+    f32 rotation_mtx[9][CHUNK_SIZE]; // Column-major.
+    f32 scale[3][CHUNK_SIZE];
+    u32 parent[CHUNK_SIZE]; // Always less than the child's index, so parents are composed before their children.
+    u32 child_count[CHUNK_SIZE];
+    u8 dirty[CHUNK_SIZE]; // Bit per swapchain image whose copy of the transform's model UBO is stale.
+    struct model_ubo model_ubos[CHUNK_SIZE];
+};
+
+struct transform_store {
+    struct chunk_list<struct transform_chunk> chunks;
+    u8 all_dirty;
+    u32 count;
+};
+
 struct camera {
     struct transform transform;
     f32 fov;
@@ -1080,187 +2803,720 @@ struct camera {
     f32 z_far;
 };
 
-struct entity {
+struct material {
     cstr name;
-    struct transform *transform;
-    struct mesh *mesh;
-    struct vtk_descriptor_set *texture_desc_set;
+    struct material_ubo *ubo;
 };
 
-struct light {
-    struct transform *transform;
-    struct model_ubo *model_ubo;
-    struct light_ubo *ubo;
-    u32 attenuation_index;
+// Entities are grouped into archetypes by the components they carry. An archetype stores its components in chunks parallel to its
+// transform chunks, so an entity's components all live at the same index, and iterating an archetype is a linear walk over packed
+// columns.
+enum {
+    ARCHETYPE_RENDERABLE,
+    ARCHETYPE_LIGHT,
 };
 
-struct material {
-    cstr name;
-    struct material_ubo *ubo;
+// Which render queues a renderable goes in; see get_render_queue().
+enum {
+    RENDER_FLAG_VISIBLE         = 1 << 0,
+    RENDER_FLAG_CASTS_SHADOW    = 1 << 1,
+    RENDER_FLAG_RECEIVES_SHADOW = 1 << 2,
+    RENDER_FLAG_TRANSPARENT     = 1 << 3,
+};
+
+static u8 const DEFAULT_RENDER_FLAGS = RENDER_FLAG_VISIBLE | RENDER_FLAG_CASTS_SHADOW | RENDER_FLAG_RECEIVES_SHADOW;
+
+static u32 const NO_RECORD = CTK_U32_MAX;
+
+struct renderable_components {
+    cstr name[CHUNK_SIZE];
+    struct mesh *mesh[CHUNK_SIZE];
+    struct vtk_descriptor_set *texture_desc_set[CHUNK_SIZE];
+    struct material *material[CHUNK_SIZE];
+    u32 record[CHUNK_SIZE];
+    u8 occluder[CHUNK_SIZE]; // Rasterised into each view's software occlusion buffer.
+    u8 render_flags[CHUNK_SIZE];
+
+    // World-space AABB and bounding sphere (around the AABB center), recomputed from the mesh bounds each frame before culling.
+    f32 bounds_center[3][CHUNK_SIZE];
+    f32 bounds_extent[3][CHUNK_SIZE];
+    f32 bounds_radius[CHUNK_SIZE];
+    u8 bounds_moved[CHUNK_SIZE]; // Set when the last bounds update changed the entity's bounds, so the BVH knows what to refit.
+};
+
+struct light_components {
+    struct light_ubo ubo[CHUNK_SIZE];
+    u32 attenuation_index[CHUNK_SIZE];
+    u32 record[CHUNK_SIZE];
+};
+
+template<typename component_chunk>
+struct archetype {
+    struct transform_store transforms;
+    struct chunk_list<component_chunk> components;
+    u32 first_hole; // Lowest index despawned in place (see despawn()), or CTK_U32_MAX when packed.
+    u32 version; // Bumped whenever entities are spawned, despawned or moved, so anything caching entity indexes knows to rebuild.
+};
+
+// Handles stay valid while their entity moves around its archetype; the generation invalidates handles to despawned entities whose
+// record has been reused.
+struct entity_handle {
+    u32 record;
+    u32 generation;
+};
+
+struct entity_record {
+    u32 generation;
+    u32 archetype;
+    u32 idx; // Index in archetype, or next free record.
+};
+
+static u32 const BVH_NO_NODE = CTK_U32_MAX;
+
+struct bvh_node {
+    f32 min[3];
+    f32 max[3];
+    u32 parent;
+    u32 left; // The right child always directly follows the left one. 0 for leaves, since the root is never a child.
+    u32 first; // Range of the node's whole subtree in bvh.entities.
+    u32 count;
+};
+
+// Bounding volume hierarchy over the renderables' world bounds. It's built top-down with binned SAH, then refit in place as entities
+// move. Spawning/despawning (which changes entity indexes) triggers a rebuild, as do refits that degrade the tree's cost past
+// BVH_REBUILD_FACTOR.
+struct bvh {
+    struct bvh_node *nodes;
+    u32 node_count;
+    u32 *entities; // Renderable indexes ordered so every subtree's entities are contiguous. Renderables without a mesh are left out.
+    u32 entity_count;
+    u32 *leaf_of; // Leaf node per renderable index, or BVH_NO_NODE.
+    u8 *stale; // Per node, refit scratch.
+    u32 *stale_nodes;
+    u32 capacity; // Renderables the arrays can hold; nodes hold twice as many.
+    u32 version; // Renderables' version the tree was built against.
+    f32 cost; // Sum of node surface areas.
+    f32 build_cost;
+    u32 rebuild_count;
 };
 
 struct scene {
     struct camera camera;
-    struct ctk_array<struct entity, MAX_ENTITIES> entities;
-    struct ctk_array<struct light, MAX_LIGHTS> lights;
+    struct archetype<struct renderable_components> renderables;
+    struct archetype<struct light_components> lights;
     struct ctk_array<struct material, MAX_MATERIALS> materials;
     struct {
-        struct ctk_array<struct transform, MAX_ENTITIES> transforms;
-        struct ctk_array<struct model_ubo, MAX_ENTITIES> model_ubos;
-    } entity;
-    struct {
-        struct ctk_array<struct transform, MAX_LIGHTS> transforms;
-        struct ctk_array<struct model_ubo, MAX_LIGHTS> model_ubos;
-        struct ctk_array<struct light_ubo, MAX_LIGHTS> ubos;
-    } light;
+        struct entity_record *data;
+        u32 count;
+        u32 capacity;
+        u32 free_head;
+    } records;
     struct {
         struct ctk_array<struct material_ubo, MAX_MATERIALS> ubos;
     } material;
+    struct bvh bvh;
+    char *strings; // Entity and material names loaded from a snapshot.
 };
 
-static struct transform DEFAULT_TRANSFORM = { {}, {}, { 1, 1, 1 } };
+static glm::quat const IDENTITY_ROTATION = { 1, 0, 0, 0 };
+static struct transform DEFAULT_TRANSFORM = { {}, IDENTITY_ROTATION, { 1, 1, 1 } };
+static struct entity_handle const NULL_ENTITY = { NO_RECORD, 0 };
 
-static struct entity *push_entity(struct scene *s, cstr name = NULL) {
-    if (s->entities.count == MAX_ENTITIES)
-        CTK_FATAL("cannot push more entities to scene (max: %u)", MAX_ENTITIES)
-    ctk_push(&s->entity.model_ubos);
-    struct entity *e = ctk_push(&s->entities);
-    e->transform = ctk_push(&s->entity.transforms, DEFAULT_TRANSFORM);
-    return e;
+// Euler angles (degrees) are only used for authoring and editing; rotation order is rotate_x * rotate_y * rotate_z.
+static glm::quat quat_from_euler(struct ctk_v3<f32> degrees) {
+    return glm::angleAxis(glm::radians(degrees.x), glm::vec3(1, 0, 0)) *
+           glm::angleAxis(glm::radians(degrees.y), glm::vec3(0, 1, 0)) *
+           glm::angleAxis(glm::radians(degrees.z), glm::vec3(0, 0, 1));
 }
 
-static struct light *push_light(struct scene *s) {
-    if (s->lights.count == MAX_LIGHTS)
-        CTK_FATAL("cannot push more lights to scene (max: %u)", MAX_LIGHTS)
-    struct light *l = ctk_push(&s->lights);
-    l->transform = ctk_push(&s->light.transforms, DEFAULT_TRANSFORM);
-    l->model_ubo = ctk_push(&s->light.model_ubos);
-    l->ubo = ctk_push(&s->light.ubos);
-    l->ubo->mode = LIGHT_MODE_POINT;
-    l->ubo->color = { 1, 1, 1, 1 };
-    l->ubo->normal_bias = 16;
-    l->ubo->ambient = 0.3f;
-    l->attenuation_index = 3;
-    return l;
+static struct ctk_v3<f32> quat_to_euler(glm::quat q) {
+    glm::mat3 r = glm::mat3_cast(q);
+    struct ctk_v3<f32> degrees = {};
+    degrees.x = glm::degrees(atan2f(-r[2][1], r[2][2]));
+    degrees.y = glm::degrees(asinf(ctk_clamp(r[2][0], -1.0f, 1.0f)));
+    degrees.z = glm::degrees(atan2f(-r[1][0], r[0][0]));
+    return degrees;
 }
 
-static struct material *push_material(struct scene *s, cstr name = NULL) {
-    if (s->materials.count == MAX_MATERIALS)
-        CTK_FATAL("cannot push more lights to scene (max: %u)", MAX_LIGHTS)
-    struct material *m = ctk_push(&s->materials);
-    m->name = name;
-    m->ubo = ctk_push(&s->material.ubos);
-    m->ubo->shine_exponent = 2;
-    return m;
+template<typename chunk>
+static chunk *chunk_at(struct chunk_list<chunk> *list, u32 idx) {
+    return list->data[idx / CHUNK_SIZE];
 }
 
-static struct scene *create_scene(struct app *app, struct vk_core *vk) {
-    auto scene = ctk_zalloc<struct scene>();
+static struct transform_store create_transform_store(u32 swapchain_img_count) {
+    CTK_ASSERT(swapchain_img_count <= 8)
+    struct transform_store store = {};
+    store.all_dirty = (u8)((1u << swapchain_img_count) - 1);
+    return store;
+}
 
-    scene->camera.transform = DEFAULT_TRANSFORM;
-    scene->camera.transform.position = { 10, -5, 14};
-    scene->camera.transform.rotation = { 45, 0, 0 };
-    scene->camera.fov = 90.0f;
-    scene->camera.aspect = vk->swapchain.extent.width / (f32)vk->swapchain.extent.height;
-    scene->camera.z_near = 0.1f;
-    scene->camera.z_far = 100.0f;
+static void destroy_transform_store(struct transform_store *store) {
+    destroy_chunk_list(&store->chunks);
+    *store = {};
+}
 
-    struct entity *cubes[] = {
-        push_entity(scene),
-        push_entity(scene),
-    };
-    cubes[0]->transform->position = { 10.0f, -3.0f, 15.0f };
-    cubes[0]->mesh = ctk_at(&app->assets.meshes, "cube");
-    cubes[0]->texture_desc_set = ctk_at(&app->descriptors.sets.textures, "wood");
-
-    cubes[1]->transform->position = { 4.0f, 0.0f, 2.0f };
-    cubes[1]->mesh = ctk_at(&app->assets.meshes, "cube");
-    cubes[1]->texture_desc_set = ctk_at(&app->descriptors.sets.textures, "wood");
-
-    struct entity *floor = push_entity(scene);
-    floor->transform->rotation = { -90.0f, 0.0f, 0.0f };
-    floor->transform->scale = { 32, 32, 1 };
-    floor->mesh = ctk_at(&app->assets.meshes, "quad");
-    floor->texture_desc_set = ctk_at(&app->descriptors.sets.textures, "wood");
-
-    struct entity *sibenik = push_entity(scene);
-    sibenik->transform->position = { 15.0f, -18.0f, 15.0f };
-    sibenik->mesh = ctk_at(&app->assets.meshes, "sibenik");
-    sibenik->texture_desc_set = ctk_at(&app->descriptors.sets.textures, "brick");
-
-    struct light *light = push_light(scene);
-    light->transform->position = { 8, -4, 15.5f };
-    light->transform->rotation = { 0.0f, -90.0f, 0.0f };
-    light->transform->scale = { 0.1f, 0.1f, 0.1f };
-    light->ubo->depth_bias = 1;
-    light->attenuation_index = 8;
+// Number of transforms in use in chunk_idx.
+static u32 chunk_transform_count(struct transform_store *store, u32 chunk_idx) {
+    u32 first = chunk_idx * CHUNK_SIZE;
+    if (store->count <= first)
+        return 0;
+    return store->count - first < CHUNK_SIZE ? store->count - first : CHUNK_SIZE;
+}
 
-    struct material *mat = push_material(scene, "test");
-    mat->ubo->shine_exponent = 2;
+static u32 get_parent(struct transform_store *store, u32 idx) {
+    return chunk_at(&store->chunks, idx)->parent[idx % CHUNK_SIZE];
+}
 
-    return scene;
+static struct model_ubo *get_model_ubo(struct transform_store *store, u32 idx) {
+    return chunk_at(&store->chunks, idx)->model_ubos + idx % CHUNK_SIZE;
 }
 
-static glm::mat4 camera_view_space_mtx(struct camera *cam) {
-    struct transform *cam_trans = &cam->transform;
+static struct transform get_transform(struct transform_store *store, u32 idx) {
+    CTK_ASSERT(idx < store->count)
+    struct transform_chunk *c = chunk_at(&store->chunks, idx);
+    u32 i = idx % CHUNK_SIZE;
+    struct transform t = {};
+    t.position = { c->position[0][i], c->position[1][i], c->position[2][i] };
+    t.rotation = glm::quat(c->rotation[3][i], c->rotation[0][i], c->rotation[1][i], c->rotation[2][i]);
+    t.scale    = { c->scale[0][i],    c->scale[1][i],    c->scale[2][i]    };
+    return t;
+}
 
-    // View Matrix
-    glm::vec3 cam_pos = { cam_trans->position.x, cam_trans->position.y, cam_trans->position.z };
-    glm::mat4 cam_mtx(1.0f);
-    cam_mtx = glm::rotate(cam_mtx, glm::radians(cam_trans->rotation.x), { 1.0f, 0.0f, 0.0f });
-    cam_mtx = glm::rotate(cam_mtx, glm::radians(cam_trans->rotation.y), { 0.0f, 1.0f, 0.0f });
-    cam_mtx = glm::rotate(cam_mtx, glm::radians(cam_trans->rotation.z), { 0.0f, 0.0f, 1.0f });
-    glm::vec3 cam_forward = { cam_mtx[0][2], cam_mtx[1][2], cam_mtx[2][2] };
-    glm::mat4 view_mtx = glm::lookAt(cam_pos, cam_pos + cam_forward, { 0.0f, -1.0f, 0.0f });
+static void set_transform(struct transform_store *store, u32 idx, struct transform *t) {
+    CTK_ASSERT(idx < store->count)
+    struct transform_chunk *c = chunk_at(&store->chunks, idx);
+    u32 i = idx % CHUNK_SIZE;
+    c->position[0][i] = t->position.x; c->position[1][i] = t->position.y; c->position[2][i] = t->position.z;
+    c->scale[0][i]    = t->scale.x;    c->scale[1][i]    = t->scale.y;    c->scale[2][i]    = t->scale.z;
+
+    glm::quat rot = glm::normalize(t->rotation);
+    c->rotation[0][i] = rot.x; c->rotation[1][i] = rot.y; c->rotation[2][i] = rot.z; c->rotation[3][i] = rot.w;
+    glm::mat3 rot_mtx = glm::mat3_cast(rot);
+    for (u32 col = 0; col < 3; ++col)
+        for (u32 row = 0; row < 3; ++row)
+            c->rotation_mtx[col * 3 + row][i] = rot_mtx[col][row];
+
+    c->dirty[i] = store->all_dirty;
+}
 
-    // Projection Matrix
-    glm::mat4 proj_mtx = glm::perspective(glm::radians(cam->fov), cam->aspect, cam->z_near, cam->z_far);
-    proj_mtx[1][1] *= -1; // Flip y value for scale (glm is designed for OpenGL).
+static u32 push_transform(struct transform_store *store, struct transform *t, u32 parent = NO_PARENT) {
+    if (parent != NO_PARENT && parent >= store->count)
+        CTK_FATAL("parent transform %u must be pushed before its children", parent)
+    if (store->count == store->chunks.count * CHUNK_SIZE)
+        push_chunk(&store->chunks);
+    u32 idx = store->count++;
+    struct transform_chunk *c = chunk_at(&store->chunks, idx);
+    c->parent[idx % CHUNK_SIZE] = parent;
+    c->child_count[idx % CHUNK_SIZE] = 0;
+    if (parent != NO_PARENT)
+        ++chunk_at(&store->chunks, parent)->child_count[parent % CHUNK_SIZE];
+    set_transform(store, idx, t);
+    return idx;
+}
 
-    return proj_mtx * view_mtx;
+// Moves every column of transform src to dst (including hierarchy links, which the caller fixes up). The moved model UBO must be
+// uploaded to its new slot.
+static void move_transform(struct transform_store *store, u32 dst, u32 src) {
+    struct transform_chunk *d = chunk_at(&store->chunks, dst);
+    struct transform_chunk *s = chunk_at(&store->chunks, src);
+    u32 di = dst % CHUNK_SIZE;
+    u32 si = src % CHUNK_SIZE;
+    for (u32 i = 0; i < 3; ++i) d->position[i][di] = s->position[i][si];
+    for (u32 i = 0; i < 4; ++i) d->rotation[i][di] = s->rotation[i][si];
+    for (u32 i = 0; i < 9; ++i) d->rotation_mtx[i][di] = s->rotation_mtx[i][si];
+    for (u32 i = 0; i < 3; ++i) d->scale[i][di] = s->scale[i][si];
+    d->parent[di] = s->parent[si];
+    d->child_count[di] = s->child_count[si];
+    d->model_ubos[di] = s->model_ubos[si];
+    d->dirty[di] = store->all_dirty;
 }
 
-static void update_lights(struct app *app, struct vk_core *vk, struct scene *scene, glm::mat4 *view_space_mtx, u32 swapchain_img_idx) {
-    if (scene->lights.count == 0)
-        return;
+// Model matrix is translate * rotate * scale, built from the cached rotation matrix. The normal matrix, transpose(inverse(rotate * scale)),
+// is then just rotate * inverse(scale).
+static void compose_model_mtx(struct transform_chunk *chunk, u32 idx) {
+    f32 (*r)[CHUNK_SIZE] = chunk->rotation_mtx;
+    f32 scale_x = chunk->scale[0][idx];
+    f32 scale_y = chunk->scale[1][idx];
+    f32 scale_z = chunk->scale[2][idx];
+
+    glm::vec4 rot_x = { r[0][idx], r[1][idx], r[2][idx], 0.0f };
+    glm::vec4 rot_y = { r[3][idx], r[4][idx], r[5][idx], 0.0f };
+    glm::vec4 rot_z = { r[6][idx], r[7][idx], r[8][idx], 0.0f };
+
+    glm::mat4 *m = &chunk->model_ubos[idx].model_mtx;
+    (*m)[0] = rot_x * scale_x;
+    (*m)[1] = rot_y * scale_y;
+    (*m)[2] = rot_z * scale_z;
+    (*m)[3] = glm::vec4(chunk->position[0][idx], chunk->position[1][idx], chunk->position[2][idx], 1.0f);
+
+    // Uniform scale needs a single reciprocal.
+    f32 inv_scale_x = 1.0f / scale_x;
+    f32 inv_scale_y = inv_scale_x;
+    f32 inv_scale_z = inv_scale_x;
+    if (scale_x != scale_y || scale_y != scale_z) {
+        inv_scale_y = 1.0f / scale_y;
+        inv_scale_z = 1.0f / scale_z;
+    }
+    glm::mat4 *n = &chunk->model_ubos[idx].normal_mtx;
+    (*n)[0] = rot_x * inv_scale_x;
+    (*n)[1] = rot_y * inv_scale_y;
+    (*n)[2] = rot_z * inv_scale_z;
+    (*n)[3] = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+}
 
-    for (u32 i = 0; i < scene->lights.count; ++i) {
-        struct light *light = scene->lights + i;
-        struct transform *trans = scene->light.transforms + i;
-        struct model_ubo *model_ubo = scene->light.model_ubos + i;
-        struct light_ubo *ubo = scene->light.ubos + i;
+// Composes model and normal matrices for chunk slots [first, first + count), SIMD_WIDTH transforms per iteration; the remainder goes
+// through the scalar path.
+static void compose_model_mtxs(struct transform_chunk *chunk, u32 first, u32 count) {
+    CTK_ASSERT(first + count <= CHUNK_SIZE)
+    simd_f32 zero = simd_set(0.0f);
+    simd_f32 one = simd_set(1.0f);
+
+    u32 end = first + count;
+    u32 i = first;
+    for (; i + SIMD_WIDTH <= end; i += SIMD_WIDTH) {
+        simd_f32 scale[] = {
+            simd_load(chunk->scale[0] + i),
+            simd_load(chunk->scale[1] + i),
+            simd_load(chunk->scale[2] + i),
+        };
+        simd_f32 r[9];
+        for (u32 e = 0; e < 9; ++e)
+            r[e] = simd_load(chunk->rotation_mtx[e] + i);
+
+        // Inverse Scale (one reciprocal when every lane is uniformly scaled)
+        simd_f32 inv_scale[3];
+        inv_scale[0] = simd_div(one, scale[0]);
+        if (simd_movemask(simd_and(simd_cmpeq(scale[0], scale[1]), simd_cmpeq(scale[1], scale[2]))) == (1u << SIMD_WIDTH) - 1) {
+            inv_scale[1] = inv_scale[0];
+            inv_scale[2] = inv_scale[0];
+        } else {
+            inv_scale[1] = simd_div(one, scale[1]);
+            inv_scale[2] = simd_div(one, scale[2]);
+        }
 
-        struct ctk_v2<f32> const *atten_consts = LIGHT_ATTENUATION_CONSTS + light->attenuation_index;
-        ubo->linear = atten_consts->x;
-        ubo->quadratic = atten_consts->y;
-        glm::vec3 light_pos = { trans->position.x, trans->position.y, trans->position.z };
+        // Model and Normal Matrices
+        simd_f32 m[16];
+        simd_f32 n[16];
+        for (u32 col = 0; col < 3; ++col) {
+            for (u32 row = 0; row < 3; ++row) {
+                m[col * 4 + row] = simd_mul(r[col * 3 + row], scale[col]);
+                n[col * 4 + row] = simd_mul(r[col * 3 + row], inv_scale[col]);
+            }
+            m[col * 4 + 3] = zero;
+            n[col * 4 + 3] = zero;
+        }
+        m[12] = simd_load(chunk->position[0] + i);
+        m[13] = simd_load(chunk->position[1] + i);
+        m[14] = simd_load(chunk->position[2] + i);
+        m[15] = one;
+        n[12] = zero;
+        n[13] = zero;
+        n[14] = zero;
+        n[15] = one;
+
+        simd_store_mtxs(m, &chunk->model_ubos[i].model_mtx, sizeof(struct model_ubo));
+        simd_store_mtxs(n, &chunk->model_ubos[i].normal_mtx, sizeof(struct model_ubo));
+    }
+    for (; i < end; ++i)
+        compose_model_mtx(chunk, i);
+}
 
-        ////////////////////////////////////////////////////////////
-        /// Light Model UBO
-        ////////////////////////////////////////////////////////////
+static void compose_dirty_chunks(void *data, u32 first, u32 count) {
+    auto store = (struct transform_store *)data;
+    for (u32 c = first; c < first + count; ++c) {
+        struct transform_chunk *chunk = store->chunks.data[c];
+        u32 transform_count = chunk_transform_count(store, c);
+        for (u32 i = 0; i < transform_count;) {
+            if (chunk->dirty[i] != store->all_dirty) {
+                ++i;
+                continue;
+            }
+            u32 start = i;
+            while (i < transform_count && chunk->dirty[i] == store->all_dirty)
+                ++i;
+            compose_model_mtxs(chunk, start, i - start);
+        }
+    }
+}
+
+// Recomposes the world matrices of transforms that changed since they were last composed, along with every transform below them in
+// the hierarchy. Parents always precede their children, so each step is a single linear pass over the store. Local matrices have no
+// dependencies and are composed a chunk per job; the hierarchy passes stay on the calling thread.
+static void update_world_mtxs(struct transform_store *store, struct job_system *jobs = NULL) {
+    u8 all_dirty = store->all_dirty;
+
+    // A transform with every bit still set has not been composed since it changed; a recomposed parent dirties its children.
+    for (u32 c = 0; c < store->chunks.count; ++c) {
+        struct transform_chunk *chunk = store->chunks.data[c];
+        u32 count = chunk_transform_count(store, c);
+        for (u32 i = 0; i < count; ++i) {
+            u32 parent = chunk->parent[i];
+            if (parent != NO_PARENT && chunk_at(&store->chunks, parent)->dirty[parent % CHUNK_SIZE] == all_dirty)
+                chunk->dirty[i] = all_dirty;
+        }
+    }
+
+    // Local matrices.
+    u32 used_chunk_count = (store->count + CHUNK_SIZE - 1) / CHUNK_SIZE;
+    parallel_for(jobs, used_chunk_count, 1, compose_dirty_chunks, store);
+
+    // World matrices. The inverse-transpose of a product is the product of inverse-transposes, so normal matrices chain the same way.
+    for (u32 c = 0; c < store->chunks.count; ++c) {
+        struct transform_chunk *chunk = store->chunks.data[c];
+        u32 count = chunk_transform_count(store, c);
+        for (u32 i = 0; i < count; ++i) {
+            u32 parent = chunk->parent[i];
+            if (parent == NO_PARENT || chunk->dirty[i] != all_dirty)
+                continue;
+            struct model_ubo *parent_ubo = get_model_ubo(store, parent);
+            chunk->model_ubos[i].model_mtx = parent_ubo->model_mtx * chunk->model_ubos[i].model_mtx;
+            chunk->model_ubos[i].normal_mtx = parent_ubo->normal_mtx * chunk->model_ubos[i].normal_mtx;
+        }
+    }
+}
+
+// Uploads every model UBO in chunk_idx still stale for this swapchain image in contiguous runs, to the slots of region matching their
+// indexes in the store. Returns the number of model UBOs uploaded.
+static u32 upload_model_ubos(struct transform_store *store, u32 chunk_idx, struct vtk_region *region, struct vk_core *vk,
+                             u32 swapchain_img_idx) {
+    struct transform_chunk *chunk = store->chunks.data[chunk_idx];
+    u32 count = chunk_transform_count(store, chunk_idx);
+    u8 img_bit = (u8)(1u << swapchain_img_idx);
+    u32 upload_count = 0;
+    for (u32 i = 0; i < count;) {
+        if ((chunk->dirty[i] & img_bit) == 0) {
+            ++i;
+            continue;
+        }
+        u32 start = i;
+        for (; i < count && (chunk->dirty[i] & img_bit); ++i)
+            chunk->dirty[i] &= ~img_bit;
+        vtk_write_to_host_region(vk->device.logical, chunk->model_ubos + start, (i - start) * sizeof(struct model_ubo), region,
+                                 (chunk_idx * CHUNK_SIZE + start) * sizeof(struct model_ubo));
+        upload_count += i - start;
+    }
+    return upload_count;
+}
+
+static void clear_dirty(struct transform_store *store) {
+    for (u32 c = 0; c < store->chunks.count; ++c)
+        memset(store->chunks.data[c]->dirty, 0, CHUNK_SIZE);
+}
+
+static void move_components(struct renderable_components *dst, u32 dst_idx, struct renderable_components *src, u32 src_idx) {
+    dst->name[dst_idx] = src->name[src_idx];
+    dst->mesh[dst_idx] = src->mesh[src_idx];
+    dst->texture_desc_set[dst_idx] = src->texture_desc_set[src_idx];
+    dst->material[dst_idx] = src->material[src_idx];
+    dst->record[dst_idx] = src->record[src_idx];
+    dst->occluder[dst_idx] = src->occluder[src_idx];
+    dst->render_flags[dst_idx] = src->render_flags[src_idx];
+}
+
+static void move_components(struct light_components *dst, u32 dst_idx, struct light_components *src, u32 src_idx) {
+    dst->ubo[dst_idx] = src->ubo[src_idx];
+    dst->attenuation_index[dst_idx] = src->attenuation_index[src_idx];
+    dst->record[dst_idx] = src->record[src_idx];
+}
+
+template<typename component_chunk>
+static void init_archetype(struct archetype<component_chunk> *arch, u32 swapchain_img_count) {
+    arch->transforms = create_transform_store(swapchain_img_count);
+    arch->first_hole = CTK_U32_MAX;
+}
+
+template<typename component_chunk>
+static void destroy_archetype(struct archetype<component_chunk> *arch) {
+    destroy_transform_store(&arch->transforms);
+    destroy_chunk_list(&arch->components);
+}
+
+template<typename component_chunk>
+static u32 get_record_idx(struct archetype<component_chunk> *arch, u32 idx) {
+    return chunk_at(&arch->components, idx)->record[idx % CHUNK_SIZE];
+}
+
+static struct entity_handle alloc_record(struct scene *s, u32 archetype, u32 idx) {
+    u32 record = s->records.free_head;
+    if (record == NO_RECORD) {
+        if (s->records.count == s->records.capacity) {
+            s->records.capacity = s->records.capacity == 0 ? 64 : s->records.capacity * 2;
+            s->records.data = (struct entity_record *)realloc(s->records.data, s->records.capacity * sizeof(struct entity_record));
+        }
+        record = s->records.count++;
+        s->records.data[record].generation = 1;
+    } else {
+        s->records.free_head = s->records.data[record].idx;
+    }
+    s->records.data[record].archetype = archetype;
+    s->records.data[record].idx = idx;
+    return { record, s->records.data[record].generation };
+}
+
+static void free_record(struct scene *s, u32 record) {
+    struct entity_record *r = s->records.data + record;
+    ++r->generation;
+    r->idx = s->records.free_head;
+    s->records.free_head = record;
+}
+
+// Returns NULL for handles to despawned entities.
+static struct entity_record *get_record(struct scene *s, struct entity_handle handle) {
+    if (handle.record >= s->records.count || s->records.data[handle.record].generation != handle.generation)
+        return NULL;
+    return s->records.data + handle.record;
+}
+
+static u32 get_entity_idx(struct scene *s, struct entity_handle handle, u32 archetype) {
+    struct entity_record *record = get_record(s, handle);
+    if (record == NULL || record->archetype != archetype)
+        CTK_FATAL("invalid entity handle (record: %u, generation: %u)", handle.record, handle.generation)
+    return record->idx;
+}
+
+template<typename component_chunk>
+static struct entity_handle spawn(struct scene *s, struct archetype<component_chunk> *arch, u32 archetype, struct transform *trans, u32 parent,
+                                  u32 *idx) {
+    *idx = push_transform(&arch->transforms, trans, parent);
+    if (arch->components.count < arch->transforms.chunks.count)
+        push_chunk(&arch->components);
+    struct entity_handle handle = alloc_record(s, archetype, *idx);
+    chunk_at(&arch->components, *idx)->record[*idx % CHUNK_SIZE] = handle.record;
+    ++arch->version;
+    return handle;
+}
+
+// Despawned entities are swapped with the archetype's last entity in O(1). That would put a child ahead of its parent when the last
+// entity's parent comes after the hole, and leaves no way to reach a despawned entity's children, so those cases (and any despawn
+// while holes are pending) leave a hole that compact() closes instead.
+template<typename component_chunk>
+static void despawn(struct scene *s, struct archetype<component_chunk> *arch, u32 idx) {
+    struct transform_store *store = &arch->transforms;
+    struct transform_chunk *chunk = chunk_at(&store->chunks, idx);
+    u32 last = store->count - 1;
+    u32 parent = chunk->parent[idx % CHUNK_SIZE];
+    u32 last_parent = get_parent(store, last);
+    free_record(s, get_record_idx(arch, idx));
+    ++arch->version;
+    if (arch->first_hole != CTK_U32_MAX || chunk->child_count[idx % CHUNK_SIZE] > 0 || (last_parent != NO_PARENT && last_parent > idx)) {
+        chunk_at(&arch->components, idx)->record[idx % CHUNK_SIZE] = NO_RECORD;
+        if (idx < arch->first_hole)
+            arch->first_hole = idx;
+        return;
+    }
+
+    if (parent != NO_PARENT)
+        --chunk_at(&store->chunks, parent)->child_count[parent % CHUNK_SIZE];
+    if (idx != last) {
+        move_transform(store, idx, last);
+        move_components(chunk_at(&arch->components, idx), idx % CHUNK_SIZE, chunk_at(&arch->components, last), last % CHUNK_SIZE);
+        s->records.data[get_record_idx(arch, idx)].idx = idx;
+    }
+    --store->count;
+}
+
+// Closes the holes left by despawn() in a single pass from the first hole, keeping relative order so parents stay ahead of their
+// children. Children of despawned entities are despawned with them.
+template<typename component_chunk>
+static void compact(struct scene *s, struct archetype<component_chunk> *arch) {
+    if (arch->first_hole == CTK_U32_MAX)
+        return;
+
+    static u32 const DESPAWNED = CTK_U32_MAX - 1;
+    struct transform_store *store = &arch->transforms;
+    u32 first = arch->first_hole;
+    auto new_idxs = (u32 *)malloc((store->count - first) * sizeof(u32));
+    u32 dst = first;
+    for (u32 src = first; src < store->count; ++src) {
+        u32 parent = get_parent(store, src);
+        if (parent != NO_PARENT && parent >= first)
+            parent = new_idxs[parent - first];
+        u32 record = get_record_idx(arch, src);
+        if (record == NO_RECORD || parent == DESPAWNED) {
+            if (record != NO_RECORD)
+                free_record(s, record);
+            if (parent != NO_PARENT && parent != DESPAWNED)
+                --chunk_at(&store->chunks, parent)->child_count[parent % CHUNK_SIZE];
+            new_idxs[src - first] = DESPAWNED;
+            continue;
+        }
+        new_idxs[src - first] = dst;
+        if (dst != src) {
+            move_transform(store, dst, src);
+            move_components(chunk_at(&arch->components, dst), dst % CHUNK_SIZE, chunk_at(&arch->components, src), src % CHUNK_SIZE);
+            s->records.data[record].idx = dst;
+        }
+        chunk_at(&store->chunks, dst)->parent[dst % CHUNK_SIZE] = parent;
+        ++dst;
+    }
+    free(new_idxs);
+    store->count = dst;
+    arch->first_hole = CTK_U32_MAX;
+    ++arch->version;
+}
+
+// A child's transform is relative to its parent's, which must be a renderable spawned before it.
+static struct entity_handle spawn_renderable(struct scene *s, struct mesh *mesh, struct vtk_descriptor_set *texture_desc_set,
+                                             struct material *material, struct transform trans = DEFAULT_TRANSFORM,
+                                             struct entity_handle parent = NULL_ENTITY, cstr name = NULL) {
+    u32 parent_idx = parent.record == NO_RECORD ? NO_PARENT : get_entity_idx(s, parent, ARCHETYPE_RENDERABLE);
+    u32 idx = 0;
+    struct entity_handle handle = spawn(s, &s->renderables, ARCHETYPE_RENDERABLE, &trans, parent_idx, &idx);
+    struct renderable_components *c = chunk_at(&s->renderables.components, idx);
+    c->name[idx % CHUNK_SIZE] = name;
+    c->mesh[idx % CHUNK_SIZE] = mesh;
+    c->texture_desc_set[idx % CHUNK_SIZE] = texture_desc_set;
+    c->material[idx % CHUNK_SIZE] = material;
+    c->occluder[idx % CHUNK_SIZE] = false;
+    c->render_flags[idx % CHUNK_SIZE] = DEFAULT_RENDER_FLAGS;
+    return handle;
+}
+
+static void set_occluder(struct scene *s, struct entity_handle handle, bool occluder) {
+    u32 idx = get_entity_idx(s, handle, ARCHETYPE_RENDERABLE);
+    chunk_at(&s->renderables.components, idx)->occluder[idx % CHUNK_SIZE] = occluder;
+}
+
+static void set_render_flags(struct scene *s, struct entity_handle handle, u8 render_flags) {
+    u32 idx = get_entity_idx(s, handle, ARCHETYPE_RENDERABLE);
+    chunk_at(&s->renderables.components, idx)->render_flags[idx % CHUNK_SIZE] = render_flags;
+}
 
-        // Model Matrix
-        glm::mat4 model_mtx(1.0f);
-        model_mtx = glm::translate(model_mtx, light_pos);
-        model_mtx = glm::rotate(model_mtx, glm::radians(trans->rotation.x), { 1.0f, 0.0f, 0.0f });
-        model_mtx = glm::rotate(model_mtx, glm::radians(trans->rotation.y), { 0.0f, 1.0f, 0.0f });
-        model_mtx = glm::rotate(model_mtx, glm::radians(trans->rotation.z), { 0.0f, 0.0f, 1.0f });
-        model_mtx = glm::scale(model_mtx, { trans->scale.x, trans->scale.y, trans->scale.z });
-        model_ubo->model_mtx = model_mtx;
-        model_ubo->mvp_mtx = *view_space_mtx * model_mtx;
+// Light UBOs are uploaded as one array and each light renders its own shadow map, so lights stay capped at MAX_LIGHTS.
+static struct entity_handle spawn_light(struct scene *s, struct transform trans = DEFAULT_TRANSFORM) {
+    if (s->lights.transforms.count == MAX_LIGHTS)
+        CTK_FATAL("cannot spawn more lights in scene (max: %u)", MAX_LIGHTS)
+    u32 idx = 0;
+    struct entity_handle handle = spawn(s, &s->lights, ARCHETYPE_LIGHT, &trans, NO_PARENT, &idx);
+    struct light_components *c = chunk_at(&s->lights.components, idx);
+    struct light_ubo *ubo = c->ubo + idx % CHUNK_SIZE;
+    *ubo = {};
+    ubo->mode = LIGHT_MODE_POINT;
+    ubo->color = { 1, 1, 1, 1 };
+    ubo->normal_bias = 16;
+    ubo->ambient = 0.3f;
+    c->attenuation_index[idx % CHUNK_SIZE] = 3;
+    return handle;
+}
+
+static void despawn_entity(struct scene *s, struct entity_handle handle) {
+    struct entity_record *record = get_record(s, handle);
+    if (record == NULL)
+        return;
+    if (record->archetype == ARCHETYPE_RENDERABLE)
+        despawn(s, &s->renderables, record->idx);
+    else
+        despawn(s, &s->lights, record->idx);
+}
+
+static struct light_ubo *get_light_ubo(struct scene *s, u32 idx) {
+    return chunk_at(&s->lights.components, idx)->ubo + idx % CHUNK_SIZE;
+}
+
+static u32 *get_light_attenuation_index(struct scene *s, u32 idx) {
+    return chunk_at(&s->lights.components, idx)->attenuation_index + idx % CHUNK_SIZE;
+}
+
+// Distance at which the light's attenuation, 1 / (1 + linear * d + quadratic * d^2), falls to 1/256 and stops registering in an 8-bit
+// channel.
+static f32 get_light_range(struct scene *s, u32 idx) {
+    struct ctk_v2<f32> const *atten_consts = LIGHT_ATTENUATION_CONSTS + *get_light_attenuation_index(s, idx);
+    f32 linear = atten_consts->x;
+    f32 quadratic = atten_consts->y;
+    return (-linear + sqrtf(linear * linear + 4 * quadratic * 255)) / (2 * quadratic);
+}
+
+static struct material *push_material(struct scene *s, cstr name = NULL) {
+    if (s->materials.count == MAX_MATERIALS)
+        CTK_FATAL("cannot push more materials to scene (max: %u)", MAX_MATERIALS)
+    struct material *m = ctk_push(&s->materials);
+    m->name = name;
+    m->ubo = ctk_push(&s->material.ubos);
+    m->ubo->shine_exponent = 2;
+    return m;
+}
+
+static struct scene *create_scene(struct app *app, struct vk_core *vk) {
+    auto scene = ctk_zalloc<struct scene>();
+    scene->records.free_head = NO_RECORD;
+    init_archetype(&scene->renderables, vk->swapchain.image_count);
+    init_archetype(&scene->lights, vk->swapchain.image_count);
+
+    scene->camera.transform = DEFAULT_TRANSFORM;
+    scene->camera.transform.position = { 10, -5, 14};
+    scene->camera.transform.rotation = quat_from_euler({ 45, 0, 0 });
+    scene->camera.fov = 90.0f;
+    scene->camera.aspect = vk->swapchain.extent.width / (f32)vk->swapchain.extent.height;
+    scene->camera.z_near = 0.1f;
+    scene->camera.z_far = 100.0f;
+
+    struct material *mat = push_material(scene, "test");
+    mat->ubo->shine_exponent = 2;
+
+    struct mesh *cube = ctk_at(&app->assets.meshes, "cube");
+    struct vtk_descriptor_set *wood = ctk_at(&app->descriptors.sets.textures, "wood");
+    set_occluder(scene, spawn_renderable(scene, cube, wood, mat, { { 10.0f, -3.0f, 15.0f }, IDENTITY_ROTATION, { 1, 1, 1 } }), true);
+    set_occluder(scene, spawn_renderable(scene, cube, wood, mat, { { 4.0f, 0.0f, 2.0f }, IDENTITY_ROTATION, { 1, 1, 1 } }), true);
+    struct entity_handle ground = spawn_renderable(scene, ctk_at(&app->assets.meshes, "quad"), wood, mat,
+                                                   { {}, quat_from_euler({ -90.0f, 0.0f, 0.0f }), { 32, 32, 1 } });
+    set_occluder(scene, ground, true);
+    set_render_flags(scene, ground, RENDER_FLAG_VISIBLE | RENDER_FLAG_RECEIVES_SHADOW); // Nothing below the ground to shadow.
+    spawn_renderable(scene, ctk_at(&app->assets.meshes, "sibenik"), ctk_at(&app->descriptors.sets.textures, "brick"), mat,
+                     { { 15.0f, -18.0f, 15.0f }, IDENTITY_ROTATION, { 1, 1, 1 } });
+
+    struct entity_handle light = spawn_light(scene, { { 8, -4, 15.5f }, quat_from_euler({ 0.0f, -90.0f, 0.0f }), { 0.1f, 0.1f, 0.1f } });
+    u32 light_idx = get_entity_idx(scene, light, ARCHETYPE_LIGHT);
+    get_light_ubo(scene, light_idx)->depth_bias = 1;
+    *get_light_attenuation_index(scene, light_idx) = 8;
+
+    return scene;
+}
+
+static glm::mat4 camera_view_space_mtx(struct camera *cam) {
+    struct transform *cam_trans = &cam->transform;
+
+    // View Matrix
+    glm::vec3 cam_pos = { cam_trans->position.x, cam_trans->position.y, cam_trans->position.z };
+    glm::mat3 cam_mtx = glm::mat3_cast(cam_trans->rotation);
+    glm::vec3 cam_forward = { cam_mtx[0][2], cam_mtx[1][2], cam_mtx[2][2] };
+    glm::mat4 view_mtx = glm::lookAt(cam_pos, cam_pos + cam_forward, { 0.0f, -1.0f, 0.0f });
+
+    // Projection Matrix
+    glm::mat4 proj_mtx = glm::perspective(glm::radians(cam->fov), cam->aspect, cam->z_near, cam->z_far);
+    proj_mtx[1][1] *= -1; // Flip y value for scale (glm is designed for OpenGL).
+
+    return proj_mtx * view_mtx;
+}
+
+static void update_camera(struct app *app, struct vk_core *vk, struct scene *scene, u32 swapchain_img_idx) {
+    struct camera_ubo ubo = {};
+    ubo.view_space_mtx = camera_view_space_mtx(&scene->camera);
+    ubo.position = scene->camera.transform.position;
+    vtk_write_to_host_region(vk->device.logical, &ubo, sizeof(ubo), app->uniform_bufs.camera_ubo.regions + swapchain_img_idx, 0);
+}
+
+// Builds light UBOs [first, first + count), including each point light's six cube-face view matrices.
+static void update_light_ubos(void *data, u32 first, u32 count) {
+    auto scene = (struct scene *)data;
+    struct transform_store *transforms = &scene->lights.transforms;
+    for (u32 i = first; i < first + count; ++i) {
+        struct transform trans = get_transform(transforms, i);
+        struct light_ubo *ubo = get_light_ubo(scene, i);
+
+        struct ctk_v2<f32> const *atten_consts = LIGHT_ATTENUATION_CONSTS + *get_light_attenuation_index(scene, i);
+        ubo->linear = atten_consts->x;
+        ubo->quadratic = atten_consts->y;
+        glm::vec3 light_pos = { trans.position.x, trans.position.y, trans.position.z };
 
         ////////////////////////////////////////////////////////////
         /// Light UBO
         ////////////////////////////////////////////////////////////
-        ubo->position = trans->position;
+        ubo->position = trans.position;
         if (ubo->mode == LIGHT_MODE_DIRECTIONAL) {
             // View Matrix
-            glm::mat4 view_mtx(1.0f);
-            view_mtx = glm::rotate(view_mtx, glm::radians(trans->rotation.x), { 1.0f, 0.0f, 0.0f });
-            view_mtx = glm::rotate(view_mtx, glm::radians(trans->rotation.y), { 0.0f, 1.0f, 0.0f });
-            view_mtx = glm::rotate(view_mtx, glm::radians(trans->rotation.z), { 0.0f, 0.0f, 1.0f });
-            glm::vec3 light_forward = { view_mtx[0][2], view_mtx[1][2], view_mtx[2][2] };
-            view_mtx = glm::lookAt(light_pos, light_pos + light_forward, { 0.0f, -1.0f, 0.0f });
+            glm::mat3 rot_mtx = glm::mat3_cast(trans.rotation);
+            glm::vec3 light_forward = { rot_mtx[0][2], rot_mtx[1][2], rot_mtx[2][2] };
+            glm::mat4 view_mtx = glm::lookAt(light_pos, light_pos + light_forward, { 0.0f, -1.0f, 0.0f });
 
             // Projection Matrix
             f32 near_plane = 1.0f;
@@ -1281,384 +3537,2837 @@ static void update_lights(struct app *app, struct vk_core *vk, struct scene *sce
             };
             glm::mat4 proj_mtx = glm::perspective(glm::radians(90.0f), 1.0f, 0.1f, 50.0f);
             proj_mtx[1][1] *= -1;
-            for (u32 i = 0; i < 6; ++i) {
-                glm::vec3 up = i == 2 ? glm::vec3(0, 0, -1) :
-                               i == 3 ? glm::vec3(0, 0, 1) :
+            for (u32 face = 0; face < 6; ++face) {
+                glm::vec3 up = face == 2 ? glm::vec3(0, 0, -1) :
+                               face == 3 ? glm::vec3(0, 0, 1) :
                                glm::vec3(0, -1, 0);
-                ubo->view_mtxs[i] = proj_mtx * glm::lookAt(light_pos, light_pos + DIRECTIONS[i], up);
+                ubo->view_mtxs[face] = proj_mtx * glm::lookAt(light_pos, light_pos + DIRECTIONS[face], up);
             }
         }
     }
-    vtk_write_to_host_region(vk->device.logical, scene->light.ubos.data, ctk_byte_count(&scene->light.ubos), app->uniform_bufs.light_ubos.regions + swapchain_img_idx, 0);
-    vtk_write_to_host_region(vk->device.logical, scene->light.model_ubos.data, ctk_byte_count(&scene->light.model_ubos),
-                             app->uniform_bufs.light_model_ubos.regions + swapchain_img_idx, 0);
 }
 
-static void update_entities(struct app *app, struct vk_core *vk, struct scene *scene, glm::mat4 *view_space_mtx, u32 swapchain_img_idx) {
-    if (scene->entities.count == 0)
+static void update_lights(struct app *app, struct vk_core *vk, struct scene *scene, u32 swapchain_img_idx) {
+    compact(scene, &scene->lights);
+    struct transform_store *transforms = &scene->lights.transforms;
+    if (transforms->count == 0)
         return;
 
-    for (u32 i = 0; i < scene->entities.count; ++i) {
-        struct transform *trans = scene->entity.transforms + i;
-        struct model_ubo *model_ubo = scene->entity.model_ubos + i;
-        glm::mat4 model_mtx(1.0f);
-        model_mtx = glm::translate(model_mtx, { trans->position.x, trans->position.y, trans->position.z });
-        model_mtx = glm::rotate(model_mtx, glm::radians(trans->rotation.x), { 1.0f, 0.0f, 0.0f });
-        model_mtx = glm::rotate(model_mtx, glm::radians(trans->rotation.y), { 0.0f, 1.0f, 0.0f });
-        model_mtx = glm::rotate(model_mtx, glm::radians(trans->rotation.z), { 0.0f, 0.0f, 1.0f });
-        model_mtx = glm::scale(model_mtx, { trans->scale.x, trans->scale.y, trans->scale.z });
+    parallel_for(app->jobs, transforms->count, 1, update_light_ubos, scene);
 
-        model_ubo->model_mtx = model_mtx;
-        model_ubo->mvp_mtx = *view_space_mtx * model_mtx;
-    }
-    vtk_write_to_host_region(vk->device.logical, scene->entity.model_ubos.data, ctk_byte_count(&scene->entity.model_ubos),
-                             app->uniform_bufs.entity_model_ubos.regions + swapchain_img_idx, 0);
+    // MAX_LIGHTS fits in one chunk, so light UBOs and model UBOs are each uploaded from the first chunk.
+    vtk_write_to_host_region(vk->device.logical, get_light_ubo(scene, 0), transforms->count * sizeof(struct light_ubo),
+                             app->uniform_bufs.light_ubos.regions + swapchain_img_idx, 0);
+    update_world_mtxs(transforms, app->jobs);
+    app->stats.model_ubo_uploads += upload_model_ubos(transforms, 0, app->uniform_bufs.light_model_ubos.regions + swapchain_img_idx, vk,
+                                                      swapchain_img_idx);
 }
 
-////////////////////////////////////////////////////////////
-/// UI
-////////////////////////////////////////////////////////////
-enum {
-    UI_MODE_ENTITY,
-    UI_MODE_LIGHT,
-    UI_MODE_MATERIAL,
+// Only entities whose transforms changed are recomposed; camera motion is covered by update_camera(). Each swapchain image's copy of the
+// model UBOs is then brought up to date by upload_entities().
+static void update_entities(struct scene *scene, struct job_system *jobs) {
+    compact(scene, &scene->renderables);
+    update_world_mtxs(&scene->renderables.transforms, jobs);
+}
+
+// Planes are (nx, ny, nz, d) with normals pointing inwards, so a point p is inside a plane when dot(n, p) + d >= 0.
+struct frustum {
+    f32 planes[6][4];
 };
 
-struct ui {
-    struct vtk_render_pass render_pass;
-    VkDescriptorPool descriptor_pool;
-    ImGuiIO *io;
-    s32 mode;
-    u32 entity_idx;
-    u32 light_idx;
-    u32 material_idx;
+// Extracts planes from a view-projection matrix's rows (Gribb/Hartmann), using Vulkan's [0, 1] clip depth for the near plane. Works for
+// both perspective and orthographic projections.
+static struct frustum extract_frustum(glm::mat4 const &view_space_mtx) {
+    glm::vec4 rows[4];
+    for (u32 i = 0; i < 4; ++i)
+        rows[i] = { view_space_mtx[0][i], view_space_mtx[1][i], view_space_mtx[2][i], view_space_mtx[3][i] };
+    glm::vec4 planes[] = {
+        rows[3] + rows[0], // Left
+        rows[3] - rows[0], // Right
+        rows[3] + rows[1], // Top/bottom (y is flipped for Vulkan)
+        rows[3] - rows[1],
+        rows[2],           // Near
+        rows[3] - rows[2], // Far
+    };
+    struct frustum frustum = {};
+    for (u32 i = 0; i < 6; ++i) {
+        f32 len = glm::length(glm::vec3(planes[i]));
+        for (u32 c = 0; c < 4; ++c)
+            frustum.planes[i][c] = planes[i][c] / len;
+    }
+    return frustum;
+}
+
+struct cull_view {
+    bool frustum_enabled;
+    struct frustum frustum;
+    bool tiny_enabled;
+    f32 eye[3];
+    f32 tiny_scale; // Projection scale / min screen size: entities with radius * tiny_scale < distance to eye are culled.
+    bool range_enabled; // Cull entities whose bounding sphere is out of range of the eye (a point light).
+    f32 range;
 };
 
-static void check_vk_result(VkResult result) {
-    vtk_validate_result(result, "imgui internal call failed");
+// Transforms each mesh's model-space bounds by its entity's world matrix. Extents go through the absolute value of the matrix's 3x3 part
+// (Arvo's method) so the box stays conservative under rotation, and the sphere radius is scaled by the largest axis scale.
+static void update_chunk_bounds(struct renderable_components *components, struct transform_chunk *transforms, u32 count) {
+    for (u32 i = 0; i < count; ++i) {
+        struct mesh *mesh = components->mesh[i];
+        components->bounds_moved[i] = 0;
+        if (mesh == NULL)
+            continue;
+        glm::mat4 const &model_mtx = transforms->model_ubos[i].model_mtx;
+        f32 center[] = { mesh->bounds_center.x, mesh->bounds_center.y, mesh->bounds_center.z };
+        f32 extent[] = { mesh->bounds_extent.x, mesh->bounds_extent.y, mesh->bounds_extent.z };
+        for (u32 row = 0; row < 3; ++row) {
+            f32 world_center = model_mtx[3][row];
+            f32 world_extent = 0;
+            for (u32 col = 0; col < 3; ++col) {
+                world_center += model_mtx[col][row] * center[col];
+                world_extent += fabsf(model_mtx[col][row]) * extent[col];
+            }
+            if (components->bounds_center[row][i] != world_center || components->bounds_extent[row][i] != world_extent)
+                components->bounds_moved[i] = 1;
+            components->bounds_center[row][i] = world_center;
+            components->bounds_extent[row][i] = world_extent;
+        }
+        f32 max_scale_sq = 0;
+        for (u32 col = 0; col < 3; ++col) {
+            glm::vec3 axis(model_mtx[col]);
+            f32 scale_sq = glm::dot(axis, axis);
+            if (scale_sq > max_scale_sq)
+                max_scale_sq = scale_sq;
+        }
+        components->bounds_radius[i] = mesh->bounds_radius * sqrtf(max_scale_sq);
+    }
 }
 
-static struct ui *create_ui(struct window *win, struct app *app, struct vk_core *vk) {
-    auto ui = ctk_zalloc<struct ui>();
-    ui->mode = UI_MODE_LIGHT;
+static void update_bounds_chunks(void *data, u32 first, u32 count) {
+    auto renderables = (struct archetype<struct renderable_components> *)data;
+    for (u32 c = first; c < first + count; ++c)
+        update_chunk_bounds(renderables->components.data[c], renderables->transforms.chunks.data[c], chunk_transform_count(&renderables->transforms, c));
+}
 
-    ////////////////////////////////////////////////////////////
-    /// Init
-    ////////////////////////////////////////////////////////////
-    ImGui::CreateContext();
-    ui->io = &ImGui::GetIO();
-    if (!ImGui_ImplGlfw_InitForVulkan(win->handle, true /* install callbacks so imgui can handle glfw input */))
-        CTK_FATAL("failed to init imgui glfw for vulkan")
+// Tests the SIMD_WIDTH entities starting at base against a view, returning a bit per visible lane. A box is outside a plane when even its
+// corner furthest along the normal is behind it: dot(n, center) + d + dot(abs(n), extent) < 0.
+static u32 cull_lanes(struct cull_view const *view, struct renderable_components const *components, u32 base) {
+    simd_f32 zero = simd_set(0.0f);
+    simd_f32 cx = simd_load(components->bounds_center[0] + base);
+    simd_f32 cy = simd_load(components->bounds_center[1] + base);
+    simd_f32 cz = simd_load(components->bounds_center[2] + base);
+    simd_f32 outside = zero;
+    if (view->frustum_enabled) {
+        simd_f32 ex = simd_load(components->bounds_extent[0] + base);
+        simd_f32 ey = simd_load(components->bounds_extent[1] + base);
+        simd_f32 ez = simd_load(components->bounds_extent[2] + base);
+        for (u32 p = 0; p < 6; ++p) {
+            f32 const *plane = view->frustum.planes[p];
+            simd_f32 dist = simd_madd(cx, simd_set(plane[0]), simd_madd(cy, simd_set(plane[1]), simd_madd(cz, simd_set(plane[2]), simd_set(plane[3]))));
+            simd_f32 reach = simd_madd(ex, simd_set(fabsf(plane[0])), simd_madd(ey, simd_set(fabsf(plane[1])), simd_mul(ez, simd_set(fabsf(plane[2])))));
+            outside = simd_or(outside, simd_cmplt(simd_add(dist, reach), zero));
+        }
+    }
+    if (view->tiny_enabled) {
+        simd_f32 dx = simd_sub(cx, simd_set(view->eye[0]));
+        simd_f32 dy = simd_sub(cy, simd_set(view->eye[1]));
+        simd_f32 dz = simd_sub(cz, simd_set(view->eye[2]));
+        simd_f32 dist_sq = simd_madd(dx, dx, simd_madd(dy, dy, simd_mul(dz, dz)));
+        simd_f32 size = simd_mul(simd_load(components->bounds_radius + base), simd_set(view->tiny_scale));
+        outside = simd_or(outside, simd_cmplt(simd_mul(size, size), dist_sq));
+    }
+    if (view->range_enabled) {
+        simd_f32 dx = simd_sub(cx, simd_set(view->eye[0]));
+        simd_f32 dy = simd_sub(cy, simd_set(view->eye[1]));
+        simd_f32 dz = simd_sub(cz, simd_set(view->eye[2]));
+        simd_f32 dist_sq = simd_madd(dx, dx, simd_madd(dy, dy, simd_mul(dz, dz)));
+        simd_f32 reach = simd_add(simd_load(components->bounds_radius + base), simd_set(view->range));
+        outside = simd_or(outside, simd_cmplt(simd_mul(reach, reach), dist_sq));
+    }
+    return ~simd_movemask(outside) & ((1u << SIMD_WIDTH) - 1);
+}
 
-    ////////////////////////////////////////////////////////////
-    /// Render Pass
-    ////////////////////////////////////////////////////////////
-    struct vtk_render_pass_info rp_info = {};
+// Scalar version of cull_lanes()'s tiny-contribution test, for entities coming out of BVH queries.
+static bool is_tiny(struct cull_view const *view, struct renderable_components const *components, u32 i) {
+    f32 dx = components->bounds_center[0][i] - view->eye[0];
+    f32 dy = components->bounds_center[1][i] - view->eye[1];
+    f32 dz = components->bounds_center[2][i] - view->eye[2];
+    f32 size = components->bounds_radius[i] * view->tiny_scale;
+    return size * size < dx * dx + dy * dy + dz * dz;
+}
 
-    // Attachments
-    VkAttachmentDescription *swapchain_attachment = ctk_push(&rp_info.attachment_descriptions);
-    swapchain_attachment->format = vk->swapchain.image_format;
-    swapchain_attachment->samples = VK_SAMPLE_COUNT_1_BIT;
-    swapchain_attachment->loadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-    swapchain_attachment->storeOp = VK_ATTACHMENT_STORE_OP_STORE;
-    swapchain_attachment->stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-    swapchain_attachment->stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-    swapchain_attachment->initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-    swapchain_attachment->finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
-    ctk_push(&rp_info.clear_values, { 0, 0, 0, 1 });
+// Scalar version of cull_lanes()'s light range test.
+static bool is_out_of_range(struct cull_view const *view, struct renderable_components const *components, u32 i) {
+    f32 dx = components->bounds_center[0][i] - view->eye[0];
+    f32 dy = components->bounds_center[1][i] - view->eye[1];
+    f32 dz = components->bounds_center[2][i] - view->eye[2];
+    f32 reach = components->bounds_radius[i] + view->range;
+    return reach * reach < dx * dx + dy * dy + dz * dz;
+}
 
-    // Subpasses
-    struct vtk_subpass_info *main = ctk_push(&rp_info.subpass_infos);
-    ctk_push(&main->color_attachment_refs, { 0, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL });
+////////////////////////////////////////////////////////////
+/// Scene Snapshots
+////////////////////////////////////////////////////////////
+// Binary snapshot of a scene, laid out like the scene's own arrays so loading is a block copy per chunk plus a pass of pointer fixups.
+// Meshes and textures are stored as tables of asset names, resolved once per table entry, and every other reference is an index into a
+// table or an offset into the string table. Snapshots are only read back by builds with the same CHUNK_SIZE and struct layouts; the
+// header's sizes reject anything else.
+static char const *const SCENE_SNAPSHOT_PATH = "assets/scenes/shadows.scene";
+static u32 const SCENE_SNAPSHOT_MAGIC = 0x53584647; // "GFXS"
+static u32 const SCENE_SNAPSHOT_VERSION = 1;
+static u32 const SNAPSHOT_NONE = CTK_U32_MAX;
+
+// Transform columns are copied byte for byte up to the per-frame state (dirty flags and model UBOs), which loading resets.
+static u32 const SNAPSHOT_TRANSFORM_BYTES = offsetof(struct transform_chunk, dirty);
+
+// Array of count elements at offset bytes into the file.
+struct snapshot_range {
+    u32 offset;
+    u32 count;
+};
 
-    // Subpass Dependencies
-    rp_info.subpass_dependencies.count = 1;
-    rp_info.subpass_dependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
-    rp_info.subpass_dependencies[0].dstSubpass = 0;
-    rp_info.subpass_dependencies[0].srcStageMask = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
-    rp_info.subpass_dependencies[0].dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-    rp_info.subpass_dependencies[0].srcAccessMask = VK_ACCESS_MEMORY_READ_BIT;
-    rp_info.subpass_dependencies[0].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-    rp_info.subpass_dependencies[0].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
+struct snapshot_header {
+    u32 magic;
+    u32 version;
+    u32 chunk_size;
+    u32 renderable_chunk_size;
+    u32 light_size;
+    u32 material_size;
+    struct camera camera;
+    struct snapshot_range strings; // Null-terminated names, referenced by offset.
+    struct snapshot_range meshes; // String offsets of mesh asset names.
+    struct snapshot_range textures; // String offsets of texture asset names.
+    struct snapshot_range materials;
+    struct snapshot_range renderable_chunks;
+    struct snapshot_range lights;
+    u32 renderable_count;
+};
 
-    // Framebuffer Infos
-    for (u32 i = 0; i < vk->swapchain.image_count; ++i) {
-        struct vtk_framebuffer_info *fb_info = ctk_push(&rp_info.framebuffer_infos);
-        ctk_push(&fb_info->attachments, vk->swapchain.image_views[i]);
-        fb_info->extent = vk->swapchain.extent;
-        fb_info->layers = 1;
-    }
+struct snapshot_renderable_chunk {
+    u8 transforms[SNAPSHOT_TRANSFORM_BYTES];
+    u32 name[CHUNK_SIZE]; // String offset or SNAPSHOT_NONE.
+    u32 mesh[CHUNK_SIZE]; // Mesh table index or SNAPSHOT_NONE.
+    u32 texture[CHUNK_SIZE]; // Texture table index or SNAPSHOT_NONE.
+    u32 material[CHUNK_SIZE]; // Scene material index or SNAPSHOT_NONE.
+    u8 occluder[CHUNK_SIZE];
+    u8 render_flags[CHUNK_SIZE];
+};
 
-    ui->render_pass = vtk_create_render_pass(vk->device.logical, vk->graphics_cmd_pool, &rp_info);
+struct snapshot_light {
+    struct light_ubo ubo;
+    struct transform transform;
+    u32 attenuation_index;
+};
 
-    ////////////////////////////////////////////////////////////
-    /// Descriptor Pool
-    ////////////////////////////////////////////////////////////
-    VkDescriptorPoolSize pool_sizes[] = {
-        { VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 16 },
-        { VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 16 },
-        { VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT, 16 },
-        { VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 16 },
-    };
-    VkDescriptorPoolCreateInfo pool_info = {};
-    pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
-    pool_info.flags = 0;
-    pool_info.maxSets = 64;
-    pool_info.poolSizeCount = CTK_ARRAY_COUNT(pool_sizes);
-    pool_info.pPoolSizes = pool_sizes;
-    vtk_validate_result(vkCreateDescriptorPool(vk->device.logical, &pool_info, NULL, &ui->descriptor_pool), "failed to create descriptor pool");
+struct snapshot_material {
+    u32 name;
+    struct material_ubo ubo;
+};
 
-    ////////////////////////////////////////////////////////////
-    /// Vulkan Init
-    ////////////////////////////////////////////////////////////
-    ImGui_ImplVulkan_InitInfo imgui_vk_info = {};
-    imgui_vk_info.Instance = vk->instance.handle;
-    imgui_vk_info.PhysicalDevice = vk->device.physical;
-    imgui_vk_info.Device = vk->device.logical;
-    imgui_vk_info.QueueFamily = vk->device.queue_family_indexes.graphics;
-    imgui_vk_info.Queue = vk->device.queues.graphics;
-    imgui_vk_info.PipelineCache = VK_NULL_HANDLE;
-    imgui_vk_info.DescriptorPool = ui->descriptor_pool;
-    imgui_vk_info.MinImageCount = vk->swapchain.image_count;
-    imgui_vk_info.ImageCount = vk->swapchain.image_count;
-    imgui_vk_info.MSAASamples = VK_SAMPLE_COUNT_1_BIT;
-    imgui_vk_info.Allocator = NULL;
-    imgui_vk_info.CheckVkResultFn = check_vk_result;
-    if (!ImGui_ImplVulkan_Init(&imgui_vk_info, ui->render_pass.handle))
-        CTK_FATAL("failed to init imgui vulkan")
+struct snapshot_strings {
+    char *data;
+    u32 size;
+    u32 capacity;
+};
 
-    ////////////////////////////////////////////////////////////
-    /// Fonts
-    ////////////////////////////////////////////////////////////
-    vtk_begin_one_time_command_buffer(app->cmd_bufs.one_time);
-        ImGui_ImplVulkan_CreateFontsTexture(app->cmd_bufs.one_time);
-    vtk_submit_one_time_command_buffer(app->cmd_bufs.one_time, vk->device.queues.graphics);
-    ImGui_ImplVulkan_DestroyFontUploadObjects();
+struct mapped_file {
+    HANDLE file;
+    HANDLE mapping;
+    u8 const *data;
+    u32 size;
+};
 
-    return ui;
+static u32 push_snapshot_string(struct snapshot_strings *strings, cstr str) {
+    if (str == NULL)
+        return SNAPSHOT_NONE;
+    u32 size = (u32)strlen(str) + 1;
+    if (strings->size + size > strings->capacity) {
+        strings->capacity = strings->capacity == 0 ? 4096 : strings->capacity * 2;
+        if (strings->capacity < strings->size + size)
+            strings->capacity = strings->size + size;
+        strings->data = (char *)realloc(strings->data, strings->capacity);
+    }
+    u32 offset = strings->size;
+    memcpy(strings->data + offset, str, size);
+    strings->size += size;
+    return offset;
 }
 
-static bool list_box_begin(cstr id, cstr title, u32 item_count, u32 viewable_item_count = -1) {
-    ImGui::PushItemWidth(-1);
-    char imgui_id[256] = {};
-    sprintf(imgui_id, "##%s", id);
-    if (title)
-        ImGui::Text(title);
-    return ImGui::ListBoxHeader(imgui_id, item_count, viewable_item_count);
+// Pads the file to 16 bytes so every array is aligned in the mapping, then writes the array.
+static struct snapshot_range write_snapshot_array(FILE *file, void const *data, u32 elem_size, u32 count) {
+    static u8 const PADDING[16] = {};
+    u32 offset = (u32)ftell(file);
+    u32 padding = (16 - offset % 16) % 16;
+    fwrite(PADDING, 1, padding, file);
+    if (count > 0)
+        fwrite(data, elem_size, count, file);
+    return { offset + padding, count };
 }
 
-static void list_box_end() {
-    ImGui::ListBoxFooter();
-    ImGui::PopItemWidth();
+template<typename type, u32 size>
+static u32 find_snapshot_index(struct ctk_map<type, size> *map, type const *value) {
+    if (value == NULL)
+        return SNAPSHOT_NONE;
+    CTK_ASSERT(value >= map->values && value < map->values + map->count)
+    return (u32)(value - map->values);
 }
 
-static bool window_begin(cstr title, s32 x, s32 y, s32 width, s32 height, s32 flags) {
-    ImGui::SetNextWindowPos({ (f32)x, (f32)y });
-    return ImGui::Begin(title, NULL, flags);
+// Holes are compacted first so the archetype's arrays are packed. Returns false when path couldn't be written.
+static bool save_scene_snapshot(struct scene *scene, cstr path, struct ctk_map<struct mesh, MAX_MESHES> *meshes,
+                                struct ctk_map<struct vtk_descriptor_set, MAX_TEXTURES> *textures) {
+    FILE *file = fopen(path, "wb");
+    if (file == NULL)
+        return false;
+    compact(scene, &scene->renderables);
+
+    struct snapshot_header header = {};
+    header.magic = SCENE_SNAPSHOT_MAGIC;
+    header.version = SCENE_SNAPSHOT_VERSION;
+    header.chunk_size = CHUNK_SIZE;
+    header.renderable_chunk_size = sizeof(struct snapshot_renderable_chunk);
+    header.light_size = sizeof(struct snapshot_light);
+    header.material_size = sizeof(struct snapshot_material);
+    header.camera = scene->camera;
+    header.renderable_count = scene->renderables.transforms.count;
+    fwrite(&header, sizeof(header), 1, file);
+
+    struct snapshot_strings strings = {};
+    u32 mesh_names[MAX_MESHES] = {};
+    for (u32 i = 0; i < meshes->count; ++i)
+        mesh_names[i] = push_snapshot_string(&strings, meshes->keys[i]);
+    u32 texture_names[MAX_TEXTURES] = {};
+    for (u32 i = 0; i < textures->count; ++i)
+        texture_names[i] = push_snapshot_string(&strings, textures->keys[i]);
+    header.meshes = write_snapshot_array(file, mesh_names, sizeof(u32), meshes->count);
+    header.textures = write_snapshot_array(file, texture_names, sizeof(u32), textures->count);
+
+    struct snapshot_material materials[MAX_MATERIALS] = {};
+    for (u32 i = 0; i < scene->materials.count; ++i) {
+        materials[i].name = push_snapshot_string(&strings, scene->materials[i].name);
+        materials[i].ubo = *scene->materials[i].ubo;
+    }
+    header.materials = write_snapshot_array(file, materials, sizeof(struct snapshot_material), scene->materials.count);
+
+    struct transform_store *transforms = &scene->renderables.transforms;
+    u32 chunk_count = (transforms->count + CHUNK_SIZE - 1) / CHUNK_SIZE;
+    auto chunk = ctk_zalloc<struct snapshot_renderable_chunk>();
+    for (u32 c = 0; c < chunk_count; ++c) {
+        struct renderable_components *components = scene->renderables.components.data[c];
+        u32 count = chunk_transform_count(transforms, c);
+        memcpy(chunk->transforms, transforms->chunks.data[c], SNAPSHOT_TRANSFORM_BYTES);
+        for (u32 i = 0; i < count; ++i) {
+            chunk->name[i] = push_snapshot_string(&strings, components->name[i]);
+            chunk->mesh[i] = find_snapshot_index(meshes, components->mesh[i]);
+            chunk->texture[i] = find_snapshot_index(textures, components->texture_desc_set[i]);
+            chunk->material[i] = components->material[i] == NULL ? SNAPSHOT_NONE : (u32)(components->material[i] - scene->materials.data);
+            chunk->occluder[i] = components->occluder[i];
+            chunk->render_flags[i] = components->render_flags[i];
+        }
+        struct snapshot_range range = write_snapshot_array(file, chunk, sizeof(struct snapshot_renderable_chunk), 1);
+        if (c == 0)
+            header.renderable_chunks.offset = range.offset;
+    }
+    header.renderable_chunks.count = chunk_count;
+    free(chunk);
+
+    struct snapshot_light lights[MAX_LIGHTS] = {};
+    for (u32 i = 0; i < scene->lights.transforms.count; ++i) {
+        lights[i].ubo = *get_light_ubo(scene, i);
+        lights[i].transform = get_transform(&scene->lights.transforms, i);
+        lights[i].attenuation_index = *get_light_attenuation_index(scene, i);
+    }
+    header.lights = write_snapshot_array(file, lights, sizeof(struct snapshot_light), scene->lights.transforms.count);
+    header.strings = write_snapshot_array(file, strings.data, 1, strings.size);
+    free(strings.data);
+
+    fseek(file, 0, SEEK_SET);
+    fwrite(&header, sizeof(header), 1, file);
+    bool written = !ferror(file);
+    return fclose(file) == 0 && written;
 }
 
-static void window_end() {
-    ImGui::End();
+static void unmap_file(struct mapped_file *mf) {
+    if (mf->data != NULL)
+        UnmapViewOfFile(mf->data);
+    if (mf->mapping != NULL)
+        CloseHandle(mf->mapping);
+    if (mf->file != INVALID_HANDLE_VALUE && mf->file != NULL)
+        CloseHandle(mf->file);
+    *mf = {};
 }
 
-static void separator() {
-    ImVec2 output_pos = ImGui::GetCursorScreenPos();
-    ImGui::GetWindowDrawList()->AddLine(ImVec2(output_pos.x, output_pos.y + 1),
-                                        ImVec2(output_pos.x + ImGui::GetColumnWidth(), output_pos.y + 1),
-                                        IM_COL32(255, 255, 255, 64));
-    ImGui::Dummy(ImVec2(0, 2));
+// Returns false when path doesn't exist or can't be mapped; only the latter is warned about.
+static bool map_file(struct mapped_file *mf, cstr path) {
+    *mf = {};
+    mf->file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (mf->file == INVALID_HANDLE_VALUE) {
+        if (GetLastError() != ERROR_FILE_NOT_FOUND && GetLastError() != ERROR_PATH_NOT_FOUND)
+            fprintf(stderr, "failed to open \"%s\"\n", path);
+        *mf = {};
+        return false;
+    }
+    LARGE_INTEGER size = {};
+    cstr err = NULL;
+    if (!GetFileSizeEx(mf->file, &size) || size.QuadPart == 0 || size.QuadPart > CTK_U32_MAX)
+        err = "can't map \"%s\" (%lld bytes)\n";
+    mf->size = (u32)size.QuadPart;
+    if (err == NULL && (mf->mapping = CreateFileMappingA(mf->file, NULL, PAGE_READONLY, 0, 0, NULL)) == NULL)
+        err = "failed to create file mapping for \"%s\" (%lld bytes)\n";
+    if (err == NULL && (mf->data = (u8 const *)MapViewOfFile(mf->mapping, FILE_MAP_READ, 0, 0, 0)) == NULL)
+        err = "failed to map view of \"%s\" (%lld bytes)\n";
+    if (err != NULL) {
+        fprintf(stderr, err, path, size.QuadPart);
+        unmap_file(mf);
+        return false;
+    }
+    return true;
 }
 
-static void transform_control(struct transform *t) {
-    ImGui::Text("transform");
-    ImGui::DragFloat3("position", &t->position.x, 0.01f);
-    ImGui::DragFloat3("rotation", &t->rotation.x, 0.1f);
-    ImGui::DragFloat3("scale", &t->scale.x, 0.01f);
+// Returns NULL when the array isn't aligned or runs past the end of the file.
+static void const *get_snapshot_array(struct mapped_file *mf, struct snapshot_range range, u32 elem_size) {
+    if (range.offset % 16 != 0 || (u64)range.offset + (u64)range.count * elem_size > mf->size)
+        return NULL;
+    return mf->data + range.offset;
 }
 
-static void enum_dropdown(cstr id, cstr *elems, u32 elem_count, s32 *enum_val) {
-    cstr curr_elem = elems[*enum_val];
-    ImGui::PushItemWidth(-1);
-    char imgui_id[256] = {};
-    sprintf(imgui_id, "##%s", id);
-    if (ImGui::BeginCombo(imgui_id, curr_elem)) {
-        for (u32 i = 0; i < elem_count; ++i) {
-            cstr elem = elems[i];
-            bool selected = curr_elem == elem;
-            if (ImGui::Selectable(elem, selected))
-                *enum_val = i;
-            if (selected)
-                ImGui::SetItemDefaultFocus();
+template<typename type, u32 size>
+static type *find_snapshot_asset(struct ctk_map<type, size> *map, cstr name) {
+    for (u32 i = 0; i < map->count; ++i)
+        if (strcmp(map->keys[i], name) == 0)
+            return map->values + i;
+    return NULL;
+}
+
+// Checks everything loading relies on before the scene is allocated, so a bad snapshot can be dropped without a half-built scene to tear
+// down. Returns why the snapshot can't be loaded, or NULL when it can.
+static cstr validate_scene_snapshot(struct mapped_file *mf, struct ctk_map<struct mesh, MAX_MESHES> *meshes,
+                                    struct ctk_map<struct vtk_descriptor_set, MAX_TEXTURES> *textures) {
+    if (mf->size < sizeof(struct snapshot_header))
+        return "truncated";
+    auto header = (struct snapshot_header const *)mf->data;
+    if (header->magic != SCENE_SNAPSHOT_MAGIC || header->version != SCENE_SNAPSHOT_VERSION)
+        return "not a scene snapshot of this version";
+    if (header->chunk_size != CHUNK_SIZE || header->renderable_chunk_size != sizeof(struct snapshot_renderable_chunk) ||
+        header->light_size != sizeof(struct snapshot_light) || header->material_size != sizeof(struct snapshot_material)) {
+        return "saved by a build with a different layout";
+    }
+    if (header->renderable_count > (u64)header->renderable_chunks.count * CHUNK_SIZE || header->lights.count > MAX_LIGHTS ||
+        header->materials.count > MAX_MATERIALS || header->meshes.count > MAX_MESHES ||
+        header->textures.count > MAX_TEXTURES) {
+        return "invalid counts";
+    }
+    auto strings = (char const *)get_snapshot_array(mf, header->strings, 1);
+    auto mesh_names = (u32 const *)get_snapshot_array(mf, header->meshes, sizeof(u32));
+    auto texture_names = (u32 const *)get_snapshot_array(mf, header->textures, sizeof(u32));
+    auto chunks = (struct snapshot_renderable_chunk const *)get_snapshot_array(mf, header->renderable_chunks,
+                                                                                sizeof(struct snapshot_renderable_chunk));
+    if (strings == NULL || mesh_names == NULL || texture_names == NULL || chunks == NULL ||
+        get_snapshot_array(mf, header->materials, sizeof(struct snapshot_material)) == NULL ||
+        get_snapshot_array(mf, header->lights, sizeof(struct snapshot_light)) == NULL) {
+        return "array out of bounds";
+    }
+    if (header->strings.count == 0 || strings[header->strings.count - 1] != '\0')
+        return "unterminated string table";
+    for (u32 i = 0; i < header->meshes.count; ++i)
+        if (mesh_names[i] < header->strings.count && find_snapshot_asset(meshes, strings + mesh_names[i]) == NULL)
+            return "unknown mesh";
+    for (u32 i = 0; i < header->textures.count; ++i)
+        if (texture_names[i] < header->strings.count && find_snapshot_asset(textures, strings + texture_names[i]) == NULL)
+            return "unknown texture";
+    for (u32 idx = 0; idx < header->renderable_count; ++idx) {
+        u32 parent = 0;
+        memcpy(&parent, chunks[idx / CHUNK_SIZE].transforms + offsetof(struct transform_chunk, parent) + idx % CHUNK_SIZE * sizeof(u32),
+               sizeof(u32));
+        if (parent != NO_PARENT && parent >= idx)
+            return "an entity's parent comes after it";
+    }
+    return NULL;
+}
+
+// Returns NULL when there's no snapshot at path, or when it can't be loaded, which is warned about. Loaded names point into the scene's
+// copy of the string table.
+static struct scene *load_scene_snapshot(cstr path, struct ctk_map<struct mesh, MAX_MESHES> *meshes,
+                                         struct ctk_map<struct vtk_descriptor_set, MAX_TEXTURES> *textures, u32 swapchain_img_count) {
+    struct mapped_file mf = {};
+    if (!map_file(&mf, path))
+        return NULL;
+    cstr err = validate_scene_snapshot(&mf, meshes, textures);
+    if (err != NULL) {
+        fprintf(stderr, "ignoring scene snapshot \"%s\": %s\n", path, err);
+        unmap_file(&mf);
+        return NULL;
+    }
+    auto header = (struct snapshot_header const *)mf.data;
+
+    auto scene = ctk_zalloc<struct scene>();
+    scene->records.free_head = NO_RECORD;
+    init_archetype(&scene->renderables, swapchain_img_count);
+    init_archetype(&scene->lights, swapchain_img_count);
+    scene->camera = header->camera;
+
+    // Strings
+    auto strings = (char const *)get_snapshot_array(&mf, header->strings, 1);
+    scene->strings = (char *)malloc(header->strings.count);
+    memcpy(scene->strings, strings, header->strings.count);
+    u32 strings_size = header->strings.count;
+
+    // Asset Tables
+    struct mesh *mesh_table[MAX_MESHES] = {};
+    auto mesh_names = (u32 const *)get_snapshot_array(&mf, header->meshes, sizeof(u32));
+    for (u32 i = 0; i < header->meshes.count; ++i)
+        mesh_table[i] = mesh_names[i] < strings_size ? find_snapshot_asset(meshes, scene->strings + mesh_names[i]) : NULL;
+    struct vtk_descriptor_set *texture_table[MAX_TEXTURES] = {};
+    auto texture_names = (u32 const *)get_snapshot_array(&mf, header->textures, sizeof(u32));
+    for (u32 i = 0; i < header->textures.count; ++i)
+        texture_table[i] = texture_names[i] < strings_size ? find_snapshot_asset(textures, scene->strings + texture_names[i]) : NULL;
+
+    // Materials
+    auto materials = (struct snapshot_material const *)get_snapshot_array(&mf, header->materials, sizeof(struct snapshot_material));
+    for (u32 i = 0; i < header->materials.count; ++i) {
+        struct material *m = push_material(scene, materials[i].name < strings_size ? scene->strings + materials[i].name : NULL);
+        *m->ubo = materials[i].ubo;
+    }
+
+    // Renderables
+    auto chunks = (struct snapshot_renderable_chunk const *)get_snapshot_array(&mf, header->renderable_chunks,
+                                                                                sizeof(struct snapshot_renderable_chunk));
+    struct archetype<struct renderable_components> *renderables = &scene->renderables;
+    u32 remaining = header->renderable_count;
+    for (u32 c = 0; remaining > 0; ++c) {
+        struct snapshot_renderable_chunk const *src = chunks + c;
+        struct transform_chunk *transforms = push_chunk(&renderables->transforms.chunks);
+        struct renderable_components *components = push_chunk(&renderables->components);
+        memcpy(transforms, src->transforms, SNAPSHOT_TRANSFORM_BYTES);
+        u32 count = remaining < CHUNK_SIZE ? remaining : CHUNK_SIZE;
+        memset(transforms->dirty, renderables->transforms.all_dirty, count);
+        for (u32 i = 0; i < count; ++i) {
+            u32 idx = c * CHUNK_SIZE + i;
+            components->name[i] = src->name[i] < strings_size ? scene->strings + src->name[i] : NULL;
+            components->mesh[i] = src->mesh[i] < header->meshes.count ? mesh_table[src->mesh[i]] : NULL;
+            components->texture_desc_set[i] = src->texture[i] < header->textures.count ? texture_table[src->texture[i]] : NULL;
+            components->material[i] = src->material[i] < scene->materials.count ? scene->materials.data + src->material[i] : NULL;
+            components->occluder[i] = src->occluder[i];
+            components->render_flags[i] = src->render_flags[i];
+            components->record[i] = alloc_record(scene, ARCHETYPE_RENDERABLE, idx).record;
         }
-        ImGui::EndCombo();
+        renderables->transforms.count += count;
+        remaining -= count;
     }
-    ImGui::PopItemWidth();
+    ++renderables->version;
+
+    // Lights
+    auto lights = (struct snapshot_light const *)get_snapshot_array(&mf, header->lights, sizeof(struct snapshot_light));
+    for (u32 i = 0; i < header->lights.count; ++i) {
+        struct transform trans = lights[i].transform;
+        u32 idx = get_entity_idx(scene, spawn_light(scene, trans), ARCHETYPE_LIGHT);
+        *get_light_ubo(scene, idx) = lights[i].ubo;
+        *get_light_attenuation_index(scene, idx) = lights[i].attenuation_index < CTK_ARRAY_COUNT(LIGHT_ATTENUATION_CONSTS)
+                                                   ? lights[i].attenuation_index
+                                                   : 0;
+    }
+
+    unmap_file(&mf);
+    return scene;
 }
 
-static void draw_ui(struct ui *ui, struct scene *scene, struct window *win) {
-    ImGui_ImplVulkan_NewFrame();
-    ImGui_ImplGlfw_NewFrame();
-    ImGui::NewFrame();
+////////////////////////////////////////////////////////////
+/// BVH
+////////////////////////////////////////////////////////////
+static u32 const BVH_BIN_COUNT = 16;
+static u32 const BVH_MAX_LEAF_SIZE = 4;
+static f32 const BVH_REBUILD_FACTOR = 1.5f;
+
+struct bvh_ref {
+    f32 min[3];
+    f32 max[3];
+    f32 center[3];
+};
 
-    s32 window_flags = ImGuiWindowFlags_NoCollapse | ImGuiWindowFlags_NoMove/* | ImGuiWindowFlags_NoResize*/;
-    if (window_begin("states", 0, 0, 600, (s32)win->height, window_flags)) {
-        ImGui::Columns(2, NULL);
+struct bvh_bin {
+    f32 min[3];
+    f32 max[3];
+    u32 count;
+};
 
-        static cstr UI_MODES[] = { "entities", "lights", "materials" };
-        enum_dropdown("ui_modes", UI_MODES, CTK_ARRAY_COUNT(UI_MODES), &ui->mode);
+static void reset_bounds(f32 *min, f32 *max) {
+    for (u32 i = 0; i < 3; ++i) {
+        min[i] = FLT_MAX;
+        max[i] = -FLT_MAX;
+    }
+}
 
-        if (ui->mode == UI_MODE_ENTITY) {
-            if (list_box_begin("0", NULL, scene->entities.count)) {
-                for (u32 i = 0; i < scene->entities.count; ++i) {
-                    cstr entity_name = scene->entities[i].name;
-                    char name[64] = {};
-                    if (entity_name != NULL)
-                        strcpy(name, entity_name);
-                    else
-                        sprintf(name, "entity %u", i);
-                    if (ImGui::Selectable(name, i == ui->entity_idx))
-                        ui->entity_idx = i;
+static void grow_bounds(f32 *min, f32 *max, f32 const *other_min, f32 const *other_max) {
+    for (u32 i = 0; i < 3; ++i) {
+        min[i] = other_min[i] < min[i] ? other_min[i] : min[i];
+        max[i] = other_max[i] > max[i] ? other_max[i] : max[i];
+    }
+}
+
+static f32 surface_area(f32 const *min, f32 const *max) {
+    f32 dx = max[0] - min[0];
+    f32 dy = max[1] - min[1];
+    f32 dz = max[2] - min[2];
+    return dx < 0 ? 0 : 2 * (dx * dy + dy * dz + dz * dx);
+}
+
+static void get_entity_bounds(struct scene *s, u32 idx, f32 *min, f32 *max) {
+    struct renderable_components *components = chunk_at(&s->renderables.components, idx);
+    u32 i = idx % CHUNK_SIZE;
+    for (u32 axis = 0; axis < 3; ++axis) {
+        min[axis] = components->bounds_center[axis][i] - components->bounds_extent[axis][i];
+        max[axis] = components->bounds_center[axis][i] + components->bounds_extent[axis][i];
+    }
+}
+
+static void reserve_bvh(struct bvh *bvh, u32 capacity) {
+    if (bvh->capacity >= capacity)
+        return;
+    bvh->capacity = capacity;
+    bvh->nodes = (struct bvh_node *)realloc(bvh->nodes, capacity * 2 * sizeof(struct bvh_node));
+    bvh->entities = (u32 *)realloc(bvh->entities, capacity * sizeof(u32));
+    bvh->leaf_of = (u32 *)realloc(bvh->leaf_of, capacity * sizeof(u32));
+    bvh->stale = (u8 *)realloc(bvh->stale, capacity * 2);
+    bvh->stale_nodes = (u32 *)realloc(bvh->stale_nodes, capacity * 2 * sizeof(u32));
+    memset(bvh->stale, 0, capacity * 2);
+}
+
+static void destroy_bvh(struct bvh *bvh) {
+    free(bvh->nodes);
+    free(bvh->entities);
+    free(bvh->leaf_of);
+    free(bvh->stale);
+    free(bvh->stale_nodes);
+    *bvh = {};
+}
+
+// Bins the node's entities by centroid along the axis the centroids spread furthest on, and picks the cheapest of the BVH_BIN_COUNT - 1
+// candidate splits under the surface area heuristic. Returns false when every centroid coincides.
+static bool find_sah_split(struct bvh_ref const *refs, struct bvh_node const *node, f32 const *centroid_min, f32 const *centroid_max,
+                           u32 *split_axis, f32 *split_pos) {
+    u32 axis = 0;
+    for (u32 i = 1; i < 3; ++i)
+        if (centroid_max[i] - centroid_min[i] > centroid_max[axis] - centroid_min[axis])
+            axis = i;
+    f32 extent = centroid_max[axis] - centroid_min[axis];
+    if (extent <= 0)
+        return false;
+
+    struct bvh_bin bins[BVH_BIN_COUNT];
+    for (u32 b = 0; b < BVH_BIN_COUNT; ++b) {
+        reset_bounds(bins[b].min, bins[b].max);
+        bins[b].count = 0;
+    }
+    f32 scale = BVH_BIN_COUNT / extent;
+    for (u32 i = node->first; i < node->first + node->count; ++i) {
+        struct bvh_ref const *ref = refs + i;
+        u32 b = (u32)((ref->center[axis] - centroid_min[axis]) * scale);
+        b = b < BVH_BIN_COUNT - 1 ? b : BVH_BIN_COUNT - 1;
+        grow_bounds(bins[b].min, bins[b].max, ref->min, ref->max);
+        ++bins[b].count;
+    }
+
+    // Areas and counts left of each split, swept from the left; the right side is swept on the way back.
+    f32 left_area[BVH_BIN_COUNT - 1];
+    u32 left_count[BVH_BIN_COUNT - 1];
+    f32 min[3];
+    f32 max[3];
+    reset_bounds(min, max);
+    u32 count = 0;
+    for (u32 b = 0; b < BVH_BIN_COUNT - 1; ++b) {
+        grow_bounds(min, max, bins[b].min, bins[b].max);
+        count += bins[b].count;
+        left_area[b] = surface_area(min, max);
+        left_count[b] = count;
+    }
+    f32 best_cost = FLT_MAX;
+    reset_bounds(min, max);
+    count = 0;
+    for (u32 b = BVH_BIN_COUNT - 1; b > 0; --b) {
+        grow_bounds(min, max, bins[b].min, bins[b].max);
+        count += bins[b].count;
+        f32 cost = left_area[b - 1] * left_count[b - 1] + surface_area(min, max) * count;
+        if (left_count[b - 1] > 0 && count > 0 && cost < best_cost) {
+            best_cost = cost;
+            *split_axis = axis;
+            *split_pos = centroid_min[axis] + b / scale;
+        }
+    }
+    return best_cost != FLT_MAX;
+}
+
+// Fits the node's bounds around its entities, along with the bounds of their centroids.
+static void fit_node(struct bvh_ref const *refs, struct bvh_node *node, f32 *centroid_min, f32 *centroid_max) {
+    reset_bounds(node->min, node->max);
+    reset_bounds(centroid_min, centroid_max);
+    for (u32 i = node->first; i < node->first + node->count; ++i) {
+        grow_bounds(node->min, node->max, refs[i].min, refs[i].max);
+        grow_bounds(centroid_min, centroid_max, refs[i].center, refs[i].center);
+    }
+}
+
+// Nodes are split in creation order, so every parent comes before its children and refitting can walk parents after children by
+// sorting on index.
+static void build_bvh(struct scene *s) {
+    struct bvh *bvh = &s->bvh;
+    struct archetype<struct renderable_components> *renderables = &s->renderables;
+    u32 count = renderables->transforms.count;
+    reserve_bvh(bvh, count);
+    bvh->version = renderables->version;
+    bvh->node_count = 0;
+    bvh->entity_count = 0;
+    bvh->cost = 0;
+    ++bvh->rebuild_count;
+
+    // Refs are kept parallel to bvh.entities and partitioned along with them, so splitting walks memory linearly.
+    auto refs = (struct bvh_ref *)malloc(count * sizeof(struct bvh_ref));
+    for (u32 i = 0; i < count; ++i) {
+        bvh->leaf_of[i] = BVH_NO_NODE;
+        if (chunk_at(&renderables->components, i)->mesh[i % CHUNK_SIZE] == NULL)
+            continue;
+        struct bvh_ref *ref = refs + bvh->entity_count;
+        get_entity_bounds(s, i, ref->min, ref->max);
+        for (u32 axis = 0; axis < 3; ++axis)
+            ref->center[axis] = (ref->min[axis] + ref->max[axis]) * 0.5f;
+        bvh->entities[bvh->entity_count++] = i;
+    }
+
+    if (bvh->entity_count > 0) {
+        struct bvh_node *root = bvh->nodes + bvh->node_count++;
+        root->parent = BVH_NO_NODE;
+        root->first = 0;
+        root->count = bvh->entity_count;
+    }
+    for (u32 n = 0; n < bvh->node_count; ++n) {
+        struct bvh_node *node = bvh->nodes + n;
+        f32 centroid_min[3];
+        f32 centroid_max[3];
+        fit_node(refs, node, centroid_min, centroid_max);
+        bvh->cost += surface_area(node->min, node->max);
+        node->left = 0;
+        if (node->count <= BVH_MAX_LEAF_SIZE) {
+            for (u32 i = node->first; i < node->first + node->count; ++i)
+                bvh->leaf_of[bvh->entities[i]] = n;
+            continue;
+        }
+
+        // Partition the node's entities around the split. Falls back to halving by count when centroids coincide or the split doesn't
+        // separate anything.
+        u32 axis = 0;
+        f32 pos = 0;
+        u32 mid = node->first;
+        if (find_sah_split(refs, node, centroid_min, centroid_max, &axis, &pos)) {
+            u32 last = node->first + node->count;
+            while (mid < last) {
+                if (refs[mid].center[axis] < pos) {
+                    ++mid;
+                } else {
+                    --last;
+                    u32 tmp_entity = bvh->entities[mid];
+                    bvh->entities[mid] = bvh->entities[last];
+                    bvh->entities[last] = tmp_entity;
+                    struct bvh_ref tmp_ref = refs[mid];
+                    refs[mid] = refs[last];
+                    refs[last] = tmp_ref;
                 }
             }
-            list_box_end();
-        } else if (ui->mode == UI_MODE_LIGHT) {
-            if (list_box_begin("1", NULL, scene->lights.count)) {
-                for (u32 i = 0; i < scene->lights.count; ++i) {
-                    char name[16] = {};
-                    sprintf(name, "light %u", i);
-                    if (ImGui::Selectable(name, i == ui->light_idx))
-                        ui->light_idx = i;
+        }
+        if (mid == node->first || mid == node->first + node->count)
+            mid = node->first + node->count / 2;
+
+        node->left = bvh->node_count;
+        struct bvh_node *left = bvh->nodes + bvh->node_count++;
+        struct bvh_node *right = bvh->nodes + bvh->node_count++;
+        left->parent = n;
+        left->first = node->first;
+        left->count = mid - node->first;
+        right->parent = n;
+        right->first = mid;
+        right->count = node->first + node->count - mid;
+    }
+    bvh->build_cost = bvh->cost;
+    free(refs);
+}
+
+static s32 compare_descending(void const *a, void const *b) {
+    u32 lhs = *(u32 const *)a;
+    u32 rhs = *(u32 const *)b;
+    return lhs < rhs ? 1 : lhs > rhs ? -1 : 0;
+}
+
+// Refits the leaves of entities whose bounds moved and their ancestors, children before parents.
+static void refit_bvh(struct scene *s) {
+    struct bvh *bvh = &s->bvh;
+    struct archetype<struct renderable_components> *renderables = &s->renderables;
+    u32 stale_count = 0;
+    for (u32 c = 0; c < renderables->components.count; ++c) {
+        struct renderable_components *components = renderables->components.data[c];
+        u32 entity_count = chunk_transform_count(&renderables->transforms, c);
+        for (u32 i = 0; i < entity_count; ++i) {
+            if (!components->bounds_moved[i])
+                continue;
+            for (u32 n = bvh->leaf_of[c * CHUNK_SIZE + i]; n != BVH_NO_NODE && !bvh->stale[n]; n = bvh->nodes[n].parent) {
+                bvh->stale[n] = 1;
+                bvh->stale_nodes[stale_count++] = n;
+            }
+        }
+    }
+    qsort(bvh->stale_nodes, stale_count, sizeof(u32), compare_descending);
+    for (u32 i = 0; i < stale_count; ++i) {
+        u32 n = bvh->stale_nodes[i];
+        struct bvh_node *node = bvh->nodes + n;
+        bvh->cost -= surface_area(node->min, node->max);
+        reset_bounds(node->min, node->max);
+        if (node->left == 0) {
+            for (u32 e = node->first; e < node->first + node->count; ++e) {
+                f32 min[3];
+                f32 max[3];
+                get_entity_bounds(s, bvh->entities[e], min, max);
+                grow_bounds(node->min, node->max, min, max);
+            }
+        } else {
+            grow_bounds(node->min, node->max, bvh->nodes[node->left].min, bvh->nodes[node->left].max);
+            grow_bounds(node->min, node->max, bvh->nodes[node->left + 1].min, bvh->nodes[node->left + 1].max);
+        }
+        bvh->cost += surface_area(node->min, node->max);
+        bvh->stale[n] = 0;
+    }
+}
+
+// Expects the renderables' bounds to be up to date (see update_bounds()).
+static void update_bvh(struct scene *s) {
+    struct bvh *bvh = &s->bvh;
+    if (bvh->version != s->renderables.version) {
+        build_bvh(s);
+        return;
+    }
+    refit_bvh(s);
+    if (bvh->cost > bvh->build_cost * BVH_REBUILD_FACTOR)
+        build_bvh(s);
+}
+
+// Next node in depth-first order once n's subtree is done, or BVH_NO_NODE when the whole tree is. Walking up through parents keeps
+// traversal stackless.
+static u32 bvh_skip(struct bvh *bvh, u32 n) {
+    while (n != 0) {
+        u32 parent = bvh->nodes[n].parent;
+        if (n == bvh->nodes[parent].left)
+            return n + 1;
+        n = parent;
+    }
+    return BVH_NO_NODE;
+}
+
+// -1 when the box is outside the frustum, 1 when fully inside, 0 when it straddles a plane.
+static s32 classify_box(struct frustum const *frustum, f32 const *center, f32 const *extent) {
+    s32 result = 1;
+    for (u32 p = 0; p < 6; ++p) {
+        f32 const *plane = frustum->planes[p];
+        f32 dist = plane[0] * center[0] + plane[1] * center[1] + plane[2] * center[2] + plane[3];
+        f32 reach = fabsf(plane[0]) * extent[0] + fabsf(plane[1]) * extent[1] + fabsf(plane[2]) * extent[2];
+        if (dist + reach < 0)
+            return -1;
+        if (dist - reach < 0)
+            result = 0;
+    }
+    return result;
+}
+
+// Squared distances from point to the nearest and furthest points of the box.
+static void box_distances_sq(f32 const *min, f32 const *max, f32 const *point, f32 *near_sq, f32 *far_sq) {
+    *near_sq = 0;
+    *far_sq = 0;
+    for (u32 axis = 0; axis < 3; ++axis) {
+        f32 to_min = point[axis] - min[axis];
+        f32 to_max = max[axis] - point[axis];
+        f32 nearest = to_min < 0 ? -to_min : to_max < 0 ? -to_max : 0;
+        f32 furthest = to_min > to_max ? to_min : to_max;
+        *near_sq += nearest * nearest;
+        *far_sq += furthest * furthest;
+    }
+}
+
+// Appends every entity whose bounds intersect the frustum to out (when not NULL) and returns how many there were. Subtrees entirely
+// inside are appended without testing their entities.
+static u32 bvh_query_frustum(struct scene *s, struct frustum const *frustum, u32 *out) {
+    struct bvh *bvh = &s->bvh;
+    u32 count = 0;
+    for (u32 n = bvh->node_count > 0 ? 0 : BVH_NO_NODE; n != BVH_NO_NODE;) {
+        struct bvh_node *node = bvh->nodes + n;
+        f32 center[3];
+        f32 extent[3];
+        for (u32 axis = 0; axis < 3; ++axis) {
+            center[axis] = (node->min[axis] + node->max[axis]) * 0.5f;
+            extent[axis] = (node->max[axis] - node->min[axis]) * 0.5f;
+        }
+        s32 side = classify_box(frustum, center, extent);
+        if (side == 0 && node->left != 0) {
+            n = node->left;
+            continue;
+        }
+        if (side > 0) {
+            if (out != NULL)
+                memcpy(out + count, bvh->entities + node->first, node->count * sizeof(u32));
+            count += node->count;
+        } else if (side == 0) {
+            for (u32 i = node->first; i < node->first + node->count; ++i) {
+                u32 e = bvh->entities[i];
+                struct renderable_components *components = chunk_at(&s->renderables.components, e);
+                f32 entity_center[] = { components->bounds_center[0][e % CHUNK_SIZE], components->bounds_center[1][e % CHUNK_SIZE], components->bounds_center[2][e % CHUNK_SIZE] };
+                f32 entity_extent[] = { components->bounds_extent[0][e % CHUNK_SIZE], components->bounds_extent[1][e % CHUNK_SIZE], components->bounds_extent[2][e % CHUNK_SIZE] };
+                if (classify_box(frustum, entity_center, entity_extent) >= 0) {
+                    if (out != NULL)
+                        out[count] = e;
+                    ++count;
                 }
             }
-            list_box_end();
-        } else if (ui->mode == UI_MODE_MATERIAL) {
-            if (list_box_begin("2", NULL, scene->materials.count)) {
-                for (u32 i = 0; i < scene->materials.count; ++i) {
-                    cstr mat_name = scene->materials[i].name;
-                    char name[64] = {};
-                    if (mat_name != NULL)
-                        strcpy(name, mat_name);
-                    else
-                        sprintf(name, "material %u", i);
-                    if (ImGui::Selectable(name, i == ui->material_idx))
-                        ui->material_idx = i;
+        }
+        n = bvh_skip(bvh, n);
+    }
+    return count;
+}
+
+// Same as bvh_query_frustum(), for entities whose bounds intersect a sphere.
+static u32 bvh_query_sphere(struct scene *s, f32 const *center, f32 radius, u32 *out) {
+    struct bvh *bvh = &s->bvh;
+    f32 radius_sq = radius * radius;
+    u32 count = 0;
+    for (u32 n = bvh->node_count > 0 ? 0 : BVH_NO_NODE; n != BVH_NO_NODE;) {
+        struct bvh_node *node = bvh->nodes + n;
+        f32 near_sq = 0;
+        f32 far_sq = 0;
+        box_distances_sq(node->min, node->max, center, &near_sq, &far_sq);
+        bool inside = far_sq <= radius_sq;
+        if (near_sq <= radius_sq && !inside && node->left != 0) {
+            n = node->left;
+            continue;
+        }
+        if (inside) {
+            if (out != NULL)
+                memcpy(out + count, bvh->entities + node->first, node->count * sizeof(u32));
+            count += node->count;
+        } else if (near_sq <= radius_sq) {
+            for (u32 i = node->first; i < node->first + node->count; ++i) {
+                f32 min[3];
+                f32 max[3];
+                get_entity_bounds(s, bvh->entities[i], min, max);
+                box_distances_sq(min, max, center, &near_sq, &far_sq);
+                if (near_sq <= radius_sq) {
+                    if (out != NULL)
+                        out[count] = bvh->entities[i];
+                    ++count;
                 }
             }
-            list_box_end();
         }
+        n = bvh_skip(bvh, n);
+    }
+    return count;
+}
 
-        ImGui::NextColumn();
-        if (ui->mode == UI_MODE_ENTITY) {
-            struct entity *entity = scene->entities + ui->entity_idx;
-            transform_control(entity->transform);
-        } else if (ui->mode == UI_MODE_LIGHT) {
-            struct light *light = scene->lights + ui->light_idx;
-            struct light_ubo *ubo = scene->light.ubos + ui->light_idx;
-            transform_control(scene->light.transforms + ui->light_idx);
+// Distance along the ray to where it enters the box, or FLT_MAX on a miss. inv_dir is 1 / dir per axis.
+static f32 intersect_box(f32 const *min, f32 const *max, f32 const *origin, f32 const *inv_dir) {
+    f32 t_enter = 0;
+    f32 t_exit = FLT_MAX;
+    for (u32 axis = 0; axis < 3; ++axis) {
+        f32 t0 = (min[axis] - origin[axis]) * inv_dir[axis];
+        f32 t1 = (max[axis] - origin[axis]) * inv_dir[axis];
+        if (t0 > t1) {
+            f32 tmp = t0;
+            t0 = t1;
+            t1 = tmp;
+        }
+        t_enter = t0 > t_enter ? t0 : t_enter;
+        t_exit = t1 < t_exit ? t1 : t_exit;
+    }
+    return t_enter <= t_exit ? t_enter : FLT_MAX;
+}
 
-            static cstr LIGHT_MODES[] = { "directional", "point" };
-            enum_dropdown("light_modes", LIGHT_MODES, CTK_ARRAY_COUNT(LIGHT_MODES), &ubo->mode);
-            ImGui::InputInt("depth_bias", &ubo->depth_bias);
-            ImGui::InputInt("normal_bias", &ubo->normal_bias);
-            ImGui::SliderInt("attenuation_index", (s32*)&light->attenuation_index, 0, CTK_ARRAY_COUNT(LIGHT_ATTENUATION_CONSTS) - 1);
-            ImGui::SliderFloat("ambient", &light->ubo->ambient, 0, 1, "%.2f");
-            ImGui::ColorPicker4("##color", &ubo->color.x);
-        } else if (ui->mode == UI_MODE_MATERIAL) {
-            struct material *mat = scene->materials + ui->material_idx;
-            ImGui::SliderInt("shine_exponent", (s32 *)&mat->ubo->shine_exponent, 1, 256);
+// Returns the entity whose bounds the ray enters first, or CTK_U32_MAX, writing the hit distance to t. Subtrees entered beyond the
+// closest hit so far are skipped.
+static u32 bvh_raycast(struct scene *s, f32 const *origin, f32 const *dir, f32 *t) {
+    struct bvh *bvh = &s->bvh;
+    f32 inv_dir[3];
+    for (u32 axis = 0; axis < 3; ++axis)
+        inv_dir[axis] = dir[axis] != 0 ? 1 / dir[axis] : FLT_MAX;
+    u32 hit = CTK_U32_MAX;
+    *t = FLT_MAX;
+    for (u32 n = bvh->node_count > 0 ? 0 : BVH_NO_NODE; n != BVH_NO_NODE;) {
+        struct bvh_node *node = bvh->nodes + n;
+        if (intersect_box(node->min, node->max, origin, inv_dir) >= *t) {
+            n = bvh_skip(bvh, n);
+        } else if (node->left != 0) {
+            n = node->left;
+        } else {
+            for (u32 i = node->first; i < node->first + node->count; ++i) {
+                f32 min[3];
+                f32 max[3];
+                get_entity_bounds(s, bvh->entities[i], min, max);
+                f32 entity_t = intersect_box(min, max, origin, inv_dir);
+                if (entity_t < *t) {
+                    *t = entity_t;
+                    hit = bvh->entities[i];
+                }
+            }
+            n = bvh_skip(bvh, n);
         }
     }
-    window_end();
+    return hit;
+}
+
+// Refreshes the renderables' world bounds and the BVH over them. Runs after world matrices are composed.
+static void update_bounds(struct scene *scene, struct job_system *jobs) {
+    u32 chunk_count = (scene->renderables.transforms.count + CHUNK_SIZE - 1) / CHUNK_SIZE;
+    parallel_for(jobs, chunk_count, 1, update_bounds_chunks, &scene->renderables);
+    update_bvh(scene);
 }
 
 ////////////////////////////////////////////////////////////
-/// Controls
+/// Draw Lists
 ////////////////////////////////////////////////////////////
-static void update_mouse_state(struct window *window) {
-    // Mouse Delta
-    struct ctk_v2<f64> prev_mouse_position = window->mouse_position;
-    f64 curr_mouse_x = 0.0;
-    f64 curr_mouse_y = 0.0;
-    glfwGetCursorPos(window->handle, &curr_mouse_x, &curr_mouse_y);
-    window->mouse_position = { curr_mouse_x, curr_mouse_y };
+static void reserve_draw_list(struct draw_list *list, u32 chunk_count) {
+    if (list->chunk_capacity >= chunk_count)
+        return;
+    list->chunk_capacity = chunk_count;
+    list->draws = (struct draw *)realloc(list->draws, chunk_count * CHUNK_SIZE * sizeof(struct draw));
+    list->sort_scratch = (struct draw *)realloc(list->sort_scratch, chunk_count * CHUNK_SIZE * sizeof(struct draw));
+    list->visible = (u32 *)realloc(list->visible, chunk_count * CHUNK_SIZE * sizeof(u32));
+    list->batches = (struct draw_batch *)realloc(list->batches, chunk_count * CHUNK_SIZE * sizeof(struct draw_batch));
+    list->chunk_counts = (u32 *)realloc(list->chunk_counts, chunk_count * sizeof(u32));
+}
 
-    // Calculate delta if previous position was not unset.
-    if (prev_mouse_position != UNSET_MOUSE_POSITION)
-        window->mouse_delta = window->mouse_position - prev_mouse_position;
+static void pack_draw_list(struct draw_list *list, u32 chunk_count) {
+    list->count = 0;
+    for (u32 c = 0; c < chunk_count; ++c) {
+        u32 count = list->chunk_counts[c];
+        if (list->count != c * CHUNK_SIZE)
+            memmove(list->draws + list->count, list->draws + c * CHUNK_SIZE, count * sizeof(struct draw));
+        list->count += count;
+    }
 }
 
-static void local_translate(struct transform *transform, struct ctk_v3<f32> translation) {
-    struct ctk_v3<f32> *pos = &transform->position;
-    struct ctk_v3<f32> *rot = &transform->rotation;
+static void destroy_draw_list(struct draw_list *list) {
+    free(list->draws);
+    free(list->sort_scratch);
+    free(list->chunk_counts);
+    free(list->visible);
+    free(list->batches);
+    free(list->occlusion_depth);
+    free(list->occluder_verts);
+    *list = {};
+}
+
+static void destroy_draw_lists(struct draw_lists *lists) {
+    destroy_draw_list(&lists->direct);
+    destroy_draw_list(&lists->transparent);
+    for (u32 i = 0; i < 6; ++i)
+        destroy_draw_list(lists->shadow + i);
+    free(lists->chunk_drawables);
+    *lists = {};
+}
 
-    glm::mat4 world_mtx(1.0f);
-    world_mtx = glm::rotate(world_mtx, glm::radians(rot->x), { 1.0f, 0.0f, 0.0f });
-    world_mtx = glm::rotate(world_mtx, glm::radians(rot->y), { 0.0f, 1.0f, 0.0f });
-    world_mtx = glm::rotate(world_mtx, glm::radians(rot->z), { 0.0f, 0.0f, 1.0f });
-    world_mtx = glm::translate(world_mtx, { pos->x, pos->y, pos->z });
+struct draw_list_job {
+    struct draw_lists *lists;
+    struct scene *scene;
+    struct cull_view views[VIEW_COUNT];
+    u32 view_count; // Views with queues to build.
+};
 
-    struct ctk_v3<f32> right = {};
-    right.x = world_mtx[0][0];
-    right.y = world_mtx[1][0];
-    right.z = world_mtx[2][0];
+static struct draw_list *get_view_draw_list(struct draw_lists *lists, u32 view_idx) {
+    return view_idx == 0 ? &lists->direct : lists->shadow + view_idx - 1;
+}
+
+// The camera draws visible renderables, split into opaque and transparent queues; shadow passes draw casters whether visible or not.
+// gpu_cull.comp applies the same rules to the queues it builds.
+static struct draw_list *get_render_queue(struct draw_lists *lists, u32 view_idx, u8 render_flags) {
+    if (view_idx != 0)
+        return render_flags & RENDER_FLAG_CASTS_SHADOW ? get_view_draw_list(lists, view_idx) : NULL;
+    if (!(render_flags & RENDER_FLAG_VISIBLE))
+        return NULL;
+    if (render_flags & RENDER_FLAG_TRANSPARENT)
+        return &lists->transparent;
+    return lists->gpu_driven ? NULL : &lists->direct;
+}
+
+// Shadow views follow shadow.vert: the first light's six cube-face matrices, or its single matrix for every pass when directional.
+static glm::mat4 get_view_space_mtx(struct scene *scene, u32 view_idx) {
+    if (view_idx == 0)
+        return camera_view_space_mtx(&scene->camera);
+    struct light_ubo *light = get_light_ubo(scene, 0);
+    return light->view_mtxs[light->mode == LIGHT_MODE_DIRECTIONAL ? 0 : view_idx - 1];
+}
+
+// Pipelines as numbered in sort keys.
+enum {
+    SORT_PIPELINE_DIRECT,
+    SORT_PIPELINE_TRANSPARENT,
+    SORT_PIPELINE_SHADOW,
+};
+
+template<typename type>
+static u64 get_sort_index(type const *assets, type const *asset) {
+    return assets != NULL && asset != NULL ? (u64)(asset - assets) & 0xFF : 0;
+}
+
+// Draws are sorted by a 64-bit key, most significant field first:
+//   opaque and shadow queues: pass:4 | pipeline:4 | texture:8 | mesh:8 | unused:24 | depth:16
+//   transparent queue:        pass:4 | pipeline:4 | inverted depth:32 | texture:8 | mesh:8 | unused:8
+// Opaque draws sharing state end up together and front to back within it; transparent draws go back to front, with state only breaking
+// ties. Depth is the squared distance from the view's eye to the renderable's bounds, whose bits order like the float since it's never
+// negative. Opaque keys only keep its top 16 bits, which is plenty for front to back and saves the sort two passes. Shadow passes don't
+// bind textures, so their keys leave the texture out.
+static u64 get_sort_key(struct draw_lists *lists, struct draw_list *queue, struct cull_view *view, struct renderable_components *components,
+                        u32 idx) {
+    f32 dx = components->bounds_center[0][idx] - view->eye[0];
+    f32 dy = components->bounds_center[1][idx] - view->eye[1];
+    f32 dz = components->bounds_center[2][idx] - view->eye[2];
+    f32 dist_sq = dx * dx + dy * dy + dz * dz;
+    u32 depth = 0;
+    memcpy(&depth, &dist_sq, sizeof(u32));
+    u64 texture = get_sort_index(lists->textures, components->texture_desc_set[idx]);
+    u64 mesh = get_sort_index(lists->meshes, components->mesh[idx]);
+    if (queue == &lists->direct)
+        return (u64)SORT_PIPELINE_DIRECT << 56 | texture << 48 | mesh << 40 | depth >> 16;
+    if (queue == &lists->transparent)
+        return (u64)1 << 60 | (u64)SORT_PIPELINE_TRANSPARENT << 56 | (u64)~depth << 24 | texture << 16 | mesh << 8;
+    return (u64)(2 + (queue - lists->shadow)) << 60 | (u64)SORT_PIPELINE_SHADOW << 56 | mesh << 40 | depth >> 16;
+}
+
+// Renderables without a mesh (e.g. parents that only group their children) aren't drawn. CHUNK_SIZE is a multiple of SIMD_WIDTH, so the
+// last group of lanes may read past the chunk's count but never past the chunk; those lanes are skipped.
+static void build_chunk_draw_lists(void *data, u32 first, u32 count) {
+    auto job = (struct draw_list_job *)data;
+    struct archetype<struct renderable_components> *renderables = &job->scene->renderables;
+    for (u32 c = first; c < first + count; ++c) {
+        struct renderable_components *components = renderables->components.data[c];
+        u32 entity_count = chunk_transform_count(&renderables->transforms, c);
+        u32 drawable_count = 0;
+        for (u32 i = 0; i < entity_count; ++i)
+            drawable_count += components->mesh[i] != NULL;
+        job->lists->chunk_drawables[c] = drawable_count;
+
+        job->lists->transparent.chunk_counts[c] = 0;
+        for (u32 v = 0; v < VIEW_COUNT; ++v)
+            get_view_draw_list(job->lists, v)->chunk_counts[c] = 0;
+        for (u32 v = 0; v < job->view_count; ++v) {
+            struct cull_view *view = job->views + v;
+            for (u32 base = 0; base < entity_count; base += SIMD_WIDTH) {
+                u32 visible = view->frustum_enabled || view->tiny_enabled || view->range_enabled ? cull_lanes(view, components, base)
+                                                                                                 : (1u << SIMD_WIDTH) - 1;
+                for (u32 lane = 0; lane < SIMD_WIDTH; ++lane) {
+                    u32 i = base + lane;
+                    if (i >= entity_count || !(visible & (1u << lane)) || components->mesh[i] == NULL)
+                        continue;
+                    struct draw_list *queue = get_render_queue(job->lists, v, components->render_flags[i]);
+                    if (queue != NULL) {
+                        queue->draws[c * CHUNK_SIZE + queue->chunk_counts[c]++] = {
+                            get_sort_key(job->lists, queue, view, components, i), components->mesh[i], components->texture_desc_set[i], c, i
+                        };
+                    }
+                }
+            }
+        }
+    }
+}
+
+// BVH path: one view per job. The BVH only holds renderables with a mesh.
+static void build_view_draw_lists(void *data, u32 first, u32 count) {
+    auto job = (struct draw_list_job *)data;
+    struct scene *scene = job->scene;
+    for (u32 v = first; v < first + count; ++v) {
+        struct cull_view *view = job->views + v;
+        struct draw_list *list = get_view_draw_list(job->lists, v);
+        u32 visible_count = scene->bvh.entity_count;
+        if (view->frustum_enabled)
+            visible_count = bvh_query_frustum(scene, &view->frustum, list->visible);
+        else
+            memcpy(list->visible, scene->bvh.entities, visible_count * sizeof(u32));
+
+        list->count = 0;
+        if (v == 0)
+            job->lists->transparent.count = 0;
+        for (u32 i = 0; i < visible_count; ++i) {
+            u32 e = list->visible[i];
+            struct renderable_components *components = chunk_at(&scene->renderables.components, e);
+            if (view->tiny_enabled && is_tiny(view, components, e % CHUNK_SIZE))
+                continue;
+            if (view->range_enabled && is_out_of_range(view, components, e % CHUNK_SIZE))
+                continue;
+            u32 idx = e % CHUNK_SIZE;
+            struct draw_list *queue = get_render_queue(job->lists, v, components->render_flags[idx]);
+            if (queue != NULL) {
+                queue->draws[queue->count++] = {
+                    get_sort_key(job->lists, queue, view, components, idx), components->mesh[idx], components->texture_desc_set[idx],
+                    e / CHUNK_SIZE, idx
+                };
+            }
+        }
+    }
+}
+
+// LSD radix sort of the list's draws by sort key, a byte per pass. Bytes every key shares (the pass and pipeline, the unused bits, and often
+// the texture) don't change the order, so their passes are skipped.
+static void radix_sort_draws(struct draw_list *list) {
+    if (list->count < 2)
+        return;
+    u32 histograms[8][256] = {};
+    for (u32 i = 0; i < list->count; ++i) {
+        u64 key = list->draws[i].sort_key;
+        for (u32 b = 0; b < 8; ++b)
+            ++histograms[b][(key >> (b * 8)) & 0xFF];
+    }
+    struct draw *src = list->draws;
+    struct draw *dst = list->sort_scratch;
+    for (u32 b = 0; b < 8; ++b) {
+        u32 *offsets = histograms[b];
+        u32 shift = b * 8;
+        if (offsets[(src[0].sort_key >> shift) & 0xFF] == list->count)
+            continue;
+        u32 offset = 0;
+        for (u32 digit = 0; digit < 256; ++digit) {
+            u32 count = offsets[digit];
+            offsets[digit] = offset;
+            offset += count;
+        }
+        for (u32 i = 0; i < list->count; ++i)
+            dst[offsets[(src[i].sort_key >> shift) & 0xFF]++] = src[i];
+        struct draw *sorted = dst;
+        dst = src;
+        src = sorted;
+    }
+    if (src != list->draws)
+        memcpy(list->draws, src, list->count * sizeof(struct draw));
+}
+
+// Sorts the list's draws by sort key, then groups them into batches of the same mesh and texture (just the same mesh for lists drawn without
+// textures), with instances numbered from first_instance in draw order. Opaque keys lead with state, so each batch's state is only bound
+// once; transparent keys lead with depth, so only neighbouring draws merge.
+static void batch_draw_list(struct draw_list *list, u32 first_instance, bool textured) {
+    radix_sort_draws(list);
+    list->batch_count = 0;
+    for (u32 i = 0; i < list->count; ++i) {
+        struct draw *draw = list->draws + i;
+        struct draw_batch *batch = list->batch_count > 0 ? list->batches + list->batch_count - 1 : NULL;
+        if (batch != NULL && batch->mesh == draw->mesh && (!textured || batch->texture_desc_set == draw->texture_desc_set))
+            ++batch->instance_count;
+        else
+            list->batches[list->batch_count++] = { draw->mesh, draw->texture_desc_set, first_instance + i, 1 };
+    }
+}
+
+// Shadow views use the first light (see get_view_space_mtx()). Point light faces only take casters within the light's range, and have their
+// far plane pulled in to it. Tiny-contribution culling only applies to the camera, since small casters can still throw large shadows.
+static void init_cull_views(struct cull_view *views, struct scene *scene, struct cull_settings *settings) {
+    struct camera *cam = &scene->camera;
+    struct cull_view *cam_view = views + 0;
+    cam_view->frustum_enabled = settings->frustum;
+    cam_view->frustum = extract_frustum(get_view_space_mtx(scene, 0));
+    cam_view->tiny_enabled = settings->tiny && settings->min_screen_size > 0;
+    cam_view->eye[0] = cam->transform.position.x;
+    cam_view->eye[1] = cam->transform.position.y;
+    cam_view->eye[2] = cam->transform.position.z;
+    cam_view->tiny_scale = 1 / tanf(glm::radians(cam->fov) * 0.5f) / settings->min_screen_size;
+
+    bool has_light = scene->lights.transforms.count > 0;
+    for (u32 face = 0; face < 6; ++face) {
+        struct cull_view *view = views + 1 + face;
+        if (!has_light)
+            continue;
+        struct light_ubo *light = get_light_ubo(scene, 0);
+        f32 range = get_light_range(scene, 0);
+        view->range_enabled = light->mode != LIGHT_MODE_DIRECTIONAL;
+        view->eye[0] = light->position.x;
+        view->eye[1] = light->position.y;
+        view->eye[2] = light->position.z;
+        view->range = range;
+        view->frustum_enabled = settings->frustum;
+        if (!view->frustum_enabled)
+            continue;
+        view->frustum = extract_frustum(get_view_space_mtx(scene, 1 + face));
+        if (light->mode != LIGHT_MODE_DIRECTIONAL) {
+            f32 *far_plane = view->frustum.planes[5];
+            f32 range_d = range - (far_plane[0] * light->position.x + far_plane[1] * light->position.y + far_plane[2] * light->position.z);
+            far_plane[3] = range_d < far_plane[3] ? range_d : far_plane[3];
+        }
+    }
+}
+
+// In GPU-driven mode only the camera view is culled here, for the transparent queue, and the other queues are left empty. Expects bounds
+// from update_bounds().
+static void build_draw_lists(struct draw_lists *lists, struct scene *scene, struct cull_settings *settings, struct job_system *jobs) {
+    u32 chunk_count = (scene->renderables.transforms.count + CHUNK_SIZE - 1) / CHUNK_SIZE;
+    if (lists->direct.chunk_capacity < chunk_count)
+        lists->chunk_drawables = (u32 *)realloc(lists->chunk_drawables, chunk_count * sizeof(u32));
+    reserve_draw_list(&lists->direct, chunk_count);
+    reserve_draw_list(&lists->transparent, chunk_count);
+    for (u32 i = 0; i < 6; ++i)
+        reserve_draw_list(lists->shadow + i, chunk_count);
+    lists->gpu_driven = settings->gpu_driven;
+
+    struct draw_list_job job = {};
+    job.lists = lists;
+    job.scene = scene;
+    job.view_count = settings->gpu_driven ? 1 : VIEW_COUNT;
+    init_cull_views(job.views, scene, settings);
+
+    if (settings->bvh) {
+        for (u32 v = job.view_count; v < VIEW_COUNT; ++v)
+            get_view_draw_list(lists, v)->count = 0;
+        parallel_for(jobs, job.view_count, 1, build_view_draw_lists, &job);
+        lists->drawable_count = scene->bvh.entity_count;
+    } else {
+        parallel_for(jobs, chunk_count, 1, build_chunk_draw_lists, &job);
+        for (u32 v = 0; v < VIEW_COUNT; ++v)
+            pack_draw_list(get_view_draw_list(lists, v), chunk_count);
+        pack_draw_list(&lists->transparent, chunk_count);
+        lists->drawable_count = 0;
+        for (u32 c = 0; c < chunk_count; ++c)
+            lists->drawable_count += lists->chunk_drawables[c];
+    }
+}
+
+////////////////////////////////////////////////////////////
+/// Software Occlusion
+////////////////////////////////////////////////////////////
+static u32 const OCCLUSION_BUFFER_WIDTH = 256; // Multiple of SIMD_WIDTH so each row splits into whole lane groups.
+static u32 const OCCLUSION_BUFFER_HEIGHT = 128;
+static f32 const LANE_INDEXES[] = { 0, 1, 2, 3, 4, 5, 6, 7 };
+static f32 const CORNER_SIGNS[3][8] = {
+    { -1, 1, -1, 1, -1, 1, -1, 1 },
+    { -1, -1, 1, 1, -1, -1, 1, 1 },
+    { -1, -1, -1, -1, 1, 1, 1, 1 },
+};
+
+struct occlusion_job {
+    struct draw_lists *lists;
+    struct scene *scene;
+    glm::mat4 view_space_mtxs[VIEW_COUNT];
+    bool enabled[VIEW_COUNT];
+};
+
+static glm::vec3 to_screen(glm::vec4 const &clip) {
+    f32 inv_w = 1 / clip.w;
+    return { (clip.x * inv_w * 0.5f + 0.5f) * OCCLUSION_BUFFER_WIDTH, (clip.y * inv_w * 0.5f + 0.5f) * OCCLUSION_BUFFER_HEIGHT, clip.z * inv_w };
+}
+
+// Sutherland-Hodgman against the near plane (z >= 0 in Vulkan clip space), which also keeps w positive for the divide.
+static u32 clip_near(glm::vec4 const *tri, glm::vec4 *poly) {
+    u32 count = 0;
+    for (u32 i = 0; i < 3; ++i) {
+        glm::vec4 const &a = tri[i];
+        glm::vec4 const &b = tri[(i + 1) % 3];
+        if (a.z >= 0)
+            poly[count++] = a;
+        if ((a.z >= 0) != (b.z >= 0))
+            poly[count++] = a + (b - a) * (a.z / (a.z - b.z));
+    }
+    return count;
+}
+
+// Rasterised conservatively so only what's really hidden gets culled: a pixel is covered only when the triangle covers all of it, and takes
+// the farthest depth the triangle has inside it. Both windings are rasterised, since occluders block from either side.
+static void rasterise_triangle(f32 *depth, glm::vec3 v0, glm::vec3 v1, glm::vec3 v2) {
+    f32 area = (v1.x - v0.x) * (v2.y - v0.y) - (v2.x - v0.x) * (v1.y - v0.y);
+    if (fabsf(area) < 1e-6f)
+        return;
+    if (area < 0) {
+        glm::vec3 swap = v1;
+        v1 = v2;
+        v2 = swap;
+        area = -area;
+    }
+
+    f32 min_xf = fminf(v0.x, fminf(v1.x, v2.x));
+    f32 max_xf = fmaxf(v0.x, fmaxf(v1.x, v2.x));
+    f32 min_yf = fminf(v0.y, fminf(v1.y, v2.y));
+    f32 max_yf = fmaxf(v0.y, fmaxf(v1.y, v2.y));
+    if (max_xf < 0 || max_yf < 0 || min_xf >= OCCLUSION_BUFFER_WIDTH || min_yf >= OCCLUSION_BUFFER_HEIGHT)
+        return;
+    s32 min_x = min_xf < 0 ? 0 : (s32)min_xf;
+    s32 min_y = min_yf < 0 ? 0 : (s32)min_yf;
+    s32 max_x = max_xf >= OCCLUSION_BUFFER_WIDTH - 1 ? OCCLUSION_BUFFER_WIDTH - 1 : (s32)max_xf;
+    s32 max_y = max_yf >= OCCLUSION_BUFFER_HEIGHT - 1 ? OCCLUSION_BUFFER_HEIGHT - 1 : (s32)max_yf;
+
+    // Edge functions as a * x + b * y + c, positive inside. Depth is interpolated linearly in screen space.
+    glm::vec3 const verts[] = { v0, v1, v2 };
+    f32 edge_a[3];
+    f32 edge_b[3];
+    f32 edge_c[3];
+    for (u32 e = 0; e < 3; ++e) {
+        glm::vec3 const &a = verts[e];
+        glm::vec3 const &b = verts[(e + 1) % 3];
+        edge_a[e] = a.y - b.y;
+        edge_b[e] = b.x - a.x;
+        edge_c[e] = a.x * b.y - a.y * b.x;
+    }
+    f32 dzdx = ((v1.z - v0.z) * (v2.y - v0.y) - (v2.z - v0.z) * (v1.y - v0.y)) / area;
+    f32 dzdy = ((v2.z - v0.z) * (v1.x - v0.x) - (v1.z - v0.z) * (v2.x - v0.x)) / area;
+
+    // Edge functions and depth are linear, so their extremes over a pixel are at its corners, half a pixel from the center along each axis.
+    // Pulling each edge in by its reach makes the center test hold only for fully covered pixels.
+    f32 edge_reach[3];
+    for (u32 e = 0; e < 3; ++e)
+        edge_reach[e] = 0.5f * (fabsf(edge_a[e]) + fabsf(edge_b[e]));
+    f32 depth_reach = 0.5f * (fabsf(dzdx) + fabsf(dzdy));
+
+    simd_f32 zero = simd_set(0);
+    simd_f32 lane_centers = simd_add(simd_load(LANE_INDEXES), simd_set(0.5f));
+    simd_f32 a0 = simd_set(edge_a[0]);
+    simd_f32 a1 = simd_set(edge_a[1]);
+    simd_f32 a2 = simd_set(edge_a[2]);
+    simd_f32 dzdx_v = simd_set(dzdx);
+    for (s32 y = min_y; y <= max_y; ++y) {
+        f32 py = y + 0.5f;
+        simd_f32 row0 = simd_set(edge_b[0] * py + edge_c[0] - edge_reach[0]);
+        simd_f32 row1 = simd_set(edge_b[1] * py + edge_c[1] - edge_reach[1]);
+        simd_f32 row2 = simd_set(edge_b[2] * py + edge_c[2] - edge_reach[2]);
+        simd_f32 row_z = simd_set(v0.z - dzdx * v0.x + dzdy * (py - v0.y) + depth_reach);
+        f32 *row = depth + y * OCCLUSION_BUFFER_WIDTH;
+        for (s32 x = min_x - min_x % SIMD_WIDTH; x <= max_x; x += SIMD_WIDTH) {
+            simd_f32 px = simd_add(simd_set((f32)x), lane_centers);
+            simd_f32 outside = simd_or(simd_or(simd_cmplt(simd_madd(px, a0, row0), zero), simd_cmplt(simd_madd(px, a1, row1), zero)),
+                                       simd_cmplt(simd_madd(px, a2, row2), zero));
+            simd_f32 dst = simd_load(row + x);
+            simd_f32 nearest = simd_min(dst, simd_madd(px, dzdx_v, row_z));
+            simd_store(row + x, simd_or(simd_and(outside, dst), simd_andnot(outside, nearest)));
+        }
+    }
+}
+
+static void rasterise_occluder(struct draw_list *list, struct mesh *mesh, glm::mat4 const &mtx) {
+    if (list->occluder_vert_capacity < mesh->vertexes.count) {
+        list->occluder_vert_capacity = mesh->vertexes.count;
+        list->occluder_verts = (glm::vec4 *)realloc(list->occluder_verts, mesh->vertexes.count * sizeof(glm::vec4));
+    }
+    for (u32 i = 0; i < mesh->vertexes.count; ++i) {
+        struct ctk_v3<f32> *pos = &mesh->vertexes.data[i].position;
+        list->occluder_verts[i] = mtx * glm::vec4(pos->x, pos->y, pos->z, 1);
+    }
+
+    for (u32 i = 0; i + 2 < mesh->indexes.count; i += 3) {
+        glm::vec4 tri[] = {
+            list->occluder_verts[mesh->indexes.data[i + 0]],
+            list->occluder_verts[mesh->indexes.data[i + 1]],
+            list->occluder_verts[mesh->indexes.data[i + 2]],
+        };
+        glm::vec4 poly[4];
+        u32 poly_count = clip_near(tri, poly);
+        if (poly_count < 3)
+            continue;
+        glm::vec3 first = to_screen(poly[0]);
+        for (u32 v = 2; v < poly_count; ++v)
+            rasterise_triangle(list->occlusion_depth, first, to_screen(poly[v - 1]), to_screen(poly[v]));
+    }
+}
+
+// Occluded when every pixel under the box's screen rect holds an occluder nearer than the box's nearest corner. Boxes reaching past the near
+// plane are kept.
+static bool is_occluded(f32 const *depth, glm::mat4 const &mtx, struct renderable_components *components, u32 idx) {
+    // Corners are the projected center plus or minus each projected half-axis, SIMD_WIDTH corners at a time.
+    glm::vec4 center = mtx * glm::vec4(components->bounds_center[0][idx], components->bounds_center[1][idx], components->bounds_center[2][idx], 1);
+    glm::vec4 axes[3];
+    for (u32 axis = 0; axis < 3; ++axis)
+        axes[axis] = mtx[axis] * components->bounds_extent[axis][idx];
+    simd_f32 zero = simd_set(0);
+    simd_f32 min_xv = simd_set(FLT_MAX);
+    simd_f32 min_yv = simd_set(FLT_MAX);
+    simd_f32 max_xv = simd_set(-FLT_MAX);
+    simd_f32 max_yv = simd_set(-FLT_MAX);
+    simd_f32 nearest_v = simd_set(FLT_MAX);
+    for (u32 base = 0; base < 8; base += SIMD_WIDTH) {
+        simd_f32 clip[4];
+        for (u32 row = 0; row < 4; ++row) {
+            clip[row] = simd_set(center[row]);
+            for (u32 axis = 0; axis < 3; ++axis)
+                clip[row] = simd_madd(simd_load(CORNER_SIGNS[axis] + base), simd_set(axes[axis][row]), clip[row]);
+        }
+        if (simd_movemask(simd_cmplt(clip[2], zero)))
+            return false;
+        simd_f32 inv_w = simd_div(simd_set(1), clip[3]);
+        simd_f32 x = simd_madd(simd_mul(clip[0], inv_w), simd_set(OCCLUSION_BUFFER_WIDTH * 0.5f), simd_set(OCCLUSION_BUFFER_WIDTH * 0.5f));
+        simd_f32 y = simd_madd(simd_mul(clip[1], inv_w), simd_set(OCCLUSION_BUFFER_HEIGHT * 0.5f), simd_set(OCCLUSION_BUFFER_HEIGHT * 0.5f));
+        min_xv = simd_min(min_xv, x);
+        min_yv = simd_min(min_yv, y);
+        max_xv = simd_max(max_xv, x);
+        max_yv = simd_max(max_yv, y);
+        nearest_v = simd_min(nearest_v, simd_mul(clip[2], inv_w));
+    }
+    f32 lanes[5][SIMD_WIDTH];
+    simd_store(lanes[0], min_xv);
+    simd_store(lanes[1], min_yv);
+    simd_store(lanes[2], max_xv);
+    simd_store(lanes[3], max_yv);
+    simd_store(lanes[4], nearest_v);
+    f32 min_x = lanes[0][0];
+    f32 min_y = lanes[1][0];
+    f32 max_x = lanes[2][0];
+    f32 max_y = lanes[3][0];
+    f32 nearest = lanes[4][0];
+    for (u32 lane = 1; lane < SIMD_WIDTH; ++lane) {
+        min_x = fminf(min_x, lanes[0][lane]);
+        min_y = fminf(min_y, lanes[1][lane]);
+        max_x = fmaxf(max_x, lanes[2][lane]);
+        max_y = fmaxf(max_y, lanes[3][lane]);
+        nearest = fminf(nearest, lanes[4][lane]);
+    }
+    if (max_x < 0 || max_y < 0 || min_x >= OCCLUSION_BUFFER_WIDTH || min_y >= OCCLUSION_BUFFER_HEIGHT)
+        return false;
+
+    // Only the on-screen part of the rect can be seen.
+    s32 x0 = min_x < 0 ? 0 : (s32)min_x;
+    s32 y0 = min_y < 0 ? 0 : (s32)min_y;
+    s32 x1 = max_x >= OCCLUSION_BUFFER_WIDTH - 1 ? OCCLUSION_BUFFER_WIDTH - 1 : (s32)max_x;
+    s32 y1 = max_y >= OCCLUSION_BUFFER_HEIGHT - 1 ? OCCLUSION_BUFFER_HEIGHT - 1 : (s32)max_y;
+    nearest_v = simd_set(nearest);
+    simd_f32 lo = simd_set((f32)x0);
+    simd_f32 hi = simd_set((f32)x1 + 1);
+    simd_f32 lane_indexes = simd_load(LANE_INDEXES);
+    for (s32 y = y0; y <= y1; ++y) {
+        f32 const *row = depth + y * OCCLUSION_BUFFER_WIDTH;
+        for (s32 x = x0 - x0 % SIMD_WIDTH; x <= x1; x += SIMD_WIDTH) {
+            simd_f32 px = simd_add(simd_set((f32)x), lane_indexes);
+            simd_f32 in_rect = simd_andnot(simd_cmplt(px, lo), simd_cmplt(px, hi));
+            if (simd_movemask(simd_andnot(simd_cmplt(simd_load(row + x), nearest_v), in_rect)))
+                return false;
+        }
+    }
+    return true;
+}
+
+// One view per job: rasterise the view's visible occluders, then drop the draws hidden behind them. Occluders are never culled themselves.
+static void cull_occluded_views(void *data, u32 first, u32 count) {
+    auto job = (struct occlusion_job *)data;
+    struct scene *scene = job->scene;
+    for (u32 v = first; v < first + count; ++v) {
+        struct draw_list *list = get_view_draw_list(job->lists, v);
+        list->occluded = 0;
+        if (!job->enabled[v])
+            continue;
+        if (list->occlusion_depth == NULL)
+            list->occlusion_depth = (f32 *)malloc(OCCLUSION_BUFFER_WIDTH * OCCLUSION_BUFFER_HEIGHT * sizeof(f32));
+        for (u32 i = 0; i < OCCLUSION_BUFFER_WIDTH * OCCLUSION_BUFFER_HEIGHT; ++i)
+            list->occlusion_depth[i] = 1;
+
+        glm::mat4 const &view_space_mtx = job->view_space_mtxs[v];
+        u32 occluder_count = 0;
+        for (u32 i = 0; i < list->count; ++i) {
+            struct draw *draw = list->draws + i;
+            u32 e = draw->model_ubo_chunk * CHUNK_SIZE + draw->model_ubo_idx;
+            if (!chunk_at(&scene->renderables.components, e)->occluder[e % CHUNK_SIZE])
+                continue;
+            rasterise_occluder(list, draw->mesh, view_space_mtx * get_model_ubo(&scene->renderables.transforms, e)->model_mtx);
+            ++occluder_count;
+        }
+        if (occluder_count == 0)
+            continue;
+
+        u32 kept = 0;
+        for (u32 i = 0; i < list->count; ++i) {
+            struct draw *draw = list->draws + i;
+            u32 e = draw->model_ubo_chunk * CHUNK_SIZE + draw->model_ubo_idx;
+            struct renderable_components *components = chunk_at(&scene->renderables.components, e);
+            if (!components->occluder[e % CHUNK_SIZE] && is_occluded(list->occlusion_depth, view_space_mtx, components, e % CHUNK_SIZE))
+                continue;
+            list->draws[kept++] = *draw;
+        }
+        list->occluded = list->count - kept;
+        list->count = kept;
+    }
+}
+
+// Runs after build_draw_lists() and before any commands are recorded. Occluders are designated per entity (set_occluder()) and should be
+// simple, large meshes; everything else is tested by its world AABB. Shadow views are culled from the light's point of view, where a caster
+// hidden behind an occluder can't add to the shadow map.
+static void cull_occluded_draws(struct draw_lists *lists, struct scene *scene, struct cull_settings *settings, struct job_system *jobs) {
+    struct occlusion_job job = {};
+    job.lists = lists;
+    job.scene = scene;
+    bool has_light = scene->lights.transforms.count > 0;
+    for (u32 v = 0; v < VIEW_COUNT; ++v) {
+        job.enabled[v] = settings->software_occlusion && (v == 0 || has_light);
+        if (job.enabled[v])
+            job.view_space_mtxs[v] = get_view_space_mtx(scene, v);
+    }
+    parallel_for(jobs, VIEW_COUNT, 1, cull_occluded_views, &job);
+}
+
+////////////////////////////////////////////////////////////
+/// UI
+////////////////////////////////////////////////////////////
+enum {
+    UI_MODE_ENTITY,
+    UI_MODE_LIGHT,
+    UI_MODE_MATERIAL,
+    UI_MODE_STATS,
+};
+
+struct ui {
+    struct vtk_render_pass render_pass;
+    VkDescriptorPool descriptor_pool; // Shared with the app's descriptor_allocator.
+    ImGuiIO *io;
+    s32 mode;
+    u32 entity_idx;
+    u32 light_idx;
+    u32 material_idx;
+    cstr snapshot_status; // Result of the last "save scene snapshot".
+};
+
+static void check_vk_result(VkResult result) {
+    vtk_validate_result(result, "imgui internal call failed");
+}
+
+static struct ui *create_ui(struct window *win, struct app *app, struct vk_core *vk) {
+    auto ui = ctk_zalloc<struct ui>();
+    ui->mode = UI_MODE_LIGHT;
+
+    ////////////////////////////////////////////////////////////
+    /// Init
+    ////////////////////////////////////////////////////////////
+    ImGui::CreateContext();
+    ui->io = &ImGui::GetIO();
+    if (!ImGui_ImplGlfw_InitForVulkan(win->handle, true /* install callbacks so imgui can handle glfw input */))
+        CTK_FATAL("failed to init imgui glfw for vulkan")
+
+    ////////////////////////////////////////////////////////////
+    /// Render Pass
+    ////////////////////////////////////////////////////////////
+    struct vtk_render_pass_info rp_info = {};
+
+    // Attachments
+    VkAttachmentDescription *swapchain_attachment = ctk_push(&rp_info.attachment_descriptions);
+    swapchain_attachment->format = vk->swapchain.image_format;
+    swapchain_attachment->samples = VK_SAMPLE_COUNT_1_BIT;
+    swapchain_attachment->loadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+    swapchain_attachment->storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+    swapchain_attachment->stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+    swapchain_attachment->stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    swapchain_attachment->initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    swapchain_attachment->finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+    ctk_push(&rp_info.clear_values, { 0, 0, 0, 1 });
+
+    // Subpasses
+    struct vtk_subpass_info *main = ctk_push(&rp_info.subpass_infos);
+    ctk_push(&main->color_attachment_refs, { 0, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL });
+
+    // Subpass Dependencies
+    rp_info.subpass_dependencies.count = 1;
+    rp_info.subpass_dependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
+    rp_info.subpass_dependencies[0].dstSubpass = 0;
+    rp_info.subpass_dependencies[0].srcStageMask = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
+    rp_info.subpass_dependencies[0].dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+    rp_info.subpass_dependencies[0].srcAccessMask = VK_ACCESS_MEMORY_READ_BIT;
+    rp_info.subpass_dependencies[0].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+    rp_info.subpass_dependencies[0].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
+
+    // Framebuffer Infos
+    for (u32 i = 0; i < vk->swapchain.image_count; ++i) {
+        struct vtk_framebuffer_info *fb_info = ctk_push(&rp_info.framebuffer_infos);
+        ctk_push(&fb_info->attachments, vk->swapchain.image_views[i]);
+        fb_info->extent = vk->swapchain.extent;
+        fb_info->layers = 1;
+    }
+
+    ui->render_pass = vtk_create_render_pass(vk->device.logical, vk->graphics_cmd_pool, &rp_info);
+
+    ////////////////////////////////////////////////////////////
+    /// Descriptor Pool
+    ////////////////////////////////////////////////////////////
+    // ImGui allocates its font texture's set once at init and never frees it, so it gets a pool from the app's descriptor_allocator with
+    // room reserved for that set.
+    u32 imgui_descriptors[CTK_ARRAY_COUNT(DESCRIPTOR_POOL_SIZES)] = {};
+    imgui_descriptors[get_descriptor_pool_size_index(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER)] = 1;
+    ui->descriptor_pool = reserve_descriptor_pool(&app->descriptors.allocator, vk->device.logical, imgui_descriptors, 1);
+
+    ////////////////////////////////////////////////////////////
+    /// Vulkan Init
+    ////////////////////////////////////////////////////////////
+    ImGui_ImplVulkan_InitInfo imgui_vk_info = {};
+    imgui_vk_info.Instance = vk->instance.handle;
+    imgui_vk_info.PhysicalDevice = vk->device.physical;
+    imgui_vk_info.Device = vk->device.logical;
+    imgui_vk_info.QueueFamily = vk->device.queue_family_indexes.graphics;
+    imgui_vk_info.Queue = vk->device.queues.graphics;
+    imgui_vk_info.PipelineCache = vk->pipelines.cache;
+    imgui_vk_info.DescriptorPool = ui->descriptor_pool;
+    imgui_vk_info.MinImageCount = vk->swapchain.image_count;
+    imgui_vk_info.ImageCount = vk->swapchain.image_count;
+    imgui_vk_info.MSAASamples = VK_SAMPLE_COUNT_1_BIT;
+    imgui_vk_info.Allocator = NULL;
+    imgui_vk_info.CheckVkResultFn = check_vk_result;
+    if (!ImGui_ImplVulkan_Init(&imgui_vk_info, ui->render_pass.handle))
+        CTK_FATAL("failed to init imgui vulkan")
+
+    ////////////////////////////////////////////////////////////
+    /// Fonts
+    ////////////////////////////////////////////////////////////
+    vtk_begin_one_time_command_buffer(app->cmd_bufs.one_time);
+        ImGui_ImplVulkan_CreateFontsTexture(app->cmd_bufs.one_time);
+    vtk_submit_one_time_command_buffer(app->cmd_bufs.one_time, vk->device.queues.graphics);
+    ImGui_ImplVulkan_DestroyFontUploadObjects();
+
+    return ui;
+}
+
+static bool list_box_begin(cstr id, cstr title, u32 item_count, u32 viewable_item_count = -1) {
+    ImGui::PushItemWidth(-1);
+    char imgui_id[256] = {};
+    sprintf(imgui_id, "##%s", id);
+    if (title)
+        ImGui::Text(title);
+    return ImGui::ListBoxHeader(imgui_id, item_count, viewable_item_count);
+}
+
+static void list_box_end() {
+    ImGui::ListBoxFooter();
+    ImGui::PopItemWidth();
+}
+
+static bool window_begin(cstr title, s32 x, s32 y, s32 width, s32 height, s32 flags) {
+    ImGui::SetNextWindowPos({ (f32)x, (f32)y });
+    return ImGui::Begin(title, NULL, flags);
+}
+
+static void window_end() {
+    ImGui::End();
+}
+
+static void separator() {
+    ImVec2 output_pos = ImGui::GetCursorScreenPos();
+    ImGui::GetWindowDrawList()->AddLine(ImVec2(output_pos.x, output_pos.y + 1),
+                                        ImVec2(output_pos.x + ImGui::GetColumnWidth(), output_pos.y + 1),
+                                        IM_COL32(255, 255, 255, 64));
+    ImGui::Dummy(ImVec2(0, 2));
+}
+
+// Rotation is edited as Euler angles. The angles are cached for the selected transform so dragging through equivalent orientations
+// doesn't make the fields jump.
+static bool transform_control(struct transform_store *store, u32 idx) {
+    static struct transform_store *euler_store = NULL;
+    static u32 euler_idx = CTK_U32_MAX;
+    static struct ctk_v3<f32> euler = {};
+
+    struct transform t = get_transform(store, idx);
+    if (euler_store != store || euler_idx != idx) {
+        euler_store = store;
+        euler_idx = idx;
+        euler = quat_to_euler(t.rotation);
+    }
+
+    ImGui::Text("transform");
+    bool changed = ImGui::DragFloat3("position", &t.position.x, 0.01f);
+    if (ImGui::DragFloat3("rotation", &euler.x, 0.1f)) {
+        t.rotation = quat_from_euler(euler);
+        changed = true;
+    }
+    changed |= ImGui::DragFloat3("scale", &t.scale.x, 0.01f);
+    if (changed)
+        set_transform(store, idx, &t);
+    return changed;
+}
+
+static void enum_dropdown(cstr id, cstr *elems, u32 elem_count, s32 *enum_val) {
+    cstr curr_elem = elems[*enum_val];
+    ImGui::PushItemWidth(-1);
+    char imgui_id[256] = {};
+    sprintf(imgui_id, "##%s", id);
+    if (ImGui::BeginCombo(imgui_id, curr_elem)) {
+        for (u32 i = 0; i < elem_count; ++i) {
+            cstr elem = elems[i];
+            bool selected = curr_elem == elem;
+            if (ImGui::Selectable(elem, selected))
+                *enum_val = i;
+            if (selected)
+                ImGui::SetItemDefaultFocus();
+        }
+        ImGui::EndCombo();
+    }
+    ImGui::PopItemWidth();
+}
+
+static void draw_ui(struct ui *ui, struct app *app, struct vk_core *vk, struct scene *scene, struct window *win) {
+    ImGui_ImplVulkan_NewFrame();
+    ImGui_ImplGlfw_NewFrame();
+    ImGui::NewFrame();
+
+    s32 window_flags = ImGuiWindowFlags_NoCollapse | ImGuiWindowFlags_NoMove/* | ImGuiWindowFlags_NoResize*/;
+    if (window_begin("states", 0, 0, 600, (s32)win->height, window_flags)) {
+        ImGui::Columns(2, NULL);
+
+        static cstr UI_MODES[] = { "entities", "lights", "materials", "stats" };
+        enum_dropdown("ui_modes", UI_MODES, CTK_ARRAY_COUNT(UI_MODES), &ui->mode);
+
+        if (ui->mode == UI_MODE_ENTITY) {
+            struct transform_store *transforms = &scene->renderables.transforms;
+            if (list_box_begin("0", NULL, transforms->count)) {
+                for (u32 i = 0; i < transforms->count; ++i) {
+                    cstr entity_name = chunk_at(&scene->renderables.components, i)->name[i % CHUNK_SIZE];
+                    u32 depth = 0;
+                    for (u32 p = get_parent(transforms, i); p != NO_PARENT; p = get_parent(transforms, p))
+                        ++depth;
+                    char name[64] = {};
+                    if (entity_name != NULL)
+                        sprintf(name, "%*s%s", depth * 2, "", entity_name);
+                    else
+                        sprintf(name, "%*sentity %u", depth * 2, "", i);
+                    if (ImGui::Selectable(name, i == ui->entity_idx))
+                        ui->entity_idx = i;
+                }
+            }
+            list_box_end();
+        } else if (ui->mode == UI_MODE_LIGHT) {
+            if (list_box_begin("1", NULL, scene->lights.transforms.count)) {
+                for (u32 i = 0; i < scene->lights.transforms.count; ++i) {
+                    char name[16] = {};
+                    sprintf(name, "light %u", i);
+                    if (ImGui::Selectable(name, i == ui->light_idx))
+                        ui->light_idx = i;
+                }
+            }
+            list_box_end();
+        } else if (ui->mode == UI_MODE_MATERIAL) {
+            if (list_box_begin("2", NULL, scene->materials.count)) {
+                for (u32 i = 0; i < scene->materials.count; ++i) {
+                    cstr mat_name = scene->materials[i].name;
+                    char name[64] = {};
+                    if (mat_name != NULL)
+                        strcpy(name, mat_name);
+                    else
+                        sprintf(name, "material %u", i);
+                    if (ImGui::Selectable(name, i == ui->material_idx))
+                        ui->material_idx = i;
+                }
+            }
+            list_box_end();
+        }
+
+        ImGui::NextColumn();
+        if (ui->mode == UI_MODE_ENTITY) {
+            transform_control(&scene->renderables.transforms, ui->entity_idx);
+            struct renderable_components *components = chunk_at(&scene->renderables.components, ui->entity_idx);
+            u32 idx = ui->entity_idx % CHUNK_SIZE;
+            u32 render_flags = components->render_flags[idx];
+            ImGui::CheckboxFlags("visible", &render_flags, RENDER_FLAG_VISIBLE);
+            ImGui::CheckboxFlags("casts shadow", &render_flags, RENDER_FLAG_CASTS_SHADOW);
+            ImGui::CheckboxFlags("receives shadow", &render_flags, RENDER_FLAG_RECEIVES_SHADOW);
+            ImGui::CheckboxFlags("transparent", &render_flags, RENDER_FLAG_TRANSPARENT);
+            components->render_flags[idx] = (u8)render_flags;
+            bool is_occluder = components->occluder[idx];
+            if (ImGui::Checkbox("occluder", &is_occluder))
+                components->occluder[idx] = is_occluder;
+        } else if (ui->mode == UI_MODE_LIGHT) {
+            struct light_ubo *ubo = get_light_ubo(scene, ui->light_idx);
+            transform_control(&scene->lights.transforms, ui->light_idx);
+
+            static cstr LIGHT_MODES[] = { "directional", "point" };
+            enum_dropdown("light_modes", LIGHT_MODES, CTK_ARRAY_COUNT(LIGHT_MODES), &ubo->mode);
+            ImGui::InputInt("depth_bias", &ubo->depth_bias);
+            ImGui::InputInt("normal_bias", &ubo->normal_bias);
+            ImGui::SliderInt("attenuation_index", (s32*)get_light_attenuation_index(scene, ui->light_idx), 0, CTK_ARRAY_COUNT(LIGHT_ATTENUATION_CONSTS) - 1);
+            f32 range = get_light_range(scene, ui->light_idx);
+            f32 light_pos[] = { ubo->position.x, ubo->position.y, ubo->position.z };
+            ImGui::Text("range: %.1f (%u entities)", range, bvh_query_sphere(scene, light_pos, range, NULL));
+            ImGui::SliderFloat("ambient", &ubo->ambient, 0, 1, "%.2f");
+            ImGui::ColorPicker4("##color", &ubo->color.x);
+        } else if (ui->mode == UI_MODE_MATERIAL) {
+            struct material *mat = scene->materials + ui->material_idx;
+            ImGui::SliderInt("shine_exponent", (s32 *)&mat->ubo->shine_exponent, 1, 256);
+        } else if (ui->mode == UI_MODE_STATS) {
+            ImGui::Text("model ubo uploads: %u", app->stats.model_ubo_uploads);
+            ImGui::Text("entities: %u (%u chunks)", scene->renderables.transforms.count, scene->renderables.transforms.chunks.count);
+            ImGui::Text("scene update: %.3f ms (%u threads)", app->stats.scene_update_ms, app->jobs->worker_count);
+            ImGui::Text("scene load: %.3f ms", app->stats.scene_load_ms);
+            ImGui::Text("pipelines: %u in %.3f ms (%s cache)", vk->pipelines.count, vk->pipelines.create_ms,
+                        vk->pipelines.cache_loaded ? "warm" : "cold");
+            ImGui::Text("shader reloads: %u", app->shader_reload->reload_count);
+            if (app->attachment_imgs.transient_depth.handle != VK_NULL_HANDLE) {
+                // Lazily-allocated memory is committed as the GPU needs it, so this is read every frame rather than once at creation.
+                VkDeviceSize committed = 0;
+                vkGetDeviceMemoryCommitment(vk->device.logical, app->attachment_imgs.transient_depth.memory, &committed);
+                VkDeviceSize required = app->attachment_imgs.transient_depth_size;
+                ImGui::Text("transient depth: %.2f MiB required, %.2f MiB committed, %.2f MiB saved", required / (1024.0 * 1024.0),
+                            committed / (1024.0 * 1024.0), (required - committed) / (1024.0 * 1024.0));
+            } else {
+                ImGui::Text("transient depth: unsupported (no lazily-allocated memory)");
+            }
+            if (ImGui::Button("save scene snapshot")) {
+                ui->snapshot_status = save_scene_snapshot(scene, SCENE_SNAPSHOT_PATH, &app->assets.meshes, &app->descriptors.sets.textures)
+                                      ? "saved to"
+                                      : "failed to write";
+            }
+            if (ui->snapshot_status != NULL) {
+                ImGui::SameLine();
+                ImGui::Text("%s %s", ui->snapshot_status, SCENE_SNAPSHOT_PATH);
+            }
+
+            struct draw_lists *lists = &app->draw_lists;
+            u32 shadow_visible = 0;
+            u32 batch_count = lists->direct.batch_count + lists->transparent.batch_count;
+            for (u32 i = 0; i < 6; ++i) {
+                shadow_visible += lists->shadow[i].count;
+                batch_count += lists->shadow[i].batch_count;
+            }
+            ImGui::Text("camera: %u opaque, %u transparent, %u culled or hidden", lists->direct.count, lists->transparent.count,
+                        lists->drawable_count - lists->direct.count - lists->transparent.count);
+            ImGui::Text("shadow faces: %u casters, %u culled or not casting", shadow_visible, lists->drawable_count * 6 - shadow_visible);
+            ImGui::Text("instances: %u in %u instanced draws, %u dropped", app->instances.count, batch_count, app->instances.dropped);
+            struct bind_stats *binds = &app->stats.binds;
+            ImGui::Text("binds: %u made, %u skipped, %.1f draws per state change", binds->binds, binds->binds_skipped,
+                        binds->state_changes > 0 ? binds->draws / (f32)binds->state_changes : 0.0f);
+            ImGui::Text("secondary command buffers: %u, %u re-recorded", app->stats.secondary_cmd_bufs, app->stats.recorded_cmd_bufs);
+            ImGui::Text("bvh: %u nodes, %u rebuilds", scene->bvh.node_count, scene->bvh.rebuild_count);
+            if (!vk->draw_indirect_first_instance)
+                ImGui::Text("gpu-driven culling: unsupported (no drawIndirectFirstInstance)");
+            else if (finish_pipeline_batch(app->pipeline_batches.deferred))
+                ImGui::Checkbox("gpu-driven culling", &app->culling.gpu_driven);
+            else
+                ImGui::Text("gpu-driven culling: creating pipelines");
+            if (app->culling.gpu_driven) {
+                ImGui::Text("gpu culling: %u camera, %u shadow faces visible in %u draw groups", app->stats.gpu_camera_visible,
+                            app->stats.gpu_shadow_visible, app->gpu_cull.group_count);
+            }
+            ImGui::Checkbox("bvh culling", &app->culling.bvh);
+            ImGui::Checkbox("frustum culling", &app->culling.frustum);
+            if (vk->draw_indirect_first_instance)
+                ImGui::Checkbox("hi-z occlusion culling", &app->culling.occlusion);
+            else
+                ImGui::Text("hi-z occlusion culling: unsupported (no drawIndirectFirstInstance)");
+            if (app->culling.occlusion) {
+                ImGui::Text("hi-z: %u early, %u late, %u occluded", app->stats.hiz_early_visible, app->stats.hiz_late_visible,
+                            app->stats.hiz_occluded);
+            }
+            ImGui::Checkbox("software occlusion culling", &app->culling.software_occlusion);
+            if (app->culling.software_occlusion) {
+                u32 shadow_occluded = 0;
+                for (u32 i = 0; i < 6; ++i)
+                    shadow_occluded += lists->shadow[i].occluded;
+                ImGui::Text("software occlusion: %u camera, %u shadow faces occluded", lists->direct.occluded, shadow_occluded);
+            }
+            ImGui::Checkbox("tiny object culling", &app->culling.tiny);
+            ImGui::SliderFloat("min screen size", &app->culling.min_screen_size, 0.001f, 0.1f, "%.3f");
+        }
+    }
+    window_end();
+}
+
+////////////////////////////////////////////////////////////
+/// Controls
+////////////////////////////////////////////////////////////
+static void update_mouse_state(struct window *window) {
+    // Mouse Delta
+    struct ctk_v2<f64> prev_mouse_position = window->mouse_position;
+    f64 curr_mouse_x = 0.0;
+    f64 curr_mouse_y = 0.0;
+    glfwGetCursorPos(window->handle, &curr_mouse_x, &curr_mouse_y);
+    window->mouse_position = { curr_mouse_x, curr_mouse_y };
+
+    // Calculate delta if previous position was not unset.
+    if (prev_mouse_position != UNSET_MOUSE_POSITION)
+        window->mouse_delta = window->mouse_position - prev_mouse_position;
+}
+
+static void local_translate(struct transform *transform, struct ctk_v3<f32> translation) {
+    struct ctk_v3<f32> *pos = &transform->position;
+    glm::mat3 world_mtx = glm::mat3_cast(transform->rotation);
+
+    struct ctk_v3<f32> right = {};
+    right.x = world_mtx[0][0];
+    right.y = world_mtx[1][0];
+    right.z = world_mtx[2][0];
+
+    struct ctk_v3<f32> up = {};
+    up.x = world_mtx[0][1];
+    up.y = world_mtx[1][1];
+    up.z = world_mtx[2][1];
+
+    struct ctk_v3<f32> forward = {};
+    forward.x = world_mtx[0][2];
+    forward.y = world_mtx[1][2];
+    forward.z = world_mtx[2][2];
+
+    struct ctk_v3<f32> new_pos = *pos;
+    new_pos = new_pos + (right * translation.x);
+    new_pos = new_pos + (up * translation.y);
+    *pos = new_pos + (forward * translation.z);
+}
+
+static void camera_controls(struct transform *cam_trans, struct window *window) {
+    if (window->mouse_button_down[GLFW_MOUSE_BUTTON_2]) {
+        static f32 const SENS = 0.4f;
+
+        // Camera rotation is pitch * yaw, so pitch is applied on the left and yaw on the right. Pitch is clamped to [-80, 80] degrees.
+        glm::mat3 rot_mtx = glm::mat3_cast(cam_trans->rotation);
+        f32 pitch = glm::degrees(atan2f(-rot_mtx[2][1], rot_mtx[2][2]));
+        f32 pitch_delta = ctk_clamp(pitch + (f32)window->mouse_delta.y * SENS, -80.0f, 80.0f) - pitch;
+        f32 yaw_delta = -(f32)window->mouse_delta.x * SENS;
+        cam_trans->rotation = glm::normalize(glm::angleAxis(glm::radians(pitch_delta), glm::vec3(1, 0, 0)) *
+                                             cam_trans->rotation *
+                                             glm::angleAxis(glm::radians(yaw_delta), glm::vec3(0, 1, 0)));
+    }
+
+    struct ctk_v3<f32> translation = {};
+    f32 mod = window->key_down[GLFW_KEY_LEFT_SHIFT] ? 4 :
+              window->key_down[GLFW_KEY_LEFT_CONTROL] ? 1 :
+              2;
+    if (window->key_down[GLFW_KEY_W]) translation.z += 0.01f * mod;
+    if (window->key_down[GLFW_KEY_S]) translation.z -= 0.01f * mod;
+    if (window->key_down[GLFW_KEY_D]) translation.x += 0.01f * mod;
+    if (window->key_down[GLFW_KEY_A]) translation.x -= 0.01f * mod;
+    if (window->key_down[GLFW_KEY_E]) translation.y -= 0.01f * mod;
+    if (window->key_down[GLFW_KEY_Q]) translation.y += 0.01f * mod;
+    local_translate(cam_trans, translation);
+}
+
+// Left-clicking outside the UI selects the entity under the cursor, tested against last frame's BVH.
+static void pick_entity(struct ui *ui, struct scene *scene, struct window *window) {
+    static bool was_down = false;
+    bool down = window->mouse_button_down[GLFW_MOUSE_BUTTON_1];
+    bool clicked = down && !was_down;
+    was_down = down;
+    if (!clicked || ui->io->WantCaptureMouse)
+        return;
+
+    // Unproject the cursor onto the near and far planes. Vulkan's clip space y points down like the window's.
+    glm::mat4 inv_view_space_mtx = glm::inverse(camera_view_space_mtx(&scene->camera));
+    f32 x = (f32)(window->mouse_position.x / window->width) * 2 - 1;
+    f32 y = (f32)(window->mouse_position.y / window->height) * 2 - 1;
+    glm::vec4 near_point = inv_view_space_mtx * glm::vec4(x, y, 0, 1);
+    glm::vec4 far_point = inv_view_space_mtx * glm::vec4(x, y, 1, 1);
+    glm::vec3 origin = glm::vec3(near_point) / near_point.w;
+    glm::vec3 dir = glm::normalize(glm::vec3(far_point) / far_point.w - origin);
+
+    f32 t = 0;
+    u32 hit = bvh_raycast(scene, &origin.x, &dir.x, &t);
+    if (hit != CTK_U32_MAX && hit < scene->renderables.transforms.count) {
+        ui->mode = UI_MODE_ENTITY;
+        ui->entity_idx = hit;
+    }
+}
+
+////////////////////////////////////////////////////////////
+/// Rendering
+////////////////////////////////////////////////////////////
+static u32 vtk_aquire_swapchain_image_index(struct app *app, struct vk_core *vk) {
+    u32 swapchain_img_idx = CTK_U32_MAX;
+    VkSemaphore img_aquired_semaphore = app->frame_sync.img_aquired[app->frame_sync.curr_frame];
+    vtk_validate_result(vkAcquireNextImageKHR(vk->device.logical, vk->swapchain.handle, CTK_U64_MAX, img_aquired_semaphore, VK_NULL_HANDLE, &swapchain_img_idx),
+                        "failed to aquire next swapchain image");
+    return swapchain_img_idx;
+}
+
+static void sync_frame(struct app *app, struct vk_core *vk, u32 swapchain_img_idx) {
+    u32 *img_prev_frame = app->frame_sync.img_prev_frame + swapchain_img_idx;
+    if (*img_prev_frame != CTK_U32_MAX)
+        vkWaitForFences(vk->device.logical, 1, app->frame_sync.in_flight + *img_prev_frame, VK_TRUE, CTK_U64_MAX);
+    vkResetFences(vk->device.logical, 1, app->frame_sync.in_flight + app->frame_sync.curr_frame);
+    *img_prev_frame = app->frame_sync.curr_frame;
+    reset_descriptor_allocator(app->descriptors.transient_allocators + swapchain_img_idx, vk->device.logical);
+}
+
+static void copy_omni_shadow_map_face(struct app *app, VkCommandBuffer cmd_buf, u32 face_idx) {
+    // Transition directional shadow map to transfer source.
+    {
+        VkImageMemoryBarrier img_barrier = {};
+        img_barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        img_barrier.srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+        img_barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+        img_barrier.oldLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        img_barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+        img_barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        img_barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        img_barrier.image = app->shadow_maps.directional.handle;
+        img_barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
+        img_barrier.subresourceRange.baseMipLevel = 0;
+        img_barrier.subresourceRange.levelCount = 1;
+        img_barrier.subresourceRange.baseArrayLayer = 0;
+        img_barrier.subresourceRange.layerCount = 1;
+        vkCmdPipelineBarrier(cmd_buf,
+                             VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+                             VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+                             0, // Dependency Flags
+                             0, NULL, // Memory Barriers
+                             0, NULL, // Buffer Memory Barriers
+                             1, &img_barrier); // Image Memory Barriers
+    }
+
+    // Copy from directional shadow map to face of omni shadow map.
+    VkImageCopy copy_region = {};
+    copy_region.srcSubresource.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
+    copy_region.srcSubresource.baseArrayLayer = 0;
+    copy_region.srcSubresource.mipLevel = 0;
+    copy_region.srcSubresource.layerCount = 1;
+    copy_region.srcOffset = { 0, 0, 0 };
+    copy_region.dstSubresource.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
+    copy_region.dstSubresource.baseArrayLayer = face_idx;
+    copy_region.dstSubresource.mipLevel = 0;
+    copy_region.dstSubresource.layerCount = 1;
+    copy_region.dstOffset = { 0, 0, 0 };
+    copy_region.extent.width = SHADOW_MAP_SIZE;
+    copy_region.extent.height = SHADOW_MAP_SIZE;
+    copy_region.extent.depth = 1;
+
+    // Copy from directional shadow map to omni shadow map face.
+    vkCmdCopyImage(cmd_buf,
+                   app->shadow_maps.directional.handle, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                   app->shadow_maps.omni.handle, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                   1, &copy_region);
+
+    // Transition directional shadow map back to depth attachment.
+    {
+        VkImageMemoryBarrier img_barrier = {};
+        img_barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        img_barrier.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+        img_barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+        img_barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+        img_barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        img_barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        img_barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        img_barrier.image = app->shadow_maps.directional.handle;
+        img_barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
+        img_barrier.subresourceRange.baseMipLevel = 0;
+        img_barrier.subresourceRange.levelCount = 1;
+        img_barrier.subresourceRange.baseArrayLayer = 0;
+        img_barrier.subresourceRange.layerCount = 1;
+        vkCmdPipelineBarrier(cmd_buf,
+                             VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+                             VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+                             0, // Dependency Flags
+                             0, NULL, // Memory Barriers
+                             0, NULL, // Buffer Memory Barriers
+                             1, &img_barrier); // Image Memory Barriers
+    }
+}
+
+static void memory_barrier(VkCommandBuffer cmd_buf, VkPipelineStageFlags src_stage, VkAccessFlags src_access, VkPipelineStageFlags dst_stage,
+                           VkAccessFlags dst_access) {
+    VkMemoryBarrier mem_barrier = {};
+    mem_barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    mem_barrier.srcAccessMask = src_access;
+    mem_barrier.dstAccessMask = dst_access;
+    vkCmdPipelineBarrier(cmd_buf,
+                         src_stage,
+                         dst_stage,
+                         0, // Dependency Flags
+                         1, &mem_barrier, // Memory Barriers
+                         0, NULL, // Buffer Memory Barriers
+                         0, NULL); // Image Memory Barriers
+}
+
+static u32 const RENDER_QUEUE_COUNT = 8; // Camera opaque and transparent, then the six shadow passes.
+
+struct instance_job {
+    u32 *instances;
+    struct draw_list *queues[RENDER_QUEUE_COUNT];
+    u32 first_instances[RENDER_QUEUE_COUNT];
+};
+
+static void write_queue_instances(void *data, u32 first, u32 count) {
+    auto job = (struct instance_job *)data;
+    for (u32 q = first; q < first + count; ++q) {
+        struct draw_list *queue = job->queues[q];
+        batch_draw_list(queue, job->first_instances[q], q < 2);
+        u32 *instances = job->instances + job->first_instances[q];
+        for (u32 i = 0; i < queue->count; ++i)
+            instances[i] = queue->draws[i].model_ubo_chunk * CHUNK_SIZE + queue->draws[i].model_ubo_idx;
+    }
+}
+
+// Batches every render queue and packs their instances' entity indexes, a queue per job. The camera's opaque draws come first, so each Hi-Z
+// object's index is also its instance. Draws of renderables past MAX_GPU_ENTITIES are dropped, and queues past MAX_INSTANCES are truncated.
+// Returns the instance count.
+static u32 pack_instances(struct draw_lists *lists, u32 entity_count, u32 *instances, u32 *dropped, struct job_system *jobs) {
+    struct instance_job job = {};
+    job.instances = instances;
+    job.queues[0] = &lists->direct;
+    job.queues[1] = &lists->transparent;
+    for (u32 i = 0; i < 6; ++i)
+        job.queues[2 + i] = lists->shadow + i;
+
+    u32 instance_count = 0;
+    *dropped = 0;
+    for (u32 q = 0; q < RENDER_QUEUE_COUNT; ++q) {
+        struct draw_list *queue = job.queues[q];
+        if (entity_count > MAX_GPU_ENTITIES) {
+            u32 kept = 0;
+            for (u32 i = 0; i < queue->count; ++i)
+                if (queue->draws[i].model_ubo_chunk < MAX_GPU_ENTITIES / CHUNK_SIZE)
+                    queue->draws[kept++] = queue->draws[i];
+            *dropped += queue->count - kept;
+            queue->count = kept;
+        }
+        u32 capacity = MAX_INSTANCES - instance_count;
+        if (queue->count > capacity) {
+            *dropped += queue->count - capacity;
+            queue->count = capacity;
+        }
+        job.first_instances[q] = instance_count;
+        instance_count += queue->count;
+    }
+    parallel_for(jobs, RENDER_QUEUE_COUNT, 1, write_queue_instances, &job);
+    return instance_count;
+}
+
+static void upload_instances(struct app *app, struct vk_core *vk, struct scene *scene, u32 swapchain_img_idx) {
+    app->instances.count = pack_instances(&app->draw_lists, scene->renderables.transforms.count, app->instances.staging,
+                                          &app->instances.dropped, app->jobs);
+    if (app->instances.count > 0)
+        vtk_write_to_host_region(vk->device.logical, app->instances.staging, app->instances.count * sizeof(u32),
+                                 app->instances.regions + swapchain_img_idx, 0);
+}
+
+struct gpu_entity_job {
+    struct scene *scene;
+    struct gpu_entity *entities;
+    u32 *chunk_group_sizes;
+    struct mesh *meshes; // Asset arrays the draw groups are numbered by.
+    struct vtk_descriptor_set *textures;
+    bool draw_groups; // Assign renderables their draw groups, which only gpu_cull.comp reads.
+    bool count_groups; // Count renderables per draw group, for rebuilding the groups.
+};
+
+// Renderables sharing a mesh and texture go in the same draw group, numbered by their mesh's and texture's places in the asset maps.
+// Renderables without a texture take their mesh's last group.
+static u32 get_draw_group(struct gpu_entity_job const *job, struct mesh *mesh, struct vtk_descriptor_set *texture_desc_set) {
+    u32 mesh_idx = (u32)(mesh - job->meshes);
+    u32 texture_idx = texture_desc_set == NULL ? DRAW_GROUP_TEXTURES - 1 : (u32)(texture_desc_set - job->textures);
+    CTK_ASSERT(mesh_idx < MAX_MESHES && texture_idx < DRAW_GROUP_TEXTURES)
+    return mesh_idx * DRAW_GROUP_TEXTURES + texture_idx;
+}
+
+// Packs each chunk's culling data into its CHUNK_SIZE range of the staging buffer, counting its renderables per draw group.
+static void pack_gpu_entity_chunks(void *data, u32 first, u32 count) {
+    auto job = (struct gpu_entity_job *)data;
+    struct archetype<struct renderable_components> *renderables = &job->scene->renderables;
+    for (u32 c = first; c < first + count; ++c) {
+        struct renderable_components *components = renderables->components.data[c];
+        u32 entity_count = chunk_transform_count(&renderables->transforms, c);
+        struct gpu_entity *entities = job->entities + c * CHUNK_SIZE;
+        u32 *group_sizes = job->chunk_group_sizes + c * MAX_DRAW_GROUPS;
+        if (job->count_groups)
+            memset(group_sizes, 0, MAX_DRAW_GROUPS * sizeof(u32));
+        for (u32 i = 0; i < entity_count; ++i) {
+            struct gpu_entity *entity = entities + i;
+            for (u32 axis = 0; axis < 3; ++axis) {
+                entity->center[axis] = components->bounds_center[axis][i];
+                entity->extent[axis] = components->bounds_extent[axis][i];
+            }
+            entity->radius = components->bounds_radius[i];
+            entity->render_flags = components->render_flags[i];
+            entity->material_index = components->material[i] == NULL ? 0 : (u32)(components->material[i] - job->scene->materials.data);
+            entity->draw_group = NO_DRAW_GROUP;
+            if (job->draw_groups && components->mesh[i] != NULL) {
+                entity->draw_group = get_draw_group(job, components->mesh[i], components->texture_desc_set[i]);
+                if (job->count_groups)
+                    ++group_sizes[entity->draw_group];
+            }
+        }
+    }
+}
+
+// Gives each draw group present a range of instances sized for all of its renderables, and builds the command templates gpu_cull.comp
+// appends to: every view's command for a group draws its mesh from the group's range, starting with no instances.
+static void build_gpu_draw_groups(struct gpu_cull *gc, u32 const *chunk_group_sizes, u32 chunk_count, struct mesh *meshes) {
+    memset(gc->group_sizes, 0, sizeof(gc->group_sizes));
+    for (u32 c = 0; c < chunk_count; ++c)
+        for (u32 g = 0; g < MAX_DRAW_GROUPS; ++g)
+            gc->group_sizes[g] += chunk_group_sizes[c * MAX_DRAW_GROUPS + g];
+
+    memset(gc->cmds_staging, 0, VIEW_COUNT * MAX_DRAW_GROUPS * sizeof(VkDrawIndexedIndirectCommand));
+    gc->group_count = 0;
+    u32 first_instance = 0;
+    for (u32 g = 0; g < MAX_DRAW_GROUPS; ++g) {
+        if (gc->group_sizes[g] == 0)
+            continue;
+        gc->groups[gc->group_count++] = g;
+        for (u32 v = 0; v < VIEW_COUNT; ++v) {
+            VkDrawIndexedIndirectCommand *cmd = gc->cmds_staging + v * MAX_DRAW_GROUPS + g;
+            cmd->indexCount = meshes[g / DRAW_GROUP_TEXTURES].indexes.count;
+            cmd->firstInstance = v * MAX_GPU_ENTITIES + first_instance;
+        }
+        first_instance += gc->group_sizes[g];
+    }
+}
+
+// Brings this swapchain image's copy of the renderables up to date: model UBOs whose transforms changed, and every renderable's culling
+// data, which is small enough to repack each frame rather than track. In GPU-driven mode the views and draw command templates for
+// gpu_cull.comp go up too, and the visible counts written by the last frame that used this swapchain image are read back.
+static void upload_entities(struct app *app, struct vk_core *vk, struct scene *scene, u32 swapchain_img_idx) {
+    struct transform_store *transforms = &scene->renderables.transforms;
+    u32 chunk_count = (transforms->count + CHUNK_SIZE - 1) / CHUNK_SIZE;
+    u32 gpu_chunk_count = chunk_count < MAX_GPU_ENTITIES / CHUNK_SIZE ? chunk_count : MAX_GPU_ENTITIES / CHUNK_SIZE;
+    for (u32 c = 0; c < gpu_chunk_count; ++c)
+        app->stats.model_ubo_uploads += upload_model_ubos(transforms, c, app->entities.regions.models + swapchain_img_idx, vk,
+                                                          swapchain_img_idx);
+
+    // Renderables past MAX_GPU_ENTITIES aren't drawn, so their model UBOs are never uploaded.
+    for (u32 c = gpu_chunk_count; c < chunk_count; ++c)
+        memset(transforms->chunks.data[c]->dirty, 0, CHUNK_SIZE);
+
+    // Draw groups only change with the renderables' structure (see archetype::version), so they're only rebuilt then, and only while
+    // they're used.
+    struct gpu_cull *gc = &app->gpu_cull;
+    bool rebuild_groups = app->culling.gpu_driven && (!gc->groups_valid || gc->groups_version != scene->renderables.version);
+    struct gpu_entity_job job = {};
+    job.scene = scene;
+    job.entities = app->entities.staging;
+    job.chunk_group_sizes = app->entities.chunk_group_sizes;
+    job.meshes = app->assets.meshes.values;
+    job.textures = app->descriptors.sets.textures.values;
+    job.draw_groups = app->culling.gpu_driven;
+    job.count_groups = rebuild_groups;
+    parallel_for(app->jobs, gpu_chunk_count, 1, pack_gpu_entity_chunks, &job);
+    app->entities.count = transforms->count < MAX_GPU_ENTITIES ? transforms->count : MAX_GPU_ENTITIES;
+    if (app->entities.count > 0)
+        vtk_write_to_host_region(vk->device.logical, app->entities.staging, app->entities.count * sizeof(struct gpu_entity),
+                                 app->entities.regions.data + swapchain_img_idx, 0);
+
+    if (!app->culling.gpu_driven) {
+        gc->groups_valid = false;
+        app->stats.gpu_camera_visible = 0;
+        app->stats.gpu_shadow_visible = 0;
+        return;
+    }
+
+    u32 counts[VIEW_COUNT] = {};
+    read_from_host_region(vk, gc->regions.counts + swapchain_img_idx, counts, sizeof(counts));
+    app->stats.gpu_camera_visible = counts[0];
+    app->stats.gpu_shadow_visible = 0;
+    for (u32 v = 1; v < VIEW_COUNT; ++v)
+        app->stats.gpu_shadow_visible += counts[v];
+
+    if (rebuild_groups) {
+        build_gpu_draw_groups(gc, app->entities.chunk_group_sizes, gpu_chunk_count, app->assets.meshes.values);
+        gc->groups_valid = true;
+        gc->groups_version = scene->renderables.version;
+        gc->stale_templates = (1u << vk->swapchain.image_count) - 1;
+    }
+    if (gc->stale_templates & (1u << swapchain_img_idx)) {
+        vtk_write_to_host_region(vk->device.logical, gc->cmds_staging, VIEW_COUNT * MAX_DRAW_GROUPS * sizeof(VkDrawIndexedIndirectCommand),
+                                 gc->regions.cmd_templates + swapchain_img_idx, 0);
+        gc->stale_templates &= ~(1u << swapchain_img_idx);
+    }
+
+    struct cull_view views[VIEW_COUNT] = {};
+    init_cull_views(views, scene, &app->culling);
+    struct gpu_cull_view gpu_views[VIEW_COUNT] = {};
+    for (u32 v = 0; v < VIEW_COUNT; ++v) {
+        struct cull_view *view = views + v;
+        struct gpu_cull_view *gpu_view = gpu_views + v;
+        memcpy(gpu_view->planes, view->frustum.planes, sizeof(gpu_view->planes));
+        memcpy(gpu_view->eye, view->eye, sizeof(gpu_view->eye));
+        gpu_view->range = view->range;
+        gpu_view->tiny_scale = view->tiny_scale;
+        gpu_view->cull_flags = (view->frustum_enabled ? GPU_CULL_FRUSTUM : 0) |
+                               (view->tiny_enabled ? GPU_CULL_TINY : 0) |
+                               (view->range_enabled ? GPU_CULL_RANGE : 0);
+    }
+    vtk_write_to_host_region(vk->device.logical, gpu_views, sizeof(gpu_views), gc->regions.views + swapchain_img_idx, 0);
+}
+
+// GPU-driven culling does its own frustum culling and draws in the single direct pass.
+static bool hiz_culling_enabled(struct app *app) {
+    return app->culling.occlusion && !app->culling.gpu_driven;
+}
+
+// Packs the camera draws' world bounds for hiz_cull.comp, and reads back the counts written by the last frame that used this swapchain
+// image, which sync_frame() has waited on.
+static void upload_hiz_objects(struct app *app, struct vk_core *vk, struct scene *scene, u32 swapchain_img_idx) {
+    struct hiz *hiz = &app->hiz;
+    if (!hiz_culling_enabled(app)) {
+        hiz->object_count = 0;
+        app->stats.hiz_early_visible = 0;
+        app->stats.hiz_late_visible = 0;
+        app->stats.hiz_occluded = 0;
+        return;
+    }
+
+    u32 counts[3] = {};
+    read_from_host_region(vk, hiz->regions.counts + swapchain_img_idx, counts, sizeof(counts));
+    app->stats.hiz_early_visible = counts[0];
+    app->stats.hiz_late_visible = counts[1];
+    app->stats.hiz_occluded = counts[2];
+
+    struct draw_list *list = &app->draw_lists.direct;
+    hiz->object_count = list->count < MAX_HIZ_OBJECTS ? list->count : MAX_HIZ_OBJECTS;
+    for (u32 i = 0; i < hiz->object_count; ++i) {
+        struct draw *draw = list->draws + i;
+        struct renderable_components *components = scene->renderables.components.data[draw->model_ubo_chunk];
+        struct hiz_object *obj = hiz->objects_staging + i;
+        for (u32 axis = 0; axis < 3; ++axis) {
+            obj->center[axis] = components->bounds_center[axis][draw->model_ubo_idx];
+            obj->extent[axis] = components->bounds_extent[axis][draw->model_ubo_idx];
+        }
+        obj->index_count = draw->mesh->indexes.count;
+    }
+    if (hiz->object_count > 0)
+        vtk_write_to_host_region(vk->device.logical, hiz->objects_staging, hiz->object_count * sizeof(struct hiz_object),
+                                 hiz->regions.objects + swapchain_img_idx, 0);
+}
+
+// Reduces the depth image into every level of the depth pyramid, one dispatch per level.
+static void build_depth_pyramid(struct app *app, VkCommandBuffer cmd_buf) {
+    struct hiz *hiz = &app->hiz;
+    struct compute_pipeline *cp = &app->compute_pipelines.hiz_reduce;
+    vkCmdBindPipeline(cmd_buf, VK_PIPELINE_BIND_POINT_COMPUTE, cp->handle);
+
+    // Culling that read the pyramid before must finish before it's overwritten.
+    memory_barrier(cmd_buf, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0);
+    for (u32 level = 0; level < hiz->level_views.count; ++level) {
+        u32 width = hiz->extent.width >> level;
+        u32 height = hiz->extent.height >> level;
+        width = width > 0 ? width : 1;
+        height = height > 0 ? height : 1;
+        vkCmdBindDescriptorSets(cmd_buf, VK_PIPELINE_BIND_POINT_COMPUTE, cp->layout, 0, 1, app->descriptors.sets.hiz_reduce + level, 0, NULL);
+        vkCmdDispatch(cmd_buf, (width + 7) / 8, (height + 7) / 8, 1);
+        memory_barrier(cmd_buf, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT,
+                       VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT);
+    }
+}
+
+static void dispatch_hiz_cull(struct app *app, VkCommandBuffer cmd_buf, u32 swapchain_img_idx, glm::mat4 const &view_space_mtx, u32 phase,
+                              bool test_occlusion) {
+    struct hiz *hiz = &app->hiz;
+    if (hiz->object_count == 0)
+        return;
+    struct compute_pipeline *cp = &app->compute_pipelines.hiz_cull;
+    vkCmdBindPipeline(cmd_buf, VK_PIPELINE_BIND_POINT_COMPUTE, cp->handle);
+    vkCmdBindDescriptorSets(cmd_buf, VK_PIPELINE_BIND_POINT_COMPUTE, cp->layout, 0, 1, app->descriptors.sets.hiz_cull + swapchain_img_idx, 0, NULL);
+
+    struct hiz_push_constants push_constants = {};
+    push_constants.view_space_mtx = view_space_mtx;
+    push_constants.object_count = hiz->object_count;
+    push_constants.phase = phase;
+    push_constants.test_occlusion = test_occlusion;
+    vkCmdPushConstants(cmd_buf, cp->layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(push_constants), &push_constants);
+    vkCmdDispatch(cmd_buf, (hiz->object_count + 63) / 64, 1, 1);
+
+    // Draw commands are read by the direct pass's indirect draws and by late culling.
+    memory_barrier(cmd_buf, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT,
+                   VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                   VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_SHADER_READ_BIT);
+}
+
+// Resets this frame's draw commands from their templates, then culls every uploaded renderable against every view in one dispatch.
+static void dispatch_gpu_cull(struct app *app, VkCommandBuffer cmd_buf, u32 swapchain_img_idx) {
+    struct gpu_cull *gc = &app->gpu_cull;
+    if (app->entities.count == 0)
+        return;
+    struct vtk_region *templates = gc->regions.cmd_templates + swapchain_img_idx;
+    struct vtk_region *cmds = gc->regions.cmds + swapchain_img_idx;
+    struct vtk_region *counts = gc->regions.counts + swapchain_img_idx;
+    VkBufferCopy copy = { templates->offset, cmds->offset, VIEW_COUNT * MAX_DRAW_GROUPS * sizeof(VkDrawIndexedIndirectCommand) };
+    vkCmdCopyBuffer(cmd_buf, templates->buffer->handle, cmds->buffer->handle, 1, &copy);
+    vkCmdFillBuffer(cmd_buf, counts->buffer->handle, counts->offset, VIEW_COUNT * sizeof(u32), 0);
+    memory_barrier(cmd_buf, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT,
+                   VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+
+    struct compute_pipeline *cp = &app->compute_pipelines.gpu_cull;
+    vkCmdBindPipeline(cmd_buf, VK_PIPELINE_BIND_POINT_COMPUTE, cp->handle);
+    vkCmdBindDescriptorSets(cmd_buf, VK_PIPELINE_BIND_POINT_COMPUTE, cp->layout, 0, 1, app->descriptors.sets.gpu_cull + swapchain_img_idx, 0, NULL);
+    vkCmdPushConstants(cmd_buf, cp->layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(u32), &app->entities.count);
+    vkCmdDispatch(cmd_buf, (app->entities.count + 63) / 64, 1, 1);
+
+    // Draw commands are read by the shadow and direct passes' indirect draws, and instances by their vertex shaders.
+    memory_barrier(cmd_buf, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT,
+                   VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT,
+                   VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_SHADER_READ_BIT);
+}
+
+// State last bound in a secondary command buffer, so draws only bind what changed since the previous one. Draw lists are sorted by state,
+// so most binds are skipped.
+struct bind_cache {
+    struct bind_stats *stats;
+    struct vtk_graphics_pipeline *pipeline;
+    struct vtk_descriptor_set *frame_desc_set;
+    struct vtk_descriptor_set *texture_desc_set;
+    struct mesh *mesh;
+};
+
+// Scene pipelines share a layout (see create_scene_pipeline_layout()), so bound sets stay bound across pipeline changes.
+static void bind_pipeline(struct bind_cache *cache, VkCommandBuffer cmd_buf, struct vtk_graphics_pipeline *gp) {
+    if (gp == cache->pipeline) {
+        ++cache->stats->binds_skipped;
+        return;
+    }
+    vkCmdBindPipeline(cmd_buf, VK_PIPELINE_BIND_POINT_GRAPHICS, gp->handle);
+    cache->pipeline = gp;
+    ++cache->stats->binds;
+}
+
+// Binds set 0 for the frame: sets.frame, or sets.gpu_frame for draws of instances written by gpu_cull.comp. Shadow draws bind it too, which
+// is fine while the shadow maps are being rendered to, as shadow shaders never read them.
+static void bind_frame_desc_set(struct bind_cache *cache, VkCommandBuffer cmd_buf, struct vtk_descriptor_set *frame_desc_set,
+                                u32 swapchain_img_idx) {
+    if (frame_desc_set == cache->frame_desc_set) {
+        ++cache->stats->binds_skipped;
+        return;
+    }
+    struct vtk_descriptor_set_binding frame_desc_set_binding = { frame_desc_set, { 0u, 0u }, swapchain_img_idx };
+    vtk_bind_descriptor_sets(cmd_buf, cache->pipeline->layout, 0, &frame_desc_set_binding, 1);
+    cache->frame_desc_set = frame_desc_set;
+    ++cache->stats->binds;
+}
+
+// Binds the texture (NULL for pipelines without one) and mesh buffers for the next draw_count draws, skipping whatever is already bound.
+static void bind_draw_state(struct bind_cache *cache, VkCommandBuffer cmd_buf, struct mesh *mesh,
+                            struct vtk_descriptor_set *texture_desc_set, u32 draw_count) {
+    struct bind_stats *stats = cache->stats;
+    u32 binds = stats->binds;
+    if (texture_desc_set != NULL && texture_desc_set != cache->texture_desc_set) {
+        struct vtk_descriptor_set_binding texture_desc_set_binding = { texture_desc_set };
+        vtk_bind_descriptor_sets(cmd_buf, cache->pipeline->layout, 1, &texture_desc_set_binding, 1);
+        cache->texture_desc_set = texture_desc_set;
+        ++stats->binds;
+    } else if (texture_desc_set != NULL) {
+        ++stats->binds_skipped;
+    }
+    if (mesh != cache->mesh) {
+        vkCmdBindVertexBuffers(cmd_buf, 0, 1, &mesh->vertex_region.buffer->handle, &mesh->vertex_region.offset);
+        vkCmdBindIndexBuffer(cmd_buf, mesh->index_region.buffer->handle, mesh->index_region.offset, VK_INDEX_TYPE_UINT32);
+        cache->mesh = mesh;
+        stats->binds += 2;
+    } else {
+        stats->binds_skipped += 2;
+    }
+    stats->state_changes += stats->binds != binds;
+    stats->draws += draw_count;
+}
+
+// Records the indirect draw gpu_cull.comp filled in for each of a view's draw groups, after binding the group's mesh (and texture, for the
+// direct pipeline). Groups with every renderable culled draw no instances. Groups are in mesh order, so only textures change between most.
+static void draw_gpu_culled_groups(struct app *app, struct bind_cache *cache, VkCommandBuffer cmd_buf, u32 swapchain_img_idx, u32 view_idx,
+                                   bool bind_texture) {
+    struct gpu_cull *gc = &app->gpu_cull;
+    struct vtk_region *cmds = gc->regions.cmds + swapchain_img_idx;
+    for (u32 i = 0; i < gc->group_count; ++i) {
+        u32 group = gc->groups[i];
+        u32 texture_idx = group % DRAW_GROUP_TEXTURES;
+        bool textured = bind_texture && texture_idx < DRAW_GROUP_TEXTURES - 1;
+        bind_draw_state(cache, cmd_buf, app->assets.meshes.values + group / DRAW_GROUP_TEXTURES,
+                        textured ? app->descriptors.sets.textures.values + texture_idx : NULL, 1);
+        vkCmdDrawIndexedIndirect(cmd_buf, cmds->buffer->handle,
+                                 cmds->offset + (view_idx * MAX_DRAW_GROUPS + group) * sizeof(VkDrawIndexedIndirectCommand), 1,
+                                 sizeof(VkDrawIndexedIndirectCommand));
+    }
+}
+
+static struct worker_cmd_pool *get_worker_cmd_pool(struct app *app, u32 swapchain_img_idx, u32 worker_idx) {
+    return app->cmd_bufs.worker_pools + swapchain_img_idx * app->jobs->worker_count + worker_idx;
+}
+
+static void release_secondary_cmd_buf(struct app *app, u32 swapchain_img_idx, VkCommandBuffer cmd_buf, u32 owner) {
+    struct worker_cmd_pool *pool = get_worker_cmd_pool(app, swapchain_img_idx, owner);
+    CTK_ASSERT(pool->free_count < CTK_ARRAY_COUNT(pool->free))
+    pool->free[pool->free_count++] = cmd_buf;
+}
+
+// Secondary command buffers come from a pool per worker and swapchain image, so workers never share a pool. A task recorded again by the
+// worker that recorded it last reuses its buffer (beginning it resets it); otherwise the buffer is retired and the worker takes one from its
+// own pool.
+static VkCommandBuffer begin_secondary_cmd_buf(struct app *app, struct vk_core *vk, struct record_task *task, struct vtk_render_pass *rp,
+                                               u32 swapchain_img_idx) {
+    if (task->cmd_buf == VK_NULL_HANDLE || task->owner != current_worker_idx) {
+        struct worker_cmd_pool *pool = get_worker_cmd_pool(app, swapchain_img_idx, current_worker_idx);
+        task->retired = task->cmd_buf;
+        task->retired_owner = task->owner;
+        task->cmd_buf = pool->free_count > 0 ? pool->free[--pool->free_count]
+                                             : vtk_allocate_command_buffer(vk->device.logical, pool->handle, VK_COMMAND_BUFFER_LEVEL_SECONDARY);
+        task->owner = current_worker_idx;
+    }
+    VkCommandBuffer cmd_buf = task->cmd_buf;
+
+    VkCommandBufferInheritanceInfo inheritance_info = {};
+    inheritance_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+    inheritance_info.renderPass = rp->handle;
+    inheritance_info.subpass = 0;
+    inheritance_info.framebuffer = rp->framebuffers[swapchain_img_idx];
+
+    VkCommandBufferBeginInfo cmd_buf_begin_info = {};
+    cmd_buf_begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    cmd_buf_begin_info.flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+    cmd_buf_begin_info.pInheritanceInfo = &inheritance_info;
+    vtk_validate_result(vkBeginCommandBuffer(cmd_buf, &cmd_buf_begin_info), "failed to begin recording secondary command buffer");
+    return cmd_buf;
+}
+
+static void record_shadow_draws(struct app *app, VkCommandBuffer cmd_buf, struct bind_cache *cache, u32 swapchain_img_idx,
+                                u32 direction_view_mtx_idx) {
+    struct vtk_graphics_pipeline *gp = &app->graphics_pipelines.shadow;
+    bind_pipeline(cache, cmd_buf, gp);
+
+    bool gpu_driven = app->culling.gpu_driven;
+    bind_frame_desc_set(cache, cmd_buf, gpu_driven ? &app->descriptors.sets.gpu_frame : &app->descriptors.sets.frame, swapchain_img_idx);
+    vkCmdPushConstants(cmd_buf, gp->layout, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(u32),
+                       &direction_view_mtx_idx);
+    if (gpu_driven)
+        draw_gpu_culled_groups(app, cache, cmd_buf, swapchain_img_idx, 1 + direction_view_mtx_idx, false);
+
+    struct draw_list *draw_list = app->draw_lists.shadow + direction_view_mtx_idx;
+    for (u32 i = 0; i < draw_list->batch_count; ++i) {
+        struct draw_batch *batch = draw_list->batches + i;
+        bind_draw_state(cache, cmd_buf, batch->mesh, NULL, 1);
+        vkCmdDrawIndexed(cmd_buf, batch->mesh->indexes.count, batch->instance_count, 0, 0, batch->first_instance);
+    }
+}
+
+// Draws the camera's opaque instances in [first_instance, end_instance). With occlusion culling, camera draws go through their Hi-Z
+// indirect command for the phase, which has an instance count of 0 when culled. A batch's commands are contiguous, so they're drawn with
+// one multi-draw per batch (or per maxDrawIndirectCount commands; one per command without multiDrawIndirect). Draws past MAX_HIZ_OBJECTS
+// are drawn instanced in the early pass. In GPU-driven mode, camera draws come from gpu_cull.comp and are all drawn in the early pass.
+static void record_direct_draws(struct app *app, struct vk_core *vk, VkCommandBuffer cmd_buf, struct bind_cache *cache, u32 swapchain_img_idx,
+                                u32 phase, u32 first_instance, u32 end_instance) {
+    struct vtk_graphics_pipeline *direct_gp = &app->graphics_pipelines.direct;
+    bind_pipeline(cache, cmd_buf, direct_gp);
+    if (app->culling.gpu_driven) {
+        bind_frame_desc_set(cache, cmd_buf, &app->descriptors.sets.gpu_frame, swapchain_img_idx);
+        draw_gpu_culled_groups(app, cache, cmd_buf, swapchain_img_idx, 0, true);
+        return;
+    }
+    bind_frame_desc_set(cache, cmd_buf, &app->descriptors.sets.frame, swapchain_img_idx);
+
+    // Camera draws' instances start at 0, so a draw's instance is also its Hi-Z object.
+    struct hiz *hiz = &app->hiz;
+    u32 hiz_draw_count = phase != HIZ_PHASE_NONE ? hiz->object_count : 0;
+    struct vtk_region *cmds = (phase == HIZ_PHASE_EARLY ? hiz->regions.early_cmds : hiz->regions.late_cmds) + swapchain_img_idx;
+    struct draw_list *direct = &app->draw_lists.direct;
+    for (u32 i = 0; i < direct->batch_count; ++i) {
+        struct draw_batch *batch = direct->batches + i;
+        u32 first = batch->first_instance > first_instance ? batch->first_instance : first_instance;
+        u32 end = batch->first_instance + batch->instance_count;
+        end = end < end_instance ? end : end_instance;
+        if (first >= end_instance)
+            break;
+        if (first >= end)
+            continue;
+        u32 hiz_end = end < hiz_draw_count ? end : hiz_draw_count;
+        u32 hiz_draws = hiz_end > first ? hiz_end - first : 0;
+        u32 direct_first = first > hiz_end ? first : hiz_end;
+        bool draw_direct = phase != HIZ_PHASE_LATE && direct_first < end;
+        if (hiz_draws == 0 && !draw_direct)
+            continue;
+        bind_draw_state(cache, cmd_buf, batch->mesh, batch->texture_desc_set, hiz_draws + draw_direct);
+        for (u32 instance = first; instance < hiz_end; instance += vk->max_draw_indirect_count) {
+            u32 draw_count = hiz_end - instance < vk->max_draw_indirect_count ? hiz_end - instance : vk->max_draw_indirect_count;
+            vkCmdDrawIndexedIndirect(cmd_buf, cmds->buffer->handle, cmds->offset + instance * sizeof(VkDrawIndexedIndirectCommand),
+                                     draw_count, sizeof(VkDrawIndexedIndirectCommand));
+        }
+        if (draw_direct)
+            vkCmdDrawIndexed(cmd_buf, batch->mesh->indexes.count, end - direct_first, 0, 0, direct_first);
+    }
+}
+
+// Lights and transparent draws go in the late (or single) direct pass, after every opaque draw.
+static void record_late_draws(struct app *app, struct scene *scene, VkCommandBuffer cmd_buf, struct bind_cache *cache,
+                              u32 swapchain_img_idx) {
+    ////////////////////////////////////////////////////////////
+    /// Render Lights
+    ////////////////////////////////////////////////////////////
+    struct vtk_graphics_pipeline *unlit_gp = &app->graphics_pipelines.unlit;
+    bind_pipeline(cache, cmd_buf, unlit_gp);
+
+    // Light data is in the frame set, indexed by a pushed light index rather than rebinding dynamic offsets per light.
+    bind_frame_desc_set(cache, cmd_buf, &app->descriptors.sets.frame, swapchain_img_idx);
+
+    struct mesh *light_diamond = ctk_at(&app->assets.meshes, "light_diamond");
+    for (u32 i = 0; i < scene->lights.transforms.count; ++i) {
+        vkCmdPushConstants(cmd_buf, unlit_gp->layout, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(u32), &i);
+        bind_draw_state(cache, cmd_buf, light_diamond, NULL, 1);
+        vkCmdDrawIndexed(cmd_buf, light_diamond->indexes.count, 1, 0, 0, 0);
+    }
+
+    ////////////////////////////////////////////////////////////
+    /// Render Transparent Entities
+    ////////////////////////////////////////////////////////////
+    struct draw_list *transparent = &app->draw_lists.transparent;
+    if (transparent->count > 0) {
+        struct vtk_graphics_pipeline *transparent_gp = &app->graphics_pipelines.direct_transparent;
+        bind_pipeline(cache, cmd_buf, transparent_gp);
+        for (u32 i = 0; i < transparent->batch_count; ++i) {
+            struct draw_batch *batch = transparent->batches + i;
+            bind_draw_state(cache, cmd_buf, batch->mesh, batch->texture_desc_set, 1);
+            vkCmdDrawIndexed(cmd_buf, batch->mesh->indexes.count, batch->instance_count, 0, 0, batch->first_instance);
+        }
+    }
+}
+
+enum {
+    RECORD_TASK_SHADOW_FACE,
+    RECORD_TASK_DIRECT,
+    RECORD_TASK_LATE, // Lights and transparent draws.
+};
+
+static u32 const MIN_RECORD_TASK_INSTANCES = 4096;
+static u32 const MAX_DIRECT_RECORD_TASKS = 16; // Per direct pass phase.
+
+static struct vtk_render_pass *get_direct_render_pass(struct app *app, u32 phase) {
+    return phase == HIZ_PHASE_EARLY ? &app->render_passes.direct
+         : phase == HIZ_PHASE_LATE  ? &app->render_passes.direct_late
+                                    : &app->render_passes.direct_single;
+}
+
+struct record_job {
+    struct app *app;
+    struct vk_core *vk;
+    struct scene *scene;
+    u32 swapchain_img_idx;
+    struct record_cache *cache;
+};
 
-    struct ctk_v3<f32> up = {};
-    up.x = world_mtx[0][1];
-    up.y = world_mtx[1][1];
-    up.z = world_mtx[2][1];
+// Task buffers are kept from the last time the task was recorded, so only the task's place in the list is set here.
+static struct record_task *push_record_task(struct record_cache *cache, u32 type, u32 idx) {
+    CTK_ASSERT(cache->task_count < MAX_RECORD_TASKS)
+    struct record_task *task = cache->tasks + cache->task_count++;
+    task->type = type;
+    task->idx = idx;
+    task->first_instance = 0;
+    task->end_instance = 0;
+    return task;
+}
 
-    struct ctk_v3<f32> forward = {};
-    forward.x = world_mtx[0][2];
-    forward.y = world_mtx[1][2];
-    forward.z = world_mtx[2][2];
+// Splits the camera's opaque instances [0, instance_count) between direct tasks for the phase.
+static void push_direct_record_tasks(struct record_cache *cache, u32 phase, u32 instance_count) {
+    u32 task_size = (instance_count + MAX_DIRECT_RECORD_TASKS - 1) / MAX_DIRECT_RECORD_TASKS;
+    task_size = task_size > MIN_RECORD_TASK_INSTANCES ? task_size : MIN_RECORD_TASK_INSTANCES;
+    for (u32 first = 0; first < instance_count; first += task_size) {
+        struct record_task *task = push_record_task(cache, RECORD_TASK_DIRECT, phase);
+        task->first_instance = first;
+        task->end_instance = instance_count - first < task_size ? instance_count : first + task_size;
+    }
+}
 
-    struct ctk_v3<f32> new_pos = *pos;
-    new_pos = new_pos + (right * translation.x);
-    new_pos = new_pos + (up * translation.y);
-    *pos = new_pos + (forward * translation.z);
+static u64 const HASH_SEED = 0xCBF29CE484222325;
+
+// FNV-1a.
+static u64 hash_bytes(u64 hash, void const *data, u32 size) {
+    auto bytes = (u8 const *)data;
+    for (u32 i = 0; i < size; ++i)
+        hash = (hash ^ bytes[i]) * 0x100000001B3;
+    return hash;
 }
 
-static void camera_controls(struct transform *cam_trans, struct window *window) {
-    if (window->mouse_button_down[GLFW_MOUSE_BUTTON_2]) {
-        static f32 const SENS = 0.4f;
-        cam_trans->rotation.x += window->mouse_delta.y * SENS;
-        cam_trans->rotation.y -= window->mouse_delta.x * SENS;
-        cam_trans->rotation.x = ctk_clamp(cam_trans->rotation.x, -80.0f, 80.0f);
+// Hashes everything a task's commands depend on: the task, the pipelines it binds, and the batches or draw groups it draws. Descriptor sets,
+// framebuffers and indirect command regions are fixed per swapchain image, and the contents of the buffers they point at (UBOs, entities,
+// instances, indirect commands) aren't part of the commands, so they can change without the task being recorded again.
+static u64 get_record_signature(struct app *app, struct scene *scene, struct record_task *task) {
+    u64 hash = HASH_SEED;
+    hash = hash_bytes(hash, &task->type, sizeof(task->type));
+    hash = hash_bytes(hash, &task->idx, sizeof(task->idx));
+    hash = hash_bytes(hash, &task->first_instance, sizeof(task->first_instance));
+    hash = hash_bytes(hash, &task->end_instance, sizeof(task->end_instance));
+    bool gpu_driven = app->culling.gpu_driven;
+    hash = hash_bytes(hash, &gpu_driven, sizeof(gpu_driven));
+    if (gpu_driven && task->type != RECORD_TASK_LATE)
+        hash = hash_bytes(hash, app->gpu_cull.groups, app->gpu_cull.group_count * sizeof(u32));
+
+    if (task->type == RECORD_TASK_SHADOW_FACE) {
+        struct draw_list *list = app->draw_lists.shadow + task->idx;
+        hash = hash_bytes(hash, &app->graphics_pipelines.shadow.handle, sizeof(VkPipeline));
+        hash = hash_bytes(hash, list->batches, list->batch_count * sizeof(struct draw_batch));
+    } else if (task->type == RECORD_TASK_DIRECT) {
+        struct draw_list *list = &app->draw_lists.direct;
+        u32 hiz_draw_count = task->idx != HIZ_PHASE_NONE ? app->hiz.object_count : 0;
+        hash = hash_bytes(hash, &app->graphics_pipelines.direct.handle, sizeof(VkPipeline));
+        hash = hash_bytes(hash, &hiz_draw_count, sizeof(hiz_draw_count));
+        for (u32 i = 0; i < list->batch_count && !gpu_driven; ++i) {
+            struct draw_batch *batch = list->batches + i;
+            if (batch->first_instance < task->end_instance && batch->first_instance + batch->instance_count > task->first_instance)
+                hash = hash_bytes(hash, batch, sizeof(struct draw_batch));
+        }
+    } else {
+        struct draw_list *list = &app->draw_lists.transparent;
+        hash = hash_bytes(hash, &app->graphics_pipelines.unlit.handle, sizeof(VkPipeline));
+        hash = hash_bytes(hash, &app->graphics_pipelines.direct_transparent.handle, sizeof(VkPipeline));
+        hash = hash_bytes(hash, &scene->lights.transforms.count, sizeof(scene->lights.transforms.count));
+        hash = hash_bytes(hash, list->batches, list->batch_count * sizeof(struct draw_batch));
     }
+    return hash;
+}
 
-    struct ctk_v3<f32> translation = {};
-    f32 mod = window->key_down[GLFW_KEY_LEFT_SHIFT] ? 4 :
-              window->key_down[GLFW_KEY_LEFT_CONTROL] ? 1 :
-              2;
-    if (window->key_down[GLFW_KEY_W]) translation.z += 0.01f * mod;
-    if (window->key_down[GLFW_KEY_S]) translation.z -= 0.01f * mod;
-    if (window->key_down[GLFW_KEY_D]) translation.x += 0.01f * mod;
-    if (window->key_down[GLFW_KEY_A]) translation.x -= 0.01f * mod;
-    if (window->key_down[GLFW_KEY_E]) translation.y -= 0.01f * mod;
-    if (window->key_down[GLFW_KEY_Q]) translation.y += 0.01f * mod;
-    local_translate(cam_trans, translation);
+static void record_task_cmd_bufs(void *data, u32 first, u32 count) {
+    auto job = (struct record_job *)data;
+    struct app *app = job->app;
+    u32 img = job->swapchain_img_idx;
+    for (u32 t = first; t < first + count; ++t) {
+        struct record_task *task = job->cache->tasks + t;
+        u64 signature = get_record_signature(app, job->scene, task);
+        if (task->cmd_buf != VK_NULL_HANDLE && task->signature == signature)
+            continue;
+        task->signature = signature;
+        task->recorded = true;
+        task->binds = {};
+
+        struct vtk_render_pass *rp = task->type == RECORD_TASK_SHADOW_FACE ? &app->render_passes.shadow
+                                   : get_direct_render_pass(app, task->idx);
+        VkCommandBuffer cmd_buf = begin_secondary_cmd_buf(app, job->vk, task, rp, img);
+        struct bind_cache cache = { &task->binds };
+        if (task->type == RECORD_TASK_SHADOW_FACE)
+            record_shadow_draws(app, cmd_buf, &cache, img, task->idx);
+        else if (task->type == RECORD_TASK_DIRECT)
+            record_direct_draws(app, job->vk, cmd_buf, &cache, img, task->idx, task->first_instance, task->end_instance);
+        else
+            record_late_draws(app, job->scene, cmd_buf, &cache, img);
+        vtk_validate_result(vkEndCommandBuffer(cmd_buf), "error during secondary command buffer recording");
+    }
 }
 
-////////////////////////////////////////////////////////////
-/// Rendering
-////////////////////////////////////////////////////////////
-static u32 vtk_aquire_swapchain_image_index(struct app *app, struct vk_core *vk) {
-    u32 swapchain_img_idx = CTK_U32_MAX;
-    VkSemaphore img_aquired_semaphore = app->frame_sync.img_aquired[app->frame_sync.curr_frame];
-    vtk_validate_result(vkAcquireNextImageKHR(vk->device.logical, vk->swapchain.handle, CTK_U64_MAX, img_aquired_semaphore, VK_NULL_HANDLE, &swapchain_img_idx),
-                        "failed to aquire next swapchain image");
-    return swapchain_img_idx;
+// Shadow faces, chunks of the camera's opaque instances, and the late pass's lights and transparent draws each get a secondary command
+// buffer. Only tasks whose signature changed since this swapchain image's last frame are recorded again, in parallel; the rest reuse their
+// buffers. A camera or light that stays put with the scene's entities, meshes, textures and pipelines unchanged records nothing.
+static void record_secondary_cmd_bufs(struct record_job *job) {
+    struct app *app = job->app;
+    struct record_cache *cache = job->cache;
+    u32 prev_task_count = cache->task_count;
+    cache->task_count = 0;
+    for (u32 face = 0; face < 6; ++face)
+        push_record_task(cache, RECORD_TASK_SHADOW_FACE, face);
+    u32 late_phase = hiz_culling_enabled(app) ? HIZ_PHASE_LATE : HIZ_PHASE_NONE;
+    if (app->culling.gpu_driven) {
+        push_record_task(cache, RECORD_TASK_DIRECT, HIZ_PHASE_NONE);
+    } else if (late_phase == HIZ_PHASE_LATE) {
+        push_direct_record_tasks(cache, HIZ_PHASE_EARLY, app->draw_lists.direct.count);
+        push_direct_record_tasks(cache, HIZ_PHASE_LATE, app->hiz.object_count);
+    } else {
+        push_direct_record_tasks(cache, HIZ_PHASE_NONE, app->draw_lists.direct.count);
+    }
+    push_record_task(cache, RECORD_TASK_LATE, late_phase);
+
+    // Tasks dropped since the last frame hand their buffers back.
+    for (u32 t = cache->task_count; t < prev_task_count; ++t) {
+        struct record_task *task = cache->tasks + t;
+        if (task->cmd_buf != VK_NULL_HANDLE)
+            release_secondary_cmd_buf(app, job->swapchain_img_idx, task->cmd_buf, task->owner);
+        *task = {};
+    }
+
+    for (u32 t = 0; t < cache->task_count; ++t)
+        cache->tasks[t].recorded = false;
+    parallel_for(app->jobs, cache->task_count, 1, record_task_cmd_bufs, job);
+
+    app->stats.binds = {};
+    app->stats.recorded_cmd_bufs = 0;
+    for (u32 t = 0; t < cache->task_count; ++t) {
+        struct record_task *task = cache->tasks + t;
+        if (task->retired != VK_NULL_HANDLE) {
+            release_secondary_cmd_buf(app, job->swapchain_img_idx, task->retired, task->retired_owner);
+            task->retired = VK_NULL_HANDLE;
+        }
+        app->stats.binds.draws += task->binds.draws;
+        app->stats.binds.state_changes += task->binds.state_changes;
+        app->stats.binds.binds += task->binds.binds;
+        app->stats.binds.binds_skipped += task->binds.binds_skipped;
+        app->stats.recorded_cmd_bufs += task->recorded;
+    }
+    app->stats.secondary_cmd_bufs = cache->task_count;
 }
 
-static void sync_frame(struct app *app, struct vk_core *vk, u32 swapchain_img_idx) {
-    u32 *img_prev_frame = app->frame_sync.img_prev_frame + swapchain_img_idx;
-    if (*img_prev_frame != CTK_U32_MAX)
-        vkWaitForFences(vk->device.logical, 1, app->frame_sync.in_flight + *img_prev_frame, VK_TRUE, CTK_U64_MAX);
-    vkResetFences(vk->device.logical, 1, app->frame_sync.in_flight + app->frame_sync.curr_frame);
-    *img_prev_frame = app->frame_sync.curr_frame;
+// Executes the job's secondary command buffers of the given type and index, in the order their tasks were pushed.
+static void execute_record_tasks(VkCommandBuffer cmd_buf, struct record_job *job, u32 type, u32 idx) {
+    VkCommandBuffer secondaries[MAX_RECORD_TASKS] = {};
+    u32 count = 0;
+    for (u32 t = 0; t < job->cache->task_count; ++t)
+        if (job->cache->tasks[t].type == type && job->cache->tasks[t].idx == idx)
+            secondaries[count++] = job->cache->tasks[t].cmd_buf;
+    if (count > 0)
+        vkCmdExecuteCommands(cmd_buf, count, secondaries);
 }
 
-static void render_omni_shadow_map_direction(struct app *app, struct vk_core *vk, struct scene *scene, u32 swapchain_img_idx, VkCommandBuffer cmd_buf, u32 direction_view_mtx_idx) {
+static void render_omni_shadow_map_direction(struct app *app, struct record_job *job, VkCommandBuffer cmd_buf, u32 direction_view_mtx_idx) {
     struct vtk_render_pass *rp = &app->render_passes.shadow;
 
     VkRect2D render_area = {};
@@ -1670,112 +6379,48 @@ static void render_omni_shadow_map_direction(struct app *app, struct vk_core *vk
     VkRenderPassBeginInfo rp_begin_info = {};
     rp_begin_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
     rp_begin_info.renderPass = rp->handle;
-    rp_begin_info.framebuffer = rp->framebuffers[swapchain_img_idx];
+    rp_begin_info.framebuffer = rp->framebuffers[job->swapchain_img_idx];
     rp_begin_info.renderArea = render_area;
     rp_begin_info.clearValueCount = rp->clear_values.count;
     rp_begin_info.pClearValues = rp->clear_values.data;
 
-    vkCmdBeginRenderPass(cmd_buf, &rp_begin_info, VK_SUBPASS_CONTENTS_INLINE);
-        struct vtk_graphics_pipeline *gp = &app->graphics_pipelines.shadow;
-        vkCmdBindPipeline(cmd_buf, VK_PIPELINE_BIND_POINT_GRAPHICS, gp->handle);
-
-        // Push Constants
-        vkCmdPushConstants(cmd_buf, gp->layout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(u32), &direction_view_mtx_idx);
-
-        // Light Descriptor Sets
-        struct vtk_descriptor_set_binding light_desc_set_binding = { &app->descriptors.sets.light_ubo, { 0u }, swapchain_img_idx };
-        vtk_bind_descriptor_sets(cmd_buf, gp->layout, 0, &light_desc_set_binding, 1);
-
-        for (u32 i = 0; i < scene->entities.count; ++i) {
-            struct entity *entity = scene->entities + i;
-            struct mesh *mesh = entity->mesh;
-
-            // Entity Descriptor Sets
-            struct vtk_descriptor_set_binding entity_desc_set_binding = { &app->descriptors.sets.entity_model_ubo, { i }, swapchain_img_idx };
-            vtk_bind_descriptor_sets(cmd_buf, gp->layout, 1, &entity_desc_set_binding, 1);
-
-            vkCmdBindVertexBuffers(cmd_buf, 0, 1, &mesh->vertex_region.buffer->handle, &mesh->vertex_region.offset);
-            vkCmdBindIndexBuffer(cmd_buf, mesh->index_region.buffer->handle, mesh->index_region.offset, VK_INDEX_TYPE_UINT32);
-            vkCmdDrawIndexed(cmd_buf, mesh->indexes.count, 1, 0, 0, 0);
-        }
+    vkCmdBeginRenderPass(cmd_buf, &rp_begin_info, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+        execute_record_tasks(cmd_buf, job, RECORD_TASK_SHADOW_FACE, direction_view_mtx_idx);
     vkCmdEndRenderPass(cmd_buf);
 }
 
-static void copy_omni_shadow_map_face(struct app *app, VkCommandBuffer cmd_buf, u32 face_idx) {
-    // Transition directional shadow map to transfer source.
-    {
-        VkImageMemoryBarrier img_barrier = {};
-        img_barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-        img_barrier.srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
-        img_barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
-        img_barrier.oldLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-        img_barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
-        img_barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-        img_barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-        img_barrier.image = app->shadow_maps.directional.handle;
-        img_barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
-        img_barrier.subresourceRange.baseMipLevel = 0;
-        img_barrier.subresourceRange.levelCount = 1;
-        img_barrier.subresourceRange.baseArrayLayer = 0;
-        img_barrier.subresourceRange.layerCount = 1;
-        vkCmdPipelineBarrier(cmd_buf,
-                             VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
-                             VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
-                             0, // Dependency Flags
-                             0, NULL, // Memory Barriers
-                             0, NULL, // Buffer Memory Barriers
-                             1, &img_barrier); // Image Memory Barriers
-    }
+static void render_direct_pass(struct app *app, struct vk_core *vk, struct record_job *job, VkCommandBuffer cmd_buf, u32 phase) {
+    struct vtk_render_pass *rp = get_direct_render_pass(app, phase);
 
-    // Copy from directional shadow map to face of omni shadow map.
-    VkImageCopy copy_region = {};
-    copy_region.srcSubresource.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
-    copy_region.srcSubresource.baseArrayLayer = 0;
-    copy_region.srcSubresource.mipLevel = 0;
-    copy_region.srcSubresource.layerCount = 1;
-    copy_region.srcOffset = { 0, 0, 0 };
-    copy_region.dstSubresource.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
-    copy_region.dstSubresource.baseArrayLayer = face_idx;
-    copy_region.dstSubresource.mipLevel = 0;
-    copy_region.dstSubresource.layerCount = 1;
-    copy_region.dstOffset = { 0, 0, 0 };
-    copy_region.extent.width = SHADOW_MAP_SIZE;
-    copy_region.extent.height = SHADOW_MAP_SIZE;
-    copy_region.extent.depth = 1;
+    VkRect2D render_area = {};
+    render_area.offset.x = 0;
+    render_area.offset.y = 0;
+    render_area.extent = vk->swapchain.extent;
 
-    // Copy from directional shadow map to omni shadow map face.
-    vkCmdCopyImage(cmd_buf,
-                   app->shadow_maps.directional.handle, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
-                   app->shadow_maps.omni.handle, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-                   1, &copy_region);
+    VkRenderPassBeginInfo rp_begin_info = {};
+    rp_begin_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+    rp_begin_info.renderPass = rp->handle;
+    rp_begin_info.framebuffer = rp->framebuffers[job->swapchain_img_idx];
+    rp_begin_info.renderArea = render_area;
+    rp_begin_info.clearValueCount = rp->clear_values.count;
+    rp_begin_info.pClearValues = rp->clear_values.data;
 
-    // Transition directional shadow map back to depth attachment.
-    {
-        VkImageMemoryBarrier img_barrier = {};
-        img_barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-        img_barrier.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
-        img_barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
-        img_barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
-        img_barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-        img_barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-        img_barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-        img_barrier.image = app->shadow_maps.directional.handle;
-        img_barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
-        img_barrier.subresourceRange.baseMipLevel = 0;
-        img_barrier.subresourceRange.levelCount = 1;
-        img_barrier.subresourceRange.baseArrayLayer = 0;
-        img_barrier.subresourceRange.layerCount = 1;
-        vkCmdPipelineBarrier(cmd_buf,
-                             VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
-                             VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
-                             0, // Dependency Flags
-                             0, NULL, // Memory Barriers
-                             0, NULL, // Buffer Memory Barriers
-                             1, &img_barrier); // Image Memory Barriers
-    }
+    vkCmdBeginRenderPass(cmd_buf, &rp_begin_info, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+        execute_record_tasks(cmd_buf, job, RECORD_TASK_DIRECT, phase);
+        if (phase != HIZ_PHASE_EARLY)
+            execute_record_tasks(cmd_buf, job, RECORD_TASK_LATE, phase);
+    vkCmdEndRenderPass(cmd_buf);
 }
 
 static void record_render_passes(struct app *app, struct vk_core *vk, struct scene *scene, struct ui *ui, u32 swapchain_img_idx) {
+    struct record_job job = {};
+    job.app = app;
+    job.vk = vk;
+    job.scene = scene;
+    job.swapchain_img_idx = swapchain_img_idx;
+    job.cache = app->cmd_bufs.record_caches + swapchain_img_idx;
+    record_secondary_cmd_bufs(&job);
+
     VkCommandBufferBeginInfo cmd_buf_begin_info = {};
     cmd_buf_begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
     cmd_buf_begin_info.flags = 0;
@@ -1783,6 +6428,8 @@ static void record_render_passes(struct app *app, struct vk_core *vk, struct sce
 
     VkCommandBuffer cmd_buf = app->cmd_bufs.render[swapchain_img_idx];
     vtk_validate_result(vkBeginCommandBuffer(cmd_buf, &cmd_buf_begin_info), "failed to begin recording command buffer");
+        if (app->culling.gpu_driven)
+            dispatch_gpu_cull(app, cmd_buf, swapchain_img_idx);
 #if 1
         // Shadow
         {
@@ -1813,7 +6460,7 @@ static void record_render_passes(struct app *app, struct vk_core *vk, struct sce
 
             // Render shadow maps for each direcion and copy to respective omni shadow map face.
             for (u32 i = 0; i < 6; ++i) {
-                render_omni_shadow_map_direction(app, vk, scene, swapchain_img_idx, cmd_buf, i);
+                render_omni_shadow_map_direction(app, &job, cmd_buf, i);
                 copy_omni_shadow_map_face(app, cmd_buf, i);
             }
 
@@ -1846,71 +6493,30 @@ static void record_render_passes(struct app *app, struct vk_core *vk, struct sce
 #if 1
         // Direct
         {
-            struct vtk_render_pass *rp = &app->render_passes.direct;
-
-            VkRect2D render_area = {};
-            render_area.offset.x = 0;
-            render_area.offset.y = 0;
-            render_area.extent = vk->swapchain.extent;
-
-            VkRenderPassBeginInfo rp_begin_info = {};
-            rp_begin_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-            rp_begin_info.renderPass = rp->handle;
-            rp_begin_info.framebuffer = rp->framebuffers[swapchain_img_idx];
-            rp_begin_info.renderArea = render_area;
-            rp_begin_info.clearValueCount = rp->clear_values.count;
-            rp_begin_info.pClearValues = rp->clear_values.data;
-
-            vkCmdBeginRenderPass(cmd_buf, &rp_begin_info, VK_SUBPASS_CONTENTS_INLINE);
-                ////////////////////////////////////////////////////////////
-                /// Render Entities
-                ////////////////////////////////////////////////////////////
-                struct vtk_graphics_pipeline *direct_gp = &app->graphics_pipelines.direct;
-                vkCmdBindPipeline(cmd_buf, VK_PIPELINE_BIND_POINT_GRAPHICS, direct_gp->handle);
-
-                // Push Constants
-                vkCmdPushConstants(cmd_buf, direct_gp->layout, VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(struct ctk_v3<f32>), &scene->camera.transform.position);
-
-                // Light Descriptor Sets
-                struct vtk_descriptor_set_binding light_desc_set_binding = { &app->descriptors.sets.light_ubo, { 0u }, swapchain_img_idx };
-                vtk_bind_descriptor_sets(cmd_buf, direct_gp->layout, 0, &light_desc_set_binding, 1);
-
-                for (u32 i = 0; i < scene->entities.count; ++i) {
-                    struct entity *entity = scene->entities + i;
-                    struct mesh *mesh = entity->mesh;
-
-                    // Entity Descriptor Sets
-                    struct vtk_descriptor_set_binding entity_desc_set_bindings[] = {
-                        { &app->descriptors.sets.entity_model_ubo, { i }, swapchain_img_idx },
-                        { entity->texture_desc_set },
-                        { &app->descriptors.sets.shadow_maps.directional },
-                        { &app->descriptors.sets.shadow_maps.omni },
-                    };
-                    vtk_bind_descriptor_sets(cmd_buf, direct_gp->layout, 1, entity_desc_set_bindings, CTK_ARRAY_COUNT(entity_desc_set_bindings));
-
-                    vkCmdBindVertexBuffers(cmd_buf, 0, 1, &mesh->vertex_region.buffer->handle, &mesh->vertex_region.offset);
-                    vkCmdBindIndexBuffer(cmd_buf, mesh->index_region.buffer->handle, mesh->index_region.offset, VK_INDEX_TYPE_UINT32);
-                    vkCmdDrawIndexed(cmd_buf, mesh->indexes.count, 1, 0, 0, 0);
-                }
-
-                ////////////////////////////////////////////////////////////
-                /// Render Lights
-                ////////////////////////////////////////////////////////////
-                struct vtk_graphics_pipeline *unlit_gp = &app->graphics_pipelines.unlit;
-                vkCmdBindPipeline(cmd_buf, VK_PIPELINE_BIND_POINT_GRAPHICS, unlit_gp->handle);
-
-                struct mesh *light_diamond = ctk_at(&app->assets.meshes, "light_diamond");
-                for (u32 i = 0; i < scene->lights.count; ++i) {
-                    struct vtk_descriptor_set_binding desc_set_bindings[] = {
-                        { &app->descriptors.sets.light_ubo, { i }, swapchain_img_idx },
-                        { &app->descriptors.sets.light_model_ubo, { i }, swapchain_img_idx },
-                    };
-                    vtk_bind_descriptor_sets(cmd_buf, unlit_gp->layout, 0, desc_set_bindings, CTK_ARRAY_COUNT(desc_set_bindings));
-                    vkCmdBindVertexBuffers(cmd_buf, 0, 1, &light_diamond->vertex_region.buffer->handle, &light_diamond->vertex_region.offset);
-                    vkCmdBindIndexBuffer(cmd_buf, light_diamond->index_region.buffer->handle, light_diamond->index_region.offset, VK_INDEX_TYPE_UINT32);
-                    vkCmdDrawIndexed(cmd_buf, light_diamond->indexes.count, 1, 0, 0, 0);
-                }
-            vkCmdEndRenderPass(cmd_buf);
+            struct hiz *hiz = &app->hiz;
+            glm::mat4 view_space_mtx = camera_view_space_mtx(&scene->camera);
+            if (hiz_culling_enabled(app)) {
+                vkCmdFillBuffer(cmd_buf, hiz->regions.counts[swapchain_img_idx].buffer->handle, hiz->regions.counts[swapchain_img_idx].offset,
+                                3 * sizeof(u32), 0);
+                memory_barrier(cmd_buf, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT,
+                               VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+
+                // Early culling tests against the previous frame's depth from the previous frame's point of view. Without one (first
+                // frame), everything goes in the early pass.
+                if (hiz->prev_depth_valid)
+                    build_depth_pyramid(app, cmd_buf);
+                dispatch_hiz_cull(app, cmd_buf, swapchain_img_idx, hiz->prev_view_space_mtx, HIZ_PHASE_EARLY, hiz->prev_depth_valid);
+                render_direct_pass(app, vk, &job, cmd_buf, HIZ_PHASE_EARLY);
+                build_depth_pyramid(app, cmd_buf);
+                dispatch_hiz_cull(app, cmd_buf, swapchain_img_idx, view_space_mtx, HIZ_PHASE_LATE, true);
+                render_direct_pass(app, vk, &job, cmd_buf, HIZ_PHASE_LATE);
+                hiz->prev_view_space_mtx = view_space_mtx;
+                hiz->prev_depth_valid = true;
+            } else {
+                // Depth isn't kept by the single pass, so turning Hi-Z culling back on starts over as on the first frame.
+                render_direct_pass(app, vk, &job, cmd_buf, HIZ_PHASE_NONE);
+                hiz->prev_depth_valid = false;
+            }
         }
 #endif
 #if 1
@@ -1935,8 +6541,16 @@ static void record_render_passes(struct app *app, struct vk_core *vk, struct sce
                 struct vtk_graphics_pipeline *gp = &app->graphics_pipelines.fullscreen_texture;
                 struct mesh *fullscreen_quad = ctk_at(&app->assets.meshes, "fullscreen_quad");
                 vkCmdBindPipeline(cmd_buf, VK_PIPELINE_BIND_POINT_GRAPHICS, gp->handle);
+
+                // The viewed texture's set is written per frame, so switching what's viewed needs no long-lived set per texture.
+                struct vtk_descriptor_set texture_set = {};
+                allocate_transient_descriptor_set(app, vk, swapchain_img_idx, &texture_set, app->descriptors.set_layouts.sampler,
+                                                  &app->descriptors.templates.sampler);
+                VkDescriptorImageInfo texture = get_texture_descriptor(&app->shadow_maps.directional);
+                write_descriptor_set(vk, texture_set.instances[0], &app->descriptors.templates.sampler, &texture);
+
                 struct vtk_descriptor_set_binding desc_set_bindings[] = {
-                    { &app->descriptors.sets.shadow_maps.directional },
+                    { &texture_set },
                     { &app->descriptors.sets.light_ubo, { 0u }, swapchain_img_idx },
                 };
                 vtk_bind_descriptor_sets(cmd_buf, gp->layout, 0, desc_set_bindings, CTK_ARRAY_COUNT(desc_set_bindings));
@@ -2030,15 +6644,641 @@ static void cycle_frame(struct app *app) {
     app->frame_sync.curr_frame = app->frame_sync.curr_frame == app->frame_sync.frame_count - 1 ? 0 : app->frame_sync.curr_frame + 1;
 }
 
+////////////////////////////////////////////////////////////
+/// Benchmarks
+////////////////////////////////////////////////////////////
+static f32 random_f32(f32 min, f32 max) {
+    return min + (max - min) * (rand() / (f32)RAND_MAX);
+}
+
+static void benchmark_model_mtxs() {
+    static u32 const TRANSFORM_COUNTS[] = { 1000, 10000, 100000 };
+    static u32 const ITERATIONS = 100;
+    for (u32 c = 0; c < CTK_ARRAY_COUNT(TRANSFORM_COUNTS); ++c) {
+        u32 count = TRANSFORM_COUNTS[c];
+        struct transform_store store = create_transform_store(1);
+        auto model_ubos = (struct model_ubo *)malloc(count * sizeof(struct model_ubo));
+        for (u32 i = 0; i < count; ++i) {
+            struct transform t = {};
+            t.position = { random_f32(-100, 100), random_f32(-100, 100), random_f32(-100, 100) };
+            t.rotation = quat_from_euler({ random_f32(-180, 180), random_f32(-180, 180), random_f32(-180, 180) });
+            t.scale = { random_f32(0.1f, 4), random_f32(0.1f, 4), random_f32(0.1f, 4) };
+            push_transform(&store, &t);
+        }
+
+        // Per-transform glm calls, as update_entities did before batching.
+        f64 start = get_time_ms();
+        for (u32 iter = 0; iter < ITERATIONS; ++iter) {
+            for (u32 i = 0; i < count; ++i) {
+                struct transform t = get_transform(&store, i);
+                glm::mat4 model_mtx(1.0f);
+                model_mtx = glm::translate(model_mtx, { t.position.x, t.position.y, t.position.z });
+                model_mtx = model_mtx * glm::mat4_cast(t.rotation);
+                model_mtx = glm::scale(model_mtx, { t.scale.x, t.scale.y, t.scale.z });
+                model_ubos[i].model_mtx = model_mtx;
+                model_ubos[i].normal_mtx = glm::mat4(glm::transpose(glm::inverse(glm::mat3(model_mtx))));
+            }
+        }
+        f64 glm_ms = (get_time_ms() - start) / ITERATIONS;
+
+        start = get_time_ms();
+        for (u32 iter = 0; iter < ITERATIONS; ++iter)
+            for (u32 chunk_idx = 0; chunk_idx < store.chunks.count; ++chunk_idx)
+                compose_model_mtxs(store.chunks.data[chunk_idx], 0, chunk_transform_count(&store, chunk_idx));
+        f64 simd_ms = (get_time_ms() - start) / ITERATIONS;
+
+        printf("model matrices %6u: glm %8.3f ms | simd x%u %8.3f ms | %.2fx\n", count, glm_ms, SIMD_WIDTH, simd_ms, glm_ms / simd_ms);
+        free(model_ubos);
+        destroy_transform_store(&store);
+    }
+}
+
+static void benchmark_transform_hierarchy() {
+    static u32 const NODE_COUNT = 100000;
+    static u32 const BRANCHING = 4;
+    static u32 const ITERATIONS = 100;
+    struct transform_store store = create_transform_store(1);
+    for (u32 i = 0; i < NODE_COUNT; ++i) {
+        struct transform t = {};
+        t.position = { random_f32(-10, 10), random_f32(-10, 10), random_f32(-10, 10) };
+        t.rotation = quat_from_euler({ random_f32(-180, 180), random_f32(-180, 180), random_f32(-180, 180) });
+        t.scale = { random_f32(0.5f, 2), random_f32(0.5f, 2), random_f32(0.5f, 2) };
+        push_transform(&store, &t, i == 0 ? NO_PARENT : (i - 1) / BRANCHING);
+    }
+    clear_dirty(&store);
+
+    // Dirty nodes: the root (whole tree), a child of the root (a quarter of the tree) and the last node (a single leaf).
+    static u32 const DIRTY_NODES[] = { 0, 1, NODE_COUNT - 1 };
+    static cstr const DIRTY_NAMES[] = { "root", "subtree", "leaf" };
+    for (u32 d = 0; d < CTK_ARRAY_COUNT(DIRTY_NODES); ++d) {
+        struct transform t = get_transform(&store, DIRTY_NODES[d]);
+        f64 total_ms = 0;
+        for (u32 iter = 0; iter < ITERATIONS; ++iter) {
+            set_transform(&store, DIRTY_NODES[d], &t);
+            f64 start = get_time_ms();
+            update_world_mtxs(&store);
+            total_ms += get_time_ms() - start;
+            clear_dirty(&store);
+        }
+        printf("hierarchy %u nodes, %-7s dirty: %8.3f ms\n", NODE_COUNT, DIRTY_NAMES[d], total_ms / ITERATIONS);
+    }
+
+    destroy_transform_store(&store);
+}
+
+static void benchmark_entity_storage() {
+    static u32 const ENTITY_COUNT = 100000;
+    auto scene = ctk_zalloc<struct scene>();
+    scene->records.free_head = NO_RECORD;
+    init_archetype(&scene->renderables, 1);
+    auto handles = (struct entity_handle *)malloc(ENTITY_COUNT * sizeof(struct entity_handle));
+
+    f64 start = get_time_ms();
+    for (u32 i = 0; i < ENTITY_COUNT; ++i) {
+        struct transform t = DEFAULT_TRANSFORM;
+        t.position = { random_f32(-100, 100), random_f32(-100, 100), random_f32(-100, 100) };
+        handles[i] = spawn_renderable(scene, NULL, NULL, NULL, t);
+    }
+    f64 spawn_ms = get_time_ms() - start;
+
+    // Every other entity, so nearly every despawn swaps in the last entity.
+    start = get_time_ms();
+    for (u32 i = 0; i < ENTITY_COUNT; i += 2)
+        despawn_entity(scene, handles[i]);
+    compact(scene, &scene->renderables);
+    f64 despawn_ms = get_time_ms() - start;
+
+    u32 stale_count = 0;
+    for (u32 i = 0; i < ENTITY_COUNT; ++i)
+        stale_count += get_record(scene, handles[i]) == NULL;
+
+    start = get_time_ms();
+    update_world_mtxs(&scene->renderables.transforms);
+    f64 update_ms = get_time_ms() - start;
+
+    printf("entities %u: spawn %8.3f ms | despawn half %8.3f ms (%u stale handles) | world matrices %8.3f ms | %u chunks\n",
+           ENTITY_COUNT, spawn_ms, despawn_ms, stale_count, update_ms, scene->renderables.transforms.chunks.count);
+
+    free(handles);
+    destroy_archetype(&scene->renderables);
+    free(scene->records.data);
+    free(scene);
+}
+
+// Every transform dirty each frame, as in a fully animated scene.
+static void benchmark_scene_update() {
+    static u32 const ENTITY_COUNT = 100000;
+    static u32 const ITERATIONS = 50;
+    static struct mesh mesh = {};
+    mesh.bounds_extent = { 1, 1, 1 };
+    mesh.bounds_radius = sqrtf(3);
+    auto scene = ctk_zalloc<struct scene>();
+    scene->records.free_head = NO_RECORD;
+    scene->camera.transform = DEFAULT_TRANSFORM;
+    scene->camera.fov = 90.0f;
+    scene->camera.aspect = 16.0f / 9.0f;
+    scene->camera.z_near = 0.1f;
+    scene->camera.z_far = 100.0f;
+    init_archetype(&scene->renderables, 1);
+    for (u32 i = 0; i < ENTITY_COUNT; ++i) {
+        struct transform t = {};
+        t.position = { random_f32(-100, 100), random_f32(-100, 100), random_f32(-100, 100) };
+        t.rotation = quat_from_euler({ random_f32(-180, 180), random_f32(-180, 180), random_f32(-180, 180) });
+        t.scale = { random_f32(0.1f, 4), random_f32(0.1f, 4), random_f32(0.1f, 4) };
+        spawn_renderable(scene, &mesh, NULL, NULL, t);
+    }
+    struct cull_settings culling = {};
+    culling.frustum = true;
+    culling.tiny = true;
+    culling.min_screen_size = 0.005f;
+
+    SYSTEM_INFO sys_info = {};
+    GetSystemInfo(&sys_info);
+    f64 single_thread_ms = 0;
+    for (u32 thread_count = 1; thread_count <= sys_info.dwNumberOfProcessors; thread_count *= 2) {
+        struct job_system *jobs = create_job_system(thread_count);
+        struct draw_lists lists = {};
+        struct transform_store *transforms = &scene->renderables.transforms;
+        f64 total_ms = 0;
+        for (u32 iter = 0; iter < ITERATIONS; ++iter) {
+            for (u32 c = 0; c < transforms->chunks.count; ++c)
+                memset(transforms->chunks.data[c]->dirty, transforms->all_dirty, CHUNK_SIZE);
+            f64 start = get_time_ms();
+            update_world_mtxs(transforms, jobs);
+            update_bounds(scene, jobs);
+            build_draw_lists(&lists, scene, &culling, jobs);
+            total_ms += get_time_ms() - start;
+        }
+        f64 ms = total_ms / ITERATIONS;
+        if (thread_count == 1)
+            single_thread_ms = ms;
+        printf("scene update %u entities, %2u threads: %8.3f ms | %.2fx | %u visible\n", ENTITY_COUNT, thread_count, ms, single_thread_ms / ms,
+               lists.direct.count);
+
+        destroy_draw_lists(&lists);
+        destroy_job_system(jobs);
+    }
+
+    destroy_bvh(&scene->bvh);
+    destroy_archetype(&scene->renderables);
+    free(scene->records.data);
+    free(scene);
+}
+
+// Static scene with 1% of entities moving per frame. Compares the linear SIMD cull against BVH queries for the camera and a point light's
+// six shadow faces.
+static void benchmark_bvh() {
+    static u32 const ENTITY_COUNT = 100000;
+    static u32 const ITERATIONS = 50;
+    static struct mesh mesh = {};
+    mesh.bounds_extent = { 1, 1, 1 };
+    mesh.bounds_radius = sqrtf(3);
+    auto scene = ctk_zalloc<struct scene>();
+    scene->records.free_head = NO_RECORD;
+    scene->camera.transform = DEFAULT_TRANSFORM;
+    scene->camera.fov = 90.0f;
+    scene->camera.aspect = 16.0f / 9.0f;
+    scene->camera.z_near = 0.1f;
+    scene->camera.z_far = 100.0f;
+    init_archetype(&scene->renderables, 1);
+    for (u32 i = 0; i < ENTITY_COUNT; ++i) {
+        struct transform t = DEFAULT_TRANSFORM;
+        t.position = { random_f32(-500, 500), random_f32(-500, 500), random_f32(-500, 500) };
+        spawn_renderable(scene, &mesh, NULL, NULL, t);
+    }
+    init_archetype(&scene->lights, 1);
+    spawn_light(scene);
+    get_light_ubo(scene, 0)->mode = LIGHT_MODE_POINT;
+    update_light_ubos(scene, 0, 1);
+    struct transform_store *transforms = &scene->renderables.transforms;
+    update_world_mtxs(transforms);
+
+    f64 start = get_time_ms();
+    update_bounds(scene, NULL);
+    f64 build_ms = get_time_ms() - start;
+
+    struct draw_lists lists = {};
+    struct cull_settings culling = {};
+    culling.frustum = true;
+    f64 refit_ms = 0;
+    f64 linear_ms = 0;
+    f64 bvh_ms = 0;
+    for (u32 iter = 0; iter < ITERATIONS; ++iter) {
+        for (u32 i = 0; i < ENTITY_COUNT / 100; ++i) {
+            u32 idx = rand() % ENTITY_COUNT;
+            struct transform t = get_transform(transforms, idx);
+            t.position.x += random_f32(-1, 1);
+            set_transform(transforms, idx, &t);
+        }
+        update_world_mtxs(transforms);
+        start = get_time_ms();
+        update_bounds(scene, NULL);
+        refit_ms += get_time_ms() - start;
+
+        culling.bvh = false;
+        start = get_time_ms();
+        build_draw_lists(&lists, scene, &culling, NULL);
+        linear_ms += get_time_ms() - start;
+
+        culling.bvh = true;
+        start = get_time_ms();
+        build_draw_lists(&lists, scene, &culling, NULL);
+        bvh_ms += get_time_ms() - start;
+    }
+    printf("bvh %u entities: build %8.3f ms | bounds + refit %8.3f ms | linear cull %8.3f ms | bvh cull %8.3f ms | %u visible, %u rebuilds\n",
+           ENTITY_COUNT, build_ms, refit_ms / ITERATIONS, linear_ms / ITERATIONS, bvh_ms / ITERATIONS, lists.direct.count, scene->bvh.rebuild_count);
+
+    destroy_draw_lists(&lists);
+    destroy_bvh(&scene->bvh);
+    destroy_archetype(&scene->lights);
+    destroy_archetype(&scene->renderables);
+    free(scene->records.data);
+    free(scene);
+}
+
+// Entities scattered behind a wall in front of the camera, with a point light beside the camera. Compares draw list building with and
+// without the software occlusion pass.
+static void benchmark_software_occlusion() {
+    static u32 const ENTITY_COUNT = 100000;
+    static u32 const ITERATIONS = 50;
+    static struct mesh mesh = {};
+    mesh.bounds_extent = { 1, 1, 1 };
+    mesh.bounds_radius = sqrtf(3);
+    static struct mesh wall = {};
+    wall.vertexes = ctk_create_buffer<struct vertex>(4);
+    wall.indexes = ctk_create_buffer<u32>(6);
+    ctk_push(&wall.vertexes)->position = { -1, -1, 0 };
+    ctk_push(&wall.vertexes)->position = { 1, -1, 0 };
+    ctk_push(&wall.vertexes)->position = { 1, 1, 0 };
+    ctk_push(&wall.vertexes)->position = { -1, 1, 0 };
+    static u32 const WALL_INDEXES[] = { 0, 1, 2, 0, 2, 3 };
+    for (u32 i = 0; i < CTK_ARRAY_COUNT(WALL_INDEXES); ++i)
+        ctk_push(&wall.indexes, WALL_INDEXES[i]);
+    wall.bounds_extent = { 1, 1, 0 };
+    wall.bounds_radius = sqrtf(2);
+
+    auto scene = ctk_zalloc<struct scene>();
+    scene->records.free_head = NO_RECORD;
+    scene->camera.transform = DEFAULT_TRANSFORM;
+    scene->camera.fov = 90.0f;
+    scene->camera.aspect = 16.0f / 9.0f;
+    scene->camera.z_near = 0.1f;
+    scene->camera.z_far = 100.0f;
+    init_archetype(&scene->renderables, 1);
+    set_occluder(scene, spawn_renderable(scene, &wall, NULL, NULL, { { 0, 0, 10 }, IDENTITY_ROTATION, { 60, 60, 1 } }), true);
+    for (u32 i = 0; i < ENTITY_COUNT; ++i) {
+        struct transform t = DEFAULT_TRANSFORM;
+        t.position = { random_f32(-50, 50), random_f32(-50, 50), random_f32(-100, 100) };
+        spawn_renderable(scene, &mesh, NULL, NULL, t);
+    }
+    init_archetype(&scene->lights, 1);
+    spawn_light(scene, { { 2, 0, 0 }, IDENTITY_ROTATION, { 1, 1, 1 } });
+    get_light_ubo(scene, 0)->mode = LIGHT_MODE_POINT;
+    update_light_ubos(scene, 0, 1);
+    update_world_mtxs(&scene->renderables.transforms);
+    update_bounds(scene, NULL);
+
+    struct job_system *jobs = create_job_system();
+    struct draw_lists lists = {};
+    struct cull_settings culling = {};
+    culling.bvh = true;
+    culling.frustum = true;
+    culling.software_occlusion = true;
+    f64 cull_ms = 0;
+    f64 occlusion_ms = 0;
+    for (u32 iter = 0; iter < ITERATIONS; ++iter) {
+        f64 start = get_time_ms();
+        build_draw_lists(&lists, scene, &culling, jobs);
+        f64 mid = get_time_ms();
+        cull_occluded_draws(&lists, scene, &culling, jobs);
+        cull_ms += mid - start;
+        occlusion_ms += get_time_ms() - mid;
+    }
+    u32 shadow_visible = 0;
+    u32 shadow_occluded = 0;
+    for (u32 i = 0; i < 6; ++i) {
+        shadow_visible += lists.shadow[i].count;
+        shadow_occluded += lists.shadow[i].occluded;
+    }
+    printf("software occlusion %u entities: frustum cull %8.3f ms | occlusion %8.3f ms | camera %u visible, %u occluded | "
+           "shadow faces %u visible, %u occluded\n", ENTITY_COUNT, cull_ms / ITERATIONS, occlusion_ms / ITERATIONS, lists.direct.count,
+           lists.direct.occluded, shadow_visible, shadow_occluded);
+
+    destroy_draw_lists(&lists);
+    destroy_job_system(jobs);
+    destroy_bvh(&scene->bvh);
+    destroy_archetype(&scene->lights);
+    destroy_archetype(&scene->renderables);
+    free(scene->records.data);
+    free(scene);
+}
+
+// Saves a hierarchy of named entities and times loading it back, with the snapshot in the OS file cache after the first load.
+static void benchmark_scene_snapshot() {
+    static u32 const ENTITY_COUNT = 100000;
+    static u32 const ITERATIONS = 10;
+    static cstr const PATH = "benchmark.scene";
+    static struct ctk_map<struct mesh, MAX_MESHES> meshes = {};
+    static struct ctk_map<struct vtk_descriptor_set, MAX_TEXTURES> textures = {};
+    struct mesh *mesh = ctk_push(&meshes, "cube");
+    mesh->bounds_extent = { 1, 1, 1 };
+    mesh->bounds_radius = sqrtf(3);
+    struct vtk_descriptor_set *texture = ctk_push(&textures, "wood");
+    auto scene = ctk_zalloc<struct scene>();
+    scene->records.free_head = NO_RECORD;
+    scene->camera.transform = DEFAULT_TRANSFORM;
+    init_archetype(&scene->renderables, 1);
+    init_archetype(&scene->lights, 1);
+    struct material *mat = push_material(scene, "test");
+    struct entity_handle parent = NULL_ENTITY;
+    for (u32 i = 0; i < ENTITY_COUNT; ++i) {
+        struct transform t = DEFAULT_TRANSFORM;
+        t.position = { random_f32(-100, 100), random_f32(-100, 100), random_f32(-100, 100) };
+        struct entity_handle handle = spawn_renderable(scene, mesh, texture, mat, t, i % 4 == 0 ? NULL_ENTITY : parent, "entity");
+        if (i % 4 == 0)
+            parent = handle;
+    }
+    spawn_light(scene);
+
+    f64 start = get_time_ms();
+    if (!save_scene_snapshot(scene, PATH, &meshes, &textures))
+        CTK_FATAL("failed to write scene snapshot \"%s\"", PATH)
+    f64 save_ms = get_time_ms() - start;
+
+    f64 first_load_ms = 0;
+    f64 total_ms = 0;
+    struct scene *loaded = NULL;
+    for (u32 iter = 0; iter < ITERATIONS; ++iter) {
+        start = get_time_ms();
+        loaded = load_scene_snapshot(PATH, &meshes, &textures, 1);
+        f64 ms = get_time_ms() - start;
+        if (iter == 0)
+            first_load_ms = ms;
+        total_ms += ms;
+        if (iter < ITERATIONS - 1) {
+            destroy_archetype(&loaded->renderables);
+            destroy_archetype(&loaded->lights);
+            free(loaded->records.data);
+            free(loaded->strings);
+            free(loaded);
+        }
+    }
+    CTK_ASSERT(loaded->renderables.transforms.count == ENTITY_COUNT)
+    printf("scene snapshot %u entities: save %8.3f ms | first load %8.3f ms | load %8.3f ms | %u records\n", ENTITY_COUNT, save_ms,
+           first_load_ms, total_ms / ITERATIONS, loaded->records.count);
+    remove(PATH);
+
+    destroy_archetype(&loaded->renderables);
+    destroy_archetype(&loaded->lights);
+    free(loaded->records.data);
+    free(loaded->strings);
+    free(loaded);
+    destroy_archetype(&scene->renderables);
+    destroy_archetype(&scene->lights);
+    free(scene->records.data);
+    free(scene);
+}
+
+// Per-frame CPU cost of getting the camera's opaque draws and a point light's six shadow faces to the GPU: culling, batching and packing
+// draw lists, against packing every renderable for gpu_cull.comp. Recording is compared by draw call count, since what each call costs is
+// up to the driver; the camera's draws are counted without Hi-Z, which records an indirect draw per draw instead of per batch.
+static void benchmark_gpu_driven() {
+    static u32 const ENTITY_COUNTS[] = { 10000, 100000 };
+    static u32 const ITERATIONS = 50;
+    static struct mesh meshes[4] = {};
+    static struct vtk_descriptor_set textures[2] = {};
+    for (u32 i = 0; i < CTK_ARRAY_COUNT(meshes); ++i) {
+        meshes[i].bounds_extent = { 1, 1, 1 };
+        meshes[i].bounds_radius = sqrtf(3);
+        meshes[i].indexes.count = 36;
+    }
+
+    struct job_system *jobs = create_job_system();
+    auto instances = (u32 *)malloc(MAX_INSTANCES * sizeof(u32));
+    auto gc = ctk_zalloc<struct gpu_cull>();
+    gc->cmds_staging = (VkDrawIndexedIndirectCommand *)malloc(VIEW_COUNT * MAX_DRAW_GROUPS * sizeof(VkDrawIndexedIndirectCommand));
+    struct gpu_entity_job entity_job = {};
+    entity_job.entities = (struct gpu_entity *)malloc(MAX_GPU_ENTITIES * sizeof(struct gpu_entity));
+    entity_job.chunk_group_sizes = (u32 *)malloc(MAX_GPU_ENTITIES / CHUNK_SIZE * MAX_DRAW_GROUPS * sizeof(u32));
+    entity_job.meshes = meshes;
+    entity_job.textures = textures;
+    entity_job.draw_groups = true;
+    entity_job.count_groups = true;
+    for (u32 e = 0; e < CTK_ARRAY_COUNT(ENTITY_COUNTS); ++e) {
+        u32 entity_count = ENTITY_COUNTS[e];
+        auto scene = ctk_zalloc<struct scene>();
+        scene->records.free_head = NO_RECORD;
+        scene->camera.transform = DEFAULT_TRANSFORM;
+        scene->camera.fov = 90.0f;
+        scene->camera.aspect = 16.0f / 9.0f;
+        scene->camera.z_near = 0.1f;
+        scene->camera.z_far = 100.0f;
+        init_archetype(&scene->renderables, 1);
+        for (u32 i = 0; i < entity_count; ++i) {
+            struct transform t = DEFAULT_TRANSFORM;
+            t.position = { random_f32(-100, 100), random_f32(-100, 100), random_f32(-100, 100) };
+            spawn_renderable(scene, meshes + rand() % CTK_ARRAY_COUNT(meshes), textures + rand() % CTK_ARRAY_COUNT(textures), NULL, t);
+        }
+        init_archetype(&scene->lights, 1);
+        spawn_light(scene, { { 2, 0, 0 }, IDENTITY_ROTATION, { 1, 1, 1 } });
+        get_light_ubo(scene, 0)->mode = LIGHT_MODE_POINT;
+        update_light_ubos(scene, 0, 1);
+        update_world_mtxs(&scene->renderables.transforms);
+        update_bounds(scene, jobs);
+        entity_job.scene = scene;
+
+        struct draw_lists lists = {};
+        lists.meshes = meshes;
+        lists.textures = textures;
+        struct cull_settings culling = {};
+        culling.bvh = true;
+        culling.frustum = true;
+        u32 chunk_count = (entity_count + CHUNK_SIZE - 1) / CHUNK_SIZE;
+        f64 cpu_ms = 0;
+        f64 gpu_ms = 0;
+        u32 cpu_draw_calls = 0;
+        u32 gpu_draw_calls = 0;
+        u32 instance_count = 0;
+        for (u32 iter = 0; iter < ITERATIONS; ++iter) {
+            culling.gpu_driven = false;
+            f64 start = get_time_ms();
+            build_draw_lists(&lists, scene, &culling, jobs);
+            u32 dropped = 0;
+            instance_count = pack_instances(&lists, entity_count, instances, &dropped, jobs);
+            cpu_ms += get_time_ms() - start;
+            cpu_draw_calls = lists.direct.batch_count;
+            for (u32 i = 0; i < 6; ++i)
+                cpu_draw_calls += lists.shadow[i].batch_count;
+
+            culling.gpu_driven = true;
+            start = get_time_ms();
+            build_draw_lists(&lists, scene, &culling, jobs);
+            pack_instances(&lists, entity_count, instances, &dropped, jobs);
+            parallel_for(jobs, chunk_count, 1, pack_gpu_entity_chunks, &entity_job);
+            build_gpu_draw_groups(gc, entity_job.chunk_group_sizes, chunk_count, meshes);
+            gpu_ms += get_time_ms() - start;
+            gpu_draw_calls = gc->group_count * VIEW_COUNT;
+        }
+        printf("gpu-driven %6u entities: cpu draw lists %8.3f ms, %u instances in %u draw calls | gpu-driven %8.3f ms, %u draw calls\n",
+               entity_count, cpu_ms / ITERATIONS, instance_count, cpu_draw_calls, gpu_ms / ITERATIONS, gpu_draw_calls);
+
+        destroy_draw_lists(&lists);
+        destroy_bvh(&scene->bvh);
+        destroy_archetype(&scene->lights);
+        destroy_archetype(&scene->renderables);
+        free(scene->records.data);
+        free(scene);
+    }
+    free(entity_job.entities);
+    free(entity_job.chunk_group_sizes);
+    free(gc->cmds_staging);
+    free(gc);
+    free(instances);
+    destroy_job_system(jobs);
+}
+
+static s32 compare_sort_keys(void const *a, void const *b) {
+    u64 lhs = ((struct draw const *)a)->sort_key;
+    u64 rhs = ((struct draw const *)b)->sort_key;
+    return lhs < rhs ? -1 : lhs > rhs ? 1 : 0;
+}
+
+// Opaque queue keys over 4 meshes and 2 textures at random depths, sorted with qsort and with radix_sort_draws().
+static void benchmark_draw_sort() {
+    static u32 const DRAW_COUNTS[] = { 10000, 100000 };
+    static u32 const ITERATIONS = 50;
+    static struct mesh meshes[4] = {};
+    static struct vtk_descriptor_set textures[2] = {};
+    u32 max_count = DRAW_COUNTS[CTK_ARRAY_COUNT(DRAW_COUNTS) - 1];
+    struct draw_list list = {};
+    reserve_draw_list(&list, (max_count + CHUNK_SIZE - 1) / CHUNK_SIZE);
+    auto draws = (struct draw *)malloc(max_count * sizeof(struct draw));
+    for (u32 d = 0; d < CTK_ARRAY_COUNT(DRAW_COUNTS); ++d) {
+        u32 draw_count = DRAW_COUNTS[d];
+        for (u32 i = 0; i < draw_count; ++i) {
+            u64 mesh = rand() % CTK_ARRAY_COUNT(meshes);
+            u64 texture = rand() % CTK_ARRAY_COUNT(textures);
+            f32 dist_sq = random_f32(0, 10000);
+            u32 depth = 0;
+            memcpy(&depth, &dist_sq, sizeof(u32));
+            draws[i] = { texture << 48 | mesh << 40 | depth >> 16, meshes + mesh, textures + texture, i / CHUNK_SIZE, i % CHUNK_SIZE };
+        }
+        list.count = draw_count;
+        f64 qsort_ms = 0;
+        f64 radix_ms = 0;
+        for (u32 iter = 0; iter < ITERATIONS; ++iter) {
+            memcpy(list.draws, draws, draw_count * sizeof(struct draw));
+            f64 start = get_time_ms();
+            qsort(list.draws, draw_count, sizeof(struct draw), compare_sort_keys);
+            qsort_ms += get_time_ms() - start;
+
+            memcpy(list.draws, draws, draw_count * sizeof(struct draw));
+            start = get_time_ms();
+            radix_sort_draws(&list);
+            radix_ms += get_time_ms() - start;
+        }
+        for (u32 i = 1; i < draw_count; ++i)
+            CTK_ASSERT(list.draws[i - 1].sort_key <= list.draws[i].sort_key)
+        batch_draw_list(&list, 0, true);
+        printf("draw sort %6u draws: qsort %8.3f ms, radix %8.3f ms, %u batches\n", draw_count, qsort_ms / ITERATIONS,
+               radix_ms / ITERATIONS, list.batch_count);
+    }
+    free(draws);
+    destroy_draw_list(&list);
+}
+
+// Records the same light draws into a secondary command buffer two ways: rebinding a dynamic-offset UBO set before each draw, and pushing
+// the draw's index with the data bound once as a storage buffer (record_late_draws()). Only recording is timed; nothing is submitted.
+static void benchmark_draw_recording(struct app *app, struct vk_core *vk) {
+    static u32 const DRAW_COUNTS[] = { 1000, 10000, 100000 };
+    static u32 const ITERATIONS = 20;
+    VkCommandPoolCreateInfo cmd_pool_info = {};
+    cmd_pool_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    cmd_pool_info.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+    cmd_pool_info.queueFamilyIndex = vk->device.queue_family_indexes.graphics;
+    VkCommandPool cmd_pool = VK_NULL_HANDLE;
+    vtk_validate_result(vkCreateCommandPool(vk->device.logical, &cmd_pool_info, NULL, &cmd_pool), "failed to create benchmark command pool");
+    VkCommandBuffer cmd_buf = vtk_allocate_command_buffer(vk->device.logical, cmd_pool, VK_COMMAND_BUFFER_LEVEL_SECONDARY);
+
+    VkCommandBufferInheritanceInfo inheritance_info = {};
+    inheritance_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+    inheritance_info.renderPass = app->render_passes.direct_late.handle;
+    inheritance_info.subpass = 0;
+    inheritance_info.framebuffer = app->render_passes.direct_late.framebuffers[0];
+    VkCommandBufferBeginInfo cmd_buf_begin_info = {};
+    cmd_buf_begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    cmd_buf_begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT | VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+    cmd_buf_begin_info.pInheritanceInfo = &inheritance_info;
+
+    struct vtk_graphics_pipeline *gp = &app->graphics_pipelines.unlit;
+    struct mesh *mesh = ctk_at(&app->assets.meshes, "light_diamond");
+    struct vtk_descriptor_set_binding frame_desc_set_binding = { &app->descriptors.sets.frame, { 0u, 0u }, 0 };
+    for (u32 d = 0; d < CTK_ARRAY_COUNT(DRAW_COUNTS); ++d) {
+        u32 draw_count = DRAW_COUNTS[d];
+        f64 rebind_ms = 0;
+        f64 push_ms = 0;
+        for (u32 iter = 0; iter < ITERATIONS; ++iter) {
+            for (u32 method = 0; method < 2; ++method) {
+                f64 start = get_time_ms();
+                vtk_validate_result(vkBeginCommandBuffer(cmd_buf, &cmd_buf_begin_info), "failed to begin recording secondary command buffer");
+                struct bind_stats stats = {};
+                struct bind_cache cache = { &stats };
+                bind_pipeline(&cache, cmd_buf, gp);
+                vtk_bind_descriptor_sets(cmd_buf, gp->layout, 0, &frame_desc_set_binding, 1);
+                u32 light_idx = 0;
+                vkCmdPushConstants(cmd_buf, gp->layout, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(u32), &light_idx);
+                for (u32 i = 0; i < draw_count; ++i) {
+                    light_idx = i % MAX_LIGHTS;
+                    if (method == 0)
+                        vtk_bind_descriptor_sets(cmd_buf, gp->layout, 0, &frame_desc_set_binding, 1);
+                    else
+                        vkCmdPushConstants(cmd_buf, gp->layout, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(u32), &light_idx);
+                    bind_draw_state(&cache, cmd_buf, mesh, NULL, 1);
+                    vkCmdDrawIndexed(cmd_buf, mesh->indexes.count, 1, 0, 0, 0);
+                }
+                vtk_validate_result(vkEndCommandBuffer(cmd_buf), "error during secondary command buffer recording");
+                (method == 0 ? rebind_ms : push_ms) += get_time_ms() - start;
+            }
+        }
+        printf("draw recording %6u draws: descriptor rebind %8.3f ms, push constant %8.3f ms\n", draw_count, rebind_ms / ITERATIONS,
+               push_ms / ITERATIONS);
+    }
+    vkDestroyCommandPool(vk->device.logical, cmd_pool, NULL);
+}
+
 ////////////////////////////////////////////////////////////
 /// Main
 ////////////////////////////////////////////////////////////
 void test_main() {
+#if 0
+    benchmark_model_mtxs();
+    benchmark_transform_hierarchy();
+    benchmark_entity_storage();
+    benchmark_scene_update();
+    benchmark_bvh();
+    benchmark_software_occlusion();
+    benchmark_scene_snapshot();
+    benchmark_gpu_driven();
+    benchmark_draw_sort();
+    return;
+#endif
     struct window *win = create_window();
     struct vk_core *vk = create_vk_core(win);
     struct app *app = create_app(vk);
-    struct scene *scene = create_scene(app, vk);
+#if 0
+    benchmark_draw_recording(app, vk);
+    return;
+#endif
+    f64 load_start = get_time_ms();
+    struct scene *scene = load_scene_snapshot(SCENE_SNAPSHOT_PATH, &app->assets.meshes, &app->descriptors.sets.textures,
+                                              vk->swapchain.image_count);
+    if (scene == NULL)
+        scene = create_scene(app, vk);
+    else
+        scene->camera.aspect = vk->swapchain.extent.width / (f32)vk->swapchain.extent.height;
+    app->stats.scene_load_ms = get_time_ms() - load_start;
     struct ui *ui = create_ui(win, app, vk);
+    app->shader_reload = create_shader_reload();
     while (!glfwWindowShouldClose(win->handle)) {
         // Input
         glfwPollEvents();
@@ -2046,18 +7286,32 @@ void test_main() {
             break;
         update_mouse_state(win);
         camera_controls(&scene->camera.transform, win);
+        pick_entity(ui, scene, win);
 
         // Rendering
         u32 swapchain_img_idx = vtk_aquire_swapchain_image_index(app, vk);
         sync_frame(app, vk, swapchain_img_idx);
-        draw_ui(ui, scene, win);
-        glm::mat4 view_space_mtx = camera_view_space_mtx(&scene->camera);
-        update_lights(app, vk, scene, &view_space_mtx, swapchain_img_idx);
-        update_entities(app, vk, scene, &view_space_mtx, swapchain_img_idx);
+        update_shader_reload(app, vk);
+        draw_ui(ui, app, vk, scene, win);
+        app->stats.model_ubo_uploads = 0;
+        f64 update_start = get_time_ms();
+        update_camera(app, vk, scene, swapchain_img_idx);
+        update_lights(app, vk, scene, swapchain_img_idx);
+        update_entities(scene, app->jobs);
+        update_bounds(scene, app->jobs);
+        build_draw_lists(&app->draw_lists, scene, &app->culling, app->jobs);
+        cull_occluded_draws(&app->draw_lists, scene, &app->culling, app->jobs);
+        app->stats.scene_update_ms = get_time_ms() - update_start;
+        upload_entities(app, vk, scene, swapchain_img_idx);
+        upload_instances(app, vk, scene, swapchain_img_idx);
+        upload_hiz_objects(app, vk, scene, swapchain_img_idx);
         record_render_passes(app, vk, scene, ui, swapchain_img_idx);
         submit_command_buffers(app, vk, swapchain_img_idx);
         cycle_frame(app);
 
         Sleep(1);
     }
+    stop_shader_reload(app);
+    wait_for_pipeline_batch(app->jobs, app->pipeline_batches.deferred);
+    save_pipeline_cache(vk);
 }
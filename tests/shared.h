@@ -232,6 +232,53 @@ static mesh create_mesh(vulkan_instance* VulkanInstance, cstr Path) {
     return Mesh;
 }
 
+// Whether a transient image created from ImageInfo can be bound to lazily-allocated memory. A device can expose a lazily-allocated type
+// that the image's memoryTypeBits don't include, so this checks a probe image's requirements rather than only the type's existence.
+static bool lazily_allocated_memory_supported(vtk::device* Device, vtk::image_info const* ImageInfo) {
+    VkImageCreateInfo ProbeInfo = {};
+    ProbeInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    ProbeInfo.imageType = VK_IMAGE_TYPE_2D;
+    ProbeInfo.format = ImageInfo->Format;
+    ProbeInfo.extent = { ImageInfo->Width, ImageInfo->Height, 1 };
+    ProbeInfo.mipLevels = 1;
+    ProbeInfo.arrayLayers = 1;
+    ProbeInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+    ProbeInfo.tiling = ImageInfo->Tiling;
+    ProbeInfo.usage = ImageInfo->UsageFlags | VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT;
+    ProbeInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    ProbeInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    VkImage Probe = VK_NULL_HANDLE;
+    vtk::validate_vk_result(vkCreateImage(Device->Logical, &ProbeInfo, NULL, &Probe), "vkCreateImage", "failed to create transient probe image");
+    VkMemoryRequirements MemoryRequirements = {};
+    vkGetImageMemoryRequirements(Device->Logical, Probe, &MemoryRequirements);
+    vkDestroyImage(Device->Logical, Probe, NULL);
+
+    VkMemoryPropertyFlags LazyFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT;
+    VkPhysicalDeviceMemoryProperties MemoryProperties = {};
+    vkGetPhysicalDeviceMemoryProperties(Device->Physical, &MemoryProperties);
+    for(u32 TypeIndex = 0; TypeIndex < MemoryProperties.memoryTypeCount; ++TypeIndex) {
+        if((MemoryRequirements.memoryTypeBits & (1u << TypeIndex)) &&
+           (MemoryProperties.memoryTypes[TypeIndex].propertyFlags & LazyFlags) == LazyFlags) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Creates an image that is only read/written inside the render pass that uses it. When the image can be backed by lazily-allocated
+// memory, it's created as a transient attachment so tiled GPUs can keep it on-chip; otherwise it stays in device-local memory. ImageInfo is
+// left untouched, so the same info can be reused for several attachments.
+static vtk::image create_transient_attachment_image(vtk::device* Device, vtk::image_info const* ImageInfo) {
+    vtk::image_info TransientImageInfo = *ImageInfo;
+    if(lazily_allocated_memory_supported(Device, ImageInfo)) {
+        TransientImageInfo.UsageFlags |= VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT;
+        TransientImageInfo.MemoryPropertyFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT;
+    } else {
+        TransientImageInfo.MemoryPropertyFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+    }
+    return vtk::create_image(Device, &TransientImageInfo);
+}
+
 static void check_vk_result(VkResult Result) {
     vtk::validate_vk_result(Result, "<imgui_internal>", "imgui internal call failed");
 }